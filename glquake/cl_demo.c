@@ -21,6 +21,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "quakedef.h"
 
 void CL_FinishTimeDemo (void);
+void CL_FinishBenchmark (void);
 
 /*
 ==============================================================================
@@ -32,9 +33,73 @@ NET_GetMessages are read from the demo file.
 
 Whenever cl.time gets past the last received message, another message is
 read from the demo file.
+
+With demo_keyframes set, demos are recorded as an indexed .dmx container
+instead.  Every demo_keyframes seconds a keyframe block holding a synthetic
+server message that rebuilds the client state is written, and a time index
+of the keyframes is appended when recording stops:
+
+header:		"QDMX" [long] DMX_VERSION [long] forcetrack
+block:		[long] type [float] demotime [long] length [angle3] viewangles
+			[length bytes] message
+index:		numkeys * ([float] demotime [long] blockofs [long] levelofs)
+trailer:	[long] numkeys [long] indexofs "QDXI"
+
+demotime is realtime since recording started, because server time restarts
+on every level.  All offsets are from the start of the demo file.
 ==============================================================================
 */
 
+#define	DMX_VERSION		1
+
+#define	DMX_MESSAGE		0
+#define	DMX_KEYFRAME	1
+
+#define	DMX_BLOCKHEADER	24
+
+typedef struct
+{
+	float	time;
+	int		blockofs;		// the keyframe block
+	int		levelofs;		// block holding that level's svc_serverinfo
+} demokey_t;
+
+cvar_t	demo_keyframes = {"demo_keyframes", "0", true};	// seconds, 0 = classic .dem
+
+static demokey_t	*demokeys;
+static int			demo_numkeys, demo_maxkeys;
+static int			demo_indexofs;		// end of the blocks
+static int			demo_blockofs;		// start of the last block read or written
+static float		demo_lastkey;
+
+static byte			demo_keybuf[NET_MAXMESSAGE];
+
+/*
+==============
+CL_FreeDemoIndex
+==============
+*/
+void CL_FreeDemoIndex (void)
+{
+	if (demokeys)
+		free (demokeys);
+	demokeys = NULL;
+	demo_numkeys = demo_maxkeys = 0;
+}
+
+/*
+==============
+CL_DemoNewLevel
+
+Called from CL_ParseServerInfo so keyframes know where their level starts
+==============
+*/
+void CL_DemoNewLevel (void)
+{
+	if (cls.demoindexed)
+		cls.demolevelofs = demo_blockofs;
+}
+
 /*
 ==============
 CL_StopPlayback
@@ -49,13 +114,177 @@ void CL_StopPlayback (void)
 
 	fclose (cls.demofile);
 	cls.demoplayback = false;
+	cls.demoindexed = false;
 	cls.demofile = NULL;
 	cls.state = ca_disconnected;
+	CL_FreeDemoIndex ();
 
+	if (cls.benchmark)
+		CL_FinishBenchmark ();
 	if (cls.timedemo)
 		CL_FinishTimeDemo ();
 }
 
+/*
+====================
+CL_WriteDemoBlock
+
+====================
+*/
+void CL_WriteDemoBlock (int type, sizebuf_t *msg)
+{
+	int		l;
+	int		i;
+	float	f;
+
+	demo_blockofs = ftell (cls.demofile);
+
+	l = LittleLong (type);
+	fwrite (&l, 4, 1, cls.demofile);
+	f = LittleFloat (cls.demotime);
+	fwrite (&f, 4, 1, cls.demofile);
+	l = LittleLong (msg->cursize);
+	fwrite (&l, 4, 1, cls.demofile);
+	for (i=0 ; i<3 ; i++)
+	{
+		f = LittleFloat (cl.viewangles[i]);
+		fwrite (&f, 4, 1, cls.demofile);
+	}
+	fwrite (msg->data, msg->cursize, 1, cls.demofile);
+}
+
+/*
+====================
+CL_WriteKeyframeIndex
+
+====================
+*/
+void CL_WriteKeyframeIndex (sizebuf_t *sb, int index)
+{
+	if (cl.protocol == PROTOCOL_EXTENDED)
+		MSG_WriteShort (sb, index);
+	else
+		MSG_WriteByte (sb, index);
+}
+
+/*
+====================
+CL_WriteDemoKeyframe
+
+Builds a server message that brings a client with the current level's
+signon up to the present state, and adds it to the index
+====================
+*/
+void CL_WriteDemoKeyframe (void)
+{
+	sizebuf_t	buf;
+	int			i, j;
+	int			bits, modnum, colormap;
+	entity_t	*ent;
+	demokey_t	*key;
+
+	buf.data = demo_keybuf;
+	buf.maxsize = sizeof(demo_keybuf);
+	buf.cursize = 0;
+	buf.allowoverflow = true;
+	buf.overflowed = false;
+
+	MSG_WriteByte (&buf, svc_time);
+	MSG_WriteFloat (&buf, cl.mtime[0]);
+
+	MSG_WriteByte (&buf, svc_setview);
+	MSG_WriteShort (&buf, cl.viewentity);
+
+	for (i=0 ; i<MAX_LIGHTSTYLES ; i++)
+	{
+		MSG_WriteByte (&buf, svc_lightstyle);
+		MSG_WriteByte (&buf, i);
+		MSG_WriteString (&buf, cl_lightstyle[i].map);
+	}
+
+	for (i=0 ; i<cl.maxclients ; i++)
+	{
+		MSG_WriteByte (&buf, svc_updatename);
+		MSG_WriteByte (&buf, i);
+		MSG_WriteString (&buf, cl.scores[i].name);
+		MSG_WriteByte (&buf, svc_updatefrags);
+		MSG_WriteByte (&buf, i);
+		MSG_WriteShort (&buf, cl.scores[i].frags);
+		MSG_WriteByte (&buf, svc_updatecolors);
+		MSG_WriteByte (&buf, i);
+		MSG_WriteByte (&buf, cl.scores[i].colors);
+	}
+
+	for (i=0 ; i<MAX_CL_STATS ; i++)
+	{
+		MSG_WriteByte (&buf, svc_updatestat);
+		MSG_WriteByte (&buf, i);
+		MSG_WriteLong (&buf, cl.stats[i]);
+	}
+
+// every entity that was in the last update, fully specified
+	for (i=1, ent = cl_entities+1 ; i<cl.num_entities ; i++, ent++)
+	{
+		if (ent->msgtime != cl.mtime[0] || !ent->model)
+			continue;
+
+		for (modnum=1 ; modnum<MAX_MODELS ; modnum++)
+			if (cl.model_precache[modnum] == ent->model)
+				break;
+		if (modnum == MAX_MODELS)
+			continue;
+
+		colormap = 0;
+		for (j=0 ; j<cl.maxclients ; j++)
+			if (ent->colormap == cl.scores[j].translations)
+				colormap = j+1;
+
+		bits = U_MOREBITS | U_MODEL | U_FRAME | U_COLORMAP | U_SKIN | U_EFFECTS
+			| U_ORIGIN1 | U_ORIGIN2 | U_ORIGIN3 | U_ANGLE1 | U_ANGLE2 | U_ANGLE3;
+		if (i >= 256)
+			bits |= U_LONGENTITY;
+
+		MSG_WriteByte (&buf, (bits | U_SIGNAL) & 255);
+		MSG_WriteByte (&buf, bits>>8);
+		if (bits & U_LONGENTITY)
+			MSG_WriteShort (&buf, i);
+		else
+			MSG_WriteByte (&buf, i);
+		CL_WriteKeyframeIndex (&buf, modnum);
+		MSG_WriteByte (&buf, ent->frame);
+		MSG_WriteByte (&buf, colormap);
+		MSG_WriteByte (&buf, ent->skinnum);
+		MSG_WriteByte (&buf, ent->effects);
+		for (j=0 ; j<3 ; j++)
+		{
+			MSG_WriteCoord (&buf, ent->msg_origins[0][j], cl.protocol);
+			MSG_WriteAngle (&buf, ent->msg_angles[0][j], cl.protocol);
+		}
+	}
+
+	if (buf.overflowed)
+	{
+		Con_DPrintf ("demo keyframe overflowed, skipped\n");
+		return;
+	}
+
+	CL_WriteDemoBlock (DMX_KEYFRAME, &buf);
+
+	if (demo_numkeys == demo_maxkeys)
+	{
+		demo_maxkeys = demo_maxkeys ? demo_maxkeys*2 : 256;
+		demokeys = realloc (demokeys, demo_maxkeys*sizeof(demokey_t));
+		if (!demokeys)
+			Sys_Error ("CL_WriteDemoKeyframe: couldn't grow the index");
+	}
+	key = &demokeys[demo_numkeys++];
+	key->time = cls.demotime;
+	key->blockofs = demo_blockofs;
+	key->levelofs = cls.demolevelofs;
+
+	demo_lastkey = cls.demotime;
+}
+
 /*
 ====================
 CL_WriteDemoMessage
@@ -69,6 +298,18 @@ void CL_WriteDemoMessage (void)
 	int		i;
 	float	f;
 
+	if (cls.demoindexed)
+	{
+	// the keyframe holds the state as of the previous message
+		if (cls.signon == SIGNONS && cls.demotime - demo_lastkey >= demo_keyframes.value)
+			CL_WriteDemoKeyframe ();
+
+		cls.demotime = realtime - cls.demostarttime;
+		CL_WriteDemoBlock (DMX_MESSAGE, &net_message);
+		fflush (cls.demofile);
+		return;
+	}
+
 	len = LittleLong (net_message.cursize);
 	fwrite (&len, 4, 1, cls.demofile);
 	for (i=0 ; i<3 ; i++)
@@ -80,6 +321,47 @@ void CL_WriteDemoMessage (void)
 	fflush (cls.demofile);
 }
 
+/*
+====================
+CL_ReadDemoBlock
+
+Reads the next .dmx block into net_message, returns the block type or -1
+at the end of the blocks
+====================
+*/
+int CL_ReadDemoBlock (void)
+{
+	int		i, r;
+	int		type;
+	float	f;
+
+	demo_blockofs = ftell (cls.demofile) - cls.demostart;
+	if (demo_blockofs + DMX_BLOCKHEADER > demo_indexofs)
+		return -1;
+
+	fread (&type, 4, 1, cls.demofile);
+	type = LittleLong (type);
+	fread (&f, 4, 1, cls.demofile);
+	cls.demotime = LittleFloat (f);
+	fread (&net_message.cursize, 4, 1, cls.demofile);
+	net_message.cursize = LittleLong (net_message.cursize);
+
+	VectorCopy (cl.mviewangles[0], cl.mviewangles[1]);
+	for (i=0 ; i<3 ; i++)
+	{
+		fread (&f, 4, 1, cls.demofile);
+		cl.mviewangles[0][i] = LittleFloat (f);
+	}
+
+	if (net_message.cursize > MAX_MSGLEN)
+		Sys_Error ("Demo message > MAX_MSGLEN");
+	r = fread (net_message.data, net_message.cursize, 1, cls.demofile);
+	if (r != 1)
+		return -1;
+
+	return type;
+}
+
 /*
 ====================
 CL_GetMessage
@@ -112,6 +394,22 @@ int CL_GetMessage (void)
 					return 0;		// don't need another message yet
 			}
 		}
+
+		if (cls.demoindexed)
+		{
+		// keyframes are only needed when seeking
+			do
+			{
+				r = CL_ReadDemoBlock ();
+			} while (r == DMX_KEYFRAME);
+
+			if (r != DMX_MESSAGE)
+			{
+				CL_StopPlayback ();
+				return 0;
+			}
+			return 1;
+		}
 		
 	// get the next message
 		fread (&net_message.cursize, 4, 1, cls.demofile);
@@ -156,6 +454,36 @@ int CL_GetMessage (void)
 }
 
 
+/*
+====================
+CL_WriteDemoIndex
+
+====================
+*/
+void CL_WriteDemoIndex (void)
+{
+	int		i;
+	int		l;
+	float	f;
+	int		indexofs;
+
+	indexofs = ftell (cls.demofile);
+	for (i=0 ; i<demo_numkeys ; i++)
+	{
+		f = LittleFloat (demokeys[i].time);
+		fwrite (&f, 4, 1, cls.demofile);
+		l = LittleLong (demokeys[i].blockofs);
+		fwrite (&l, 4, 1, cls.demofile);
+		l = LittleLong (demokeys[i].levelofs);
+		fwrite (&l, 4, 1, cls.demofile);
+	}
+	l = LittleLong (demo_numkeys);
+	fwrite (&l, 4, 1, cls.demofile);
+	l = LittleLong (indexofs);
+	fwrite (&l, 4, 1, cls.demofile);
+	fwrite ("QDXI", 4, 1, cls.demofile);
+}
+
 /*
 ====================
 CL_Stop_f
@@ -179,10 +507,16 @@ void CL_Stop_f (void)
 	MSG_WriteByte (&net_message, svc_disconnect);
 	CL_WriteDemoMessage ();
 
+// append the keyframe index
+	if (cls.demoindexed)
+		CL_WriteDemoIndex ();
+
 // finish up
 	fclose (cls.demofile);
 	cls.demofile = NULL;
 	cls.demorecording = false;
+	cls.demoindexed = false;
+	CL_FreeDemoIndex ();
 	Con_Printf ("Completed demo\n");
 }
 
@@ -241,23 +575,108 @@ void CL_Record_f (void)
 //
 // open the demo file
 //
-	COM_DefaultExtension (name, ".dem");
+	cls.demoindexed = demo_keyframes.value > 0;
+	COM_DefaultExtension (name, cls.demoindexed ? ".dmx" : ".dem");
 
 	Con_Printf ("recording to %s.\n", name);
 	cls.demofile = fopen (name, "wb");
 	if (!cls.demofile)
 	{
 		Con_Printf ("ERROR: couldn't open.\n");
+		cls.demoindexed = false;
 		return;
 	}
 
 	cls.forcetrack = track;
-	fprintf (cls.demofile, "%i\n", cls.forcetrack);
+	if (cls.demoindexed)
+	{
+		fwrite ("QDMX", 4, 1, cls.demofile);
+		c = LittleLong (DMX_VERSION);
+		fwrite (&c, 4, 1, cls.demofile);
+		c = LittleLong (cls.forcetrack);
+		fwrite (&c, 4, 1, cls.demofile);
+
+		CL_FreeDemoIndex ();
+		cls.demostart = 0;
+		cls.demotime = 0;
+		cls.demostarttime = realtime;
+		cls.demolevelofs = 0;
+		demo_lastkey = -999999;
+	}
+	else
+		fprintf (cls.demofile, "%i\n", cls.forcetrack);
 	
 	cls.demorecording = true;
 }
 
 
+/*
+====================
+CL_OpenDemoIndex
+
+The file is positioned after the .dmx magic.  A demo whose recording
+never finished has no index and plays, but can't seek.
+====================
+*/
+void CL_OpenDemoIndex (void)
+{
+	int		i;
+	int		version;
+	int		trailer[3];
+	int		firstblock;
+	float	f;
+
+	fread (&version, 4, 1, cls.demofile);
+	version = LittleLong (version);
+	fread (&cls.forcetrack, 4, 1, cls.demofile);
+	cls.forcetrack = LittleLong (cls.forcetrack);
+	firstblock = ftell (cls.demofile);
+
+	cls.demoindexed = true;
+	cls.demotime = 0;
+	cls.demolevelofs = 0;
+	CL_FreeDemoIndex ();
+	demo_indexofs = cls.demolength;
+
+	if (version != DMX_VERSION)
+		Con_Printf ("WARNING: demo is version %i, not %i\n", version, DMX_VERSION);
+
+	fseek (cls.demofile, cls.demostart + cls.demolength - 12, SEEK_SET);
+	if (fread (trailer, 12, 1, cls.demofile) == 1 && !memcmp (&trailer[2], "QDXI", 4))
+	{
+		demo_numkeys = LittleLong (trailer[0]);
+		demo_indexofs = LittleLong (trailer[1]);
+		if (demo_numkeys < 0 || demo_indexofs < 0 || demo_indexofs + demo_numkeys*12 + 12 != cls.demolength)
+		{
+			Con_Printf ("WARNING: bad demo index\n");
+			demo_numkeys = 0;
+			demo_indexofs = cls.demolength;
+		}
+	}
+	else
+		Con_Printf ("demo has no index, seeking disabled\n");
+
+	if (demo_numkeys)
+	{
+		demo_maxkeys = demo_numkeys;
+		demokeys = malloc (demo_maxkeys*sizeof(demokey_t));
+		if (!demokeys)
+			Sys_Error ("CL_OpenDemoIndex: couldn't allocate %i keys", demo_numkeys);
+		fseek (cls.demofile, cls.demostart + demo_indexofs, SEEK_SET);
+		for (i=0 ; i<demo_numkeys ; i++)
+		{
+			fread (&f, 4, 1, cls.demofile);
+			demokeys[i].time = LittleFloat (f);
+			fread (&demokeys[i].blockofs, 4, 1, cls.demofile);
+			demokeys[i].blockofs = LittleLong (demokeys[i].blockofs);
+			fread (&demokeys[i].levelofs, 4, 1, cls.demofile);
+			demokeys[i].levelofs = LittleLong (demokeys[i].levelofs);
+		}
+	}
+
+	fseek (cls.demofile, firstblock, SEEK_SET);
+}
+
 /*
 ====================
 CL_PlayDemo_f
@@ -270,6 +689,7 @@ void CL_PlayDemo_f (void)
 	char	name[256];
 	int c;
 	qboolean neg = false;
+	char	magic[4];
 
 	if (cmd_source != src_command)
 		return;
@@ -292,7 +712,7 @@ void CL_PlayDemo_f (void)
 	COM_DefaultExtension (name, ".dem");
 
 	Con_Printf ("Playing demo from %s.\n", name);
-	COM_FOpenFile (name, &cls.demofile);
+	cls.demolength = COM_FOpenFile (name, &cls.demofile);
 	if (!cls.demofile)
 	{
 		Con_Printf ("ERROR: couldn't open.\n");
@@ -303,6 +723,14 @@ void CL_PlayDemo_f (void)
 	cls.demoplayback = true;
 	cls.state = ca_connected;
 	cls.forcetrack = 0;
+	cls.demostart = ftell (cls.demofile);
+
+	if (fread (magic, 4, 1, cls.demofile) == 1 && !memcmp (magic, "QDMX", 4))
+	{
+		CL_OpenDemoIndex ();
+		return;
+	}
+	fseek (cls.demofile, cls.demostart, SEEK_SET);
 
 	while ((c = getc(cls.demofile)) != '\n')
 		if (c == '-')
@@ -316,6 +744,235 @@ void CL_PlayDemo_f (void)
 //	fscanf (cls.demofile, "%i\n", &cls.forcetrack);
 }
 
+/*
+====================
+CL_FindDemoKey
+
+Binary search for the last keyframe at or before time
+====================
+*/
+int CL_FindDemoKey (float time)
+{
+	int		lo, hi, mid;
+
+	lo = 0;
+	hi = demo_numkeys - 1;
+	while (lo < hi)
+	{
+		mid = (lo + hi + 1) >> 1;
+		if (demokeys[mid].time <= time)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	return lo;
+}
+
+/*
+====================
+CL_DemoSeek
+
+Rebuilds the client state at time from the nearest earlier keyframe
+====================
+*/
+void CL_DemoSeek (float time)
+{
+	int			i, type;
+	demokey_t	*key;
+
+	key = &demokeys[CL_FindDemoKey (time)];
+
+// a keyframe only holds the dynamic state, so if it is on another level
+// run through that level's signon first, which brings its static sounds.
+// The keyframe covers everything after the signon.
+	if (key->levelofs != cls.demolevelofs)
+	{
+		S_StopAllSounds (true);
+		cls.signon = 0;		// as the reconnect before the level did
+		fseek (cls.demofile, cls.demostart + key->levelofs, SEEK_SET);
+		do
+		{
+			type = CL_ReadDemoBlock ();
+			if (type == -1 || demo_blockofs >= key->blockofs)
+				Host_Error ("CL_DemoSeek: keyframe before the signon finished");
+			if (type == DMX_MESSAGE)
+				CL_ParseServerMessage ();
+		} while (cls.signon != SIGNONS);
+	}
+
+	fseek (cls.demofile, cls.demostart + key->blockofs, SEEK_SET);
+	if (CL_ReadDemoBlock () != DMX_KEYFRAME)
+		Host_Error ("CL_DemoSeek: bad keyframe offset");
+
+// anything the keyframe doesn't mention is gone
+	for (i=0 ; i<cl.num_entities ; i++)
+		cl_entities[i].msgtime = 0;
+	CL_ParseServerMessage ();
+
+// play forward to the requested time
+	while (1)
+	{
+		type = CL_ReadDemoBlock ();
+		if (type == -1)
+			break;
+		if (cls.demotime > time)
+		{
+			fseek (cls.demofile, cls.demostart + demo_blockofs, SEEK_SET);
+			break;
+		}
+		if (type == DMX_MESSAGE)
+			CL_ParseServerMessage ();
+	}
+
+// drop what fast forwarding started, the level's ambient and static
+// sounds keep playing
+	S_StopDynamicSounds ();
+	R_ClearParticles ();
+	memset (cl_dlights, 0, sizeof(cl_dlights));
+
+	cl.mtime[1] = cl.mtime[0];
+	cl.time = cl.oldtime = cl.mtime[0];
+	VectorCopy (cl.mviewangles[0], cl.mviewangles[1]);
+}
+
+/*
+====================
+CL_DemoSeek_f
+
+demoseek <seconds> | +<seconds> | -<seconds>
+====================
+*/
+void CL_DemoSeek_f (void)
+{
+	char	*s;
+	float	time;
+
+	if (cmd_source != src_command)
+		return;
+
+	if (Cmd_Argc() != 2)
+	{
+		Con_Printf ("demoseek <time> : jump to an absolute or +/- relative demo time\n");
+		return;
+	}
+
+	if (!cls.demoplayback || cls.timedemo)
+	{
+		Con_Printf ("Not playing a demo.\n");
+		return;
+	}
+	if (!cls.demoindexed || !demo_numkeys)
+	{
+		Con_Printf ("Demo has no keyframe index.\n");
+		return;
+	}
+
+	s = Cmd_Argv(1);
+	time = Q_atof (s);
+	if (s[0] == '+' || s[0] == '-')
+		time += cls.demotime;
+	if (time < 0)
+		time = 0;
+
+	CL_DemoSeek (time);
+	Con_Printf ("demo time %.1f\n", cls.demotime);
+}
+
+/*
+====================
+CL_DemoExport_f
+
+demoexport <indexed demo> <classic demo>
+
+Strips the keyframes and the index, leaving a .dem that any Quake plays
+====================
+*/
+void CL_DemoExport_f (void)
+{
+	char	name[MAX_OSPATH];
+	FILE	*in, *out;
+	int		length;
+	int		start;
+	int		trailer[3];
+	int		indexofs;
+	int		l, type, len;
+	float	angles[3];
+	int		blocks;
+
+	if (Cmd_Argc() != 3)
+	{
+		Con_Printf ("demoexport <in.dmx> <out.dem> : convert to a classic demo\n");
+		return;
+	}
+
+	strcpy (name, Cmd_Argv(1));
+	COM_DefaultExtension (name, ".dmx");
+	length = COM_FOpenFile (name, &in);
+	if (!in)
+	{
+		Con_Printf ("ERROR: couldn't open %s.\n", name);
+		return;
+	}
+	start = ftell (in);
+
+	if (fread (trailer, 12, 1, in) != 1 || memcmp (trailer, "QDMX", 4))
+	{
+		Con_Printf ("%s is not an indexed demo\n", name);
+		fclose (in);
+		return;
+	}
+
+	indexofs = length;
+	fseek (in, start + length - 12, SEEK_SET);
+	if (fread (&trailer, 12, 1, in) == 1 && !memcmp (&trailer[2], "QDXI", 4))
+		indexofs = LittleLong (trailer[1]);
+	fseek (in, start + 12, SEEK_SET);
+
+	if (strstr(Cmd_Argv(2), ".."))
+	{
+		Con_Printf ("Relative pathnames are not allowed.\n");
+		fclose (in);
+		return;
+	}
+	sprintf (name, "%s/%s", com_gamedir, Cmd_Argv(2));
+	COM_DefaultExtension (name, ".dem");
+	out = fopen (name, "wb");
+	if (!out)
+	{
+		Con_Printf ("ERROR: couldn't open %s.\n", name);
+		fclose (in);
+		return;
+	}
+
+	fseek (in, start + 8, SEEK_SET);
+	fread (&l, 4, 1, in);
+	fprintf (out, "%i\n", LittleLong (l));
+
+	blocks = 0;
+	while (ftell (in) - start + DMX_BLOCKHEADER <= indexofs)
+	{
+		fread (&type, 4, 1, in);
+		type = LittleLong (type);
+		fread (&l, 4, 1, in);				// demotime
+		fread (&len, 4, 1, in);
+		fread (angles, 12, 1, in);
+		l = LittleLong (len);
+		if (l < 0 || l > (int)sizeof(demo_keybuf) || fread (demo_keybuf, l, 1, in) != 1)
+			break;
+		if (type != DMX_MESSAGE)
+			continue;
+
+		fwrite (&len, 4, 1, out);
+		fwrite (angles, 12, 1, out);
+		fwrite (demo_keybuf, l, 1, out);
+		blocks++;
+	}
+
+	fclose (in);
+	fclose (out);
+	Con_Printf ("wrote %i messages to %s\n", blocks, name);
+}
+
 /*
 ====================
 CL_FinishTimeDemo
@@ -365,3 +1022,175 @@ void CL_TimeDemo_f (void)
 	cls.td_lastframe = -1;		// get a new message this frame
 }
 
+
+/*
+==============================================================================
+
+BENCHMARK
+
+benchdemo is a timedemo that runs the client without drawing anything:
+each frame takes the next demo message, sets the client clock to its time,
+and then relinks entities, runs particles and mixes sound (into the -simsound
+fake device when there is no real one).  The wall clock time of each stage
+is written per frame to a CSV file, so client side CPU cost can be tracked
+without depending on a video driver.
+
+==============================================================================
+*/
+
+static FILE		*bench_file;
+static double	bench_parse, bench_relink, bench_particles, bench_sound;
+static int		bench_frames;
+
+/*
+====================
+CL_BenchmarkFrame
+
+Replaces the client half of _Host_Frame while benchmarking
+====================
+*/
+void CL_BenchmarkFrame (void)
+{
+	double	t0, t1, t2, t3, t4;
+	int		ret;
+	vec3_t	forward, right, up;
+
+	t0 = Sys_FloatTime ();
+
+	cl.oldtime = cl.time;
+	do
+	{
+		ret = CL_GetMessage ();
+		if (ret == -1)
+			Host_Error ("CL_BenchmarkFrame: bad demo message");
+		if (!ret)
+			break;
+		CL_ParseServerMessage ();
+	} while (cls.state == ca_connected);
+
+	if (!cls.benchmark)
+		return;		// the demo ended
+
+	if (cl.time < cl.mtime[0])
+		cl.time = cl.mtime[0];
+	host_frametime = cl.time - cl.oldtime;
+
+	t1 = Sys_FloatTime ();
+
+	CL_RelinkEntities ();
+	CL_UpdateTEnts ();
+
+	t2 = Sys_FloatTime ();
+
+	R_UpdateParticles ();
+
+	t3 = Sys_FloatTime ();
+
+	if (cls.signon == SIGNONS)
+	{
+		AngleVectors (cl.viewangles, forward, right, up);
+		S_Update (cl_entities[cl.viewentity].origin, forward, right, up);
+		CL_DecayLights ();
+	}
+	else
+		S_Update (vec3_origin, vec3_origin, vec3_origin, vec3_origin);
+
+	t4 = Sys_FloatTime ();
+
+	if (cls.signon != SIGNONS)
+		return;		// loading doesn't count
+
+	bench_parse += t1 - t0;
+	bench_relink += t2 - t1;
+	bench_particles += t3 - t2;
+	bench_sound += t4 - t3;
+	bench_frames++;
+
+	if (bench_file)
+		fprintf (bench_file, "%i,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%i\n", bench_frames,
+			cl.time, (t1-t0)*1000, (t2-t1)*1000, (t3-t2)*1000, (t4-t3)*1000,
+			(t4-t0)*1000, cl_numvisedicts);
+}
+
+/*
+====================
+CL_FinishBenchmark
+
+====================
+*/
+void CL_FinishBenchmark (void)
+{
+	double	total;
+
+	cls.benchmark = false;
+
+	if (bench_file)
+	{
+		fclose (bench_file);
+		bench_file = NULL;
+	}
+
+	if (!bench_frames)
+		bench_frames = 1;
+	total = bench_parse + bench_relink + bench_particles + bench_sound;
+	Con_Printf ("benchmark: %i frames, %.3f ms/frame\n", bench_frames, total*1000/bench_frames);
+	Con_Printf ("  parse %.3f  relink %.3f  particles %.3f  sound %.3f\n",
+		bench_parse*1000/bench_frames, bench_relink*1000/bench_frames,
+		bench_particles*1000/bench_frames, bench_sound*1000/bench_frames);
+
+	if (COM_CheckParm ("-benchmark"))
+		Cbuf_AddText ("quit\n");
+}
+
+/*
+====================
+CL_BenchDemo_f
+
+benchdemo <demoname> [csvfile]
+====================
+*/
+void CL_BenchDemo_f (void)
+{
+	char	name[MAX_OSPATH];
+	char	csv[MAX_OSPATH];
+
+	if (cmd_source != src_command)
+		return;
+
+	if (Cmd_Argc() != 2 && Cmd_Argc() != 3)
+	{
+		Con_Printf ("benchdemo <demoname> [csvfile] : time the client without rendering\n");
+		return;
+	}
+
+	csv[0] = 0;
+	if (Cmd_Argc() == 3)
+	{
+		if (strstr(Cmd_Argv(2), ".."))
+		{
+			Con_Printf ("Relative pathnames are not allowed.\n");
+			return;
+		}
+		sprintf (csv, "%s/%s", com_gamedir, Cmd_Argv(2));
+		COM_DefaultExtension (csv, ".csv");
+	}
+	Q_strncpy (name, Cmd_Argv(1), sizeof(name)-1);
+	name[sizeof(name)-1] = 0;
+
+	Cmd_ExecuteString (va("timedemo %s", name), src_command);
+	if (!cls.demoplayback)
+		return;
+
+	if (csv[0])
+	{
+		bench_file = fopen (csv, "w");
+		if (!bench_file)
+			Con_Printf ("ERROR: couldn't open %s.\n", csv);
+		else
+			fprintf (bench_file, "frame,time,parse_ms,relink_ms,particles_ms,sound_ms,total_ms,visedicts\n");
+	}
+
+	bench_parse = bench_relink = bench_particles = bench_sound = 0;
+	bench_frames = 0;
+	cls.benchmark = true;
+}
@@ -71,13 +71,13 @@ void CL_ParseBeam (model_t *m)
 	
 	ent = MSG_ReadShort ();
 	
-	start[0] = MSG_ReadCoord ();
-	start[1] = MSG_ReadCoord ();
-	start[2] = MSG_ReadCoord ();
+	start[0] = MSG_ReadCoord (cl.protocol);
+	start[1] = MSG_ReadCoord (cl.protocol);
+	start[2] = MSG_ReadCoord (cl.protocol);
 	
-	end[0] = MSG_ReadCoord ();
-	end[1] = MSG_ReadCoord ();
-	end[2] = MSG_ReadCoord ();
+	end[0] = MSG_ReadCoord (cl.protocol);
+	end[1] = MSG_ReadCoord (cl.protocol);
+	end[2] = MSG_ReadCoord (cl.protocol);
 
 // override any beam with the same entity
 	for (i=0, b=cl_beams ; i< MAX_BEAMS ; i++, b++)
@@ -127,25 +127,25 @@ void CL_ParseTEnt (void)
 	switch (type)
 	{
 	case TE_WIZSPIKE:			// spike hitting wall
-		pos[0] = MSG_ReadCoord ();
-		pos[1] = MSG_ReadCoord ();
-		pos[2] = MSG_ReadCoord ();
+		pos[0] = MSG_ReadCoord (cl.protocol);
+		pos[1] = MSG_ReadCoord (cl.protocol);
+		pos[2] = MSG_ReadCoord (cl.protocol);
 		R_RunParticleEffect (pos, vec3_origin, 20, 30);
 		S_StartSound (-1, 0, cl_sfx_wizhit, pos, 1, 1);
 		break;
 		
 	case TE_KNIGHTSPIKE:			// spike hitting wall
-		pos[0] = MSG_ReadCoord ();
-		pos[1] = MSG_ReadCoord ();
-		pos[2] = MSG_ReadCoord ();
+		pos[0] = MSG_ReadCoord (cl.protocol);
+		pos[1] = MSG_ReadCoord (cl.protocol);
+		pos[2] = MSG_ReadCoord (cl.protocol);
 		R_RunParticleEffect (pos, vec3_origin, 226, 20);
 		S_StartSound (-1, 0, cl_sfx_knighthit, pos, 1, 1);
 		break;
 		
 	case TE_SPIKE:			// spike hitting wall
-		pos[0] = MSG_ReadCoord ();
-		pos[1] = MSG_ReadCoord ();
-		pos[2] = MSG_ReadCoord ();
+		pos[0] = MSG_ReadCoord (cl.protocol);
+		pos[1] = MSG_ReadCoord (cl.protocol);
+		pos[2] = MSG_ReadCoord (cl.protocol);
 #ifdef GLTEST
 		Test_Spawn (pos);
 #else
@@ -165,9 +165,9 @@ void CL_ParseTEnt (void)
 		}
 		break;
 	case TE_SUPERSPIKE:			// super spike hitting wall
-		pos[0] = MSG_ReadCoord ();
-		pos[1] = MSG_ReadCoord ();
-		pos[2] = MSG_ReadCoord ();
+		pos[0] = MSG_ReadCoord (cl.protocol);
+		pos[1] = MSG_ReadCoord (cl.protocol);
+		pos[2] = MSG_ReadCoord (cl.protocol);
 		R_RunParticleEffect (pos, vec3_origin, 0, 20);
 
 		if ( rand() % 5 )
@@ -185,16 +185,16 @@ void CL_ParseTEnt (void)
 		break;
 		
 	case TE_GUNSHOT:			// bullet hitting wall
-		pos[0] = MSG_ReadCoord ();
-		pos[1] = MSG_ReadCoord ();
-		pos[2] = MSG_ReadCoord ();
+		pos[0] = MSG_ReadCoord (cl.protocol);
+		pos[1] = MSG_ReadCoord (cl.protocol);
+		pos[2] = MSG_ReadCoord (cl.protocol);
 		R_RunParticleEffect (pos, vec3_origin, 0, 20);
 		break;
 		
 	case TE_EXPLOSION:			// rocket explosion
-		pos[0] = MSG_ReadCoord ();
-		pos[1] = MSG_ReadCoord ();
-		pos[2] = MSG_ReadCoord ();
+		pos[0] = MSG_ReadCoord (cl.protocol);
+		pos[1] = MSG_ReadCoord (cl.protocol);
+		pos[2] = MSG_ReadCoord (cl.protocol);
 		R_ParticleExplosion (pos);
 		dl = CL_AllocDlight (0);
 		VectorCopy (pos, dl->origin);
@@ -205,9 +205,9 @@ void CL_ParseTEnt (void)
 		break;
 		
 	case TE_TAREXPLOSION:			// tarbaby explosion
-		pos[0] = MSG_ReadCoord ();
-		pos[1] = MSG_ReadCoord ();
-		pos[2] = MSG_ReadCoord ();
+		pos[0] = MSG_ReadCoord (cl.protocol);
+		pos[1] = MSG_ReadCoord (cl.protocol);
+		pos[2] = MSG_ReadCoord (cl.protocol);
 		R_BlobExplosion (pos);
 
 		S_StartSound (-1, 0, cl_sfx_r_exp3, pos, 1, 1);
@@ -232,23 +232,23 @@ void CL_ParseTEnt (void)
 // PGM 01/21/97
 
 	case TE_LAVASPLASH:	
-		pos[0] = MSG_ReadCoord ();
-		pos[1] = MSG_ReadCoord ();
-		pos[2] = MSG_ReadCoord ();
+		pos[0] = MSG_ReadCoord (cl.protocol);
+		pos[1] = MSG_ReadCoord (cl.protocol);
+		pos[2] = MSG_ReadCoord (cl.protocol);
 		R_LavaSplash (pos);
 		break;
 	
 	case TE_TELEPORT:
-		pos[0] = MSG_ReadCoord ();
-		pos[1] = MSG_ReadCoord ();
-		pos[2] = MSG_ReadCoord ();
+		pos[0] = MSG_ReadCoord (cl.protocol);
+		pos[1] = MSG_ReadCoord (cl.protocol);
+		pos[2] = MSG_ReadCoord (cl.protocol);
 		R_TeleportSplash (pos);
 		break;
 		
 	case TE_EXPLOSION2:				// color mapped explosion
-		pos[0] = MSG_ReadCoord ();
-		pos[1] = MSG_ReadCoord ();
-		pos[2] = MSG_ReadCoord ();
+		pos[0] = MSG_ReadCoord (cl.protocol);
+		pos[1] = MSG_ReadCoord (cl.protocol);
+		pos[2] = MSG_ReadCoord (cl.protocol);
 		colorStart = MSG_ReadByte ();
 		colorLength = MSG_ReadByte ();
 		R_ParticleExplosion2 (pos, colorStart, colorLength);
@@ -262,19 +262,19 @@ void CL_ParseTEnt (void)
 		
 #ifdef QUAKE2
 	case TE_IMPLOSION:
-		pos[0] = MSG_ReadCoord ();
-		pos[1] = MSG_ReadCoord ();
-		pos[2] = MSG_ReadCoord ();
+		pos[0] = MSG_ReadCoord (cl.protocol);
+		pos[1] = MSG_ReadCoord (cl.protocol);
+		pos[2] = MSG_ReadCoord (cl.protocol);
 		S_StartSound (-1, 0, cl_sfx_imp, pos, 1, 1);
 		break;
 
 	case TE_RAILTRAIL:
-		pos[0] = MSG_ReadCoord ();
-		pos[1] = MSG_ReadCoord ();
-		pos[2] = MSG_ReadCoord ();
-		endpos[0] = MSG_ReadCoord ();
-		endpos[1] = MSG_ReadCoord ();
-		endpos[2] = MSG_ReadCoord ();
+		pos[0] = MSG_ReadCoord (cl.protocol);
+		pos[1] = MSG_ReadCoord (cl.protocol);
+		pos[2] = MSG_ReadCoord (cl.protocol);
+		endpos[0] = MSG_ReadCoord (cl.protocol);
+		endpos[1] = MSG_ReadCoord (cl.protocol);
+		endpos[2] = MSG_ReadCoord (cl.protocol);
 		S_StartSound (-1, 0, cl_sfx_rail, pos, 1, 1);
 		S_StartSound (-1, 1, cl_sfx_r_exp3, endpos, 1, 1);
 		R_RocketTrail (pos, endpos, 0+128);
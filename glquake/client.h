@@ -131,6 +131,16 @@ typedef struct
 	int			td_startframe;		// host_framecount at start
 	float		td_starttime;		// realtime at second frame of timedemo
 
+// indexed (.dmx) demos
+	qboolean	demoindexed;
+	int			demostart;			// file offset of the demo, it may be in a pak
+	int			demolength;
+	float		demotime;			// of the last block read or written
+	double		demostarttime;		// realtime recording started
+	int			demolevelofs;		// block with the current svc_serverinfo
+
+	qboolean	benchmark;			// benchdemo: headless timedemo
+
 
 // connection information
 	int			signon;			// 0 to SIGNONS
@@ -212,6 +222,7 @@ typedef struct
 	char		levelname[40];	// for display on solo scoreboard
 	int			viewentity;		// cl_entitites[cl.viewentity] = player
 	int			maxclients;
+	int			protocol;		// from svc_serverinfo, selects the encodings
 	int			gametype;
 
 // refresh related state
@@ -240,6 +251,7 @@ typedef struct
 //
 extern	cvar_t	cl_name;
 extern	cvar_t	cl_color;
+extern	cvar_t	cl_rate;
 
 extern	cvar_t	cl_upspeed;
 extern	cvar_t	cl_forwardspeed;
@@ -348,12 +360,20 @@ void CL_Stop_f (void);
 void CL_Record_f (void);
 void CL_PlayDemo_f (void);
 void CL_TimeDemo_f (void);
+void CL_DemoSeek_f (void);
+void CL_DemoExport_f (void);
+void CL_DemoNewLevel (void);
+void CL_BenchDemo_f (void);
+void CL_BenchmarkFrame (void);
+
+extern	cvar_t	demo_keyframes;
 
 //
 // cl_parse.c
 //
 void CL_ParseServerMessage (void);
 void CL_NewTranslation (int slot);
+int CL_ReadPrecacheIndex (void);
 
 //
 // view
@@ -581,14 +581,34 @@ void MSG_WriteString (sizebuf_t *sb, char *s)
 		SZ_Write (sb, s, Q_strlen(s)+1);
 }
 
-void MSG_WriteCoord (sizebuf_t *sb, float f)
+void MSG_WriteCoord (sizebuf_t *sb, float f, int protocol)
 {
-	MSG_WriteShort (sb, (int)(f*8));
+	int		c;
+	byte	*buf;
+
+	if (protocol != PROTOCOL_EXTENDED)
+	{
+		MSG_WriteShort (sb, (int)(f*8));
+		return;
+	}
+
+// 16.8 fixed point, +-32767 at 1/256 unit
+	c = (int)floor(f*256 + 0.5);
+	buf = SZ_GetSpace (sb, 3);
+	buf[0] = c & 0xff;
+	buf[1] = (c >> 8) & 0xff;
+	buf[2] = (c >> 16) & 0xff;
 }
 
-void MSG_WriteAngle (sizebuf_t *sb, float f)
+void MSG_WriteAngle (sizebuf_t *sb, float f, int protocol)
 {
-	MSG_WriteByte (sb, ((int)f*256/360) & 255);
+	if (protocol != PROTOCOL_EXTENDED)
+	{
+		MSG_WriteByte (sb, ((int)f*256/360) & 255);
+		return;
+	}
+
+	MSG_WriteShort (sb, (int)floor(f*65536/360 + 0.5) & 65535);
 }
 
 //
@@ -714,14 +734,36 @@ char *MSG_ReadString (void)
 	return string;
 }
 
-float MSG_ReadCoord (void)
+float MSG_ReadCoord (int protocol)
 {
-	return MSG_ReadShort() * (1.0/8);
+	int		c;
+
+	if (protocol != PROTOCOL_EXTENDED)
+		return MSG_ReadShort() * (1.0/8);
+
+	if (msg_readcount+3 > net_message.cursize)
+	{
+		msg_badread = true;
+		return 0;
+	}
+
+	c = net_message.data[msg_readcount]
+	+ (net_message.data[msg_readcount+1]<<8)
+	+ (net_message.data[msg_readcount+2]<<16);
+	msg_readcount += 3;
+
+	if (c & 0x800000)
+		c -= 0x1000000;		// sign extend
+
+	return c * (1.0/256);
 }
 
-float MSG_ReadAngle (void)
+float MSG_ReadAngle (int protocol)
 {
-	return MSG_ReadChar() * (360.0/256);
+	if (protocol != PROTOCOL_EXTENDED)
+		return MSG_ReadChar() * (360.0/256);
+
+	return MSG_ReadShort() * (360.0/65536);
 }
 
 
@@ -23,6 +23,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "quakedef.h"
 
+#if idSSE
+#include <emmintrin.h>
+#endif
+
 #define GL_COLOR_INDEX8_EXT     0x80E5
 
 extern unsigned char d_15to8table[65536];
@@ -30,6 +34,9 @@ extern unsigned char d_15to8table[65536];
 cvar_t		gl_nobind = {"gl_nobind", "0"};
 cvar_t		gl_max_size = {"gl_max_size", "1024"};
 cvar_t		gl_picmip = {"gl_picmip", "0"};
+cvar_t		gl_texturecache = {"gl_texturecache", "1"};
+
+char		texturecachedir[MAX_OSPATH];	// glquake/textures, see GL_TextureCacheName
 
 byte		*draw_chars;				// 8*8 graphic characters
 qpic_t		*draw_disc;
@@ -37,6 +44,7 @@ qpic_t		*draw_backtile;
 
 int			translate_texture;
 int			char_texture;
+float		char_sl, char_tl;			// charset origin in its scrap
 
 typedef struct
 {
@@ -57,19 +65,23 @@ int		gl_filter_max = GL_LINEAR;
 
 int		texels;
 
-typedef struct
+typedef struct gltexture_s
 {
 	int		texnum;
 	char	identifier[64];
 	int		width, height;
 	qboolean	mipmap;
 	int             lhcsum;
+	struct gltexture_s	*hashnext;
 } gltexture_t;
 
 #define	MAX_GLTEXTURES	1024
 gltexture_t	gltextures[MAX_GLTEXTURES];
 int			numgltextures;
 
+#define	TEXTURE_HASH_SIZE	256
+gltexture_t	*gltexturehash[TEXTURE_HASH_SIZE];
+
 
 void GL_Bind (int texnum)
 {
@@ -91,22 +103,24 @@ void GL_Bind (int texnum)
 
   scrap allocation
 
-  Allocate all the little status bar obejcts into a single texture
-  to crutch up stupid hardware / drivers
+  Allocate the charset, the status bar objects and the menu pics into a
+  few shared textures, so the 2D batches below rarely change texture.
+  The charset has a scrap to itself, the only one drawn unfiltered.
 
 =============================================================================
 */
 
-#define	MAX_SCRAPS		2
+#define	MAX_SCRAPS		8
 #define	BLOCK_WIDTH		256
 #define	BLOCK_HEIGHT	256
 
 int			scrap_allocated[MAX_SCRAPS][BLOCK_WIDTH];
-byte		scrap_texels[MAX_SCRAPS][BLOCK_WIDTH*BLOCK_HEIGHT*4];
-qboolean	scrap_dirty;
+byte		scrap_texels[MAX_SCRAPS][BLOCK_WIDTH*BLOCK_HEIGHT];
+int			scrap_dirty;		// bit per scrap
 int			scrap_texnum;
 
-// returns a texture number and the position inside it
+// returns a texture number and the position inside it, or -1 if
+// there is no room left
 int Scrap_AllocBlock (int w, int h, int *x, int *y)
 {
 	int		i, j;
@@ -118,7 +132,7 @@ int Scrap_AllocBlock (int w, int h, int *x, int *y)
 	{
 		best = BLOCK_HEIGHT;
 
-		for (i=0 ; i<BLOCK_WIDTH-w ; i++)
+		for (i=0 ; i<=BLOCK_WIDTH-w ; i++)
 		{
 			best2 = 0;
 
@@ -145,7 +159,7 @@ int Scrap_AllocBlock (int w, int h, int *x, int *y)
 		return texnum;
 	}
 
-	Sys_Error ("Scrap_AllocBlock: full");
+	return -1;
 }
 
 int	scrap_uploads;
@@ -154,13 +168,160 @@ void Scrap_Upload (void)
 {
 	int		texnum;
 
-	scrap_uploads++;
-
-	for (texnum=0 ; texnum<MAX_SCRAPS ; texnum++) {
+	for (texnum=0 ; texnum<MAX_SCRAPS ; texnum++)
+	{
+		if (!(scrap_dirty & (1<<texnum)))
+			continue;
+		scrap_uploads++;
 		GL_Bind(scrap_texnum + texnum);
 		GL_Upload8 (scrap_texels[texnum], BLOCK_WIDTH, BLOCK_HEIGHT, false, true);
+
+		// pics keep gl_filter_max, the charset has always been unfiltered
+		if (scrap_texnum + texnum == char_texture)
+		{
+			glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		}
 	}
-	scrap_dirty = false;
+	scrap_dirty = 0;
+}
+
+/*
+================
+Scrap_CopyBlock
+
+Returns the scrap a w*h block of texels went into, or -1.  Blocks are
+kept a texel apart so filtering doesn't pick up their neighbours.
+================
+*/
+int Scrap_CopyBlock (byte *data, int w, int h, int *x, int *y)
+{
+	int		texnum, i;
+
+	if (w >= BLOCK_WIDTH || h >= BLOCK_HEIGHT)
+		return -1;
+	texnum = Scrap_AllocBlock (w+1, h+1, x, y);
+	if (texnum == -1)
+		return -1;
+
+	for (i=0 ; i<h ; i++)
+		memcpy (&scrap_texels[texnum][(*y+i)*BLOCK_WIDTH + *x], data + i*w, w);
+	scrap_dirty |= 1<<texnum;
+
+	return texnum;
+}
+
+/*
+=============================================================================
+
+  2D BATCHING
+
+Everything drawn after GL_Set2D goes through Draw_Quad, which queues it
+until the texture or blending changes.  Draw_Flush then sends the run
+with one glDrawArrays.  GL_EndRendering flushes, as does anything that
+changes GL state underneath the queue.
+
+=============================================================================
+*/
+
+#define	MAX_DRAW_QUADS	2048
+
+float		draw_xyz[MAX_DRAW_QUADS*4][2];
+float		draw_st[MAX_DRAW_QUADS*4][2];
+byte		draw_colors[MAX_DRAW_QUADS*4][4];
+int			draw_numquads;
+int			draw_texnum;		// 0 for untextured
+qboolean	draw_blend;			// alpha blended instead of alpha tested
+
+byte		draw_white[4] = {255, 255, 255, 255};
+
+cvar_t		gl_batch2d = {"gl_batch2d", "1"};
+
+int			c_2d_draws, c_2d_quads;
+int			draw_lastdraws, draw_lastquads;	// for r_speeds, which runs before 2D
+
+/*
+================
+Draw_Flush
+================
+*/
+void Draw_Flush (void)
+{
+	if (!draw_numquads)
+		return;
+
+	if (draw_texnum)
+	{
+		GL_Bind (draw_texnum);
+		glTexCoordPointer (2, GL_FLOAT, 0, draw_st);
+		glEnableClientState (GL_TEXTURE_COORD_ARRAY);
+	}
+	else
+		glDisable (GL_TEXTURE_2D);
+	if (draw_blend)
+	{
+		glDisable (GL_ALPHA_TEST);
+		glEnable (GL_BLEND);
+	}
+
+	glVertexPointer (2, GL_FLOAT, 0, draw_xyz);
+	glColorPointer (4, GL_UNSIGNED_BYTE, 0, draw_colors);
+	glEnableClientState (GL_VERTEX_ARRAY);
+	glEnableClientState (GL_COLOR_ARRAY);
+
+	glDrawArrays (GL_QUADS, 0, draw_numquads*4);
+
+	glDisableClientState (GL_VERTEX_ARRAY);
+	glDisableClientState (GL_COLOR_ARRAY);
+	if (draw_texnum)
+		glDisableClientState (GL_TEXTURE_COORD_ARRAY);
+	else
+		glEnable (GL_TEXTURE_2D);
+	if (draw_blend)
+	{
+		glEnable (GL_ALPHA_TEST);
+		glDisable (GL_BLEND);
+	}
+	glColor4f (1,1,1,1);
+
+	c_2d_draws++;
+	c_2d_quads += draw_numquads;
+	draw_numquads = 0;
+}
+
+/*
+================
+Draw_Quad
+================
+*/
+void Draw_Quad (int texnum, qboolean blend, float x, float y, float w, float h,
+	float sl, float tl, float sh, float th, byte *color)
+{
+	int		i;
+	float	*xyz, *st;
+
+	if (draw_numquads && (texnum != draw_texnum || blend != draw_blend))
+		Draw_Flush ();
+	if (draw_numquads == MAX_DRAW_QUADS)
+		Draw_Flush ();
+	draw_texnum = texnum;
+	draw_blend = blend;
+
+	i = draw_numquads*4;
+	xyz = draw_xyz[i];
+	st = draw_st[i];
+	xyz[0] = x;		xyz[1] = y;		st[0] = sl;	st[1] = tl;
+	xyz[2] = x+w;	xyz[3] = y;		st[2] = sh;	st[3] = tl;
+	xyz[4] = x+w;	xyz[5] = y+h;	st[4] = sh;	st[5] = th;
+	xyz[6] = x;		xyz[7] = y+h;	st[6] = sl;	st[7] = th;
+	*(int *)draw_colors[i] = *(int *)color;
+	*(int *)draw_colors[i+1] = *(int *)color;
+	*(int *)draw_colors[i+2] = *(int *)color;
+	*(int *)draw_colors[i+3] = *(int *)color;
+	draw_numquads++;
+
+	if (!gl_batch2d.value)
+		Draw_Flush ();
 }
 
 //=============================================================================
@@ -182,45 +343,48 @@ byte		menuplyr_pixels[4096];
 int		pic_texels;
 int		pic_count;
 
-qpic_t *Draw_PicFromWad (char *name)
-{
-	qpic_t	*p;
-	glpic_t	*gl;
+/*
+================
+Draw_UploadPic
 
-	p = W_GetLumpName (name);
-	gl = (glpic_t *)p->data;
+Packs a pic into the scrap when it fits, otherwise gives it a texture of
+its own.  gl may overlap the pixels, so it is only filled in after them.
+================
+*/
+void Draw_UploadPic (qpic_t *p, glpic_t *gl, qboolean scrap)
+{
+	int		x, y;
+	int		texnum;
 
-	// load little ones into the scrap
-	if (p->width < 64 && p->height < 64)
+	texnum = scrap ? Scrap_CopyBlock (p->data, p->width, p->height, &x, &y) : -1;
+	if (texnum != -1)
 	{
-		int		x, y;
-		int		i, j, k;
-		int		texnum;
-
-		texnum = Scrap_AllocBlock (p->width, p->height, &x, &y);
-		scrap_dirty = true;
-		k = 0;
-		for (i=0 ; i<p->height ; i++)
-			for (j=0 ; j<p->width ; j++, k++)
-				scrap_texels[texnum][(y+i)*BLOCK_WIDTH + x + j] = p->data[k];
-		texnum += scrap_texnum;
-		gl->texnum = texnum;
+		gl->texnum = scrap_texnum + texnum;
 		gl->sl = (x+0.01)/(float)BLOCK_WIDTH;
 		gl->sh = (x+p->width-0.01)/(float)BLOCK_WIDTH;
-		gl->tl = (y+0.01)/(float)BLOCK_WIDTH;
-		gl->th = (y+p->height-0.01)/(float)BLOCK_WIDTH;
+		gl->tl = (y+0.01)/(float)BLOCK_HEIGHT;
+		gl->th = (y+p->height-0.01)/(float)BLOCK_HEIGHT;
 
 		pic_count++;
 		pic_texels += p->width*p->height;
 	}
 	else
 	{
-		gl->texnum = GL_LoadPicTexture (p);
+		texnum = GL_LoadPicTexture (p);
+		gl->texnum = texnum;
 		gl->sl = 0;
 		gl->sh = 1;
 		gl->tl = 0;
 		gl->th = 1;
 	}
+}
+
+qpic_t *Draw_PicFromWad (char *name)
+{
+	qpic_t	*p;
+
+	p = W_GetLumpName (name);
+	Draw_UploadPic (p, (glpic_t *)p->data, true);
 	return p;
 }
 
@@ -264,11 +428,7 @@ qpic_t	*Draw_CachePic (char *path)
 	pic->pic.height = dat->height;
 
 	gl = (glpic_t *)pic->pic.data;
-	gl->texnum = GL_LoadPicTexture (dat);
-	gl->sl = 0;
-	gl->sh = 1;
-	gl->tl = 0;
-	gl->th = 1;
+	Draw_UploadPic (dat, gl, true);
 
 	return &pic->pic;
 }
@@ -382,6 +542,11 @@ void Draw_Init (void)
 	Cvar_RegisterVariable (&gl_nobind);
 	Cvar_RegisterVariable (&gl_max_size);
 	Cvar_RegisterVariable (&gl_picmip);
+	Cvar_RegisterVariable (&gl_texturecache);
+	Cvar_RegisterVariable (&gl_batch2d);
+
+	sprintf (texturecachedir, "%s/glquake/textures", com_gamedir);
+	Sys_mkdir (texturecachedir);
 
 	// 3dfx can only handle 256 wide textures
 	if (!Q_strncasecmp ((char *)gl_renderer, "3dfx",4) ||
@@ -399,8 +564,21 @@ void Draw_Init (void)
 		if (draw_chars[i] == 0)
 			draw_chars[i] = 255;	// proper transparent color
 
-	// now turn them into textures
-	char_texture = GL_LoadTexture ("charset", 128, 128, draw_chars, false, true);
+	// save slots for scraps, with their unused texels transparent
+	scrap_texnum = texture_extension_number;
+	texture_extension_number += MAX_SCRAPS;
+	memset (scrap_texels, 255, sizeof(scrap_texels));
+
+	// the charset goes first in the scrap, and fills it so no pic
+	// shares its nearest filtering
+	i = Scrap_CopyBlock (draw_chars, 128, 128, &x, &y);
+	if (i == -1)
+		Sys_Error ("Draw_Init: no scrap space for conchars");
+	char_texture = scrap_texnum + i;
+	char_sl = x/(float)BLOCK_WIDTH;
+	char_tl = y/(float)BLOCK_HEIGHT;
+	for (x=0 ; x<BLOCK_WIDTH ; x++)
+		scrap_allocated[i][x] = BLOCK_HEIGHT;
 
 	start = Hunk_LowMark();
 
@@ -455,9 +633,6 @@ void Draw_Init (void)
 	ncdata = cb->data;
 #endif
 
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
 	gl = (glpic_t *)conback->data;
 	gl->texnum = GL_LoadTexture ("conback", conback->width, conback->height, ncdata, false, false);
 	gl->sl = 0;
@@ -473,15 +648,14 @@ void Draw_Init (void)
 	// save a texture slot for translated picture
 	translate_texture = texture_extension_number++;
 
-	// save slots for scraps
-	scrap_texnum = texture_extension_number;
-	texture_extension_number += MAX_SCRAPS;
-
 	//
 	// get the other pics we need
 	//
 	draw_disc = Draw_PicFromWad ("disc");
-	draw_backtile = Draw_PicFromWad ("backtile");
+
+	// the backtile repeats, so it can't share a texture
+	draw_backtile = W_GetLumpName ("backtile");
+	Draw_UploadPic (draw_backtile, (glpic_t *)draw_backtile->data, false);
 }
 
 
@@ -497,10 +671,6 @@ smoothly scrolled off.
 */
 void Draw_Character (int x, int y, int num)
 {
-	byte			*dest;
-	byte			*source;
-	unsigned short	*pusdest;
-	int				drawline;	
 	int				row, col;
 	float			frow, fcol, size;
 
@@ -512,25 +682,17 @@ void Draw_Character (int x, int y, int num)
 	if (y <= -8)
 		return;			// totally off screen
 
+	if (scrap_dirty)
+		Scrap_Upload ();
+
 	row = num>>4;
 	col = num&15;
 
-	frow = row*0.0625;
-	fcol = col*0.0625;
-	size = 0.0625;
-
-	GL_Bind (char_texture);
-
-	glBegin (GL_QUADS);
-	glTexCoord2f (fcol, frow);
-	glVertex2f (x, y);
-	glTexCoord2f (fcol + size, frow);
-	glVertex2f (x+8, y);
-	glTexCoord2f (fcol + size, frow + size);
-	glVertex2f (x+8, y+8);
-	glTexCoord2f (fcol, frow + size);
-	glVertex2f (x, y+8);
-	glEnd ();
+	size = 8.0/BLOCK_WIDTH;
+	frow = char_tl + row*size;
+	fcol = char_sl + col*size;
+
+	Draw_Quad (char_texture, false, x, y, 8, 8, fcol, frow, fcol + size, frow + size, draw_white);
 }
 
 /*
@@ -568,33 +730,15 @@ Draw_AlphaPic
 */
 void Draw_AlphaPic (int x, int y, qpic_t *pic, float alpha)
 {
-	byte			*dest, *source;
-	unsigned short	*pusdest;
-	int				v, u;
 	glpic_t			*gl;
+	byte			color[4];
 
 	if (scrap_dirty)
 		Scrap_Upload ();
 	gl = (glpic_t *)pic->data;
-	glDisable(GL_ALPHA_TEST);
-	glEnable (GL_BLEND);
-//	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-//	glCullFace(GL_FRONT);
-	glColor4f (1,1,1,alpha);
-	GL_Bind (gl->texnum);
-	glBegin (GL_QUADS);
-	glTexCoord2f (gl->sl, gl->tl);
-	glVertex2f (x, y);
-	glTexCoord2f (gl->sh, gl->tl);
-	glVertex2f (x+pic->width, y);
-	glTexCoord2f (gl->sh, gl->th);
-	glVertex2f (x+pic->width, y+pic->height);
-	glTexCoord2f (gl->sl, gl->th);
-	glVertex2f (x, y+pic->height);
-	glEnd ();
-	glColor4f (1,1,1,1);
-	glEnable(GL_ALPHA_TEST);
-	glDisable (GL_BLEND);
+	color[0] = color[1] = color[2] = 255;
+	color[3] = alpha < 0 ? 0 : alpha > 1 ? 255 : alpha*255;
+	Draw_Quad (gl->texnum, true, x, y, pic->width, pic->height, gl->sl, gl->tl, gl->sh, gl->th, color);
 }
 
 
@@ -605,26 +749,12 @@ Draw_Pic
 */
 void Draw_Pic (int x, int y, qpic_t *pic)
 {
-	byte			*dest, *source;
-	unsigned short	*pusdest;
-	int				v, u;
 	glpic_t			*gl;
 
 	if (scrap_dirty)
 		Scrap_Upload ();
 	gl = (glpic_t *)pic->data;
-	glColor4f (1,1,1,1);
-	GL_Bind (gl->texnum);
-	glBegin (GL_QUADS);
-	glTexCoord2f (gl->sl, gl->tl);
-	glVertex2f (x, y);
-	glTexCoord2f (gl->sh, gl->tl);
-	glVertex2f (x+pic->width, y);
-	glTexCoord2f (gl->sh, gl->th);
-	glVertex2f (x+pic->width, y+pic->height);
-	glTexCoord2f (gl->sl, gl->th);
-	glVertex2f (x, y+pic->height);
-	glEnd ();
+	Draw_Quad (gl->texnum, false, x, y, pic->width, pic->height, gl->sl, gl->tl, gl->sh, gl->th, draw_white);
 }
 
 
@@ -663,6 +793,8 @@ void Draw_TransPicTranslate (int x, int y, qpic_t *pic, byte *translation)
 	byte			*src;
 	int				p;
 
+	// queued quads may still use the last translation
+	Draw_Flush ();
 	GL_Bind (translate_texture);
 
 	c = pic->width * pic->height;
@@ -686,17 +818,7 @@ void Draw_TransPicTranslate (int x, int y, qpic_t *pic, byte *translation)
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-	glColor3f (1,1,1);
-	glBegin (GL_QUADS);
-	glTexCoord2f (0, 0);
-	glVertex2f (x, y);
-	glTexCoord2f (1, 0);
-	glVertex2f (x+pic->width, y);
-	glTexCoord2f (1, 1);
-	glVertex2f (x+pic->width, y+pic->height);
-	glTexCoord2f (0, 1);
-	glVertex2f (x, y+pic->height);
-	glEnd ();
+	Draw_Quad (translate_texture, false, x, y, pic->width, pic->height, 0, 0, 1, 1, draw_white);
 }
 
 
@@ -727,18 +849,8 @@ refresh window.
 */
 void Draw_TileClear (int x, int y, int w, int h)
 {
-	glColor3f (1,1,1);
-	GL_Bind (*(int *)draw_backtile->data);
-	glBegin (GL_QUADS);
-	glTexCoord2f (x/64.0, y/64.0);
-	glVertex2f (x, y);
-	glTexCoord2f ( (x+w)/64.0, y/64.0);
-	glVertex2f (x+w, y);
-	glTexCoord2f ( (x+w)/64.0, (y+h)/64.0);
-	glVertex2f (x+w, y+h);
-	glTexCoord2f ( x/64.0, (y+h)/64.0 );
-	glVertex2f (x, y+h);
-	glEnd ();
+	Draw_Quad (((glpic_t *)draw_backtile->data)->texnum, false, x, y, w, h,
+		x/64.0, y/64.0, (x+w)/64.0, (y+h)/64.0, draw_white);
 }
 
 
@@ -751,21 +863,13 @@ Fills a box of pixels with a single color
 */
 void Draw_Fill (int x, int y, int w, int h, int c)
 {
-	glDisable (GL_TEXTURE_2D);
-	glColor3f (host_basepal[c*3]/255.0,
-		host_basepal[c*3+1]/255.0,
-		host_basepal[c*3+2]/255.0);
-
-	glBegin (GL_QUADS);
-
-	glVertex2f (x,y);
-	glVertex2f (x+w, y);
-	glVertex2f (x+w, y+h);
-	glVertex2f (x, y+h);
+	byte	color[4];
 
-	glEnd ();
-	glColor3f (1,1,1);
-	glEnable (GL_TEXTURE_2D);
+	color[0] = host_basepal[c*3];
+	color[1] = host_basepal[c*3+1];
+	color[2] = host_basepal[c*3+2];
+	color[3] = 255;
+	Draw_Quad (0, false, x, y, w, h, 0, 0, 0, 0, color);
 }
 //=============================================================================
 
@@ -777,20 +881,9 @@ Draw_FadeScreen
 */
 void Draw_FadeScreen (void)
 {
-	glEnable (GL_BLEND);
-	glDisable (GL_TEXTURE_2D);
-	glColor4f (0, 0, 0, 0.8);
-	glBegin (GL_QUADS);
+	static byte	color[4] = {0, 0, 0, 204};
 
-	glVertex2f (0,0);
-	glVertex2f (vid.width, 0);
-	glVertex2f (vid.width, vid.height);
-	glVertex2f (0, vid.height);
-
-	glEnd ();
-	glColor4f (1,1,1,1);
-	glEnable (GL_TEXTURE_2D);
-	glDisable (GL_BLEND);
+	Draw_Quad (0, true, 0, 0, vid.width, vid.height, 0, 0, 0, 0, color);
 
 	Sbar_Changed();
 }
@@ -809,8 +902,10 @@ void Draw_BeginDisc (void)
 {
 	if (!draw_disc)
 		return;
+	Draw_Flush ();
 	glDrawBuffer  (GL_FRONT);
 	Draw_Pic (vid.width - 24, 0, draw_disc);
+	Draw_Flush ();
 	glDrawBuffer  (GL_BACK);
 }
 
@@ -836,6 +931,10 @@ Setup as if the screen was 320*200
 */
 void GL_Set2D (void)
 {
+	draw_lastdraws = c_2d_draws;
+	draw_lastquads = c_2d_quads;
+	c_2d_draws = c_2d_quads = 0;
+
 	glViewport (glx, gly, glwidth, glheight);
 
 	glMatrixMode(GL_PROJECTION);
@@ -858,21 +957,49 @@ void GL_Set2D (void)
 
 /*
 ================
-GL_FindTexture
+GL_HashTexture
 ================
 */
-int GL_FindTexture (char *identifier)
+int GL_HashTexture (char *identifier)
+{
+	unsigned	hash;
+
+	for (hash=0 ; *identifier ; identifier++)
+		hash = hash*31 + *identifier;
+	return hash & (TEXTURE_HASH_SIZE-1);
+}
+
+/*
+================
+GL_FindTextureEntry
+================
+*/
+gltexture_t *GL_FindTextureEntry (char *identifier)
 {
-	int		i;
 	gltexture_t	*glt;
 
-	for (i=0, glt=gltextures ; i<numgltextures ; i++, glt++)
+	for (glt = gltexturehash[GL_HashTexture (identifier)] ; glt ; glt = glt->hashnext)
 	{
 		if (!strcmp (identifier, glt->identifier))
-			return gltextures[i].texnum;
+			return glt;
 	}
 
-	return -1;
+	return NULL;
+}
+
+/*
+================
+GL_FindTexture
+================
+*/
+int GL_FindTexture (char *identifier)
+{
+	gltexture_t	*glt;
+
+	glt = GL_FindTextureEntry (identifier);
+	if (!glt)
+		return -1;
+	return glt->texnum;
 }
 
 /*
@@ -891,7 +1018,7 @@ void GL_ResampleTexture (unsigned *in, int inwidth, int inheight, unsigned *out,
 	{
 		inrow = in + inwidth*(i*inheight/outheight);
 		frac = fracstep >> 1;
-		for (j=0 ; j<outwidth ; j+=4)
+		for (j=0 ; j+4<=outwidth ; j+=4)
 		{
 			out[j] = inrow[frac>>16];
 			frac += fracstep;
@@ -902,6 +1029,12 @@ void GL_ResampleTexture (unsigned *in, int inwidth, int inheight, unsigned *out,
 			out[j+3] = inrow[frac>>16];
 			frac += fracstep;
 		}
+		// 1 and 2 wide mips, which have no room past the row
+		for ( ; j<outwidth ; j++)
+		{
+			out[j] = inrow[frac>>16];
+			frac += fracstep;
+		}
 	}
 }
 
@@ -938,31 +1071,100 @@ void GL_Resample8BitTexture (unsigned char *in, int inwidth, int inheight, unsig
 
 /*
 ================
-GL_MipMap
+GL_MipMap_C
+
+Box filters a level into out, which may be the same as in, halving each
+side that is larger than one
+================
+*/
+void GL_MipMap_C (byte *in, int width, int height, byte *out)
+{
+	int		i, j, k, w2, h2, dx, dy;
+	byte	*a, *b;
+
+	w2 = width > 1 ? width >> 1 : 1;
+	h2 = height > 1 ? height >> 1 : 1;
+	dx = width > 1 ? 4 : 0;
+	dy = height > 1 ? width*4 : 0;
+
+	for (i=0 ; i<h2 ; i++)
+	{
+		a = in + i*2*width*4;
+		b = a + dy;
+		for (j=0 ; j<w2 ; j++, a+=8, b+=8, out+=4)
+		{
+			for (k=0 ; k<4 ; k++)
+				out[k] = (a[k] + a[k+dx] + b[k] + b[k+dx])>>2;
+		}
+	}
+}
+
+#if idSSE
+
+/*
+================
+GL_MipMap_SSE
 
-Operates in place, quartering the size of the texture
+Eight pixels of each row pair to four at a time
 ================
 */
-void GL_MipMap (byte *in, int width, int height)
+void GL_MipMap_SSE (byte *in, int width, int height, byte *out)
 {
 	int		i, j;
-	byte	*out;
+	byte	*a, *b;
+	__m128i	zero, lo, hi, s0, s1;
 
-	width <<=2;
-	height >>= 1;
-	out = in;
-	for (i=0 ; i<height ; i++, in+=width)
+	if (width < 8 || height < 2)
+	{
+		GL_MipMap_C (in, width, height, out);
+		return;
+	}
+
+	zero = _mm_setzero_si128 ();
+	for (i=0 ; i<height>>1 ; i++)
 	{
-		for (j=0 ; j<width ; j+=8, out+=4, in+=8)
+		a = in + i*2*width*4;
+		b = a + width*4;
+		for (j=0 ; j<width ; j+=8, a+=32, b+=32, out+=16)
 		{
-			out[0] = (in[0] + in[4] + in[width+0] + in[width+4])>>2;
-			out[1] = (in[1] + in[5] + in[width+1] + in[width+5])>>2;
-			out[2] = (in[2] + in[6] + in[width+2] + in[width+6])>>2;
-			out[3] = (in[3] + in[7] + in[width+3] + in[width+7])>>2;
+			lo = _mm_add_epi16 (_mm_unpacklo_epi8 (_mm_loadu_si128 ((__m128i *)a), zero),
+				_mm_unpacklo_epi8 (_mm_loadu_si128 ((__m128i *)b), zero));
+			hi = _mm_add_epi16 (_mm_unpackhi_epi8 (_mm_loadu_si128 ((__m128i *)a), zero),
+				_mm_unpackhi_epi8 (_mm_loadu_si128 ((__m128i *)b), zero));
+			s0 = _mm_add_epi16 (_mm_unpacklo_epi64 (lo, hi), _mm_unpackhi_epi64 (lo, hi));
+
+			lo = _mm_add_epi16 (_mm_unpacklo_epi8 (_mm_loadu_si128 ((__m128i *)(a+16)), zero),
+				_mm_unpacklo_epi8 (_mm_loadu_si128 ((__m128i *)(b+16)), zero));
+			hi = _mm_add_epi16 (_mm_unpackhi_epi8 (_mm_loadu_si128 ((__m128i *)(a+16)), zero),
+				_mm_unpackhi_epi8 (_mm_loadu_si128 ((__m128i *)(b+16)), zero));
+			s1 = _mm_add_epi16 (_mm_unpacklo_epi64 (lo, hi), _mm_unpackhi_epi64 (lo, hi));
+
+			_mm_storeu_si128 ((__m128i *)out, _mm_packus_epi16 (_mm_srli_epi16 (s0, 2), _mm_srli_epi16 (s1, 2)));
 		}
 	}
 }
 
+#endif
+
+void (*GL_MipMap) (byte *in, int width, int height, byte *out);
+
+/*
+================
+GL_SelectTextureKernels
+================
+*/
+void GL_SelectTextureKernels (void)
+{
+#if idSSE
+	if (r_simd.value && Sys_HaveSSE2 ())
+	{
+		GL_MipMap = GL_MipMap_SSE;
+		return;
+	}
+#endif
+	GL_MipMap = GL_MipMap_C;
+}
+
 /*
 ================
 GL_MipMap8Bit
@@ -997,85 +1199,328 @@ void GL_MipMap8Bit (byte *in, int width, int height)
 	}
 }
 
+/*
+=============================================================================
+
+  TEXTURE PIPELINE
+
+A texture is converted to the levels it will be uploaded with by
+GL_ConvertTexture, then sent by GL_UploadTexture.  Between
+GL_BeginTextureBatch and GL_EndTextureBatch, GL_LoadTexture only queues
+the texture; the end converts the whole queue on the job threads and
+uploads it on this one.  Models are loaded inside a batch.
+
+=============================================================================
+*/
+
+typedef struct
+{
+	int			texnum;
+	byte		*data;			// 8 bit source, or NULL
+	unsigned	*data32;		// 32 bit source
+	int			width, height;
+	qboolean	mipmap, alpha;
+	unsigned	*mips;			// converted levels, largest first
+	int			scaled_width, scaled_height;
+	qboolean	cache;			// may use the texture cache
+	qboolean	cached;			// levels came from the texture cache
+} texjob_t;
+
+#define	MAX_TEXJOBS		256
+
+texjob_t	texjobs[MAX_TEXJOBS];
+int			numtexjobs;
+int			texbatch;			// nesting depth
+
+// map load timing, printed by R_NewMap
+double		load_models, load_texconvert, load_texupload;
+int			load_textures, load_texcached;
+
+/*
+=============================================================================
+
+  TEXTURE CACHE
+
+Converted 8 bit textures are saved in glquake/textures, named by a crc
+and checksum of the source and by the settings that change the levels,
+so a repeat load only reads back what it would have built.  A changed
+source gets a new name; stale files are never read, only left behind.
+
+=============================================================================
+*/
+
+#define	TEXCACHE_VERSION	1
+
+typedef struct
+{
+	int			version;
+	int			width, height;
+	int			scaled_width, scaled_height;
+	int			mipmap;
+	int			alpha;
+	int			size;			// bytes of levels that follow
+} texcache_t;
+
 /*
 ===============
-GL_Upload32
+GL_TextureChecksum
+
+LordHavoc's checksum, weighting each palette index by how often it has
+been seen so far
 ===============
 */
-void GL_Upload32 (unsigned *data, int width, int height,  qboolean mipmap, qboolean alpha)
+int GL_TextureChecksum (byte *data, int size)
 {
-	int			samples;
-static	unsigned	scaled[1024*512];	// [512*256];
-	int			scaled_width, scaled_height;
+	int		i, sum;
+	int		table[256];
+
+	for (i=0 ; i<256 ; i++)
+		table[i] = i + 1;
+	for (i=0, sum=0 ; i<size ; i++)
+		sum += table[data[i]]++;
+	return sum;
+}
 
-	for (scaled_width = 1 ; scaled_width < width ; scaled_width<<=1)
-		;
-	for (scaled_height = 1 ; scaled_height < height ; scaled_height<<=1)
-		;
+/*
+===============
+GL_TextureCacheName
+===============
+*/
+void GL_TextureCacheName (texjob_t *job, char *name)
+{
+	int				i, s, format;
+	unsigned short	crc;
 
-	scaled_width >>= (int)gl_picmip.value;
-	scaled_height >>= (int)gl_picmip.value;
+	s = job->width*job->height;
+	CRC_Init (&crc);
+	for (i=0 ; i<s ; i++)
+		CRC_ProcessByte (&crc, job->data[i]);
 
-	if (scaled_width > gl_max_size.value)
-		scaled_width = gl_max_size.value;
-	if (scaled_height > gl_max_size.value)
-		scaled_height = gl_max_size.value;
+	format = job->alpha ? gl_alpha_format : gl_solid_format;
+	sprintf (name, "%s/%04x%08x_%i_%i_%x.tex", texturecachedir, CRC_Value (crc),
+		GL_TextureChecksum (job->data, s), (int)gl_picmip.value, (int)gl_max_size.value, format);
+}
 
-	if (scaled_width * scaled_height > sizeof(scaled)/4)
-		Sys_Error ("GL_LoadTexture: too big");
+/*
+===============
+GL_ReadTextureCache
 
-	samples = alpha ? gl_alpha_format : gl_solid_format;
+Fills job->mips, which holds size bytes, from a cache file if there is a
+matching one
+===============
+*/
+qboolean GL_ReadTextureCache (texjob_t *job, char *name, int size)
+{
+	FILE		*f;
+	texcache_t	header;
+	qboolean	ok;
+
+	f = fopen (name, "rb");
+	if (!f)
+		return false;
+
+	ok = fread (&header, sizeof(header), 1, f) == 1
+		&& header.version == TEXCACHE_VERSION
+		&& header.width == job->width && header.height == job->height
+		&& header.scaled_width == job->scaled_width && header.scaled_height == job->scaled_height
+		&& header.mipmap == job->mipmap && header.alpha == job->alpha
+		&& header.size == size
+		&& fread (job->mips, size, 1, f) == 1;
+	fclose (f);
+
+	return ok;
+}
 
-#if 0
-	if (mipmap)
-		gluBuild2DMipmaps (GL_TEXTURE_2D, samples, width, height, GL_RGBA, GL_UNSIGNED_BYTE, trans);
-	else if (scaled_width == width && scaled_height == height)
-		glTexImage2D (GL_TEXTURE_2D, 0, samples, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, trans);
-	else
+/*
+===============
+GL_WriteTextureCache
+===============
+*/
+void GL_WriteTextureCache (texjob_t *job, char *name, int size)
+{
+	FILE		*f;
+	texcache_t	header;
+
+	f = fopen (name, "wb");
+	if (!f)
+		return;
+
+	header.version = TEXCACHE_VERSION;
+	header.width = job->width;
+	header.height = job->height;
+	header.scaled_width = job->scaled_width;
+	header.scaled_height = job->scaled_height;
+	header.mipmap = job->mipmap;
+	header.alpha = job->alpha;
+	header.size = size;
+	fwrite (&header, sizeof(header), 1, f);
+	fwrite (job->mips, size, 1, f);
+	fclose (f);
+}
+
+/*
+===============
+GL_ConvertTexture
+
+Palette expands, resamples to the upload size and builds the mip levels,
+or reads them back from the texture cache.  Runs on the job threads, so
+it only reads cvars and uses stdio directly.
+===============
+*/
+void GL_ConvertTexture (texjob_t *job)
+{
+	int			i, s, w, h, total;
+	unsigned	*trans, *level;
+	char		cachename[MAX_OSPATH];
+	qboolean	usecache;
+
+	s = job->width*job->height;
+
+	// if there are no transparent pixels, make it a 3 component
+	// texture even if it was specified as otherwise
+	if (job->data && job->alpha)
 	{
-		gluScaleImage (GL_RGBA, width, height, GL_UNSIGNED_BYTE, trans,
-			scaled_width, scaled_height, GL_UNSIGNED_BYTE, scaled);
-		glTexImage2D (GL_TEXTURE_2D, 0, samples, scaled_width, scaled_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, scaled);
+		for (i=0 ; i<s ; i++)
+			if (job->data[i] == 255)
+				break;
+		if (i == s)
+			job->alpha = false;
 	}
-#else
-texels += scaled_width * scaled_height;
 
-	if (scaled_width == width && scaled_height == height)
+	for (w = 1 ; w < job->width ; w<<=1)
+		;
+	for (h = 1 ; h < job->height ; h<<=1)
+		;
+
+	w >>= (int)gl_picmip.value;
+	h >>= (int)gl_picmip.value;
+
+	if (w > gl_max_size.value)
+		w = gl_max_size.value;
+	if (h > gl_max_size.value)
+		h = gl_max_size.value;
+	if (w < 1)
+		w = 1;
+	if (h < 1)
+		h = 1;
+	job->scaled_width = w;
+	job->scaled_height = h;
+
+	total = w*h;
+	if (job->mipmap)
 	{
-		if (!mipmap)
+		while (w > 1 || h > 1)
 		{
-			glTexImage2D (GL_TEXTURE_2D, 0, samples, scaled_width, scaled_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-			goto done;
+			if (w > 1)
+				w >>= 1;
+			if (h > 1)
+				h >>= 1;
+			total += w*h;
 		}
-		memcpy (scaled, data, width*height*4);
 	}
-	else
-		GL_ResampleTexture (data, width, height, scaled, scaled_width, scaled_height);
 
-	glTexImage2D (GL_TEXTURE_2D, 0, samples, scaled_width, scaled_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, scaled);
-	if (mipmap)
+	job->mips = malloc (total*4);
+	if (!job->mips)
+		return;
+
+	usecache = job->cache && gl_texturecache.value && texturecachedir[0];
+	if (usecache)
 	{
-		int		miplevel;
+		GL_TextureCacheName (job, cachename);
+		if (GL_ReadTextureCache (job, cachename, total*4))
+		{
+			job->cached = true;
+			return;
+		}
+	}
 
-		miplevel = 0;
-		while (scaled_width > 1 || scaled_height > 1)
+	trans = job->data32;
+	if (job->data)
+	{
+		if (job->scaled_width == job->width && job->scaled_height == job->height)
+			trans = job->mips;
+		else
 		{
-			GL_MipMap ((byte *)scaled, scaled_width, scaled_height);
-			scaled_width >>= 1;
-			scaled_height >>= 1;
-			if (scaled_width < 1)
-				scaled_width = 1;
-			if (scaled_height < 1)
-				scaled_height = 1;
-			miplevel++;
-			glTexImage2D (GL_TEXTURE_2D, miplevel, samples, scaled_width, scaled_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, scaled);
+			trans = malloc (s*4);
+			if (!trans)
+			{
+				free (job->mips);
+				job->mips = NULL;
+				return;
+			}
 		}
+		for (i=0 ; i<s ; i++)
+			trans[i] = d_8to24table[job->data[i]];
 	}
-done: ;
-#endif
 
+	if (job->scaled_width == job->width && job->scaled_height == job->height)
+	{
+		if (trans != job->mips)
+			memcpy (job->mips, trans, s*4);
+	}
+	else
+		GL_ResampleTexture (trans, job->width, job->height, job->mips, job->scaled_width, job->scaled_height);
 
-	if (mipmap)
+	if (job->data && trans != job->mips)
+		free (trans);
+
+	if (job->mipmap)
+	{
+		w = job->scaled_width;
+		h = job->scaled_height;
+		level = job->mips;
+		while (w > 1 || h > 1)
+		{
+			GL_MipMap ((byte *)level, w, h, (byte *)(level + w*h));
+			level += w*h;
+			if (w > 1)
+				w >>= 1;
+			if (h > 1)
+				h >>= 1;
+		}
+	}
+
+	if (usecache)
+		GL_WriteTextureCache (job, cachename, total*4);
+}
+
+/*
+===============
+GL_UploadTexture
+
+Sends a converted texture to the bound texture object
+===============
+*/
+void GL_UploadTexture (texjob_t *job)
+{
+	int			samples, w, h, miplevel;
+	unsigned	*level;
+
+	if (!job->mips)
+		Sys_Error ("GL_UploadTexture: out of memory");
+
+	samples = job->alpha ? gl_alpha_format : gl_solid_format;
+
+	w = job->scaled_width;
+	h = job->scaled_height;
+	texels += w*h;
+
+	level = job->mips;
+	miplevel = 0;
+	while (1)
+	{
+		glTexImage2D (GL_TEXTURE_2D, miplevel, samples, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, level);
+		if (!job->mipmap || (w == 1 && h == 1))
+			break;
+		level += w*h;
+		if (w > 1)
+			w >>= 1;
+		if (h > 1)
+			h >>= 1;
+		miplevel++;
+	}
+
+	if (job->mipmap)
 	{
 		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, gl_filter_min);
 		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, gl_filter_max);
@@ -1085,6 +1530,136 @@ done: ;
 		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, gl_filter_max);
 		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, gl_filter_max);
 	}
+
+	free (job->mips);
+	job->mips = NULL;
+}
+
+/*
+===============
+GL_ConvertTextureJob
+===============
+*/
+void GL_ConvertTextureJob (void *data, int index, int thread)
+{
+	GL_ConvertTexture ((texjob_t *)data + index);
+}
+
+/*
+===============
+GL_FlushTextures
+
+Converts everything queued on the job threads, then uploads it in order
+===============
+*/
+void GL_FlushTextures (void)
+{
+	int			i;
+	double		start, mid;
+
+	if (!numtexjobs)
+		return;
+
+	GL_SelectTextureKernels ();
+
+	start = Sys_ProfileTime ();
+	Job_Run (GL_ConvertTextureJob, texjobs, numtexjobs);
+	mid = Sys_ProfileTime ();
+
+	for (i=0 ; i<numtexjobs ; i++)
+	{
+		GL_Bind (texjobs[i].texnum);
+		if (texjobs[i].cached)
+			load_texcached++;
+		GL_UploadTexture (&texjobs[i]);
+		free (texjobs[i].data);
+	}
+
+	load_texconvert += mid - start;
+	load_texupload += Sys_ProfileTime () - mid;
+	load_textures += numtexjobs;
+	numtexjobs = 0;
+}
+
+/*
+===============
+GL_BeginTextureBatch
+===============
+*/
+void GL_BeginTextureBatch (void)
+{
+	texbatch++;
+}
+
+/*
+===============
+GL_EndTextureBatch
+===============
+*/
+void GL_EndTextureBatch (void)
+{
+	if (--texbatch > 0)
+		return;
+	texbatch = 0;
+	GL_FlushTextures ();
+}
+
+/*
+===============
+GL_QueueTexture
+
+Copies the source, since model loading frees it before the batch ends
+===============
+*/
+void GL_QueueTexture (int texnum, byte *data, int width, int height, qboolean mipmap, qboolean alpha)
+{
+	texjob_t	*job;
+
+	if (numtexjobs == MAX_TEXJOBS)
+		GL_FlushTextures ();
+
+	job = &texjobs[numtexjobs];
+	memset (job, 0, sizeof(*job));
+	job->data = malloc (width*height);
+	if (!job->data)
+		Sys_Error ("GL_QueueTexture: out of memory");
+	memcpy (job->data, data, width*height);
+	job->texnum = texnum;
+	job->width = width;
+	job->height = height;
+	job->mipmap = mipmap;
+	job->alpha = alpha;
+	job->cache = true;
+	numtexjobs++;
+}
+
+/*
+===============
+GL_Upload32
+===============
+*/
+void GL_Upload32 (unsigned *data, int width, int height,  qboolean mipmap, qboolean alpha)
+{
+	texjob_t	job;
+	double		start, mid;
+
+	GL_SelectTextureKernels ();
+
+	memset (&job, 0, sizeof(job));
+	job.data32 = data;
+	job.width = width;
+	job.height = height;
+	job.mipmap = mipmap;
+	job.alpha = alpha;
+
+	start = Sys_ProfileTime ();
+	GL_ConvertTexture (&job);
+	mid = Sys_ProfileTime ();
+	GL_UploadTexture (&job);
+
+	load_texconvert += mid - start;
+	load_texupload += Sys_ProfileTime () - mid;
+	load_textures++;
 }
 
 void GL_Upload8_EXT (byte *data, int width, int height,  qboolean mipmap, qboolean alpha) 
@@ -1180,51 +1755,53 @@ done: ;
 
 /*
 ===============
-GL_Upload8
+GL_UploadPaletted
+
+Only named textures go in the texture cache; the scrap changes as pics
+are added to it
 ===============
 */
-void GL_Upload8 (byte *data, int width, int height,  qboolean mipmap, qboolean alpha)
+void GL_UploadPaletted (byte *data, int width, int height,  qboolean mipmap, qboolean alpha, qboolean cache)
 {
-static	unsigned	trans[640*480];		// FIXME, temporary
-	int			i, s;
-	qboolean	noalpha;
-	int			p;
-
-	s = width*height;
-	// if there are no transparent pixels, make it a 3 component
-	// texture even if it was specified as otherwise
-	if (alpha)
-	{
-		noalpha = true;
-		for (i=0 ; i<s ; i++)
-		{
-			p = data[i];
-			if (p == 255)
-				noalpha = false;
-			trans[i] = d_8to24table[p];
-		}
-
-		if (alpha && noalpha)
-			alpha = false;
-	}
-	else
-	{
-		if (s&3)
-			Sys_Error ("GL_Upload8: s&3");
-		for (i=0 ; i<s ; i+=4)
-		{
-			trans[i] = d_8to24table[data[i]];
-			trans[i+1] = d_8to24table[data[i+1]];
-			trans[i+2] = d_8to24table[data[i+2]];
-			trans[i+3] = d_8to24table[data[i+3]];
-		}
-	}
-
- 	if (VID_Is8bit() && !alpha && (data!=scrap_texels[0])) {
- 		GL_Upload8_EXT (data, width, height, mipmap, alpha);
+	texjob_t	job;
+	double		start, mid;
+
+	GL_SelectTextureKernels ();
+
+	memset (&job, 0, sizeof(job));
+	job.cache = cache;
+	job.data = data;
+	job.width = width;
+	job.height = height;
+	job.mipmap = mipmap;
+	job.alpha = alpha;
+
+	start = Sys_ProfileTime ();
+	GL_ConvertTexture (&job);
+	mid = Sys_ProfileTime ();
+
+ 	if (VID_Is8bit() && !job.alpha && (data!=scrap_texels[0])) {
+		free (job.mips);
+ 		GL_Upload8_EXT (data, width, height, mipmap, job.alpha);
  		return;
 	}
-	GL_Upload32 (trans, width, height, mipmap, alpha);
+	if (job.cached)
+		load_texcached++;
+	GL_UploadTexture (&job);
+
+	load_texconvert += mid - start;
+	load_texupload += Sys_ProfileTime () - mid;
+	load_textures++;
+}
+
+/*
+===============
+GL_Upload8
+===============
+*/
+void GL_Upload8 (byte *data, int width, int height,  qboolean mipmap, qboolean alpha)
+{
+	GL_UploadPaletted (data, width, height, mipmap, alpha, false);
 }
 
 /*
@@ -1232,40 +1809,40 @@ static	unsigned	trans[640*480];		// FIXME, temporary
 GL_LoadTexture
 ================
 */
-int lhcsumtable[256];
 int GL_LoadTexture (char *identifier, int width, int height, byte *data, qboolean mipmap, qboolean alpha)
 {
-	qboolean noalpha;
-	int   i, p, s, lhcsum;
+	int   lhcsum, hash;
 	gltexture_t *glt;
 	// LordHavoc: do a checksum to confirm the data really is the same as previous
 	// occurances. well this isn't exactly a checksum, it's better than that but
 	// not following any standards.
-	lhcsum = 0;
-	s = width*height;
-	for (i = 0;i < 256;i++) lhcsumtable[i] = i + 1;
-	for (i = 0;i < s;i++) lhcsum += (lhcsumtable[data[i] & 255]++);
+	lhcsum = GL_TextureChecksum (data, width*height);
 	// see if the texture is allready present
 	if (identifier[0])
 	{
-		for (i=0, glt=gltextures ; i<numgltextures ; i++, glt++)
+		glt = GL_FindTextureEntry (identifier);
+		if (glt)
 		{
 			// LordHavoc: everyone hates cache mismatchs, so I fixed it
-			if (lhcsum != glt->lhcsum || width != glt->width || height != glt->height)
-			{
-				Con_DPrintf("GL_LoadTexture: cache mismatch, replacing old texture\n");
-				goto GL_LoadTexture_setup; // drop out with glt pointing to the texture to replace
-			}
-			return glt->texnum;
+			if (lhcsum == glt->lhcsum && width == glt->width && height == glt->height)
+				return glt->texnum;
+			Con_DPrintf("GL_LoadTexture: cache mismatch, replacing old texture\n");
+			goto GL_LoadTexture_setup; // drop out with glt pointing to the texture to replace
 		}
 	}
-	// LordHavoc: this was an else condition, causing disasterous results,
-	// whoever at id or threewave must've been half asleep...
+	if (numgltextures == MAX_GLTEXTURES)
+		Sys_Error ("GL_LoadTexture: too many textures");
 	glt = &gltextures[numgltextures];
 	numgltextures++;
 	strcpy (glt->identifier, identifier);
 	glt->texnum = texture_extension_number;
 	texture_extension_number++;
+	if (identifier[0])
+	{
+		hash = GL_HashTexture (identifier);
+		glt->hashnext = gltexturehash[hash];
+		gltexturehash[hash] = glt;
+	}
 	// LordHavoc: label to drop out of the loop into the setup code
 	GL_LoadTexture_setup:
 	glt->lhcsum = lhcsum; // LordHavoc: used to verify textures are identical
@@ -1274,8 +1851,13 @@ int GL_LoadTexture (char *identifier, int width, int height, byte *data, qboolea
 	glt->mipmap = mipmap;
 	if (!isDedicated)
 	{
-		GL_Bind(glt->texnum);
-		GL_Upload8 (data, width, height, mipmap, alpha);
+		if (texbatch && !VID_Is8bit ())
+			GL_QueueTexture (glt->texnum, data, width, height, mipmap, alpha);
+		else
+		{
+			GL_Bind(glt->texnum);
+			GL_UploadPaletted (data, width, height, mipmap, alpha, true);
+		}
 	}
 	return glt->texnum;
 }
@@ -291,7 +291,10 @@ void GL_MakeAliasModelDisplayLists (model_t *m, aliashdr_t *hdr)
 {
 	int		i, j;
 	maliasgroup_t	*paliasgroup;
-	int			*cmds;
+	int			*cmds, *order;
+	int			count, v, n;
+	float		*tc;
+	unsigned short	*index;
 	trivertx_t	*verts;
 	char	cache[MAX_QPATH], fullpath[MAX_OSPATH], *c;
 	FILE	*f;
@@ -350,6 +353,53 @@ void GL_MakeAliasModelDisplayLists (model_t *m, aliashdr_t *hdr)
 	paliashdr->commands = (byte *)cmds - (byte *)paliashdr;
 	memcpy (cmds, commands, numcommands * 4);
 
+	//
+	// unroll the strips and fans into triangles for vertex arrays,
+	// the command list vertexes are the pose vertexes in order
+	//
+	tc = Hunk_Alloc (numorder * 2 * sizeof(float));
+	paliashdr->texcoords = (byte *)tc - (byte *)paliashdr;
+	index = Hunk_Alloc (paliashdr->numtris * 3 * sizeof(unsigned short));
+	paliashdr->indexes = (byte *)index - (byte *)paliashdr;
+
+	order = commands;
+	v = n = 0;
+	while ((count = *order++) != 0)
+	{
+		j = count < 0;		// fan
+		if (j)
+			count = -count;
+		if (n + (count-2)*3 > paliashdr->numtris*3)
+			Sys_Error ("GL_MakeAliasModelDisplayLists: %s has too many triangles", m->name);
+
+		for (i=0 ; i<count ; i++, order += 2)
+		{
+			tc[(v+i)*2] = ((float *)order)[0];
+			tc[(v+i)*2+1] = ((float *)order)[1];
+		}
+		for (i=2 ; i<count ; i++)
+		{
+			if (j)
+			{
+				index[n++] = v;
+				index[n++] = v+i-1;
+			}
+			else if (i & 1)
+			{	// odd strip triangles are wound backwards
+				index[n++] = v+i-1;
+				index[n++] = v+i-2;
+			}
+			else
+			{
+				index[n++] = v+i-2;
+				index[n++] = v+i-1;
+			}
+			index[n++] = v+i;
+		}
+		v += count;
+	}
+	paliashdr->numindexes = n;
+
 	verts = Hunk_Alloc (paliashdr->numposes * paliashdr->poseverts 
 		* sizeof(trivertx_t) );
 	paliashdr->posedata = (byte *)verts - (byte *)paliashdr;
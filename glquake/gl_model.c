@@ -239,6 +239,7 @@ model_t *Mod_LoadModel (model_t *mod, qboolean crash)
 	void	*d;
 	unsigned *buf;
 	byte	stackbuf[1024];		// avoid dirtying the cache heap
+	double	start;
 
 	if (!mod->needload)
 	{
@@ -284,6 +285,9 @@ model_t *Mod_LoadModel (model_t *mod, qboolean crash)
 
 // call the apropriate loader
 	mod->needload = false;
+
+	start = Sys_ProfileTime ();
+	GL_BeginTextureBatch ();
 	
 	switch (LittleLong(*(unsigned *)buf))
 	{
@@ -300,6 +304,11 @@ model_t *Mod_LoadModel (model_t *mod, qboolean crash)
 		break;
 	}
 
+	load_models += Sys_ProfileTime () - start;
+
+	// the skins and wall textures are converted and uploaded together
+	GL_EndTextureBatch ();
+
 	return mod;
 }
 
@@ -1151,6 +1160,7 @@ void Mod_LoadBrushModel (model_t *mod, void *buffer)
 	dmodel_t 	*bm;
 	
 	loadmodel->type = mod_brush;
+	loadmodel->sortedsurfaces = NULL;		// built by GL_BuildLightmaps
 	
 	header = (dheader_t *)buffer;
 
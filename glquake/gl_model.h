@@ -118,6 +118,7 @@ typedef struct glpoly_s
 	struct	glpoly_s	*chain;
 	int		numverts;
 	int		flags;			// for SURF_UNDERWATER
+	int		firstvert;		// in world_verts or warp_xyz, or -1 if drawn by hand
 	float	verts[4][VERTEXSIZE];	// variable sized (xyz s1t1 s2t2)
 } glpoly_t;
 
@@ -157,6 +158,7 @@ typedef struct mnode_s
 // common with leaf
 	int			contents;		// 0, to differentiate from leafs
 	int			visframe;		// node needs to be traversed if current
+	int			cullframe;		// outside the frustum if current
 	
 	float		minmaxs[6];		// for bounding box culling
 
@@ -177,6 +179,7 @@ typedef struct mleaf_s
 // common with node
 	int			contents;		// wil be a negative contents number
 	int			visframe;		// node needs to be traversed if current
+	int			cullframe;		// outside the frustum if current
 
 	float		minmaxs[6];		// for bounding box culling
 
@@ -309,6 +312,9 @@ typedef struct {
 	int					poseverts;
 	int					posedata;	// numposes*poseverts trivert_t
 	int					commands;	// gl command list with embedded s/t
+	int					numindexes;
+	int					indexes;	// numindexes unsigned shorts, triangles into a pose
+	int					texcoords;	// poseverts s/t pairs
 	int					gl_texturenum[MAX_SKINS][4];
 	int					texels[MAX_SKINS];	// only for player skins
 	maliasframedesc_t	frames[1];	// variable sized
@@ -366,6 +372,8 @@ typedef struct model_s
 // brush model
 //
 	int			firstmodelsurface, nummodelsurfaces;
+	msurface_t	**sortedsurfaces;	// the model surfaces grouped by texture
+	int			mergeframe;			// r_framecount when chained with the world
 
 	int			numsubmodels;
 	dmodel_t	*submodels;
@@ -21,6 +21,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "quakedef.h"
 
+#if idSSE
+#include <emmintrin.h>
+#endif
+
 entity_t	r_worldentity;
 
 qboolean	r_cache_thrash;		// compatability
@@ -34,6 +38,7 @@ int			r_framecount;		// used for dlight push checking
 mplane_t	frustum[4];
 
 int			c_brush_polys, c_alias_polys;
+int			c_boxes_culled, c_boxes_accepted;
 
 qboolean	envmap;				// true during envmap command capture 
 
@@ -84,6 +89,8 @@ cvar_t	r_mirroralpha = {"r_mirroralpha","1"};
 cvar_t	r_wateralpha = {"r_wateralpha","1"};
 cvar_t	r_dynamic = {"r_dynamic","1"};
 cvar_t	r_novis = {"r_novis","0"};
+cvar_t	r_viscache = {"r_viscache","1"};
+cvar_t	r_viscachesize = {"r_viscachesize","2048"};	// kilobytes
 
 cvar_t	gl_finish = {"gl_finish","0"};
 cvar_t	gl_clear = {"gl_clear","0"};
@@ -98,6 +105,11 @@ cvar_t	gl_nocolors = {"gl_nocolors","0"};
 cvar_t	gl_keeptjunctions = {"gl_keeptjunctions","0"};
 cvar_t	gl_reporttjunctions = {"gl_reporttjunctions","0"};
 cvar_t	gl_doubleeyes = {"gl_doubleeys", "1"};
+cvar_t	gl_lightmap_pbo = {"gl_lightmap_pbo", "1"};
+cvar_t	r_simd = {"r_simd", "1"};
+cvar_t	gl_vertexbuffers = {"gl_vertexbuffers", "1"};
+cvar_t	r_lerpmodels = {"r_lerpmodels", "1"};
+cvar_t	r_mergebrushes = {"r_mergebrushes", "1"};
 
 extern	cvar_t	gl_ztrick;
 
@@ -114,10 +126,143 @@ qboolean R_CullBox (vec3_t mins, vec3_t maxs)
 
 	for (i=0 ; i<4 ; i++)
 		if (BoxOnPlaneSide (mins, maxs, &frustum[i]) == 2)
+		{
+			c_boxes_culled++;
 			return true;
+		}
+	c_boxes_accepted++;
 	return false;
 }
 
+/*
+=================
+R_CullBoxes_C
+
+Sets culled[i] for each box completely outside the frustum and returns
+how many were.  A box is outside a plane when its corner furthest along
+the normal is behind it, which is the test BoxOnPlaneSide makes.
+=================
+*/
+int R_CullBoxes_C (cullboxes_t *b, byte *culled)
+{
+	int		i, p, count;
+	float	*x, *y, *z;
+	mplane_t	*plane;
+
+	memset (culled, 0, b->numboxes);
+
+	for (p=0, plane=frustum ; p<4 ; p++, plane++)
+	{
+		x = plane->normal[0] < 0 ? b->mins[0] : b->maxs[0];
+		y = plane->normal[1] < 0 ? b->mins[1] : b->maxs[1];
+		z = plane->normal[2] < 0 ? b->mins[2] : b->maxs[2];
+		for (i=0 ; i<b->numboxes ; i++)
+			if (plane->normal[0]*x[i] + plane->normal[1]*y[i] + plane->normal[2]*z[i] < plane->dist)
+				culled[i] = 1;
+	}
+
+	count = 0;
+	for (i=0 ; i<b->numboxes ; i++)
+		count += culled[i];
+	return count;
+}
+
+#if idSSE
+
+/*
+=================
+R_CullBoxes_SSE
+
+Four boxes against all four planes at a time
+=================
+*/
+int R_CullBoxes_SSE (cullboxes_t *b, byte *culled)
+{
+	int		i, p, bits, count;
+	float	*x[4], *y[4], *z[4];
+	__m128	nx[4], ny[4], nz[4], dist[4], out;
+	mplane_t	*plane;
+
+	for (p=0, plane=frustum ; p<4 ; p++, plane++)
+	{
+		x[p] = plane->normal[0] < 0 ? b->mins[0] : b->maxs[0];
+		y[p] = plane->normal[1] < 0 ? b->mins[1] : b->maxs[1];
+		z[p] = plane->normal[2] < 0 ? b->mins[2] : b->maxs[2];
+		nx[p] = _mm_set1_ps (plane->normal[0]);
+		ny[p] = _mm_set1_ps (plane->normal[1]);
+		nz[p] = _mm_set1_ps (plane->normal[2]);
+		dist[p] = _mm_set1_ps (plane->dist);
+	}
+
+	count = 0;
+	for (i=0 ; i+4<=b->numboxes ; i+=4)
+	{
+		out = _mm_setzero_ps ();
+		for (p=0 ; p<4 ; p++)
+			out = _mm_or_ps (out, _mm_cmplt_ps (_mm_add_ps (_mm_add_ps (
+				_mm_mul_ps (nx[p], _mm_loadu_ps (x[p] + i)),
+				_mm_mul_ps (ny[p], _mm_loadu_ps (y[p] + i))),
+				_mm_mul_ps (nz[p], _mm_loadu_ps (z[p] + i))), dist[p]));
+		bits = _mm_movemask_ps (out);
+		culled[i] = bits & 1;
+		culled[i+1] = (bits >> 1) & 1;
+		culled[i+2] = (bits >> 2) & 1;
+		culled[i+3] = bits >> 3;
+		count += culled[i] + culled[i+1] + culled[i+2] + culled[i+3];
+	}
+
+	for ( ; i<b->numboxes ; i++)
+	{
+		culled[i] = 0;
+		for (p=0, plane=frustum ; p<4 ; p++, plane++)
+			if (plane->normal[0]*x[p][i] + plane->normal[1]*y[p][i] + plane->normal[2]*z[p][i] < plane->dist)
+				culled[i] = 1;
+		count += culled[i];
+	}
+
+	return count;
+}
+
+#endif
+
+int (*R_CullBoxKernel) (cullboxes_t *b, byte *culled);
+
+/*
+=================
+R_SelectCullKernel
+=================
+*/
+void R_SelectCullKernel (void)
+{
+#if idSSE
+	if (r_simd.value && Sys_HaveSSE2 ())
+	{
+		R_CullBoxKernel = R_CullBoxes_SSE;
+		return;
+	}
+#endif
+	R_CullBoxKernel = R_CullBoxes_C;
+}
+
+/*
+=================
+R_CullBoxes
+
+Frustum culls a batch of boxes in structure of arrays form
+=================
+*/
+int R_CullBoxes (cullboxes_t *b, byte *culled)
+{
+	int		count;
+
+	if (!b->numboxes)
+		return 0;
+	count = R_CullBoxKernel (b, culled);
+	c_boxes_culled += count;
+	c_boxes_accepted += b->numboxes - count;
+	return count;
+}
+
 
 void R_RotateForEntity (entity_t *e)
 {
@@ -336,6 +481,290 @@ lastposenum = posenum;
 	}
 }
 
+/*
+=============================================================
+
+  ALIAS VERTEX ARRAYS
+
+Poses are lerped and lit into float arrays in one pass, then drawn
+as indexed triangles.  The texcoords and indexes are built at load
+time in gl_mesh.c, in the same vertex order as the poses.
+
+=============================================================
+*/
+
+#define	MAX_ALIAS_ARRAYVERTS	8192	// vertexorder size in gl_mesh.c
+
+float		alias_xyz[MAX_ALIAS_ARRAYVERTS*4];		// x y z pad
+byte		alias_colors[MAX_ALIAS_ARRAYVERTS*4];
+
+typedef void (*aliaslerp_t) (trivertx_t *v1, trivertx_t *v2, int numverts, float frac, float *dots, float scale, float *xyz, byte *colors);
+
+aliaslerp_t	R_LerpAliasVerts;
+
+/*
+=============
+R_LerpAliasVerts_C
+
+scale is shadelight*255
+=============
+*/
+void R_LerpAliasVerts_C (trivertx_t *v1, trivertx_t *v2, int numverts, float frac, float *dots, float scale, float *xyz, byte *colors)
+{
+	int		i, c;
+	float	d1, d2;
+
+	for (i=0 ; i<numverts ; i++, v1++, v2++, xyz += 4, colors += 4)
+	{
+		xyz[0] = (float)v1->v[0] + (float)(v2->v[0] - v1->v[0]) * frac;
+		xyz[1] = (float)v1->v[1] + (float)(v2->v[1] - v1->v[1]) * frac;
+		xyz[2] = (float)v1->v[2] + (float)(v2->v[2] - v1->v[2]) * frac;
+
+		d1 = dots[v1->lightnormalindex];
+		d2 = dots[v2->lightnormalindex];
+		c = (int)((d1 + (d2 - d1) * frac) * scale);
+		if (c < 0)
+			c = 0;
+		else if (c > 255)
+			c = 255;
+		colors[0] = colors[1] = colors[2] = c;
+		colors[3] = 255;
+	}
+}
+
+#if idSSE
+
+/*
+=============
+R_LerpAliasVerts_SSE
+
+Four verts at a time.  A trivertx_t is four bytes, so each one widens
+to a vector of x y z and the light index, which lands in the pad.
+=============
+*/
+void R_LerpAliasVerts_SSE (trivertx_t *v1, trivertx_t *v2, int numverts, float frac, float *dots, float scale, float *xyz, byte *colors)
+{
+	int		i, j;
+	__m128i	zero, alpha, a, b, wa[4], wb[4], c;
+	__m128	vfrac, vscale, fa, fb, d1, d2;
+
+	zero = _mm_setzero_si128 ();
+	alpha = _mm_set1_epi32 (0xff000000);
+	vfrac = _mm_set1_ps (frac);
+	vscale = _mm_set1_ps (scale);
+
+	for (i=0 ; i+4<=numverts ; i+=4, v1+=4, v2+=4, xyz+=16, colors+=16)
+	{
+		a = _mm_loadu_si128 ((__m128i *)v1);
+		b = _mm_loadu_si128 ((__m128i *)v2);
+		wa[0] = _mm_unpacklo_epi8 (a, zero);
+		wa[2] = _mm_unpackhi_epi8 (a, zero);
+		wb[0] = _mm_unpacklo_epi8 (b, zero);
+		wb[2] = _mm_unpackhi_epi8 (b, zero);
+		wa[1] = _mm_unpackhi_epi16 (wa[0], zero);
+		wa[0] = _mm_unpacklo_epi16 (wa[0], zero);
+		wa[3] = _mm_unpackhi_epi16 (wa[2], zero);
+		wa[2] = _mm_unpacklo_epi16 (wa[2], zero);
+		wb[1] = _mm_unpackhi_epi16 (wb[0], zero);
+		wb[0] = _mm_unpacklo_epi16 (wb[0], zero);
+		wb[3] = _mm_unpackhi_epi16 (wb[2], zero);
+		wb[2] = _mm_unpacklo_epi16 (wb[2], zero);
+
+		for (j=0 ; j<4 ; j++)
+		{
+			fa = _mm_cvtepi32_ps (wa[j]);
+			fb = _mm_cvtepi32_ps (wb[j]);
+			_mm_storeu_ps (xyz + j*4, _mm_add_ps (fa, _mm_mul_ps (_mm_sub_ps (fb, fa), vfrac)));
+		}
+
+		// the normal table is a gather, the rest is four wide
+		d1 = _mm_set_ps (dots[v1[3].lightnormalindex], dots[v1[2].lightnormalindex],
+			dots[v1[1].lightnormalindex], dots[v1[0].lightnormalindex]);
+		d2 = _mm_set_ps (dots[v2[3].lightnormalindex], dots[v2[2].lightnormalindex],
+			dots[v2[1].lightnormalindex], dots[v2[0].lightnormalindex]);
+		d1 = _mm_mul_ps (_mm_add_ps (d1, _mm_mul_ps (_mm_sub_ps (d2, d1), vfrac)), vscale);
+
+		// saturate to bytes and spread each one over r g b
+		c = _mm_cvttps_epi32 (d1);
+		c = _mm_packs_epi32 (c, c);
+		c = _mm_packus_epi16 (c, c);
+		c = _mm_unpacklo_epi8 (c, c);
+		c = _mm_unpacklo_epi16 (c, c);
+		_mm_storeu_si128 ((__m128i *)colors, _mm_or_si128 (c, alpha));
+	}
+
+	if (i < numverts)
+		R_LerpAliasVerts_C (v1, v2, numverts - i, frac, dots, scale, xyz, colors);
+}
+
+#endif
+
+/*
+=============
+R_SelectAliasKernels
+=============
+*/
+void R_SelectAliasKernels (void)
+{
+#if idSSE
+	if (r_simd.value && Sys_HaveSSE2 ())
+	{
+		R_LerpAliasVerts = R_LerpAliasVerts_SSE;
+		return;
+	}
+#endif
+	R_LerpAliasVerts = R_LerpAliasVerts_C;
+}
+
+/*
+=============
+R_DrawAliasArrays
+
+Lerps from the entity's previous pose to the new one over interval
+seconds, so animation is smooth between the 10hz server frames
+=============
+*/
+void R_DrawAliasArrays (entity_t *e, aliashdr_t *paliashdr, int posenum, float interval)
+{
+	trivertx_t	*verts;
+	float		frac;
+
+	lastposenum = posenum;
+
+	// start over if the model changed or the poses are stale
+	if (e->lerpmodel != e->model || e->previouspose < 0 || e->currentpose < 0
+		|| e->previouspose >= paliashdr->numposes || e->currentpose >= paliashdr->numposes)
+	{
+		e->lerpmodel = e->model;
+		e->previouspose = e->currentpose = posenum;
+		e->lerpstart = 0;
+	}
+	if (posenum != e->currentpose)
+	{
+		e->previouspose = e->currentpose;
+		e->currentpose = posenum;
+		e->lerpstart = cl.time;
+	}
+
+	frac = 1;
+	if (r_lerpmodels.value && interval > 0)
+	{
+		frac = (cl.time - e->lerpstart) / interval;
+		if (frac < 0)
+			frac = 0;
+		else if (frac > 1)
+			frac = 1;
+	}
+
+	verts = (trivertx_t *)((byte *)paliashdr + paliashdr->posedata);
+	R_LerpAliasVerts (verts + e->previouspose * paliashdr->poseverts,
+		verts + e->currentpose * paliashdr->poseverts,
+		paliashdr->poseverts, frac, shadedots, shadelight*255, alias_xyz, alias_colors);
+
+	glVertexPointer (3, GL_FLOAT, 4*sizeof(float), alias_xyz);
+	glColorPointer (4, GL_UNSIGNED_BYTE, 0, alias_colors);
+	glTexCoordPointer (2, GL_FLOAT, 0, (byte *)paliashdr + paliashdr->texcoords);
+	glEnableClientState (GL_VERTEX_ARRAY);
+	glEnableClientState (GL_COLOR_ARRAY);
+	glEnableClientState (GL_TEXTURE_COORD_ARRAY);
+
+	glDrawElements (GL_TRIANGLES, paliashdr->numindexes, GL_UNSIGNED_SHORT,
+		(byte *)paliashdr + paliashdr->indexes);
+
+	glDisableClientState (GL_VERTEX_ARRAY);
+	glDisableClientState (GL_COLOR_ARRAY);
+	glDisableClientState (GL_TEXTURE_COORD_ARRAY);
+	glColor4f (1,1,1,1);
+}
+
+/*
+=============
+R_AliasBench_f
+
+r_aliasbench [passes]
+Times the C and SSE2 pose lerp over every pose of the loaded alias
+models and checks that they agree.
+=============
+*/
+void R_AliasBench_f (void)
+{
+	int			i, p, k, passes, models, poses, verts, differ;
+	aliashdr_t	*hdr;
+	model_t		*m;
+	trivertx_t	*v;
+	float		savedsimd;
+	double		start, ctime, stime;
+	static float	cxyz[MAX_ALIAS_ARRAYVERTS*4];
+	static byte		ccolors[MAX_ALIAS_ARRAYVERTS*4];
+
+	passes = 20;
+	if (Cmd_Argc () > 1)
+		passes = Q_atoi (Cmd_Argv (1));
+	if (passes < 1)
+		passes = 1;
+
+	savedsimd = r_simd.value;
+	models = poses = verts = differ = 0;
+	ctime = stime = 0;
+
+	for (i=1 ; i<MAX_MODELS ; i++)
+	{
+		m = cl.model_precache[i];
+		if (!m || m->type != mod_alias)
+			continue;
+		hdr = (aliashdr_t *)Mod_Extradata (m);
+		if (hdr->poseverts > MAX_ALIAS_ARRAYVERTS)
+			continue;
+		v = (trivertx_t *)((byte *)hdr + hdr->posedata);
+		models++;
+		poses += hdr->numposes;
+		verts += hdr->numposes * hdr->poseverts;
+
+		r_simd.value = 0;
+		R_SelectAliasKernels ();
+		start = Sys_ProfileTime ();
+		for (k=0 ; k<passes ; k++)
+			for (p=0 ; p<hdr->numposes ; p++)
+				R_LerpAliasVerts (v + p*hdr->poseverts, v + ((p+1)%hdr->numposes)*hdr->poseverts,
+					hdr->poseverts, 0.3f, r_avertexnormal_dots[p&(SHADEDOT_QUANT-1)], 255, cxyz, ccolors);
+		ctime += Sys_ProfileTime () - start;
+
+		r_simd.value = 1;
+		R_SelectAliasKernels ();
+		start = Sys_ProfileTime ();
+		for (k=0 ; k<passes ; k++)
+			for (p=0 ; p<hdr->numposes ; p++)
+				R_LerpAliasVerts (v + p*hdr->poseverts, v + ((p+1)%hdr->numposes)*hdr->poseverts,
+					hdr->poseverts, 0.3f, r_avertexnormal_dots[p&(SHADEDOT_QUANT-1)], 255, alias_xyz, alias_colors);
+		stime += Sys_ProfileTime () - start;
+
+		// the last pose of each pass is left in both buffers
+		for (p=0 ; p<hdr->poseverts ; p++)
+			if (cxyz[p*4] != alias_xyz[p*4] || cxyz[p*4+1] != alias_xyz[p*4+1]
+				|| cxyz[p*4+2] != alias_xyz[p*4+2] || *(int *)&ccolors[p*4] != *(int *)&alias_colors[p*4])
+				differ++;
+	}
+
+	r_simd.value = savedsimd;
+	R_SelectAliasKernels ();
+
+	if (!models)
+	{
+		Con_Printf ("No alias models loaded\n");
+		return;
+	}
+
+	Con_Printf ("%i models, %i poses, %i verts, %i passes\n", models, poses, verts, passes);
+	Con_Printf ("lerp: C %6.2f ms", ctime*1000/passes);
+#if idSSE
+	if (Sys_HaveSSE2 ())
+		Con_Printf ("  SSE2 %6.2f ms (%.1fx)", stime*1000/passes, ctime/stime);
+#endif
+	Con_Printf ("\n");
+	if (differ)
+		Con_Printf ("%i verts differ between C and SSE2\n", differ);
+}
+
 
 /*
 =============
@@ -431,8 +860,13 @@ void R_SetupAliasFrame (int frame, aliashdr_t *paliashdr)
 		interval = paliashdr->frames[frame].interval;
 		pose += (int)(cl.time / interval) % numposes;
 	}
+	else
+		interval = 0.1;
 
-	GL_DrawAliasFrame (paliashdr, pose);
+	if (gl_vertexbuffers.value && paliashdr->poseverts <= MAX_ALIAS_ARRAYVERTS)
+		R_DrawAliasArrays (currententity, paliashdr, pose, interval);
+	else
+		GL_DrawAliasFrame (paliashdr, pose);
 }
 
 
@@ -462,7 +896,7 @@ void R_DrawAliasModel (entity_t *e)
 	VectorAdd (currententity->origin, clmodel->mins, mins);
 	VectorAdd (currententity->origin, clmodel->maxs, maxs);
 
-	if (R_CullBox (mins, maxs))
+	if (!r_entaccepted && R_CullBox (mins, maxs))
 		return;
 
 
@@ -594,6 +1028,52 @@ void R_DrawAliasModel (entity_t *e)
 
 //==================================================================================
 
+/*
+=============
+R_CullEntities
+
+Frustum culls the models on the list in one batch, with the same boxes
+R_DrawAliasModel and R_DrawBrushModel would use.  Sprites are drawn
+regardless.
+=============
+*/
+float		entbox[6][MAX_VISEDICTS];
+byte		entculled[MAX_VISEDICTS];
+qboolean	r_entaccepted;		// currententity already passed the cull
+
+void R_CullEntities (void)
+{
+	int			i, j;
+	entity_t	*e;
+	cullboxes_t	boxes;
+
+	for (i=0 ; i<cl_numvisedicts ; i++)
+	{
+		e = cl_visedicts[i];
+		for (j=0 ; j<3 ; j++)
+		{
+			if (e->model->type == mod_brush && (e->angles[0] || e->angles[1] || e->angles[2]))
+			{
+				entbox[j][i] = e->origin[j] - e->model->radius;
+				entbox[3+j][i] = e->origin[j] + e->model->radius;
+			}
+			else
+			{
+				entbox[j][i] = e->origin[j] + e->model->mins[j];
+				entbox[3+j][i] = e->origin[j] + e->model->maxs[j];
+			}
+		}
+	}
+
+	boxes.numboxes = cl_numvisedicts;
+	for (j=0 ; j<3 ; j++)
+	{
+		boxes.mins[j] = entbox[j];
+		boxes.maxs[j] = entbox[3+j];
+	}
+	R_CullBoxes (&boxes, entculled);
+}
+
 /*
 =============
 R_DrawEntitiesOnList
@@ -606,9 +1086,14 @@ void R_DrawEntitiesOnList (void)
 	if (!r_drawentities.value)
 		return;
 
+	R_CullEntities ();
+
 	// draw sprites seperately, because of alpha blending
+	r_entaccepted = true;
 	for (i=0 ; i<cl_numvisedicts ; i++)
 	{
+		if (entculled[i])
+			continue;
 		currententity = cl_visedicts[i];
 
 		switch (currententity->model->type)
@@ -618,13 +1103,15 @@ void R_DrawEntitiesOnList (void)
 			break;
 
 		case mod_brush:
-			R_DrawBrushModel (currententity);
+			if (currententity->worldframe != r_framecount)
+				R_DrawBrushModel (currententity);
 			break;
 
 		default:
 			break;
 		}
 	}
+	r_entaccepted = false;
 
 	for (i=0 ; i<cl_numvisedicts ; i++)
 	{
@@ -818,6 +1305,9 @@ void R_SetupFrame (void)
 		Cvar_Set ("r_fullbright", "0");
 
 	R_AnimateLight ();
+	R_SelectAliasKernels ();
+	R_SelectCullKernel ();
+	R_SelectWarpKernels ();
 
 	r_framecount++;
 
@@ -1119,6 +1609,10 @@ void R_RenderView (void)
 		c_brush_polys = 0;
 		c_alias_polys = 0;
 	}
+	c_lightmap_texels = c_lightmap_bytes = c_lightmap_uploads = 0;
+	c_draw_calls = 0;
+	c_boxes_culled = c_boxes_accepted = 0;
+	c_brush_merged = c_brush_drawn = 0;
 
 	mirror = false;
 
@@ -1155,5 +1649,13 @@ void R_RenderView (void)
 //		glFinish ();
 		time2 = Sys_FloatTime ();
 		Con_Printf ("%3i ms  %4i wpoly %4i epoly\n", (int)((time2-time1)*1000), c_brush_polys, c_alias_polys); 
+		if (r_speeds.value > 1)
+		{
+			Con_Printf ("%6i lm texels %7i lm bytes %3i lm uploads\n", c_lightmap_texels, c_lightmap_bytes, c_lightmap_uploads);
+			Con_Printf ("%5i brush draw calls\n", c_draw_calls);
+			Con_Printf ("%5i boxes culled %5i accepted\n", c_boxes_culled, c_boxes_accepted);
+			Con_Printf ("%5i brush entities in world batches %5i drawn alone\n", c_brush_merged, c_brush_drawn);
+			Con_Printf ("%5i 2d draw calls %5i 2d quads\n", draw_lastdraws, draw_lastquads);
+		}
 	}
 }
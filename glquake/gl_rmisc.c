@@ -176,6 +176,11 @@ void R_Init (void)
 	Cmd_AddCommand ("timerefresh", R_TimeRefresh_f);	
 	Cmd_AddCommand ("envmap", R_Envmap_f);	
 	Cmd_AddCommand ("pointfile", R_ReadPointFile_f);	
+	Cmd_AddCommand ("r_lightbench", R_LightBench_f);
+	Cmd_AddCommand ("r_aliasbench", R_AliasBench_f);
+	Cmd_AddCommand ("r_visbench", R_VisBench_f);
+	Cmd_AddCommand ("r_partbench", R_PartBench_f);
+	Cmd_AddCommand ("r_warpbench", R_WarpBench_f);
 
 	Cvar_RegisterVariable (&r_norefresh);
 	Cvar_RegisterVariable (&r_lightmap);
@@ -188,6 +193,9 @@ void R_Init (void)
 	Cvar_RegisterVariable (&r_dynamic);
 	Cvar_RegisterVariable (&r_novis);
 	Cvar_RegisterVariable (&r_speeds);
+	Cvar_RegisterVariable (&r_simd);
+	Cvar_RegisterVariable (&r_viscache);
+	Cvar_RegisterVariable (&r_viscachesize);
 
 	Cvar_RegisterVariable (&gl_finish);
 	Cvar_RegisterVariable (&gl_clear);
@@ -208,6 +216,10 @@ void R_Init (void)
 	Cvar_RegisterVariable (&gl_reporttjunctions);
 
 	Cvar_RegisterVariable (&gl_doubleeyes);
+	Cvar_RegisterVariable (&gl_lightmap_pbo);
+	Cvar_RegisterVariable (&gl_vertexbuffers);
+	Cvar_RegisterVariable (&r_lerpmodels);
+	Cvar_RegisterVariable (&r_mergebrushes);
 
 	R_InitParticles ();
 	R_InitParticleTexture ();
@@ -379,6 +391,7 @@ R_NewMap
 void R_NewMap (void)
 {
 	int		i;
+	double	start, lightmaptime;
 	
 	for (i=0 ; i<256 ; i++)
 		d_lightstylevalue[i] = 264;		// normal light value
@@ -392,9 +405,17 @@ void R_NewMap (void)
 		cl.worldmodel->leafs[i].efrags = NULL;
 		 	
 	r_viewleaf = NULL;
+	R_FlushVisCache ();
 	R_ClearParticles ();
 
+	start = Sys_ProfileTime ();
 	GL_BuildLightmaps ();
+	lightmaptime = Sys_ProfileTime () - start;
+
+	Con_DPrintf ("map load: models %.3f, %i textures (%i cached) convert %.3f upload %.3f, lightmaps %.3f\n",
+		load_models, load_textures, load_texcached, load_texconvert, load_texupload, lightmaptime);
+	load_models = load_texconvert = load_texupload = 0;
+	load_textures = load_texcached = 0;
 
 	// identify sky texture
 	skytexturenum = -1;
@@ -21,6 +21,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "quakedef.h"
 
+#if idSSE
+#include <emmintrin.h>
+#endif
+
 int			skytexturenum;
 
 #ifndef GL_RGBA4
@@ -32,7 +36,7 @@ int		lightmap_bytes;		// 1, 2, or 4
 
 int		lightmap_textures;
 
-unsigned		blocklights[18*18];
+unsigned		blocklightbuf[MAX_JOB_THREADS][18*18];	// one per builder thread
 
 #define	BLOCK_WIDTH		128
 #define	BLOCK_HEIGHT	128
@@ -57,15 +61,56 @@ byte		lightmaps[4*MAX_LIGHTMAPS*BLOCK_WIDTH*BLOCK_HEIGHT];
 // For gl_texsort 0
 msurface_t  *skychain = NULL;
 msurface_t  *waterchain = NULL;
+msurface_t	*sequentialchain = NULL;		// in drawing order
+msurface_t	**sequentialtail = &sequentialchain;
+
+qboolean	r_texsort;			// gl_texsort, or forced by the world arrays
 
 void R_RenderDynamicLightmaps (msurface_t *fa);
+void R_QueueLightmap (msurface_t *fa);
+void R_BuildQueuedLightmaps (void);
+void R_FlushLightmaps (void);
+
+/*
+=============================================================================
+
+  LIGHTMAP BUILDING
+
+R_BuildLightMap runs in three stages, each with a C and an SSE2 kernel:
+lightstyle accumulation, dynamic light falloff, and the final clamp and
+pack to gl_lightmap_format.  The SSE2 kernels give exactly the C results.
+r_simd 0 forces the C versions.
+
+=============================================================================
+*/
+
+typedef void (*lmstyle_t) (unsigned *bl, byte *lightmap, int size, unsigned scale);
+typedef void (*lmdlights_t) (msurface_t *surf, unsigned *bl);
+typedef void (*lmstore_t) (byte *dest, int stride, unsigned *bl, int smax, int tmax);
+
+lmstyle_t	R_AddLightStyle;
+lmdlights_t	R_AddDynamicLights;
+lmstore_t	R_StoreLightMap;
+
+/*
+===============
+R_AddLightStyle_C
+===============
+*/
+void R_AddLightStyle_C (unsigned *bl, byte *lightmap, int size, unsigned scale)
+{
+	int		i;
+
+	for (i=0 ; i<size ; i++)
+		bl[i] += lightmap[i] * scale;
+}
 
 /*
 ===============
-R_AddDynamicLights
+R_AddDynamicLights_C
 ===============
 */
-void R_AddDynamicLights (msurface_t *surf)
+void R_AddDynamicLights_C (msurface_t *surf, unsigned *blocklights)
 {
 	int			lnum;
 	int			sd, td;
@@ -127,6 +172,289 @@ void R_AddDynamicLights (msurface_t *surf)
 	}
 }
 
+/*
+===============
+R_StoreLightMap_C
+
+Bound, invert, and shift
+===============
+*/
+void R_StoreLightMap_C (byte *dest, int stride, unsigned *bl, int smax, int tmax)
+{
+	int			i, j, t;
+
+	switch (gl_lightmap_format)
+	{
+	case GL_RGBA:
+		stride -= (smax<<2);
+		for (i=0 ; i<tmax ; i++, dest += stride)
+		{
+			for (j=0 ; j<smax ; j++)
+			{
+				t = *bl++;
+				t >>= 7;
+				if (t > 255)
+					t = 255;
+				dest[3] = 255-t;
+				dest += 4;
+			}
+		}
+		break;
+	case GL_ALPHA:
+	case GL_LUMINANCE:
+	case GL_INTENSITY:
+		for (i=0 ; i<tmax ; i++, dest += stride)
+		{
+			for (j=0 ; j<smax ; j++)
+			{
+				t = *bl++;
+				t >>= 7;
+				if (t > 255)
+					t = 255;
+				dest[j] = 255-t;
+			}
+		}
+		break;
+	default:
+		Sys_Error ("Bad lightmap format");
+	}
+}
+
+#if idSSE
+
+/*
+===============
+R_AddLightStyle_SSE
+
+Widens eight samples to dwords and multiplies with pmaddwd, whose
+high halves are zero, so style scales must fit in 15 bits
+===============
+*/
+void R_AddLightStyle_SSE (unsigned *bl, byte *lightmap, int size, unsigned scale)
+{
+	int		i;
+	__m128i	zero, vscale, x, lo, hi;
+
+	if (scale > 32767)
+	{
+		R_AddLightStyle_C (bl, lightmap, size, scale);
+		return;
+	}
+
+	zero = _mm_setzero_si128 ();
+	vscale = _mm_set1_epi32 (scale);
+	for (i=0 ; i+8<=size ; i+=8)
+	{
+		x = _mm_unpacklo_epi8 (_mm_loadl_epi64 ((__m128i *)(lightmap + i)), zero);
+		lo = _mm_madd_epi16 (_mm_unpacklo_epi16 (x, zero), vscale);
+		hi = _mm_madd_epi16 (_mm_unpackhi_epi16 (x, zero), vscale);
+		_mm_storeu_si128 ((__m128i *)(bl + i),
+			_mm_add_epi32 (_mm_loadu_si128 ((__m128i *)(bl + i)), lo));
+		_mm_storeu_si128 ((__m128i *)(bl + i + 4),
+			_mm_add_epi32 (_mm_loadu_si128 ((__m128i *)(bl + i + 4)), hi));
+	}
+	for ( ; i<size ; i++)
+		bl[i] += lightmap[i] * scale;
+}
+
+/*
+===============
+R_AddDynamicLights_SSE
+
+Four texels of a row at a time.  Rows whose t distance alone is past
+the light are skipped, since the falloff distance is never less.
+===============
+*/
+void R_AddDynamicLights_SSE (msurface_t *surf, unsigned *blocklights)
+{
+	int			lnum;
+	int			sd, td;
+	float		dist, rad, minlight;
+	vec3_t		impact, local;
+	int			s, t;
+	int			i;
+	int			smax, tmax;
+	mtexinfo_t	*tex;
+	unsigned	*bl;
+	__m128		vlocal, vrad, vminlight, v256, voffs, vdist, vmask;
+	__m128i		vtd, vsd, sign, gt, big, small, old, sum, mask;
+
+	smax = (surf->extents[0]>>4)+1;
+	tmax = (surf->extents[1]>>4)+1;
+	tex = surf->texinfo;
+
+	v256 = _mm_set1_ps (256);
+	voffs = _mm_set_ps (48, 32, 16, 0);
+
+	for (lnum=0 ; lnum<MAX_DLIGHTS ; lnum++)
+	{
+		if ( !(surf->dlightbits & (1<<lnum) ) )
+			continue;		// not lit by this light
+
+		rad = cl_dlights[lnum].radius;
+		dist = DotProduct (cl_dlights[lnum].origin, surf->plane->normal) -
+				surf->plane->dist;
+		rad -= fabs(dist);
+		minlight = cl_dlights[lnum].minlight;
+		if (rad < minlight)
+			continue;
+		minlight = rad - minlight;
+
+		for (i=0 ; i<3 ; i++)
+		{
+			impact[i] = cl_dlights[lnum].origin[i] -
+					surf->plane->normal[i]*dist;
+		}
+
+		local[0] = DotProduct (impact, tex->vecs[0]) + tex->vecs[0][3];
+		local[1] = DotProduct (impact, tex->vecs[1]) + tex->vecs[1][3];
+
+		local[0] -= surf->texturemins[0];
+		local[1] -= surf->texturemins[1];
+
+		vlocal = _mm_set1_ps (local[0]);
+		vrad = _mm_set1_ps (rad);
+		vminlight = _mm_set1_ps (minlight);
+
+		for (t = 0 ; t<tmax ; t++)
+		{
+			td = local[1] - t*16;
+			if (td < 0)
+				td = -td;
+			if (td >= minlight)
+				continue;
+
+			bl = blocklights + t*smax;
+			vtd = _mm_set1_epi32 (td);
+			for (s=0 ; s+4<=smax ; s+=4)
+			{
+				// sd = abs(local[0] - s*16)
+				vsd = _mm_cvttps_epi32 (_mm_sub_ps (vlocal,
+					_mm_add_ps (_mm_set1_ps (s*16), voffs)));
+				sign = _mm_srai_epi32 (vsd, 31);
+				vsd = _mm_sub_epi32 (_mm_xor_si128 (vsd, sign), sign);
+
+				// dist = larger + smaller/2
+				gt = _mm_cmpgt_epi32 (vsd, vtd);
+				big = _mm_or_si128 (_mm_and_si128 (gt, vsd), _mm_andnot_si128 (gt, vtd));
+				small = _mm_or_si128 (_mm_and_si128 (gt, vtd), _mm_andnot_si128 (gt, vsd));
+				vdist = _mm_cvtepi32_ps (_mm_add_epi32 (big, _mm_srai_epi32 (small, 1)));
+
+				vmask = _mm_cmplt_ps (vdist, vminlight);
+				if (!_mm_movemask_ps (vmask))
+					continue;
+				mask = _mm_castps_si128 (vmask);
+
+				old = _mm_loadu_si128 ((__m128i *)(bl + s));
+				sum = _mm_cvttps_epi32 (_mm_add_ps (_mm_cvtepi32_ps (old),
+					_mm_mul_ps (_mm_sub_ps (vrad, vdist), v256)));
+				_mm_storeu_si128 ((__m128i *)(bl + s),
+					_mm_or_si128 (_mm_and_si128 (mask, sum), _mm_andnot_si128 (mask, old)));
+			}
+			for ( ; s<smax ; s++)
+			{
+				sd = local[0] - s*16;
+				if (sd < 0)
+					sd = -sd;
+				if (sd > td)
+					dist = sd + (td>>1);
+				else
+					dist = td + (sd>>1);
+				if (dist < minlight)
+					bl[s] += (rad - dist)*256;
+			}
+		}
+	}
+}
+
+/*
+===============
+R_StoreLightMap_SSE
+
+The saturating packs do the clamp; 255-t is t^255 on bytes
+===============
+*/
+void R_StoreLightMap_SSE (byte *dest, int stride, unsigned *bl, int smax, int tmax)
+{
+	int			i, j, t;
+	__m128i		zero, ones, alpha, a, b;
+
+	zero = _mm_setzero_si128 ();
+	ones = _mm_set1_epi32 (-1);
+
+	switch (gl_lightmap_format)
+	{
+	case GL_RGBA:
+		alpha = _mm_set1_epi32 (0x00ffffff);
+		for (i=0 ; i<tmax ; i++, dest += stride, bl += smax)
+		{
+			for (j=0 ; j+4<=smax ; j+=4)
+			{
+				a = _mm_srli_epi32 (_mm_loadu_si128 ((__m128i *)(bl + j)), 7);
+				a = _mm_packus_epi16 (_mm_packs_epi32 (a, a), zero);
+				a = _mm_xor_si128 (a, ones);
+				a = _mm_unpacklo_epi16 (zero, _mm_unpacklo_epi8 (zero, a));
+				b = _mm_loadu_si128 ((__m128i *)(dest + j*4));
+				b = _mm_or_si128 (_mm_and_si128 (b, alpha), a);
+				_mm_storeu_si128 ((__m128i *)(dest + j*4), b);
+			}
+			for ( ; j<smax ; j++)
+			{
+				t = bl[j] >> 7;
+				if (t > 255)
+					t = 255;
+				dest[j*4+3] = 255-t;
+			}
+		}
+		break;
+	case GL_ALPHA:
+	case GL_LUMINANCE:
+	case GL_INTENSITY:
+		for (i=0 ; i<tmax ; i++, dest += stride, bl += smax)
+		{
+			for (j=0 ; j+8<=smax ; j+=8)
+			{
+				a = _mm_srli_epi32 (_mm_loadu_si128 ((__m128i *)(bl + j)), 7);
+				b = _mm_srli_epi32 (_mm_loadu_si128 ((__m128i *)(bl + j + 4)), 7);
+				a = _mm_packus_epi16 (_mm_packs_epi32 (a, b), zero);
+				_mm_storel_epi64 ((__m128i *)(dest + j), _mm_xor_si128 (a, ones));
+			}
+			for ( ; j<smax ; j++)
+			{
+				t = bl[j] >> 7;
+				if (t > 255)
+					t = 255;
+				dest[j] = 255-t;
+			}
+		}
+		break;
+	default:
+		Sys_Error ("Bad lightmap format");
+	}
+}
+
+#endif
+
+/*
+===============
+R_SelectLightmapKernels
+===============
+*/
+void R_SelectLightmapKernels (void)
+{
+#if idSSE
+	if (r_simd.value && Sys_HaveSSE2 ())
+	{
+		R_AddLightStyle = R_AddLightStyle_SSE;
+		R_AddDynamicLights = R_AddDynamicLights_SSE;
+		R_StoreLightMap = R_StoreLightMap_SSE;
+		return;
+	}
+#endif
+	R_AddLightStyle = R_AddLightStyle_C;
+	R_AddDynamicLights = R_AddDynamicLights_C;
+	R_StoreLightMap = R_StoreLightMap_C;
+}
 
 /*
 ===============
@@ -135,16 +463,13 @@ R_BuildLightMap
 Combine and scale multiple lightmaps into the 8.8 format in blocklights
 ===============
 */
-void R_BuildLightMap (msurface_t *surf, byte *dest, int stride)
+void R_BuildLightMap (msurface_t *surf, byte *dest, int stride, unsigned *blocklights)
 {
 	int			smax, tmax;
-	int			t;
-	int			i, j, size;
+	int			i, size;
 	byte		*lightmap;
 	unsigned	scale;
 	int			maps;
-	int			lightadj[4];
-	unsigned	*bl;
 
 	surf->cached_dlight = (surf->dlightframe == r_framecount);
 
@@ -172,54 +497,17 @@ void R_BuildLightMap (msurface_t *surf, byte *dest, int stride)
 		{
 			scale = d_lightstylevalue[surf->styles[maps]];
 			surf->cached_light[maps] = scale;	// 8.8 fraction
-			for (i=0 ; i<size ; i++)
-				blocklights[i] += lightmap[i] * scale;
+			R_AddLightStyle (blocklights, lightmap, size, scale);
 			lightmap += size;	// skip to next lightmap
 		}
 
 // add all the dynamic lights
 	if (surf->dlightframe == r_framecount)
-		R_AddDynamicLights (surf);
+		R_AddDynamicLights (surf, blocklights);
 
 // bound, invert, and shift
 store:
-	switch (gl_lightmap_format)
-	{
-	case GL_RGBA:
-		stride -= (smax<<2);
-		bl = blocklights;
-		for (i=0 ; i<tmax ; i++, dest += stride)
-		{
-			for (j=0 ; j<smax ; j++)
-			{
-				t = *bl++;
-				t >>= 7;
-				if (t > 255)
-					t = 255;
-				dest[3] = 255-t;
-				dest += 4;
-			}
-		}
-		break;
-	case GL_ALPHA:
-	case GL_LUMINANCE:
-	case GL_INTENSITY:
-		bl = blocklights;
-		for (i=0 ; i<tmax ; i++, dest += stride)
-		{
-			for (j=0 ; j<smax ; j++)
-			{
-				t = *bl++;
-				t >>= 7;
-				if (t > 255)
-					t = 255;
-				dest[j] = 255-t;
-			}
-		}
-		break;
-	default:
-		Sys_Error ("Bad lightmap format");
-	}
+	R_StoreLightMap (dest, stride, blocklights, smax, tmax);
 }
 
 
@@ -404,7 +692,8 @@ void R_DrawSequentialPoly (msurface_t *s)
 R_DrawSequentialPoly
 
 Systems that have fast state and texture changes can
-just do everything as it passes with no need to sort
+just do everything as it passes with no need to sort.
+The lightmap must already have been marked and flushed.
 ================
 */
 void R_DrawSequentialPoly (msurface_t *s)
@@ -416,7 +705,6 @@ void R_DrawSequentialPoly (msurface_t *s)
 	vec3_t		nv, dir;
 	float		ss, ss2, length;
 	float		s1, t1;
-	glRect_t	*theRect;
 
 	//
 	// normal lightmaped poly
@@ -424,7 +712,6 @@ void R_DrawSequentialPoly (msurface_t *s)
 
 	if (! (s->flags & (SURF_DRAWSKY|SURF_DRAWTURB|SURF_UNDERWATER) ) )
 	{
-		R_RenderDynamicLightmaps (s);
 		if (gl_mtexable) {
 			p = s->polys;
 
@@ -436,20 +723,8 @@ void R_DrawSequentialPoly (msurface_t *s)
 			// Binds lightmap to texenv 1
 			GL_EnableMultitexture(); // Same as SelectTexture (TEXTURE1)
 			GL_Bind (lightmap_textures + s->lightmaptexturenum);
-			i = s->lightmaptexturenum;
-			if (lightmap_modified[i])
-			{
-				lightmap_modified[i] = false;
-				theRect = &lightmap_rectchange[i];
-				glTexSubImage2D(GL_TEXTURE_2D, 0, 0, theRect->t, 
-					BLOCK_WIDTH, theRect->h, gl_lightmap_format, GL_UNSIGNED_BYTE,
-					lightmaps+(i* BLOCK_HEIGHT + theRect->t) *BLOCK_WIDTH*lightmap_bytes);
-				theRect->l = BLOCK_WIDTH;
-				theRect->t = BLOCK_HEIGHT;
-				theRect->h = 0;
-				theRect->w = 0;
-			}
 			glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_BLEND);
+			c_draw_calls++;
 			glBegin(GL_POLYGON);
 			v = p->verts[0];
 			for (i=0 ; i<p->numverts ; i++, v+= VERTEXSIZE)
@@ -465,6 +740,7 @@ void R_DrawSequentialPoly (msurface_t *s)
 
 			t = R_TextureAnimation (s->texinfo->texture);
 			GL_Bind (t->gl_texturenum);
+			c_draw_calls++;
 			glBegin (GL_POLYGON);
 			v = p->verts[0];
 			for (i=0 ; i<p->numverts ; i++, v+= VERTEXSIZE)
@@ -476,6 +752,7 @@ void R_DrawSequentialPoly (msurface_t *s)
 
 			GL_Bind (lightmap_textures + s->lightmaptexturenum);
 			glEnable (GL_BLEND);
+			c_draw_calls++;
 			glBegin (GL_POLYGON);
 			v = p->verts[0];
 			for (i=0 ; i<p->numverts ; i++, v+= VERTEXSIZE)
@@ -528,7 +805,6 @@ void R_DrawSequentialPoly (msurface_t *s)
 	//
 	// underwater warped with lightmap
 	//
-	R_RenderDynamicLightmaps (s);
 	if (gl_mtexable) {
 		p = s->polys;
 
@@ -538,20 +814,8 @@ void R_DrawSequentialPoly (msurface_t *s)
 		glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
 		GL_EnableMultitexture();
 		GL_Bind (lightmap_textures + s->lightmaptexturenum);
-		i = s->lightmaptexturenum;
-		if (lightmap_modified[i])
-		{
-			lightmap_modified[i] = false;
-			theRect = &lightmap_rectchange[i];
-			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, theRect->t, 
-				BLOCK_WIDTH, theRect->h, gl_lightmap_format, GL_UNSIGNED_BYTE,
-				lightmaps+(i* BLOCK_HEIGHT + theRect->t) *BLOCK_WIDTH*lightmap_bytes);
-			theRect->l = BLOCK_WIDTH;
-			theRect->t = BLOCK_HEIGHT;
-			theRect->h = 0;
-			theRect->w = 0;
-		}
 		glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_BLEND);
+		c_draw_calls++;
 		glBegin (GL_TRIANGLE_FAN);
 		v = p->verts[0];
 		for (i=0 ; i<p->numverts ; i++, v+= VERTEXSIZE)
@@ -599,6 +863,7 @@ void DrawGLWaterPoly (glpoly_t *p)
 
 	GL_DisableMultitexture();
 
+	c_draw_calls++;
 	glBegin (GL_TRIANGLE_FAN);
 	v = p->verts[0];
 	for (i=0 ; i<p->numverts ; i++, v+= VERTEXSIZE)
@@ -623,6 +888,7 @@ void DrawGLWaterPolyLightmap (glpoly_t *p)
 
 	GL_DisableMultitexture();
 
+	c_draw_calls++;
 	glBegin (GL_TRIANGLE_FAN);
 	v = p->verts[0];
 	for (i=0 ; i<p->numverts ; i++, v+= VERTEXSIZE)
@@ -648,6 +914,7 @@ void DrawGLPoly (glpoly_t *p)
 	int		i;
 	float	*v;
 
+	c_draw_calls++;
 	glBegin (GL_POLYGON);
 	v = p->verts[0];
 	for (i=0 ; i<p->numverts ; i++, v+= VERTEXSIZE)
@@ -660,20 +927,543 @@ void DrawGLPoly (glpoly_t *p)
 
 
 /*
-================
-R_BlendLightmaps
-================
-*/
-void R_BlendLightmaps (void)
-{
-	int			i, j;
+=============================================================================
+
+  LIGHTMAP STREAMING
+
+Surfaces whose lightmaps change are queued as the frame is walked, and
+each lightmap block grows a single dirty rectangle.  Before any lightmap
+is drawn, R_FlushLightmaps rebuilds the whole queue, one lightmap block
+per job thread, then sends each dirty rectangle once from this thread.
+When the driver can keep a buffer mapped, the rectangles are packed into
+a ring of pixel buffer segments so the copy to the card doesn't stall on
+the texture being in use.
+
+=============================================================================
+*/
+
+#define	MAX_LIGHTMAP_QUEUE	4096
+
+#define	LM_THREAD_MIN		32			// smaller queues are built inline
+
+msurface_t	*lightmap_queue[MAX_LIGHTMAP_QUEUE];
+int			lightmap_queued;
+
+typedef struct
+{
+	int		first;			// in lightmap_sorted
+	int		count;
+} lmjob_t;
+
+msurface_t	*lightmap_sorted[MAX_LIGHTMAP_QUEUE];
+lmjob_t		lightmap_jobs[MAX_LIGHTMAPS];
+
+int		c_lightmap_texels, c_lightmap_bytes, c_lightmap_uploads;
+
+#define	LM_RING_SEGMENTS	3
+#define	LM_SEGMENT_SIZE		(1024*1024)
+
+static GLuint	lm_ringbuffer;
+static byte		*lm_ring;			// persistently mapped
+static GLsync	lm_fence[LM_RING_SEGMENTS];
+static int		lm_segment;
+static int		lm_segmentframe;
+static int		lm_segmentused;
+
+/*
+================
+R_QueueLightmap
+
+Grows the block's dirty rectangle over the surface and
+holds it for rebuilding
+================
+*/
+void R_QueueLightmap (msurface_t *fa)
+{
+	glRect_t	*theRect;
+	int			smax, tmax;
+
+	if (lightmap_queued == MAX_LIGHTMAP_QUEUE)
+		R_BuildQueuedLightmaps ();
+
+	lightmap_modified[fa->lightmaptexturenum] = true;
+	theRect = &lightmap_rectchange[fa->lightmaptexturenum];
+	if (fa->light_t < theRect->t) {
+		if (theRect->h)
+			theRect->h += theRect->t - fa->light_t;
+		theRect->t = fa->light_t;
+	}
+	if (fa->light_s < theRect->l) {
+		if (theRect->w)
+			theRect->w += theRect->l - fa->light_s;
+		theRect->l = fa->light_s;
+	}
+	smax = (fa->extents[0]>>4)+1;
+	tmax = (fa->extents[1]>>4)+1;
+	if ((theRect->w + theRect->l) < (fa->light_s + smax))
+		theRect->w = (fa->light_s-theRect->l)+smax;
+	if ((theRect->h + theRect->t) < (fa->light_t + tmax))
+		theRect->h = (fa->light_t-theRect->t)+tmax;
+
+	lightmap_queue[lightmap_queued++] = fa;
+}
+
+/*
+================
+R_BuildLightmapJob
+
+Builds the queued surfaces of one lightmap block
+================
+*/
+void R_BuildLightmapJob (void *data, int index, int thread)
+{
+	int			i;
+	msurface_t	*fa;
+	byte		*base;
+	lmjob_t		*job;
+
+	job = &lightmap_jobs[index];
+	for (i=0 ; i<job->count ; i++)
+	{
+		fa = lightmap_sorted[job->first + i];
+		base = lightmaps + fa->lightmaptexturenum*lightmap_bytes*BLOCK_WIDTH*BLOCK_HEIGHT;
+		base += fa->light_t * BLOCK_WIDTH * lightmap_bytes + fa->light_s * lightmap_bytes;
+		R_BuildLightMap (fa, base, BLOCK_WIDTH*lightmap_bytes, blocklightbuf[thread]);
+	}
+}
+
+/*
+================
+R_BuildQueuedLightmaps
+
+Sorts the queue by lightmap block and hands the blocks to the job
+threads.  Surfaces in different blocks never share texels.
+================
+*/
+void R_BuildQueuedLightmaps (void)
+{
+	int			i, n, numjobs;
+	msurface_t	*fa;
+	lmjob_t		*job;
+	int			counts[MAX_LIGHTMAPS];
+	int			jobnum[MAX_LIGHTMAPS];
+
+	if (!lightmap_queued)
+		return;
+
+	R_SelectLightmapKernels ();
+
+	memset (counts, 0, sizeof(counts));
+	for (i=0 ; i<lightmap_queued ; i++)
+	{
+		fa = lightmap_queue[i];
+		counts[fa->lightmaptexturenum]++;
+		c_lightmap_texels += ((fa->extents[0]>>4)+1) * ((fa->extents[1]>>4)+1);
+	}
+
+	numjobs = n = 0;
+	for (i=0 ; i<MAX_LIGHTMAPS ; i++)
+	{
+		if (!counts[i])
+			continue;
+		jobnum[i] = numjobs;
+		lightmap_jobs[numjobs].first = n;
+		lightmap_jobs[numjobs].count = 0;
+		numjobs++;
+		n += counts[i];
+	}
+
+	for (i=0 ; i<lightmap_queued ; i++)
+	{
+		fa = lightmap_queue[i];
+		job = &lightmap_jobs[jobnum[fa->lightmaptexturenum]];
+		lightmap_sorted[job->first + job->count++] = fa;
+	}
+
+	if (lightmap_queued < LM_THREAD_MIN)
+	{	// not worth waking anyone
+		for (i=0 ; i<numjobs ; i++)
+			R_BuildLightmapJob (NULL, i, 0);
+	}
+	else
+		Job_Run (R_BuildLightmapJob, NULL, numjobs);
+
+	lightmap_queued = 0;
+}
+
+/*
+================
+R_InitLightmapRing
+================
+*/
+void R_InitLightmapRing (void)
+{
+	int		flags;
+
+	if (lm_ringbuffer || !gl_persistent || COM_CheckParm ("-nolmpbo"))
+		return;
+
+	flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	qglGenBuffers (1, &lm_ringbuffer);
+	qglBindBuffer (GL_PIXEL_UNPACK_BUFFER_ARB, lm_ringbuffer);
+	qglBufferStorage (GL_PIXEL_UNPACK_BUFFER_ARB, LM_RING_SEGMENTS*LM_SEGMENT_SIZE, NULL, flags);
+	lm_ring = qglMapBufferRange (GL_PIXEL_UNPACK_BUFFER_ARB, 0, LM_RING_SEGMENTS*LM_SEGMENT_SIZE, flags);
+	qglBindBuffer (GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+
+	if (!lm_ring)
+	{
+		Con_Printf ("Couldn't map lightmap upload buffer\n");
+		qglDeleteBuffers (1, &lm_ringbuffer);
+		lm_ringbuffer = 0;
+	}
+}
+
+/*
+================
+R_LightmapRingAlloc
+
+Returns space in this frame's segment of the ring, or NULL if it is full.
+The first allocation of a frame fences the last frame's segment and waits
+for the card to be done with the one it moves on to.
+================
+*/
+byte *R_LightmapRingAlloc (int size)
+{
+	byte	*buf;
+
+	if (lm_segmentframe != r_framecount)
+	{
+		if (lm_segmentused)
+		{
+			lm_fence[lm_segment] = qglFenceSync (GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			lm_segment = (lm_segment + 1) % LM_RING_SEGMENTS;
+		}
+		lm_segmentframe = r_framecount;
+		lm_segmentused = 0;
+
+		if (lm_fence[lm_segment])
+		{
+			qglClientWaitSync (lm_fence[lm_segment], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+			qglDeleteSync (lm_fence[lm_segment]);
+			lm_fence[lm_segment] = NULL;
+		}
+	}
+
+	if (lm_segmentused + size > LM_SEGMENT_SIZE)
+		return NULL;
+
+	buf = lm_ring + lm_segment*LM_SEGMENT_SIZE + lm_segmentused;
+	lm_segmentused += (size + 15) & ~15;
+	return buf;
+}
+
+/*
+================
+R_UploadLightmap
+
+Sends the dirty rectangle of the bound lightmap block
+================
+*/
+void R_UploadLightmap (int lightmapnum)
+{
+	glRect_t	*theRect;
+	byte		*src, *buf;
+	int			rowbytes, pitch, y;
+
+	theRect = &lightmap_rectchange[lightmapnum];
+	rowbytes = theRect->w * lightmap_bytes;
+	pitch = (rowbytes + 3) & ~3;		// default unpack alignment
+	src = lightmaps + ((lightmapnum*BLOCK_HEIGHT + theRect->t)*BLOCK_WIDTH + theRect->l)*lightmap_bytes;
+
+	buf = NULL;
+	if (lm_ring && gl_lightmap_pbo.value)
+		buf = R_LightmapRingAlloc (pitch * theRect->h);
+
+	if (buf)
+	{
+		for (y=0 ; y<theRect->h ; y++)
+			memcpy (buf + y*pitch, src + y*BLOCK_WIDTH*lightmap_bytes, rowbytes);
+		qglBindBuffer (GL_PIXEL_UNPACK_BUFFER_ARB, lm_ringbuffer);
+		glTexSubImage2D (GL_TEXTURE_2D, 0, theRect->l, theRect->t,
+			theRect->w, theRect->h, gl_lightmap_format, GL_UNSIGNED_BYTE,
+			(void *)(buf - lm_ring));
+		qglBindBuffer (GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+	}
+	else
+	{
+		glPixelStorei (GL_UNPACK_ROW_LENGTH, BLOCK_WIDTH);
+		glTexSubImage2D (GL_TEXTURE_2D, 0, theRect->l, theRect->t,
+			theRect->w, theRect->h, gl_lightmap_format, GL_UNSIGNED_BYTE, src);
+		glPixelStorei (GL_UNPACK_ROW_LENGTH, 0);
+	}
+
+	c_lightmap_bytes += rowbytes * theRect->h;
+	c_lightmap_uploads++;
+
+	lightmap_modified[lightmapnum] = false;
+	theRect->l = BLOCK_WIDTH;
+	theRect->t = BLOCK_HEIGHT;
+	theRect->h = 0;
+	theRect->w = 0;
+}
+
+/*
+================
+R_FlushLightmaps
+
+Rebuilds everything queued and uploads every dirty block.
+Leaves the last block bound on the current texture unit.
+================
+*/
+void R_FlushLightmaps (void)
+{
+	int		i;
+
+	R_BuildQueuedLightmaps ();
+
+	for (i=0 ; i<MAX_LIGHTMAPS ; i++)
+	{
+		if (!lightmap_modified[i])
+			continue;
+		GL_Bind (lightmap_textures + i);
+		R_UploadLightmap (i);
+	}
+}
+
+/*
+=============================================================================
+
+  WORLD VERTEX ARRAYS
+
+With gl_vertexbuffers, the polys of every lightmapped brush surface are
+packed into one vertex array at map load, in a buffer object when the
+driver has them.  Drawing then only builds triangle lists of indexes,
+one glDrawElements per texture or lightmap run.  Warped and sky polys
+come from their own static arrays in gl_warp.c, which take the client
+array state over through R_SuspendWorldArrays.  Always draws in texture
+sorted order.
+
+=============================================================================
+*/
+
+#define	MAX_BATCH_INDEXES	(3*8192)
+
+float		*world_verts;			// VERTEXSIZE floats each
+int			world_numverts;
+GLuint		world_vbo;
+qboolean	r_worldarrays;			// drawing from world_verts this frame
+
+unsigned	batch_indexes[MAX_BATCH_INDEXES];
+int			batch_numindexes;
+qboolean	batch_active;
+int			batch_texcoords;
+
+int			c_draw_calls;
+
+/*
+================
+GL_BuildWorldArrays
+================
+*/
+void GL_BuildWorldArrays (void)
+{
+	int			i, j;
+	model_t		*m;
+	msurface_t	*surf;
 	glpoly_t	*p;
 	float		*v;
-	glRect_t	*theRect;
+
+	world_numverts = 0;
+	for (j=1 ; j<MAX_MODELS ; j++)
+	{
+		m = cl.model_precache[j];
+		if (!m)
+			break;
+		if (m->name[0] == '*' || m->type != mod_brush)
+			continue;
+		for (i=0, surf=m->surfaces ; i<m->numsurfaces ; i++, surf++)
+		{
+			if (surf->flags & (SURF_DRAWSKY|SURF_DRAWTURB|SURF_UNDERWATER) || !surf->polys)
+				continue;
+			world_numverts += surf->polys->numverts;
+		}
+	}
+
+	if (!world_numverts)
+	{
+		world_verts = NULL;
+		return;
+	}
+
+	world_verts = Hunk_AllocName (world_numverts*VERTEXSIZE*sizeof(float), "worldverts");
+	v = world_verts;
+	world_numverts = 0;
+	for (j=1 ; j<MAX_MODELS ; j++)
+	{
+		m = cl.model_precache[j];
+		if (!m)
+			break;
+		if (m->name[0] == '*' || m->type != mod_brush)
+			continue;
+		for (i=0, surf=m->surfaces ; i<m->numsurfaces ; i++, surf++)
+		{
+			if (surf->flags & (SURF_DRAWSKY|SURF_DRAWTURB|SURF_UNDERWATER) || !surf->polys)
+				continue;
+			p = surf->polys;
+			p->firstvert = world_numverts;
+			memcpy (v, p->verts, p->numverts*VERTEXSIZE*sizeof(float));
+			v += p->numverts*VERTEXSIZE;
+			world_numverts += p->numverts;
+		}
+	}
+
+	if (gl_vbo)
+	{
+		if (!world_vbo)
+			qglGenBuffers (1, &world_vbo);
+		qglBindBuffer (GL_ARRAY_BUFFER_ARB, world_vbo);
+		qglBufferData (GL_ARRAY_BUFFER_ARB, world_numverts*VERTEXSIZE*sizeof(float), world_verts, GL_STATIC_DRAW_ARB);
+		qglBindBuffer (GL_ARRAY_BUFFER_ARB, 0);
+	}
+
+	Con_DPrintf ("%i brush vertexes in arrays\n", world_numverts);
+}
+
+/*
+================
+R_BeginWorldArrays
+
+texcoords is 3 for the texture coordinates, 5 for the lightmap's
+================
+*/
+void R_BeginWorldArrays (int texcoords)
+{
+	float	*base;
+
+	if (!r_worldarrays)
+		return;
+
+	if (world_vbo)
+	{
+		qglBindBuffer (GL_ARRAY_BUFFER_ARB, world_vbo);
+		base = NULL;
+	}
+	else
+		base = world_verts;
+
+	glVertexPointer (3, GL_FLOAT, VERTEXSIZE*sizeof(float), base);
+	glTexCoordPointer (2, GL_FLOAT, VERTEXSIZE*sizeof(float), base + texcoords);
+	glEnableClientState (GL_VERTEX_ARRAY);
+	glEnableClientState (GL_TEXTURE_COORD_ARRAY);
+
+	batch_numindexes = 0;
+	batch_active = true;
+	batch_texcoords = texcoords;
+}
+
+/*
+================
+R_FlushBatch
+
+Draws everything batched since the last flush.  Must be called before
+the bound texture or any other state changes.
+================
+*/
+void R_FlushBatch (void)
+{
+	if (!batch_numindexes)
+		return;
+
+	glDrawElements (GL_TRIANGLES, batch_numindexes, GL_UNSIGNED_INT, batch_indexes);
+	c_draw_calls++;
+	batch_numindexes = 0;
+}
+
+/*
+================
+R_EndWorldArrays
+================
+*/
+void R_EndWorldArrays (void)
+{
+	if (!batch_active)
+		return;
+
+	R_FlushBatch ();
+	glDisableClientState (GL_VERTEX_ARRAY);
+	glDisableClientState (GL_TEXTURE_COORD_ARRAY);
+	if (world_vbo)
+		qglBindBuffer (GL_ARRAY_BUFFER_ARB, 0);
+	batch_active = false;
+}
+
+/*
+================
+R_SuspendWorldArrays
+
+Flushes and unsets the world arrays so something else can use the
+vertex array state.  Returns what to hand R_BeginWorldArrays to carry
+on, or 0 if they weren't in use.
+================
+*/
+int R_SuspendWorldArrays (void)
+{
+	int		texcoords;
+
+	if (!batch_active)
+		return 0;
+
+	texcoords = batch_texcoords;
+	R_EndWorldArrays ();
+	return texcoords;
+}
+
+/*
+================
+R_BatchPoly
+
+Adds the poly's fan as triangles, or returns false if it isn't in the
+arrays and has to be drawn by hand
+================
+*/
+qboolean R_BatchPoly (glpoly_t *p)
+{
+	int			i;
+	unsigned	*index;
+
+	if (!batch_active || p->firstvert < 0)
+		return false;
+
+	if (batch_numindexes + (p->numverts-2)*3 > MAX_BATCH_INDEXES)
+		R_FlushBatch ();
+
+	index = batch_indexes + batch_numindexes;
+	for (i=2 ; i<p->numverts ; i++, index += 3)
+	{
+		index[0] = p->firstvert;
+		index[1] = p->firstvert + i - 1;
+		index[2] = p->firstvert + i;
+	}
+	batch_numindexes += (p->numverts-2)*3;
+	return true;
+}
+
+/*
+================
+R_BlendLightmaps
+================
+*/
+void R_BlendLightmaps (void)
+{
+	int			i, j;
+	glpoly_t	*p;
+	float		*v;
+
+	R_FlushLightmaps ();
 
 	if (r_fullbright.value)
 		return;
-	if (!gl_texsort.value)
+	if (!r_texsort)
 		return;
 
 	glDepthMask (0);		// don't bother writing Z
@@ -692,36 +1482,21 @@ void R_BlendLightmaps (void)
 		glEnable (GL_BLEND);
 	}
 
+	R_BeginWorldArrays (5);
+
 	for (i=0 ; i<MAX_LIGHTMAPS ; i++)
 	{
 		p = lightmap_polys[i];
 		if (!p)
 			continue;
 		GL_Bind(lightmap_textures+i);
-		if (lightmap_modified[i])
-		{
-			lightmap_modified[i] = false;
-			theRect = &lightmap_rectchange[i];
-//			glTexImage2D (GL_TEXTURE_2D, 0, lightmap_bytes
-//			, BLOCK_WIDTH, BLOCK_HEIGHT, 0, 
-//			gl_lightmap_format, GL_UNSIGNED_BYTE, lightmaps+i*BLOCK_WIDTH*BLOCK_HEIGHT*lightmap_bytes);
-//			glTexImage2D (GL_TEXTURE_2D, 0, lightmap_bytes
-//				, BLOCK_WIDTH, theRect->h, 0, 
-//				gl_lightmap_format, GL_UNSIGNED_BYTE, lightmaps+(i*BLOCK_HEIGHT+theRect->t)*BLOCK_WIDTH*lightmap_bytes);
-			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, theRect->t, 
-				BLOCK_WIDTH, theRect->h, gl_lightmap_format, GL_UNSIGNED_BYTE,
-				lightmaps+(i* BLOCK_HEIGHT + theRect->t) *BLOCK_WIDTH*lightmap_bytes);
-			theRect->l = BLOCK_WIDTH;
-			theRect->t = BLOCK_HEIGHT;
-			theRect->h = 0;
-			theRect->w = 0;
-		}
 		for ( ; p ; p=p->chain)
 		{
 			if (p->flags & SURF_UNDERWATER)
 				DrawGLWaterPolyLightmap (p);
-			else
+			else if (!R_BatchPoly (p))
 			{
+				c_draw_calls++;
 				glBegin (GL_POLYGON);
 				v = p->verts[0];
 				for (j=0 ; j<p->numverts ; j++, v+= VERTEXSIZE)
@@ -732,8 +1507,11 @@ void R_BlendLightmaps (void)
 				glEnd ();
 			}
 		}
+		R_FlushBatch ();
 	}
 
+	R_EndWorldArrays ();
+
 	glDisable (GL_BLEND);
 	if (gl_lightmap_format == GL_LUMINANCE)
 		glBlendFunc (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -754,20 +1532,20 @@ R_RenderBrushPoly
 void R_RenderBrushPoly (msurface_t *fa)
 {
 	texture_t	*t;
-	byte		*base;
 	int			maps;
-	glRect_t    *theRect;
-	int smax, tmax;
 
 	c_brush_polys++;
 
 	if (fa->flags & SURF_DRAWSKY)
 	{	// warp texture, no lightmaps
+		R_FlushBatch ();
 		EmitBothSkyLayers (fa);
 		return;
 	}
 		
 	t = R_TextureAnimation (fa->texinfo->texture);
+	if (t->gl_texturenum != currenttexture)
+		R_FlushBatch ();
 	GL_Bind (t->gl_texturenum);
 
 	if (fa->flags & SURF_DRAWTURB)
@@ -778,7 +1556,7 @@ void R_RenderBrushPoly (msurface_t *fa)
 
 	if (fa->flags & SURF_UNDERWATER)
 		DrawGLWaterPoly (fa->polys);
-	else
+	else if (!R_BatchPoly (fa->polys))
 		DrawGLPoly (fa->polys);
 
 	// add the poly to the proper lightmap chain
@@ -797,29 +1575,7 @@ void R_RenderBrushPoly (msurface_t *fa)
 	{
 dynamic:
 		if (r_dynamic.value)
-		{
-			lightmap_modified[fa->lightmaptexturenum] = true;
-			theRect = &lightmap_rectchange[fa->lightmaptexturenum];
-			if (fa->light_t < theRect->t) {
-				if (theRect->h)
-					theRect->h += theRect->t - fa->light_t;
-				theRect->t = fa->light_t;
-			}
-			if (fa->light_s < theRect->l) {
-				if (theRect->w)
-					theRect->w += theRect->l - fa->light_s;
-				theRect->l = fa->light_s;
-			}
-			smax = (fa->extents[0]>>4)+1;
-			tmax = (fa->extents[1]>>4)+1;
-			if ((theRect->w + theRect->l) < (fa->light_s + smax))
-				theRect->w = (fa->light_s-theRect->l)+smax;
-			if ((theRect->h + theRect->t) < (fa->light_t + tmax))
-				theRect->h = (fa->light_t-theRect->t)+tmax;
-			base = lightmaps + fa->lightmaptexturenum*lightmap_bytes*BLOCK_WIDTH*BLOCK_HEIGHT;
-			base += fa->light_t * BLOCK_WIDTH * lightmap_bytes + fa->light_s * lightmap_bytes;
-			R_BuildLightMap (fa, base, BLOCK_WIDTH*lightmap_bytes);
-		}
+			R_QueueLightmap (fa);
 	}
 }
 
@@ -831,11 +1587,7 @@ Multitexture
 */
 void R_RenderDynamicLightmaps (msurface_t *fa)
 {
-	texture_t	*t;
-	byte		*base;
 	int			maps;
-	glRect_t    *theRect;
-	int smax, tmax;
 
 	c_brush_polys++;
 
@@ -851,35 +1603,40 @@ void R_RenderDynamicLightmaps (msurface_t *fa)
 		if (d_lightstylevalue[fa->styles[maps]] != fa->cached_light[maps])
 			goto dynamic;
 
-	if (fa->dlightframe == r_framecount	// dynamic this frame
-		|| fa->cached_dlight)			// dynamic previously
-	{
-dynamic:
-		if (r_dynamic.value)
-		{
-			lightmap_modified[fa->lightmaptexturenum] = true;
-			theRect = &lightmap_rectchange[fa->lightmaptexturenum];
-			if (fa->light_t < theRect->t) {
-				if (theRect->h)
-					theRect->h += theRect->t - fa->light_t;
-				theRect->t = fa->light_t;
-			}
-			if (fa->light_s < theRect->l) {
-				if (theRect->w)
-					theRect->w += theRect->l - fa->light_s;
-				theRect->l = fa->light_s;
-			}
-			smax = (fa->extents[0]>>4)+1;
-			tmax = (fa->extents[1]>>4)+1;
-			if ((theRect->w + theRect->l) < (fa->light_s + smax))
-				theRect->w = (fa->light_s-theRect->l)+smax;
-			if ((theRect->h + theRect->t) < (fa->light_t + tmax))
-				theRect->h = (fa->light_t-theRect->t)+tmax;
-			base = lightmaps + fa->lightmaptexturenum*lightmap_bytes*BLOCK_WIDTH*BLOCK_HEIGHT;
-			base += fa->light_t * BLOCK_WIDTH * lightmap_bytes + fa->light_s * lightmap_bytes;
-			R_BuildLightMap (fa, base, BLOCK_WIDTH*lightmap_bytes);
-		}
-	}
+	if (fa->dlightframe == r_framecount	// dynamic this frame
+		|| fa->cached_dlight)			// dynamic previously
+	{
+dynamic:
+		if (r_dynamic.value)
+			R_QueueLightmap (fa);
+	}
+}
+
+/*
+================
+R_DrawSequentialChain
+
+Marks the lightmaps of the whole chain before drawing any of it, so
+each changed block is rebuilt and uploaded once instead of per poly
+================
+*/
+void R_DrawSequentialChain (void)
+{
+	msurface_t	*s;
+
+	*sequentialtail = NULL;
+
+	for (s = sequentialchain ; s ; s = s->texturechain)
+		if (!(s->flags & (SURF_DRAWSKY|SURF_DRAWTURB)))
+			R_RenderDynamicLightmaps (s);
+
+	R_FlushLightmaps ();
+
+	for (s = sequentialchain ; s ; s = s->texturechain)
+		R_DrawSequentialPoly (s);
+
+	sequentialchain = NULL;
+	sequentialtail = &sequentialchain;
 }
 
 /*
@@ -957,7 +1714,7 @@ void R_DrawWaterSurfaces (void)
 	msurface_t	*s;
 	texture_t	*t;
 
-	if (r_wateralpha.value == 1.0 && gl_texsort.value)
+	if (r_wateralpha.value == 1.0 && r_texsort)
 		return;
 
 	//
@@ -972,7 +1729,7 @@ void R_DrawWaterSurfaces (void)
 		glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
 	}
 
-	if (!gl_texsort.value) {
+	if (!r_texsort) {
 		if (!waterchain)
 			return;
 
@@ -999,8 +1756,7 @@ void R_DrawWaterSurfaces (void)
 			
 			GL_Bind (t->gl_texturenum);
 
-			for ( ; s ; s=s->texturechain)
-				EmitWaterPolys (s);
+			EmitWaterChain (s);
 			
 			t->texturechain = NULL;
 		}
@@ -1026,10 +1782,10 @@ DrawTextureChains
 void DrawTextureChains (void)
 {
 	int		i;
-	msurface_t	*s;
+	msurface_t	*s, *fa;
 	texture_t	*t;
 
-	if (!gl_texsort.value) {
+	if (!r_texsort) {
 		GL_DisableMultitexture();
 
 		if (skychain) {
@@ -1040,6 +1796,8 @@ void DrawTextureChains (void)
 		return;
 	} 
 
+	R_BeginWorldArrays (3);
+
 	for (i=0 ; i<cl.worldmodel->numtextures ; i++)
 	{
 		t = cl.worldmodel->textures[i];
@@ -1059,12 +1817,95 @@ void DrawTextureChains (void)
 		{
 			if ((s->flags & SURF_DRAWTURB) && r_wateralpha.value != 1.0)
 				continue;	// draw translucent water later
+			if (s->flags & SURF_DRAWTURB)
+			{	// the whole chain warps and draws at once
+				R_FlushBatch ();
+				GL_Bind (R_TextureAnimation (t)->gl_texturenum);
+				for (fa=s ; fa ; fa=fa->texturechain)
+					c_brush_polys++;
+				EmitWaterChain (s);
+				t->texturechain = NULL;
+				continue;
+			}
 			for ( ; s ; s=s->texturechain)
 				R_RenderBrushPoly (s);
+			R_FlushBatch ();
 		}
 
 		t->texturechain = NULL;
 	}
+
+	R_EndWorldArrays ();
+}
+
+int		c_brush_merged, c_brush_drawn;
+
+/*
+=================
+R_BrushTransform
+
+Rebuilds e->transform if the entity has moved since it was last drawn.
+The columns are the axes R_RotateForEntity turns to, pitch flip and all.
+=================
+*/
+void R_BrushTransform (entity_t *e)
+{
+	vec3_t	forward, right, up;
+	float	*m;
+
+	if (e->transformvalid && VectorCompare (e->origin, e->transformorigin)
+		&& VectorCompare (e->angles, e->transformangles))
+		return;
+
+	AngleVectors (e->angles, forward, right, up);
+
+	m = e->transform;
+	m[0] = forward[0];
+	m[1] = forward[1];
+	m[2] = forward[2];
+	m[3] = 0;
+	m[4] = -right[0];
+	m[5] = -right[1];
+	m[6] = -right[2];
+	m[7] = 0;
+	m[8] = up[0];
+	m[9] = up[1];
+	m[10] = up[2];
+	m[11] = 0;
+	m[12] = e->origin[0];
+	m[13] = e->origin[1];
+	m[14] = e->origin[2];
+	m[15] = 1;
+
+	VectorCopy (e->origin, e->transformorigin);
+	VectorCopy (e->angles, e->transformangles);
+	e->transformvalid = true;
+}
+
+/*
+=================
+R_MarkBrushLights
+
+calculate dynamic lighting for bmodel if it's not an
+instanced model
+=================
+*/
+void R_MarkBrushLights (model_t *clmodel)
+{
+	int		k;
+
+	if (clmodel->firstmodelsurface == 0 || gl_flashblend.value)
+		return;
+
+	for (k=0 ; k<MAX_DLIGHTS ; k++)
+	{
+		if ((cl_dlights[k].die < cl.time) ||
+			(!cl_dlights[k].radius))
+			continue;
+
+		R_MarkLights (&cl_dlights[k], 1<<k,
+			clmodel->nodes + clmodel->hulls[0].firstclipnode);
+	}
 }
 
 /*
@@ -1074,11 +1915,10 @@ R_DrawBrushModel
 */
 void R_DrawBrushModel (entity_t *e)
 {
-	int			j, k;
-	vec3_t		mins, maxs;
-	int			i, numsurfaces;
+	vec3_t		mins, maxs, temp;
+	int			i;
 	msurface_t	*psurf;
-	float		dot;
+	float		dot, *m;
 	mplane_t	*pplane;
 	model_t		*clmodel;
 	qboolean	rotated;
@@ -1104,52 +1944,45 @@ void R_DrawBrushModel (entity_t *e)
 		VectorAdd (e->origin, clmodel->maxs, maxs);
 	}
 
-	if (R_CullBox (mins, maxs))
+	if (!r_entaccepted && R_CullBox (mins, maxs))
 		return;
 
+	c_brush_drawn++;
+
 	glColor3f (1,1,1);
 	memset (lightmap_polys, 0, sizeof(lightmap_polys));
 
-	VectorSubtract (r_refdef.vieworg, e->origin, modelorg);
+	R_BrushTransform (e);
+	m = e->transform;
+
+	VectorSubtract (r_refdef.vieworg, e->origin, temp);
 	if (rotated)
 	{
-		vec3_t	temp;
-		vec3_t	forward, right, up;
-
-		VectorCopy (modelorg, temp);
-		AngleVectors (e->angles, forward, right, up);
-		modelorg[0] = DotProduct (temp, forward);
-		modelorg[1] = -DotProduct (temp, right);
-		modelorg[2] = DotProduct (temp, up);
+		modelorg[0] = temp[0]*m[0] + temp[1]*m[1] + temp[2]*m[2];
+		modelorg[1] = temp[0]*m[4] + temp[1]*m[5] + temp[2]*m[6];
+		modelorg[2] = temp[0]*m[8] + temp[1]*m[9] + temp[2]*m[10];
 	}
+	else
+		VectorCopy (temp, modelorg);
 
-	psurf = &clmodel->surfaces[clmodel->firstmodelsurface];
-
-// calculate dynamic lighting for bmodel if it's not an
-// instanced model
-	if (clmodel->firstmodelsurface != 0 && !gl_flashblend.value)
-	{
-		for (k=0 ; k<MAX_DLIGHTS ; k++)
-		{
-			if ((cl_dlights[k].die < cl.time) ||
-				(!cl_dlights[k].radius))
-				continue;
-
-			R_MarkLights (&cl_dlights[k], 1<<k,
-				clmodel->nodes + clmodel->hulls[0].firstclipnode);
-		}
-	}
+	R_MarkBrushLights (clmodel);
 
     glPushMatrix ();
-e->angles[0] = -e->angles[0];	// stupid quake bug
-	R_RotateForEntity (e);
-e->angles[0] = -e->angles[0];	// stupid quake bug
+	glMultMatrixf (m);
 
 	//
 	// draw texture
 	//
-	for (i=0 ; i<clmodel->nummodelsurfaces ; i++, psurf++)
+	if (r_texsort)
+		R_BeginWorldArrays (3);
+
+	for (i=0 ; i<clmodel->nummodelsurfaces ; i++)
 	{
+		if (clmodel->sortedsurfaces)
+			psurf = clmodel->sortedsurfaces[i];
+		else
+			psurf = &clmodel->surfaces[clmodel->firstmodelsurface + i];
+
 	// find which side of the node we are on
 		pplane = psurf->plane;
 
@@ -1159,151 +1992,647 @@ e->angles[0] = -e->angles[0];	// stupid quake bug
 		if (((psurf->flags & SURF_PLANEBACK) && (dot < -BACKFACE_EPSILON)) ||
 			(!(psurf->flags & SURF_PLANEBACK) && (dot > BACKFACE_EPSILON)))
 		{
-			if (gl_texsort.value)
-				R_RenderBrushPoly (psurf);
-			else
-				R_DrawSequentialPoly (psurf);
+			if (r_texsort)
+				R_RenderBrushPoly (psurf);
+			else
+			{
+				*sequentialtail = psurf;
+				sequentialtail = &psurf->texturechain;
+			}
+		}
+	}
+
+	if (!r_texsort)
+		R_DrawSequentialChain ();
+	else
+		R_EndWorldArrays ();
+
+	R_BlendLightmaps ();
+
+	glPopMatrix ();
+}
+
+/*
+=============================================================
+
+	WORLD MODEL
+
+=============================================================
+*/
+
+/*
+================
+R_ChainWorldSurface
+
+Stores a visible world surface out for drawing
+================
+*/
+void R_ChainWorldSurface (msurface_t *surf)
+{
+	// if sorting by texture, just store it out
+	if (r_texsort)
+	{
+		if (!mirror
+		|| surf->texinfo->texture != cl.worldmodel->textures[mirrortexturenum])
+		{
+			surf->texturechain = surf->texinfo->texture->texturechain;
+			surf->texinfo->texture->texturechain = surf;
+		}
+	} else if (surf->flags & SURF_DRAWSKY) {
+		surf->texturechain = skychain;
+		skychain = surf;
+	} else if (surf->flags & SURF_DRAWTURB) {
+		surf->texturechain = waterchain;
+		waterchain = surf;
+	} else {
+		*sequentialtail = surf;
+		sequentialtail = &surf->texturechain;
+	}
+}
+
+/*
+================
+R_RecursiveWorldNode
+================
+*/
+void R_RecursiveWorldNode (mnode_t *node)
+{
+	int			i, c, side, *pindex;
+	vec3_t		acceptpt, rejectpt;
+	mplane_t	*plane;
+	msurface_t	*surf, **mark;
+	mleaf_t		*pleaf;
+	double		d, dot;
+	vec3_t		mins, maxs;
+
+	if (node->contents == CONTENTS_SOLID)
+		return;		// solid
+
+	if (node->visframe != r_visframecount)
+		return;
+	if (node->cullframe == r_framecount)
+		return;
+	
+// if a leaf node, draw stuff
+	if (node->contents < 0)
+	{
+		pleaf = (mleaf_t *)node;
+
+		mark = pleaf->firstmarksurface;
+		c = pleaf->nummarksurfaces;
+
+		if (c)
+		{
+			do
+			{
+				(*mark)->visframe = r_framecount;
+				mark++;
+			} while (--c);
+		}
+
+	// deal with model fragments in this leaf
+		if (pleaf->efrags)
+			R_StoreEfrags (&pleaf->efrags);
+
+		return;
+	}
+
+// node is just a decision point, so go down the apropriate sides
+
+// find which side of the node we are on
+	plane = node->plane;
+
+	switch (plane->type)
+	{
+	case PLANE_X:
+		dot = modelorg[0] - plane->dist;
+		break;
+	case PLANE_Y:
+		dot = modelorg[1] - plane->dist;
+		break;
+	case PLANE_Z:
+		dot = modelorg[2] - plane->dist;
+		break;
+	default:
+		dot = DotProduct (modelorg, plane->normal) - plane->dist;
+		break;
+	}
+
+	if (dot >= 0)
+		side = 0;
+	else
+		side = 1;
+
+// recurse down the children, front side first
+	R_RecursiveWorldNode (node->children[side]);
+
+// draw stuff
+	c = node->numsurfaces;
+
+	if (c)
+	{
+		surf = cl.worldmodel->surfaces + node->firstsurface;
+
+		if (dot < 0 -BACKFACE_EPSILON)
+			side = SURF_PLANEBACK;
+		else if (dot > BACKFACE_EPSILON)
+			side = 0;
+		{
+			for ( ; c ; c--, surf++)
+			{
+				if (surf->visframe != r_framecount)
+					continue;
+
+				// don't backface underwater surfaces, because they warp
+				if ( !(surf->flags & SURF_UNDERWATER) && ( (dot < 0) ^ !!(surf->flags & SURF_PLANEBACK)) )
+					continue;		// wrong side
+
+				R_ChainWorldSurface (surf);
+			}
+		}
+
+	}
+
+// recurse down the back side
+	R_RecursiveWorldNode (node->children[!side]);
+}
+
+
+
+/*
+=============================================================================
+
+  VISIBILITY CACHE
+
+For each view leaf the leafs in its PVS and their marksurfaces are
+copied into one flat block the first time the leaf is entered.  Each
+frame the leafs are frustum culled from that array instead of walking
+the node tree.  Blocks are kept most recently used first and the oldest
+are freed past r_viscachesize kilobytes.
+
+=============================================================================
+*/
+
+typedef struct
+{
+	mleaf_t		*leaf;
+	int			firstsurface;		// in viscache_t surfaces
+	int			numsurfaces;
+} visleaf_t;
+
+typedef struct viscache_s
+{
+	struct viscache_s	*prev, *next;	// most recently used first
+	int			leafnum;			// view leaf this was built for
+	int			size;
+	int			numleafs;
+	visleaf_t	*leafs;
+	cullboxes_t	boxes;				// of the leafs
+	msurface_t	**surfaces;
+} viscache_t;
+
+viscache_t	**viscache_leafs;		// numleafs+1, by view leaf
+viscache_t	viscache_head;			// sentinel
+viscache_t	*r_vis;					// current, or NULL for the node walk
+int			viscache_bytes, viscache_entries;
+int			viscache_hits, viscache_misses;
+
+// for the node walk, the nodes and leafs R_MarkLeaves marked
+mnode_t		**r_visnodes;
+cullboxes_t	r_visnodeboxes;
+byte		*r_visculled;			// R_CullBoxes results, for either
+
+/*
+===============
+R_FreeVisCache
+===============
+*/
+void R_FreeVisCache (viscache_t *vc)
+{
+	vc->prev->next = vc->next;
+	vc->next->prev = vc->prev;
+	viscache_leafs[vc->leafnum] = NULL;
+	viscache_bytes -= vc->size;
+	viscache_entries--;
+	if (r_vis == vc)
+		r_vis = NULL;
+	free (vc);
+}
+
+/*
+===============
+R_FlushVisCache
+
+Called for each new map, also sizes the node walk's cull arrays
+===============
+*/
+void R_FlushVisCache (void)
+{
+	int		i, count;
+
+	while (viscache_head.next && viscache_head.next != &viscache_head)
+		R_FreeVisCache (viscache_head.next);
+	viscache_head.next = viscache_head.prev = &viscache_head;
+	viscache_hits = viscache_misses = 0;
+
+	if (viscache_leafs)
+		free (viscache_leafs);
+	viscache_leafs = calloc (cl.worldmodel->numleafs+1, sizeof(*viscache_leafs));
+	if (!viscache_leafs)
+		Sys_Error ("R_FlushVisCache: out of memory");
+
+	if (r_visnodes)
+		free (r_visnodes);
+	count = cl.worldmodel->numnodes + cl.worldmodel->numleafs + 1;
+	r_visnodes = malloc (count * (sizeof(mnode_t *) + 6*sizeof(float) + 1));
+	if (!r_visnodes)
+		Sys_Error ("R_FlushVisCache: out of memory");
+	for (i=0 ; i<3 ; i++)
+	{
+		r_visnodeboxes.mins[i] = (float *)(r_visnodes + count) + i*count;
+		r_visnodeboxes.maxs[i] = (float *)(r_visnodes + count) + (3+i)*count;
+	}
+	r_visnodeboxes.numboxes = 0;
+	r_visculled = (byte *)(r_visnodeboxes.maxs[2] + count);
+
+	r_vis = NULL;
+	r_oldviewleaf = NULL;
+}
+
+/*
+===============
+R_VisCacheForLeaf
+
+Leaf 0 sees everything, so it also serves r_novis
+===============
+*/
+viscache_t *R_VisCacheForLeaf (mleaf_t *viewleaf)
+{
+	int			i, j, leafnum, numleafs, numsurfaces, size;
+	byte		*vis;
+	mleaf_t		*leaf;
+	viscache_t	*vc;
+	visleaf_t	*vl;
+	msurface_t	**surf;
+
+	leafnum = viewleaf - cl.worldmodel->leafs;
+	vc = viscache_leafs[leafnum];
+	if (vc)
+	{
+		viscache_hits++;
+		vc->prev->next = vc->next;
+		vc->next->prev = vc->prev;
+	}
+	else
+	{
+		viscache_misses++;
+		vis = Mod_LeafPVS (viewleaf, cl.worldmodel);
+
+		numleafs = numsurfaces = 0;
+		for (i=0 ; i<cl.worldmodel->numleafs ; i++)
+		{
+			if (vis[i>>3] & (1<<(i&7)))
+			{
+				numleafs++;
+				numsurfaces += cl.worldmodel->leafs[i+1].nummarksurfaces;
+			}
+		}
+
+		size = sizeof(viscache_t) + numleafs*(sizeof(visleaf_t) + 6*sizeof(float))
+			+ numsurfaces*sizeof(msurface_t *);
+		while (viscache_head.prev != &viscache_head
+			&& viscache_bytes + size > r_viscachesize.value*1024)
+			R_FreeVisCache (viscache_head.prev);
+
+		vc = malloc (size);
+		if (!vc)
+			Sys_Error ("R_VisCacheForLeaf: out of memory");
+		vc->leafnum = leafnum;
+		vc->size = size;
+		vc->numleafs = numleafs;
+		vc->leafs = (visleaf_t *)(vc + 1);
+		vc->boxes.numboxes = numleafs;
+		for (i=0 ; i<3 ; i++)
+		{
+			vc->boxes.mins[i] = (float *)(vc->leafs + numleafs) + i*numleafs;
+			vc->boxes.maxs[i] = (float *)(vc->leafs + numleafs) + (3+i)*numleafs;
+		}
+		vc->surfaces = (msurface_t **)(vc->boxes.maxs[2] + numleafs);
+
+		vl = vc->leafs;
+		surf = vc->surfaces;
+		for (i=0 ; i<cl.worldmodel->numleafs ; i++)
+		{
+			if (!(vis[i>>3] & (1<<(i&7))))
+				continue;
+			leaf = &cl.worldmodel->leafs[i+1];
+			for (j=0 ; j<3 ; j++)
+			{
+				vc->boxes.mins[j][vl - vc->leafs] = leaf->minmaxs[j];
+				vc->boxes.maxs[j][vl - vc->leafs] = leaf->minmaxs[3+j];
+			}
+			vl->leaf = leaf;
+			vl->firstsurface = surf - vc->surfaces;
+			vl->numsurfaces = leaf->nummarksurfaces;
+			for (j=0 ; j<leaf->nummarksurfaces ; j++)
+				*surf++ = leaf->firstmarksurface[j];
+			vl++;
 		}
+
+		viscache_leafs[leafnum] = vc;
+		viscache_bytes += size;
+		viscache_entries++;
 	}
 
-	R_BlendLightmaps ();
+	vc->next = viscache_head.next;
+	vc->prev = &viscache_head;
+	vc->next->prev = vc;
+	viscache_head.next = vc;
 
-	glPopMatrix ();
+	return vc;
 }
 
 /*
-=============================================================
-
-	WORLD MODEL
-
-=============================================================
-*/
+===============
+R_CachedWorldSurfaces
 
-/*
-================
-R_RecursiveWorldNode
-================
+Does the job of R_RecursiveWorldNode from the flat leaf list
+===============
 */
-void R_RecursiveWorldNode (mnode_t *node)
+void R_CachedWorldSurfaces (void)
 {
-	int			i, c, side, *pindex;
-	vec3_t		acceptpt, rejectpt;
-	mplane_t	*plane;
+	int			i, c;
+	visleaf_t	*vl;
 	msurface_t	*surf, **mark;
-	mleaf_t		*pleaf;
-	double		d, dot;
-	vec3_t		mins, maxs;
+	mplane_t	*plane;
+	double		dot;
 
-	if (node->contents == CONTENTS_SOLID)
-		return;		// solid
+	R_CullBoxes (&r_vis->boxes, r_visculled);
 
-	if (node->visframe != r_visframecount)
-		return;
-	if (R_CullBox (node->minmaxs, node->minmaxs+3))
-		return;
-	
-// if a leaf node, draw stuff
-	if (node->contents < 0)
+	for (i=0, vl=r_vis->leafs ; i<r_vis->numleafs ; i++, vl++)
 	{
-		pleaf = (mleaf_t *)node;
-
-		mark = pleaf->firstmarksurface;
-		c = pleaf->nummarksurfaces;
+		if (r_visculled[i])
+			continue;
 
-		if (c)
+		mark = r_vis->surfaces + vl->firstsurface;
+		for (c=vl->numsurfaces ; c ; c--, mark++)
 		{
-			do
+			surf = *mark;
+			if (surf->visframe == r_framecount)
+				continue;		// already seen from another leaf
+			surf->visframe = r_framecount;
+
+			plane = surf->plane;
+			switch (plane->type)
 			{
-				(*mark)->visframe = r_framecount;
-				mark++;
-			} while (--c);
-		}
+			case PLANE_X:
+				dot = modelorg[0] - plane->dist;
+				break;
+			case PLANE_Y:
+				dot = modelorg[1] - plane->dist;
+				break;
+			case PLANE_Z:
+				dot = modelorg[2] - plane->dist;
+				break;
+			default:
+				dot = DotProduct (modelorg, plane->normal) - plane->dist;
+				break;
+			}
 
-	// deal with model fragments in this leaf
-		if (pleaf->efrags)
-			R_StoreEfrags (&pleaf->efrags);
+			// don't backface underwater surfaces, because they warp
+			if ( !(surf->flags & SURF_UNDERWATER) && ( (dot < 0) ^ !!(surf->flags & SURF_PLANEBACK)) )
+				continue;		// wrong side
 
-		return;
+			R_ChainWorldSurface (surf);
+		}
+
+		if (vl->leaf->efrags)
+			R_StoreEfrags (&vl->leaf->efrags);
 	}
+}
 
-// node is just a decision point, so go down the apropriate sides
+/*
+===============
+R_WorldSurfaces
 
-// find which side of the node we are on
-	plane = node->plane;
+Chains the visible world surfaces, from the cache or by the node walk
+after culling every marked node in one batch
+===============
+*/
+void R_WorldSurfaces (void)
+{
+	int		i;
 
-	switch (plane->type)
+	if (r_vis)
 	{
-	case PLANE_X:
-		dot = modelorg[0] - plane->dist;
-		break;
-	case PLANE_Y:
-		dot = modelorg[1] - plane->dist;
-		break;
-	case PLANE_Z:
-		dot = modelorg[2] - plane->dist;
-		break;
-	default:
-		dot = DotProduct (modelorg, plane->normal) - plane->dist;
-		break;
+		R_CachedWorldSurfaces ();
+		return;
 	}
 
-	if (dot >= 0)
-		side = 0;
-	else
-		side = 1;
+	R_CullBoxes (&r_visnodeboxes, r_visculled);
+	for (i=0 ; i<r_visnodeboxes.numboxes ; i++)
+		if (r_visculled[i])
+			r_visnodes[i]->cullframe = r_framecount;
 
-// recurse down the children, front side first
-	R_RecursiveWorldNode (node->children[side]);
+	R_RecursiveWorldNode (cl.worldmodel->nodes);
+}
 
-// draw stuff
-	c = node->numsurfaces;
+/*
+===============
+R_VisBenchPass
 
-	if (c)
-	{
-		surf = cl.worldmodel->surfaces + node->firstsurface;
+Returns the seconds spent finding surfaces, and counts and sums the
+chained surfaces so the two ways can be compared
+===============
+*/
+#define	VISBENCH_TURNS	4
 
-		if (dot < 0 -BACKFACE_EPSILON)
-			side = SURF_PLANEBACK;
-		else if (dot > BACKFACE_EPSILON)
-			side = 0;
+double R_VisBenchPass (int passes, int *frames, int *surfaces, int *checksum)
+{
+	int			i, k, p, t, visedicts;
+	mleaf_t		*leaf;
+	texture_t	*tex;
+	msurface_t	*s;
+	double		start, time;
+
+	visedicts = cl_numvisedicts;
+	time = 0;
+	*frames = *surfaces = *checksum = 0;
+	r_oldviewleaf = NULL;
+
+	for (p=0 ; p<passes ; p++)
+	{
+		for (i=1 ; i<=cl.worldmodel->numleafs ; i++)
 		{
-			for ( ; c ; c--, surf++)
-			{
-				if (surf->visframe != r_framecount)
-					continue;
+			leaf = &cl.worldmodel->leafs[i];
+			if (leaf->contents != CONTENTS_EMPTY)
+				continue;
 
-				// don't backface underwater surfaces, because they warp
-				if ( !(surf->flags & SURF_UNDERWATER) && ( (dot < 0) ^ !!(surf->flags & SURF_PLANEBACK)) )
-					continue;		// wrong side
+			r_origin[0] = (leaf->minmaxs[0] + leaf->minmaxs[3]) * 0.5;
+			r_origin[1] = (leaf->minmaxs[1] + leaf->minmaxs[4]) * 0.5;
+			r_origin[2] = (leaf->minmaxs[2] + leaf->minmaxs[5]) * 0.5;
+			VectorCopy (r_origin, modelorg);
+			r_viewleaf = leaf;
 
-				// if sorting by texture, just store it out
-				if (gl_texsort.value)
+			for (t=0 ; t<VISBENCH_TURNS ; t++)
+			{
+				r_refdef.viewangles[0] = 0;
+				r_refdef.viewangles[1] = i*17 + t*(360/VISBENCH_TURNS);
+				r_refdef.viewangles[2] = 0;
+				AngleVectors (r_refdef.viewangles, vpn, vright, vup);
+				R_SetFrustum ();
+				r_framecount++;
+				(*frames)++;
+
+				start = Sys_ProfileTime ();
+				R_MarkLeaves ();
+				R_WorldSurfaces ();
+				time += Sys_ProfileTime () - start;
+
+				cl_numvisedicts = visedicts;
+				for (s=skychain ; s ; s=s->texturechain)
+					(*surfaces)++;
+				for (s=waterchain ; s ; s=s->texturechain)
+					(*surfaces)++;
+				skychain = waterchain = NULL;
+				for (k=0 ; k<cl.worldmodel->numtextures ; k++)
 				{
-					if (!mirror
-					|| surf->texinfo->texture != cl.worldmodel->textures[mirrortexturenum])
+					tex = cl.worldmodel->textures[k];
+					if (!tex)
+						continue;
+					for (s=tex->texturechain ; s ; s=s->texturechain)
 					{
-						surf->texturechain = surf->texinfo->texture->texturechain;
-						surf->texinfo->texture->texturechain = surf;
+						(*surfaces)++;
+						*checksum += (s - cl.worldmodel->surfaces) * (*frames);
 					}
-				} else if (surf->flags & SURF_DRAWSKY) {
-					surf->texturechain = skychain;
-					skychain = surf;
-				} else if (surf->flags & SURF_DRAWTURB) {
-					surf->texturechain = waterchain;
-					waterchain = surf;
-				} else
-					R_DrawSequentialPoly (surf);
-
+					tex->texturechain = NULL;
+				}
 			}
 		}
+	}
+
+	return time;
+}
+
+/*
+===============
+R_VisBench_f
 
+r_visbench [passes]
+Flies the view through every empty leaf of the current map, turning
+as it goes, and times finding the world surfaces with the node walk
+and with the visibility cache.  Nothing is drawn.
+===============
+*/
+void R_VisBench_f (void)
+{
+	int			passes, frames, nsurfs, csurfs, nsum, csum;
+	float		savedcache;
+	qboolean	savedtexsort;
+	refdef_t	savedrefdef;
+	vec3_t		savedorigin;
+	mleaf_t		*savedleaf;
+	double		ntime, ctime;
+
+	if (!cl.worldmodel)
+	{
+		Con_Printf ("No map loaded\n");
+		return;
 	}
 
-// recurse down the back side
-	R_RecursiveWorldNode (node->children[!side]);
+	passes = 4;
+	if (Cmd_Argc () > 1)
+		passes = Q_atoi (Cmd_Argv (1));
+	if (passes < 1)
+		passes = 1;
+
+	savedcache = r_viscache.value;
+	savedtexsort = r_texsort;
+	savedrefdef = r_refdef;
+	savedleaf = r_viewleaf;
+	VectorCopy (r_origin, savedorigin);
+
+	r_texsort = true;
+	r_refdef.fov_x = r_refdef.fov_y = 90;
+
+	r_viscache.value = 0;
+	ntime = R_VisBenchPass (passes, &frames, &nsurfs, &nsum);
+
+	r_viscache.value = 1;
+	viscache_hits = viscache_misses = 0;
+	ctime = R_VisBenchPass (passes, &frames, &csurfs, &csum);
+
+	r_viscache.value = savedcache;
+	r_texsort = savedtexsort;
+	r_refdef = savedrefdef;
+	r_viewleaf = savedleaf;
+	r_oldviewleaf = NULL;
+	VectorCopy (savedorigin, r_origin);
+
+	Con_Printf ("%i frames, %i surfaces\n", frames, csurfs);
+	Con_Printf ("node walk %7.4f ms/frame\n", ntime*1000/frames);
+	Con_Printf ("viscache  %7.4f ms/frame (%.1fx)\n", ctime*1000/frames, ntime/ctime);
+	Con_Printf ("%i hits, %i misses, %i leafs cached in %i KB\n",
+		viscache_hits, viscache_misses, viscache_entries, viscache_bytes>>10);
+	if (nsurfs != csurfs || nsum != csum)
+		Con_Printf ("surface lists differ: %i node walk, %i viscache\n", nsurfs, csurfs);
 }
 
+/*
+=================
+R_ChainBrushEntities
+
+Brush entities that are submodels of the world and still where the map
+put them are drawn with the world, their surfaces chained with its own.
+R_DrawEntitiesOnList skips them.
+=================
+*/
+void R_ChainBrushEntities (void)
+{
+	int			i, j;
+	entity_t	*e;
+	model_t		*clmodel;
+	msurface_t	*psurf;
+	mplane_t	*pplane;
+	float		dot;
+
+	if (!r_drawentities.value || !r_mergebrushes.value)
+		return;
+
+	for (i=0 ; i<cl_numvisedicts ; i++)
+	{
+		e = cl_visedicts[i];
+		clmodel = e->model;
+		if (clmodel->type != mod_brush || clmodel->name[0] != '*')
+			continue;
+		// the world draws its textures as frame 0
+		if (e->frame || e->origin[0] || e->origin[1] || e->origin[2]
+			|| e->angles[0] || e->angles[1] || e->angles[2])
+			continue;
+
+		e->worldframe = r_framecount;
+		// entities sharing a submodel chain its surfaces only once,
+		// a surface linked twice would make its chain loop
+		if (clmodel->mergeframe == r_framecount)
+			continue;
+		clmodel->mergeframe = r_framecount;
+		if (R_CullBox (clmodel->mins, clmodel->maxs))
+			continue;
+
+		c_brush_merged++;
+		R_MarkBrushLights (clmodel);
 
+		psurf = &clmodel->surfaces[clmodel->firstmodelsurface];
+		for (j=0 ; j<clmodel->nummodelsurfaces ; j++, psurf++)
+		{
+			pplane = psurf->plane;
+			dot = DotProduct (modelorg, pplane->normal) - pplane->dist;
+			if (((psurf->flags & SURF_PLANEBACK) && (dot < -BACKFACE_EPSILON)) ||
+				(!(psurf->flags & SURF_PLANEBACK) && (dot > BACKFACE_EPSILON)))
+				R_ChainWorldSurface (psurf);
+		}
+	}
+}
 
 /*
 =============
@@ -1323,13 +2652,22 @@ void R_DrawWorld (void)
 	currententity = &ent;
 	currenttexture = -1;
 
+	r_worldarrays = gl_vertexbuffers.value && world_numverts;
+	r_texsort = gl_texsort.value || r_worldarrays;
+	if (r_texsort && gl_mtexable)
+		GL_DisableMultitexture ();
+
 	glColor3f (1,1,1);
 	memset (lightmap_polys, 0, sizeof(lightmap_polys));
 #ifdef QUAKE2
 	R_ClearSkyBox ();
 #endif
 
-	R_RecursiveWorldNode (cl.worldmodel->nodes);
+	R_WorldSurfaces ();
+	R_ChainBrushEntities ();
+
+	if (!r_texsort)
+		R_DrawSequentialChain ();
 
 	DrawTextureChains ();
 
@@ -1350,10 +2688,11 @@ void R_MarkLeaves (void)
 {
 	byte	*vis;
 	mnode_t	*node;
-	int		i;
+	int		i, j, n;
 	byte	solid[4096];
 
-	if (r_oldviewleaf == r_viewleaf && !r_novis.value)
+	if (r_oldviewleaf == r_viewleaf && !r_novis.value
+		&& (r_viscache.value != 0) == (r_vis != NULL))
 		return;
 	
 	if (mirror)
@@ -1362,6 +2701,14 @@ void R_MarkLeaves (void)
 	r_visframecount++;
 	r_oldviewleaf = r_viewleaf;
 
+	if (r_viscache.value)
+	{
+		r_vis = R_VisCacheForLeaf (r_novis.value ? cl.worldmodel->leafs : r_viewleaf);
+		return;
+	}
+	r_vis = NULL;
+	r_visnodeboxes.numboxes = 0;
+
 	if (r_novis.value)
 	{
 		vis = solid;
@@ -1380,6 +2727,13 @@ void R_MarkLeaves (void)
 				if (node->visframe == r_visframecount)
 					break;
 				node->visframe = r_visframecount;
+				n = r_visnodeboxes.numboxes++;
+				r_visnodes[n] = node;
+				for (j=0 ; j<3 ; j++)
+				{
+					r_visnodeboxes.mins[j][n] = node->minmaxs[j];
+					r_visnodeboxes.maxs[j][n] = node->minmaxs[3+j];
+				}
 				node = node->parent;
 			} while (node);
 		}
@@ -1474,6 +2828,7 @@ void BuildSurfaceDisplayList (msurface_t *fa)
 	poly = Hunk_Alloc (sizeof(glpoly_t) + (lnumverts-4) * VERTEXSIZE*sizeof(float));
 	poly->next = fa->polys;
 	poly->flags = fa->flags;
+	poly->firstvert = -1;
 	fa->polys = poly;
 	poly->numverts = lnumverts;
 
@@ -1583,9 +2938,38 @@ void GL_CreateSurfaceLightmap (msurface_t *surf)
 	surf->lightmaptexturenum = AllocBlock (smax, tmax, &surf->light_s, &surf->light_t);
 	base = lightmaps + surf->lightmaptexturenum*lightmap_bytes*BLOCK_WIDTH*BLOCK_HEIGHT;
 	base += (surf->light_t * BLOCK_WIDTH + surf->light_s) * lightmap_bytes;
-	R_BuildLightMap (surf, base, BLOCK_WIDTH*lightmap_bytes);
+	R_BuildLightMap (surf, base, BLOCK_WIDTH*lightmap_bytes, blocklightbuf[0]);
+}
+
+
+/*
+==================
+GL_SortModelSurfaces
+
+Groups a brush model's surfaces by texture, so R_DrawBrushModel flushes
+its batch once per texture rather than whenever the texture changes
+==================
+*/
+int GL_SurfaceTextureCompare (const void *a, const void *b)
+{
+	msurface_t	*sa, *sb;
+
+	sa = *(msurface_t **)a;
+	sb = *(msurface_t **)b;
+	if (sa->texinfo->texture != sb->texinfo->texture)
+		return sa->texinfo->texture < sb->texinfo->texture ? -1 : 1;
+	return sa < sb ? -1 : sa > sb;
 }
 
+void GL_SortModelSurfaces (model_t *m)
+{
+	int		i;
+
+	m->sortedsurfaces = Hunk_AllocName (m->nummodelsurfaces*sizeof(msurface_t *), "sortsurfs");
+	for (i=0 ; i<m->nummodelsurfaces ; i++)
+		m->sortedsurfaces[i] = m->surfaces + m->firstmodelsurface + i;
+	qsort (m->sortedsurfaces, m->nummodelsurfaces, sizeof(msurface_t *), GL_SurfaceTextureCompare);
+}
 
 /*
 ==================
@@ -1602,6 +2986,7 @@ void GL_BuildLightmaps (void)
 	extern qboolean isPermedia;
 
 	memset (allocated, 0, sizeof(allocated));
+	lightmap_queued = 0;
 
 	r_framecount = 1;		// no dlightcache
 
@@ -1642,11 +3027,15 @@ void GL_BuildLightmaps (void)
 		break;
 	}
 
+	R_InitLightmapRing ();
+	R_SelectLightmapKernels ();
+
 	for (j=1 ; j<MAX_MODELS ; j++)
 	{
 		m = cl.model_precache[j];
 		if (!m)
 			break;
+		m->mergeframe = 0;		// r_framecount starts over
 		if (m->name[0] == '*')
 			continue;
 		r_pcurrentvertbase = m->vertexes;
@@ -1664,6 +3053,18 @@ void GL_BuildLightmaps (void)
 		}
 	}
 
+	GL_BuildWorldArrays ();
+	GL_BuildWarpArrays ();
+
+	for (j=2 ; j<MAX_MODELS ; j++)
+	{
+		m = cl.model_precache[j];
+		if (!m)
+			break;
+		if (m->type == mod_brush)
+			GL_SortModelSurfaces (m);
+	}
+
  	if (!gl_texsort.value)
  		GL_SelectTexture(TEXTURE1_SGIS);
 
@@ -1692,3 +3093,205 @@ void GL_BuildLightmaps (void)
 
 }
 
+
+/*
+=============================================================================
+
+  LIGHTMAP BENCHMARK
+
+=============================================================================
+*/
+
+#define	BENCH_DLIGHTS	4
+
+/*
+===============
+R_LightBenchPass
+
+Builds every lightmap of the world into dest, passes times.  With
+dynamic set, each surface is lit by BENCH_DLIGHTS lights stacked
+in front of its first vertex.
+===============
+*/
+double R_LightBenchPass (int passes, qboolean dynamic, byte *dest, int stride)
+{
+	int			i, k;
+	msurface_t	*surf;
+	float		*v;
+	double		start;
+
+	start = Sys_ProfileTime ();
+	while (passes--)
+	{
+		surf = cl.worldmodel->surfaces;
+		for (i=0 ; i<cl.worldmodel->numsurfaces ; i++, surf++)
+		{
+			if (surf->flags & (SURF_DRAWSKY|SURF_DRAWTURB) || !surf->polys)
+				continue;
+			if (dynamic)
+			{
+				v = surf->polys->verts[0];
+				for (k=0 ; k<BENCH_DLIGHTS ; k++)
+					VectorMA (v, 16 + 24*k, surf->plane->normal, cl_dlights[k].origin);
+				surf->dlightframe = r_framecount;
+				surf->dlightbits = (1<<BENCH_DLIGHTS) - 1;
+			}
+			else
+			{
+			// an earlier dynamic pass leaves the lights marked
+				surf->dlightframe = 0;
+				surf->dlightbits = 0;
+			}
+			R_BuildLightMap (surf, dest, stride, blocklightbuf[0]);
+		}
+	}
+	return Sys_ProfileTime () - start;
+}
+
+/*
+===============
+R_LightBench_f
+
+r_lightbench [passes]
+Times the C and SSE2 lightmap kernels over the current map, with and
+without dynamic lights, and checks that they build the same lightmaps.
+Then times the threaded rebuild of every lightmap at 1 to 16 threads.
+===============
+*/
+void R_LightBench_f (void)
+{
+	int			i, k, p, passes, texels, surfaces, differ, threads;
+	msurface_t	*surf;
+	byte		c[18*18*4], simd[18*18*4];
+	int			stride;
+	float		savedsimd, savedthreads;
+	dlight_t	saved[BENCH_DLIGHTS];
+	double		cstyle, cdyn, sstyle, sdyn, start, single, time;
+
+	if (!cl.worldmodel)
+	{
+		Con_Printf ("No map loaded\n");
+		return;
+	}
+
+	passes = 20;
+	if (Cmd_Argc () > 1)
+		passes = Q_atoi (Cmd_Argv (1));
+	if (passes < 1)
+		passes = 1;
+
+	memcpy (saved, cl_dlights, sizeof(saved));
+	for (k=0 ; k<BENCH_DLIGHTS ; k++)
+	{
+		cl_dlights[k].radius = 200 + 50*k;
+		cl_dlights[k].minlight = 32;
+	}
+	stride = 18*lightmap_bytes;
+	savedsimd = r_simd.value;
+
+	texels = surfaces = 0;
+	surf = cl.worldmodel->surfaces;
+	for (i=0 ; i<cl.worldmodel->numsurfaces ; i++, surf++)
+	{
+		if (surf->flags & (SURF_DRAWSKY|SURF_DRAWTURB) || !surf->polys)
+			continue;
+		surfaces++;
+		texels += ((surf->extents[0]>>4)+1) * ((surf->extents[1]>>4)+1);
+	}
+
+	r_simd.value = 0;
+	R_SelectLightmapKernels ();
+	cstyle = R_LightBenchPass (passes, false, c, stride);
+	cdyn = R_LightBenchPass (passes, true, c, stride);
+
+	r_simd.value = 1;
+	R_SelectLightmapKernels ();
+	sstyle = R_LightBenchPass (passes, false, simd, stride);
+	sdyn = R_LightBenchPass (passes, true, simd, stride);
+
+	// check every surface builds the same both ways
+	differ = 0;
+	surf = cl.worldmodel->surfaces;
+	for (i=0 ; i<cl.worldmodel->numsurfaces ; i++, surf++)
+	{
+		if (surf->flags & (SURF_DRAWSKY|SURF_DRAWTURB) || !surf->polys)
+			continue;
+		memset (c, 0, sizeof(c));
+		memset (simd, 0, sizeof(simd));
+		surf->dlightframe = r_framecount;
+		surf->dlightbits = (1<<BENCH_DLIGHTS) - 1;
+		for (k=0 ; k<BENCH_DLIGHTS ; k++)
+			VectorMA (surf->polys->verts[0], 16 + 24*k, surf->plane->normal, cl_dlights[k].origin);
+
+		r_simd.value = 0;
+		R_SelectLightmapKernels ();
+		R_BuildLightMap (surf, c, stride, blocklightbuf[0]);
+		r_simd.value = 1;
+		R_SelectLightmapKernels ();
+		R_BuildLightMap (surf, simd, stride, blocklightbuf[0]);
+		if (memcmp (c, simd, sizeof(c)))
+			differ++;
+	}
+
+	r_simd.value = savedsimd;
+	R_SelectLightmapKernels ();
+
+	Con_Printf ("%i surfaces, %i texels, %i passes\n", surfaces, texels, passes);
+	Con_Printf ("styles:  C %6.2f ms", cstyle*1000/passes);
+#if idSSE
+	if (Sys_HaveSSE2 ())
+		Con_Printf ("  SSE2 %6.2f ms (%.1fx)", sstyle*1000/passes, cstyle/sstyle);
+#endif
+	Con_Printf ("\n");
+	Con_Printf ("dlights: C %6.2f ms", cdyn*1000/passes);
+#if idSSE
+	if (Sys_HaveSSE2 ())
+		Con_Printf ("  SSE2 %6.2f ms (%.1fx)", sdyn*1000/passes, cdyn/sdyn);
+#endif
+	Con_Printf ("\n");
+	if (differ)
+		Con_Printf ("%i surfaces differ between C and SSE2\n", differ);
+
+	// thread scaling, through the frame queue with every surface dirty
+	// and the lights spread over the map
+	for (k=0 ; k<BENCH_DLIGHTS ; k++)
+	{
+		surf = cl.worldmodel->surfaces + (k+1)*cl.worldmodel->numsurfaces/(BENCH_DLIGHTS+1);
+		if (surf->polys)
+			VectorMA (surf->polys->verts[0], 32, surf->plane->normal, cl_dlights[k].origin);
+	}
+	savedthreads = job_threads.value;
+	single = 0;
+	for (threads=1 ; threads<=MAX_JOB_THREADS ; threads<<=1)
+	{
+		job_threads.value = threads;
+		start = Sys_ProfileTime ();
+		for (p=0 ; p<passes ; p++)
+		{
+			surf = cl.worldmodel->surfaces;
+			for (i=0 ; i<cl.worldmodel->numsurfaces ; i++, surf++)
+			{
+				if (surf->flags & (SURF_DRAWSKY|SURF_DRAWTURB) || !surf->polys)
+					continue;
+				surf->dlightframe = r_framecount;
+				surf->dlightbits = (1<<BENCH_DLIGHTS) - 1;
+				R_QueueLightmap (surf);
+			}
+			R_BuildQueuedLightmaps ();
+		}
+		time = Sys_ProfileTime () - start;
+		if (threads == 1)
+			single = time;
+		Con_Printf ("%2i threads: %6.2f ms (%.1fx)\n", threads, time*1000/passes, single/time);
+	}
+	job_threads.value = savedthreads;
+
+	// put things back and have visible surfaces rebuilt
+	memcpy (cl_dlights, saved, sizeof(saved));
+	surf = cl.worldmodel->surfaces;
+	for (i=0 ; i<cl.worldmodel->numsurfaces ; i++, surf++)
+	{
+		surf->dlightframe = 0;
+		surf->cached_dlight = true;
+	}
+}
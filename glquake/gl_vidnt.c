@@ -591,6 +591,65 @@ void CheckMultiTextureExtensions(void)
 }
 #endif
 
+lpGenBuffersFUNC qglGenBuffers;
+lpDeleteBuffersFUNC qglDeleteBuffers;
+lpBindBufferFUNC qglBindBuffer;
+lpBufferDataFUNC qglBufferData;
+lpBufferSubDataFUNC qglBufferSubData;
+lpMapBufferRangeFUNC qglMapBufferRange;
+lpUnmapBufferFUNC qglUnmapBuffer;
+lpBufferStorageFUNC qglBufferStorage;
+lpFenceSyncFUNC qglFenceSync;
+lpClientWaitSyncFUNC qglClientWaitSync;
+lpDeleteSyncFUNC qglDeleteSync;
+
+qboolean gl_vbo = false;
+qboolean gl_pbo = false;
+qboolean gl_persistent = false;
+
+/*
+===============
+CheckBufferExtensions
+
+Each level needs the one below it; -novbo turns all of them off
+===============
+*/
+void CheckBufferExtensions (void)
+{
+	if (!strstr(gl_extensions, "GL_ARB_vertex_buffer_object") || COM_CheckParm("-novbo"))
+		return;
+
+	qglGenBuffers = (void *) wglGetProcAddress("glGenBuffersARB");
+	qglDeleteBuffers = (void *) wglGetProcAddress("glDeleteBuffersARB");
+	qglBindBuffer = (void *) wglGetProcAddress("glBindBufferARB");
+	qglBufferData = (void *) wglGetProcAddress("glBufferDataARB");
+	qglBufferSubData = (void *) wglGetProcAddress("glBufferSubDataARB");
+	qglUnmapBuffer = (void *) wglGetProcAddress("glUnmapBufferARB");
+	if (!qglGenBuffers || !qglDeleteBuffers || !qglBindBuffer || !qglBufferData
+	|| !qglBufferSubData || !qglUnmapBuffer)
+		return;
+	Con_Printf ("Vertex buffer objects found.\n");
+	gl_vbo = true;
+
+	if (!strstr(gl_extensions, "GL_ARB_pixel_buffer_object"))
+		return;
+	gl_pbo = true;
+
+	if (!strstr(gl_extensions, "GL_ARB_buffer_storage") || !strstr(gl_extensions, "GL_ARB_sync")
+	|| !strstr(gl_extensions, "GL_ARB_map_buffer_range"))
+		return;
+	qglMapBufferRange = (void *) wglGetProcAddress("glMapBufferRange");
+	qglBufferStorage = (void *) wglGetProcAddress("glBufferStorage");
+	qglFenceSync = (void *) wglGetProcAddress("glFenceSync");
+	qglClientWaitSync = (void *) wglGetProcAddress("glClientWaitSync");
+	qglDeleteSync = (void *) wglGetProcAddress("glDeleteSync");
+	if (!qglMapBufferRange || !qglBufferStorage || !qglFenceSync || !qglClientWaitSync
+	|| !qglDeleteSync)
+		return;
+	Con_Printf ("Persistent buffer mapping found.\n");
+	gl_persistent = true;
+}
+
 /*
 ===============
 GL_Init
@@ -618,6 +677,7 @@ void GL_Init (void)
 
 	CheckTextureExtensions ();
 	CheckMultiTextureExtensions ();
+	CheckBufferExtensions ();
 
 	glClearColor (1,0,0,0);
 	glCullFace(GL_FRONT);
@@ -673,6 +733,8 @@ void GL_BeginRendering (int *x, int *y, int *width, int *height)
 
 void GL_EndRendering (void)
 {
+	Draw_Flush ();
+
 	if (!scr_skipupdate || block_drawing)
 		SwapBuffers(maindc);
 
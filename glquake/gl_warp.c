@@ -21,6 +21,10 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "quakedef.h"
 
+#if idSSE
+#include <emmintrin.h>
+#endif
+
 extern	model_t	*loadmodel;
 
 int		skytexturenum;
@@ -124,6 +128,7 @@ void SubdividePolygon (int numverts, float *verts)
 	poly->next = warpface->polys;
 	warpface->polys = poly;
 	poly->numverts = numverts;
+	poly->firstvert = -1;
 	for (i=0 ; i<numverts ; i++, verts+= 3)
 	{
 		VectorCopy (verts, poly->verts[i]);
@@ -184,6 +189,558 @@ float	turbsin[] =
 };
 #define TURBSCALE (256.0 / (2 * M_PI))
 
+/*
+=============================================================================
+
+  WARP ARRAYS
+
+The subdivided water and sky polys of every brush model are copied into
+one static mesh at load, positions in a vertex buffer when there is one.
+Each frame only the texture coordinates of the visible warped surfaces
+are recomputed, four or two vertexes at a time, and the polys go out as
+one glDrawElements per texture.  Both sky layers share coordinates; the
+scroll is a texture matrix translate.
+
+=============================================================================
+*/
+
+// turbsin index as a float multiple of the texture coordinate
+#define	TURBARG		((float)(0.125*TURBSCALE))
+
+float		*warp_xyz;				// 3 floats per vertex
+float		*warp_base;				// unwarped s/t
+float		*warp_st;				// this frame's s/t
+unsigned	*warp_indexes;
+int			warp_numverts;
+GLuint		warp_vbo;
+
+void (*R_WarpWater) (float *base, float *st, int count, float phase);
+void (*R_WarpSky) (float *xyz, float *st, int count, vec3_t origin);
+
+/*
+================
+GL_BuildWarpArrays
+================
+*/
+void GL_BuildWarpArrays (void)
+{
+	int			i, j, k;
+	model_t		*m;
+	msurface_t	*surf;
+	glpoly_t	*p;
+	float		*v;
+
+	warp_numverts = 0;
+	for (j=1 ; j<MAX_MODELS ; j++)
+	{
+		m = cl.model_precache[j];
+		if (!m)
+			break;
+		if (m->name[0] == '*' || m->type != mod_brush)
+			continue;
+		for (i=0, surf=m->surfaces ; i<m->numsurfaces ; i++, surf++)
+		{
+			if (!(surf->flags & (SURF_DRAWSKY|SURF_DRAWTURB)))
+				continue;
+			for (p=surf->polys ; p ; p=p->next)
+				warp_numverts += p->numverts;
+		}
+	}
+
+	if (!warp_numverts)
+		return;
+
+	warp_xyz = Hunk_AllocName (warp_numverts*3*sizeof(float), "warpverts");
+	warp_base = Hunk_AllocName (warp_numverts*2*sizeof(float), "warpverts");
+	warp_st = Hunk_AllocName (warp_numverts*2*sizeof(float), "warpverts");
+	warp_indexes = Hunk_AllocName (warp_numverts*3*sizeof(unsigned), "warpverts");
+
+	warp_numverts = 0;
+	for (j=1 ; j<MAX_MODELS ; j++)
+	{
+		m = cl.model_precache[j];
+		if (!m)
+			break;
+		if (m->name[0] == '*' || m->type != mod_brush)
+			continue;
+		for (i=0, surf=m->surfaces ; i<m->numsurfaces ; i++, surf++)
+		{
+			if (!(surf->flags & (SURF_DRAWSKY|SURF_DRAWTURB)))
+				continue;
+			for (p=surf->polys ; p ; p=p->next)
+			{
+				p->firstvert = warp_numverts;
+				for (k=0 ; k<p->numverts ; k++, warp_numverts++)
+				{
+					v = warp_xyz + warp_numverts*3;
+					VectorCopy (p->verts[k], v);
+					warp_base[warp_numverts*2] = p->verts[k][3];
+					warp_base[warp_numverts*2+1] = p->verts[k][4];
+				}
+			}
+		}
+	}
+
+	if (gl_vbo)
+	{
+		if (!warp_vbo)
+			qglGenBuffers (1, &warp_vbo);
+		qglBindBuffer (GL_ARRAY_BUFFER_ARB, warp_vbo);
+		qglBufferData (GL_ARRAY_BUFFER_ARB, warp_numverts*3*sizeof(float), warp_xyz, GL_STATIC_DRAW_ARB);
+		qglBindBuffer (GL_ARRAY_BUFFER_ARB, 0);
+	}
+
+	Con_DPrintf ("%i warp vertexes in arrays\n", warp_numverts);
+}
+
+/*
+=============
+R_WarpPhase
+
+time folded into one turbsin period, kept positive so the truncation
+in the warp kernels still floors.  Every water path indexes turbsin
+with (int)(coord*TURBARG + phase) & 255.
+=============
+*/
+float R_WarpPhase (double time)
+{
+	return fmod (time*TURBSCALE, 256) + 65536;
+}
+
+/*
+=============
+R_WarpWater_C
+
+Each step is rounded to a float the way the SSE2 kernel rounds it, so
+an x87 build picks the same turbsin entries
+=============
+*/
+void R_WarpWater_C (float *base, float *st, int count, float phase)
+{
+	int		i;
+	float	os, ot, as, at, s, t;
+
+	for (i=0 ; i<count ; i++, base+=2, st+=2)
+	{
+		os = base[0];
+		ot = base[1];
+		as = os*TURBARG;
+		at = ot*TURBARG;
+		as += phase;
+		at += phase;
+		s = os + turbsin[(int)at & 255];
+		t = ot + turbsin[(int)as & 255];
+		st[0] = s * (1.0f/64);
+		st[1] = t * (1.0f/64);
+	}
+}
+
+/*
+=============
+R_WarpSky_C
+
+Projects the view direction onto the sky sphere, flattened vertically.
+The layer scroll is left to the texture matrix.
+=============
+*/
+void R_WarpSky_C (float *xyz, float *st, int count, vec3_t origin)
+{
+	int		i;
+	float	dir0, dir1, dir2, length;
+
+	for (i=0 ; i<count ; i++, xyz+=3, st+=2)
+	{
+		dir0 = xyz[0] - origin[0];
+		dir1 = xyz[1] - origin[1];
+		dir2 = (xyz[2] - origin[2]) * 3;	// flatten the sphere
+
+		length = (float)sqrt (dir0*dir0 + dir1*dir1 + dir2*dir2);
+		length = 378.0f / length;
+
+		st[0] = dir0*length * (1.0f/128);
+		st[1] = dir1*length * (1.0f/128);
+	}
+}
+
+#if idSSE
+
+/*
+=============
+R_WarpWater_SSE
+
+Two vertexes at a time; SSE2 has no gather, so the table reads stay scalar
+=============
+*/
+void R_WarpWater_SSE (float *base, float *st, int count, float phase)
+{
+	int		i;
+	int		index[4];
+	__m128	v, swap, sn, k, ph, scale;
+	__m128i	mask;
+
+	k = _mm_set1_ps (TURBARG);
+	ph = _mm_set1_ps (phase);
+	scale = _mm_set1_ps (1.0f/64);
+	mask = _mm_set1_epi32 (255);
+
+	for (i=0 ; i+2<=count ; i+=2, base+=4, st+=4)
+	{
+		v = _mm_loadu_ps (base);			// os0 ot0 os1 ot1
+		swap = _mm_shuffle_ps (v, v, _MM_SHUFFLE(2,3,0,1));
+		_mm_storeu_si128 ((__m128i *)index, _mm_and_si128 (
+			_mm_cvttps_epi32 (_mm_add_ps (_mm_mul_ps (swap, k), ph)), mask));
+		sn = _mm_setr_ps (turbsin[index[0]], turbsin[index[1]], turbsin[index[2]], turbsin[index[3]]);
+		_mm_storeu_ps (st, _mm_mul_ps (_mm_add_ps (v, sn), scale));
+	}
+
+	if (i < count)
+		R_WarpWater_C (base, st, count-i, phase);
+}
+
+/*
+=============
+R_WarpSky_SSE
+
+Four vertexes at a time
+=============
+*/
+void R_WarpSky_SSE (float *xyz, float *st, int count, vec3_t origin)
+{
+	int		i;
+	__m128	x, y, z, ox, oy, oz, three, radius, scale, length, s, t;
+
+	ox = _mm_set1_ps (origin[0]);
+	oy = _mm_set1_ps (origin[1]);
+	oz = _mm_set1_ps (origin[2]);
+	three = _mm_set1_ps (3);
+	radius = _mm_set1_ps (378.0f);
+	scale = _mm_set1_ps (1.0f/128);
+
+	for (i=0 ; i+4<=count ; i+=4, xyz+=12, st+=8)
+	{
+		x = _mm_sub_ps (_mm_setr_ps (xyz[0], xyz[3], xyz[6], xyz[9]), ox);
+		y = _mm_sub_ps (_mm_setr_ps (xyz[1], xyz[4], xyz[7], xyz[10]), oy);
+		z = _mm_mul_ps (_mm_sub_ps (_mm_setr_ps (xyz[2], xyz[5], xyz[8], xyz[11]), oz), three);
+
+		length = _mm_add_ps (_mm_add_ps (_mm_mul_ps (x, x), _mm_mul_ps (y, y)), _mm_mul_ps (z, z));
+		length = _mm_div_ps (radius, _mm_sqrt_ps (length));
+
+		s = _mm_mul_ps (_mm_mul_ps (x, length), scale);
+		t = _mm_mul_ps (_mm_mul_ps (y, length), scale);
+		_mm_storeu_ps (st, _mm_unpacklo_ps (s, t));
+		_mm_storeu_ps (st+4, _mm_unpackhi_ps (s, t));
+	}
+
+	if (i < count)
+		R_WarpSky_C (xyz, st, count-i, origin);
+}
+
+#endif
+
+/*
+=============
+R_SelectWarpKernels
+=============
+*/
+void R_SelectWarpKernels (void)
+{
+#if idSSE
+	if (r_simd.value && Sys_HaveSSE2 ())
+	{
+		R_WarpWater = R_WarpWater_SSE;
+		R_WarpSky = R_WarpSky_SSE;
+		return;
+	}
+#endif
+	R_WarpWater = R_WarpWater_C;
+	R_WarpSky = R_WarpSky_C;
+}
+
+/*
+=============
+R_WarpArrays
+
+True if fa can be drawn from the warp arrays
+=============
+*/
+qboolean R_WarpArrays (msurface_t *fa)
+{
+	return warp_numverts && gl_vertexbuffers.value && fa->polys && fa->polys->firstvert >= 0;
+}
+
+/*
+=============
+R_WarpSurfaces
+
+Warps the texture coordinates of fa, and of the rest of its texturechain
+if chain is set, and returns the number of indexes written for them
+=============
+*/
+int R_WarpSurfaces (msurface_t *fa, qboolean chain, qboolean sky)
+{
+	int			i, first, count, numindexes;
+	float		phase;
+	glpoly_t	*p;
+	unsigned	*index;
+
+	phase = R_WarpPhase (realtime);
+
+	index = warp_indexes;
+	for ( ; fa ; fa = chain ? fa->texturechain : NULL)
+	{
+		first = fa->polys->firstvert;
+		count = 0;
+		for (p=fa->polys ; p ; p=p->next)
+		{
+			for (i=2 ; i<p->numverts ; i++, index += 3)
+			{
+				index[0] = p->firstvert;
+				index[1] = p->firstvert + i - 1;
+				index[2] = p->firstvert + i;
+			}
+			count += p->numverts;
+		}
+
+		if (sky)
+			R_WarpSky (warp_xyz + first*3, warp_st + first*2, count, r_origin);
+		else
+			R_WarpWater (warp_base + first*2, warp_st + first*2, count, phase);
+	}
+
+	numindexes = index - warp_indexes;
+	return numindexes;
+}
+
+/*
+=============
+R_DrawWarpArrays
+
+Draws what R_WarpSurfaces set up, with the texture coordinates
+offset by scroll
+=============
+*/
+void R_DrawWarpArrays (int numindexes, float scroll)
+{
+	int		resume;
+
+	resume = R_SuspendWorldArrays ();
+
+	if (warp_vbo)
+	{
+		qglBindBuffer (GL_ARRAY_BUFFER_ARB, warp_vbo);
+		glVertexPointer (3, GL_FLOAT, 0, NULL);
+		qglBindBuffer (GL_ARRAY_BUFFER_ARB, 0);
+	}
+	else
+		glVertexPointer (3, GL_FLOAT, 0, warp_xyz);
+	glTexCoordPointer (2, GL_FLOAT, 0, warp_st);
+	glEnableClientState (GL_VERTEX_ARRAY);
+	glEnableClientState (GL_TEXTURE_COORD_ARRAY);
+
+	if (scroll)
+	{
+		glMatrixMode (GL_TEXTURE);
+		glPushMatrix ();
+		glTranslatef (scroll, scroll, 0);
+	}
+
+	glDrawElements (GL_TRIANGLES, numindexes, GL_UNSIGNED_INT, warp_indexes);
+	c_draw_calls++;
+
+	if (scroll)
+	{
+		glPopMatrix ();
+		glMatrixMode (GL_MODELVIEW);
+	}
+
+	glDisableClientState (GL_VERTEX_ARRAY);
+	glDisableClientState (GL_TEXTURE_COORD_ARRAY);
+
+	if (resume)
+		R_BeginWorldArrays (resume);
+}
+
+/*
+=============
+R_WarpRefError
+
+Largest difference between st and the double precision warp of base,
+floor indexed; steps counts the lookups whose float index was a table
+entry off the exact one
+=============
+*/
+double R_WarpRefError (float *base, float *st, int count, float phase, int *steps)
+{
+	int		i, j, exact;
+	float	arg;
+	double	c, err, maxerr;
+
+	maxerr = 0;
+	for (i=0 ; i<count ; i++, base+=2, st+=2)
+	{
+		for (j=0 ; j<2 ; j++)
+		{
+			c = base[!j];
+			exact = (int)floor (c*0.125*TURBSCALE + phase) & 255;
+			arg = base[!j]*TURBARG;
+			arg += phase;
+			if (((int)arg & 255) != exact)
+				(*steps)++;
+			err = fabs (st[j] - (base[j] + turbsin[exact]) / 64);
+			if (err > maxerr)
+				maxerr = err;
+		}
+	}
+	return maxerr;
+}
+
+/*
+=============
+R_WarpBench_f
+
+Times the water and sky kernels over every warp vertex of the map,
+checks the C and SSE2 kernels agree exactly, and both against a double
+precision reference.  The float index may round onto the next table
+entry near a step, so the water tolerance is one table step.
+=============
+*/
+#define	BENCH_PHASES		16
+#define	BENCH_SKYTOLERANCE	0.0001
+
+void R_WarpBench_f (void)
+{
+	int		i, p, passes, steps, differ, skydiffer;
+	float	*c, *simd, phase, step, tolerance;
+	double	err, watererr, skyerr, dir[3], len, start;
+	double	cwater, csky, swater, ssky;
+	float	*xyz;
+
+	if (!cl.worldmodel)
+	{
+		Con_Printf ("No map loaded\n");
+		return;
+	}
+	if (!warp_numverts)
+	{
+		Con_Printf ("No warp surfaces\n");
+		return;
+	}
+
+	passes = 200;
+	if (Cmd_Argc () > 1)
+		passes = Q_atoi (Cmd_Argv (1));
+	if (passes < 1)
+		passes = 1;
+
+	c = malloc (warp_numverts*2*sizeof(float));
+	simd = malloc (warp_numverts*2*sizeof(float));
+
+	phase = R_WarpPhase (realtime);
+	start = Sys_ProfileTime ();
+	for (p=0 ; p<passes ; p++)
+		R_WarpWater_C (warp_base, c, warp_numverts, phase);
+	cwater = Sys_ProfileTime () - start;
+	start = Sys_ProfileTime ();
+	for (p=0 ; p<passes ; p++)
+		R_WarpSky_C (warp_xyz, c, warp_numverts, r_origin);
+	csky = Sys_ProfileTime () - start;
+	swater = ssky = 0;
+#if idSSE
+	if (Sys_HaveSSE2 ())
+	{
+		start = Sys_ProfileTime ();
+		for (p=0 ; p<passes ; p++)
+			R_WarpWater_SSE (warp_base, simd, warp_numverts, phase);
+		swater = Sys_ProfileTime () - start;
+		start = Sys_ProfileTime ();
+		for (p=0 ; p<passes ; p++)
+			R_WarpSky_SSE (warp_xyz, simd, warp_numverts, r_origin);
+		ssky = Sys_ProfileTime () - start;
+	}
+#endif
+
+	// water over phases spread across the period, off the table steps
+	differ = steps = 0;
+	watererr = 0;
+	for (p=0 ; p<BENCH_PHASES ; p++)
+	{
+		phase = R_WarpPhase ((p + 0.37) * (2*M_PI/BENCH_PHASES));
+		R_WarpWater_C (warp_base, c, warp_numverts, phase);
+#if idSSE
+		if (Sys_HaveSSE2 ())
+		{
+			R_WarpWater_SSE (warp_base, simd, warp_numverts, phase);
+			if (memcmp (c, simd, warp_numverts*2*sizeof(float)))
+				differ++;
+		}
+#endif
+		err = R_WarpRefError (warp_base, c, warp_numverts, phase, &steps);
+		if (err > watererr)
+			watererr = err;
+	}
+
+	// sky from the current view
+	skydiffer = 0;
+	R_WarpSky_C (warp_xyz, c, warp_numverts, r_origin);
+#if idSSE
+	if (Sys_HaveSSE2 ())
+	{
+		R_WarpSky_SSE (warp_xyz, simd, warp_numverts, r_origin);
+		for (i=0 ; i<warp_numverts*2 ; i++)
+			if (c[i] != simd[i])
+				skydiffer++;
+	}
+#endif
+	skyerr = 0;
+	for (i=0, xyz=warp_xyz ; i<warp_numverts ; i++, xyz+=3)
+	{
+		dir[0] = xyz[0] - r_origin[0];
+		dir[1] = xyz[1] - r_origin[1];
+		dir[2] = (xyz[2] - r_origin[2]) * 3;
+		len = sqrt (dir[0]*dir[0] + dir[1]*dir[1] + dir[2]*dir[2]);
+		if (!len)
+			continue;
+		err = fabs (c[i*2] - dir[0]*378/len/128);
+		if (err > skyerr)
+			skyerr = err;
+		err = fabs (c[i*2+1] - dir[1]*378/len/128);
+		if (err > skyerr)
+			skyerr = err;
+	}
+
+	free (c);
+	free (simd);
+
+	step = 0;
+	for (i=0 ; i<256 ; i++)
+		if (fabs (turbsin[(i+1)&255] - turbsin[i]) > step)
+			step = fabs (turbsin[(i+1)&255] - turbsin[i]);
+	tolerance = step/64 + 0.0001f;
+
+	Con_Printf ("%i warp vertexes, %i passes\n", warp_numverts, passes);
+	Con_Printf ("water: C %6.3f ms", cwater*1000/passes);
+#if idSSE
+	if (Sys_HaveSSE2 ())
+		Con_Printf ("  SSE2 %6.3f ms (%.1fx)", swater*1000/passes, cwater/swater);
+#endif
+	Con_Printf ("\n");
+	Con_Printf ("sky:   C %6.3f ms", csky*1000/passes);
+#if idSSE
+	if (Sys_HaveSSE2 ())
+		Con_Printf ("  SSE2 %6.3f ms (%.1fx)", ssky*1000/passes, csky/ssky);
+#endif
+	Con_Printf ("\n");
+#if idSSE
+	if (Sys_HaveSSE2 ())
+		Con_Printf ("C / SSE2: %i of %i water phases differ, %i sky values differ: %s\n",
+			differ, BENCH_PHASES, skydiffer, differ || skydiffer ? "FAILED" : "ok");
+#endif
+	Con_Printf ("water reference: %i lookups a step off, largest error %f, tolerance %f: %s\n",
+		steps, watererr, tolerance, watererr <= tolerance ? "ok" : "FAILED");
+	Con_Printf ("sky reference: largest error %f, tolerance %f: %s\n",
+		skyerr, BENCH_SKYTOLERANCE, skyerr <= BENCH_SKYTOLERANCE ? "ok" : "FAILED");
+}
+
 /*
 =============
 EmitWaterPolys
@@ -196,30 +753,50 @@ void EmitWaterPolys (msurface_t *fa)
 	glpoly_t	*p;
 	float		*v;
 	int			i;
-	float		s, t, os, ot;
+	float		phase;
+	float		st[2];
 
+	if (R_WarpArrays (fa))
+	{
+		R_DrawWarpArrays (R_WarpSurfaces (fa, false, false), 0);
+		return;
+	}
+
+	// the same lookup as the arrays, so negative coordinates floor here too
+	phase = R_WarpPhase (realtime);
 
 	for (p=fa->polys ; p ; p=p->next)
 	{
 		glBegin (GL_POLYGON);
 		for (i=0,v=p->verts[0] ; i<p->numverts ; i++, v+=VERTEXSIZE)
 		{
-			os = v[3];
-			ot = v[4];
-
-			s = os + turbsin[(int)((ot*0.125+realtime) * TURBSCALE) & 255];
-			s *= (1.0/64);
-
-			t = ot + turbsin[(int)((os*0.125+realtime) * TURBSCALE) & 255];
-			t *= (1.0/64);
-
-			glTexCoord2f (s, t);
+			R_WarpWater_C (v+3, st, 1, phase);
+			glTexCoord2fv (st);
 			glVertex3fv (v);
 		}
 		glEnd ();
 	}
 }
 
+/*
+=============
+EmitWaterChain
+
+Draws a texturechain of water surfaces that share a texture
+=============
+*/
+void EmitWaterChain (msurface_t *s)
+{
+	if (R_WarpArrays (s))
+	{
+		R_DrawWarpArrays (R_WarpSurfaces (s, true, false), 0);
+		return;
+	}
+
+	for ( ; s ; s=s->texturechain)
+		EmitWaterPolys (s);
+}
+
 
 
 
@@ -237,6 +814,12 @@ void EmitSkyPolys (msurface_t *fa)
 	vec3_t	dir;
 	float	length;
 
+	if (R_WarpArrays (fa))
+	{
+		R_DrawWarpArrays (R_WarpSurfaces (fa, false, true), speedscale * (1.0/128));
+		return;
+	}
+
 	for (p=fa->polys ; p ; p=p->next)
 	{
 		glBegin (GL_POLYGON);
@@ -264,37 +847,61 @@ void EmitSkyPolys (msurface_t *fa)
 
 /*
 ===============
-EmitBothSkyLayers
+EmitSkyLayers
 
-Does a sky warp on the pre-fragmented glpoly_t chain
-This will be called for brushmodels, the world
-will have them chained together.
+Both layers of the sky on fa, or its whole texturechain, warping the
+coordinates once for the two
 ===============
 */
-void EmitBothSkyLayers (msurface_t *fa)
+void EmitSkyLayers (msurface_t *fa, qboolean chain)
 {
-	int			i;
-	int			lindex;
-	float		*vec;
+	int			numindexes;
+	msurface_t	*s;
 
 	GL_DisableMultitexture();
 
+	numindexes = 0;
+	if (R_WarpArrays (fa))
+		numindexes = R_WarpSurfaces (fa, chain, true);
+
 	GL_Bind (solidskytexture);
 	speedscale = realtime*8;
 	speedscale -= (int)speedscale & ~127 ;
 
-	EmitSkyPolys (fa);
+	if (numindexes)
+		R_DrawWarpArrays (numindexes, speedscale * (1.0/128));
+	else
+		for (s=fa ; s ; s = chain ? s->texturechain : NULL)
+			EmitSkyPolys (s);
 
 	glEnable (GL_BLEND);
 	GL_Bind (alphaskytexture);
 	speedscale = realtime*16;
 	speedscale -= (int)speedscale & ~127 ;
 
-	EmitSkyPolys (fa);
+	if (numindexes)
+		R_DrawWarpArrays (numindexes, speedscale * (1.0/128));
+	else
+		for (s=fa ; s ; s = chain ? s->texturechain : NULL)
+			EmitSkyPolys (s);
 
 	glDisable (GL_BLEND);
 }
 
+/*
+===============
+EmitBothSkyLayers
+
+Does a sky warp on the pre-fragmented glpoly_t chain
+This will be called for brushmodels, the world
+will have them chained together.
+===============
+*/
+void EmitBothSkyLayers (msurface_t *fa)
+{
+	EmitSkyLayers (fa, false);
+}
+
 #ifndef QUAKE2
 /*
 =================
@@ -303,27 +910,8 @@ R_DrawSkyChain
 */
 void R_DrawSkyChain (msurface_t *s)
 {
-	msurface_t	*fa;
-
-	GL_DisableMultitexture();
-
 	// used when gl_texsort is on
-	GL_Bind(solidskytexture);
-	speedscale = realtime*8;
-	speedscale -= (int)speedscale & ~127 ;
-
-	for (fa=s ; fa ; fa=fa->texturechain)
-		EmitSkyPolys (fa);
-
-	glEnable (GL_BLEND);
-	GL_Bind (alphaskytexture);
-	speedscale = realtime*16;
-	speedscale -= (int)speedscale & ~127 ;
-
-	for (fa=s ; fa ; fa=fa->texturechain)
-		EmitSkyPolys (fa);
-
-	glDisable (GL_BLEND);
+	EmitSkyLayers (s, true);
 }
 
 #endif
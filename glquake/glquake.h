@@ -27,6 +27,7 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include <windows.h>
 #endif
 
+#include <stddef.h>
 #include <GL/gl.h>
 #include <GL/glu.h>
 
@@ -60,6 +61,11 @@ void GL_Upload32 (unsigned *data, int width, int height,  qboolean mipmap, qbool
 void GL_Upload8 (byte *data, int width, int height,  qboolean mipmap, qboolean alpha);
 int GL_LoadTexture (char *identifier, int width, int height, byte *data, qboolean mipmap, qboolean alpha);
 int GL_FindTexture (char *identifier);
+void GL_BeginTextureBatch (void);
+void GL_EndTextureBatch (void);
+
+extern	double	load_models, load_texconvert, load_texupload;	// map load stages, seconds
+extern	int		load_textures, load_texcached;
 
 typedef struct
 {
@@ -97,6 +103,13 @@ extern	PROC glVertexPointerEXT;
 
 void R_TimeRefresh_f (void);
 void R_ReadPointFile_f (void);
+void R_LightBench_f (void);
+void R_AliasBench_f (void);
+void R_VisBench_f (void);
+void R_PartBench_f (void);
+void R_WarpBench_f (void);
+void R_FlushVisCache (void);
+void R_MarkLeaves (void);
 texture_t *R_TextureAnimation (texture_t *base);
 
 typedef struct surfcache_s
@@ -132,20 +145,20 @@ typedef enum {
 	pt_static, pt_grav, pt_slowgrav, pt_fire, pt_explode, pt_explode2, pt_blob, pt_blob2
 } ptype_t;
 
-// !!! if this is changed, it must be changed in d_ifacea.h too !!!
+// a particle being spawned, see r_part.c for how live ones are stored
 typedef struct particle_s
 {
-// driver-usable fields
 	vec3_t		org;
 	float		color;
-// drivers never touch the following fields
-	struct particle_s	*next;
 	vec3_t		vel;
 	float		ramp;
 	float		die;
 	ptype_t		type;
 } particle_t;
 
+particle_t *R_NewParticle (void);
+void R_FlushNewParticles (void);
+
 
 //====================================================
 
@@ -158,6 +171,33 @@ extern	int			r_visframecount;	// ??? what difs?
 extern	int			r_framecount;
 extern	mplane_t	frustum[4];
 extern	int		c_brush_polys, c_alias_polys;
+extern	int		c_lightmap_texels, c_lightmap_bytes, c_lightmap_uploads;
+extern	int		c_draw_calls;
+extern	int		c_boxes_culled, c_boxes_accepted;
+extern	int		c_brush_merged, c_brush_drawn;
+extern	int		draw_lastdraws, draw_lastquads;	// 2D batches of the last frame
+
+//
+// boxes for R_CullBoxes, one array per axis so four can be tested at once
+//
+typedef struct
+{
+	int		numboxes;
+	float	*mins[3];
+	float	*maxs[3];
+} cullboxes_t;
+
+int R_CullBoxes (cullboxes_t *b, byte *culled);
+extern	qboolean	r_entaccepted;
+
+//
+// brush and warp vertex arrays
+//
+void R_BeginWorldArrays (int texcoords);
+int R_SuspendWorldArrays (void);
+void GL_BuildWarpArrays (void);
+void R_SelectWarpKernels (void);
+void EmitWaterChain (msurface_t *s);
 
 
 //
@@ -197,6 +237,9 @@ extern	cvar_t	r_mirroralpha;
 extern	cvar_t	r_wateralpha;
 extern	cvar_t	r_dynamic;
 extern	cvar_t	r_novis;
+extern	cvar_t	r_viscache;
+extern	cvar_t	r_viscachesize;
+extern	cvar_t	r_simd;
 
 extern	cvar_t	gl_clear;
 extern	cvar_t	gl_cull;
@@ -210,12 +253,17 @@ extern	cvar_t	gl_reporttjunctions;
 extern	cvar_t	gl_flashblend;
 extern	cvar_t	gl_nocolors;
 extern	cvar_t	gl_doubleeyes;
+extern	cvar_t	gl_lightmap_pbo;
+extern	cvar_t	gl_vertexbuffers;
+extern	cvar_t	r_lerpmodels;
+extern	cvar_t	r_mergebrushes;
 
 extern	int		gl_lightmap_format;
 extern	int		gl_solid_format;
 extern	int		gl_alpha_format;
 
 extern	cvar_t	gl_max_size;
+extern	cvar_t	gl_texturecache;
 extern	cvar_t	gl_playermip;
 
 extern	int			mirrortexturenum;	// quake texturenum, not gltexturenum
@@ -247,5 +295,67 @@ extern lpSelTexFUNC qglSelectTextureSGIS;
 
 extern qboolean gl_mtexable;
 
+// Buffer objects, for streaming texture data and holding static geometry
+#ifndef GL_ARRAY_BUFFER_ARB
+#define GL_ARRAY_BUFFER_ARB				0x8892
+#define GL_ELEMENT_ARRAY_BUFFER_ARB		0x8893
+#define GL_STREAM_DRAW_ARB				0x88E0
+#define GL_STATIC_DRAW_ARB				0x88E4
+#define GL_DYNAMIC_DRAW_ARB				0x88E8
+#endif
+#ifndef GL_PIXEL_UNPACK_BUFFER_ARB
+#define GL_PIXEL_UNPACK_BUFFER_ARB		0x88EC
+#endif
+#ifndef GL_MAP_WRITE_BIT
+#define GL_MAP_WRITE_BIT				0x0002
+#define GL_MAP_INVALIDATE_BUFFER_BIT	0x0008
+#define GL_MAP_UNSYNCHRONIZED_BIT		0x0020
+#endif
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT			0x0040
+#define GL_MAP_COHERENT_BIT				0x0080
+#endif
+#ifndef GL_SYNC_GPU_COMMANDS_COMPLETE
+#define GL_SYNC_GPU_COMMANDS_COMPLETE	0x9117
+#define GL_SYNC_FLUSH_COMMANDS_BIT		0x00000001
+#define GL_TIMEOUT_EXPIRED				0x911B
+#define GL_WAIT_FAILED					0x911D
+typedef struct __GLsync *GLsync;
+#endif
+
+#ifdef _WIN32
+typedef unsigned __int64	qgluint64;
+#else
+typedef unsigned long long	qgluint64;
+#endif
+
+typedef void (APIENTRY *lpGenBuffersFUNC) (GLsizei, GLuint *);
+typedef void (APIENTRY *lpDeleteBuffersFUNC) (GLsizei, const GLuint *);
+typedef void (APIENTRY *lpBindBufferFUNC) (GLenum, GLuint);
+typedef void (APIENTRY *lpBufferDataFUNC) (GLenum, ptrdiff_t, const void *, GLenum);
+typedef void (APIENTRY *lpBufferSubDataFUNC) (GLenum, ptrdiff_t, ptrdiff_t, const void *);
+typedef void *(APIENTRY *lpMapBufferRangeFUNC) (GLenum, ptrdiff_t, ptrdiff_t, GLbitfield);
+typedef GLboolean (APIENTRY *lpUnmapBufferFUNC) (GLenum);
+typedef void (APIENTRY *lpBufferStorageFUNC) (GLenum, ptrdiff_t, const void *, GLbitfield);
+typedef GLsync (APIENTRY *lpFenceSyncFUNC) (GLenum, GLbitfield);
+typedef GLenum (APIENTRY *lpClientWaitSyncFUNC) (GLsync, GLbitfield, qgluint64);
+typedef void (APIENTRY *lpDeleteSyncFUNC) (GLsync);
+
+extern lpGenBuffersFUNC qglGenBuffers;
+extern lpDeleteBuffersFUNC qglDeleteBuffers;
+extern lpBindBufferFUNC qglBindBuffer;
+extern lpBufferDataFUNC qglBufferData;
+extern lpBufferSubDataFUNC qglBufferSubData;
+extern lpMapBufferRangeFUNC qglMapBufferRange;
+extern lpUnmapBufferFUNC qglUnmapBuffer;
+extern lpBufferStorageFUNC qglBufferStorage;
+extern lpFenceSyncFUNC qglFenceSync;
+extern lpClientWaitSyncFUNC qglClientWaitSync;
+extern lpDeleteSyncFUNC qglDeleteSync;
+
+extern qboolean gl_vbo;				// ARB_vertex_buffer_object
+extern qboolean gl_pbo;				// and ARB_pixel_buffer_object
+extern qboolean gl_persistent;		// and ARB_buffer_storage, ARB_sync
+
 void GL_DisableMultitexture(void);
 void GL_EnableMultitexture(void);
@@ -458,6 +458,8 @@ void Host_ShutdownServer(qboolean crash)
 		if (host_client->active)
 			SV_DropClient(crash);
 
+	SV_MVDStop ();
+
 //
 // clear structures
 //
@@ -687,6 +689,14 @@ void _Host_Frame (float time)
 
 	host_time += host_frametime;
 
+// a benchmark steps the client itself and never draws
+	if (cls.benchmark)
+	{
+		CL_BenchmarkFrame ();
+		host_framecount++;
+		return;
+	}
+
 // fetch results from server
 	if (cls.state == ca_connected)
 	{
@@ -865,6 +875,7 @@ void Host_Init (quakeparms_t *parms)
 	M_Init ();	
 	PR_Init ();
 	Mod_Init ();
+	Job_Init ();
 	NET_Init ();
 	SV_Init ();
 
@@ -945,10 +956,12 @@ void Host_Shutdown(void)
 
 	Host_WriteConfiguration (); 
 
+	SV_MVDStop ();
 	CDAudio_Shutdown ();
 	NET_Shutdown ();
 	S_Shutdown();
 	IN_Shutdown ();
+	Job_Shutdown ();
 
 	if (cls.state != ca_dedicated)
 	{
@@ -99,6 +99,7 @@ void Host_Status_f (void)
 			hours = 0;
 		print ("#%-2u %-16.16s  %3i  %2i:%02i:%02i\n", j+1, client->name, (int)client->edict->v.frags, hours, minutes, seconds);
 		print ("   %s\n", client->netconnection->address);
+		print ("   rate %i  choked %i  dropped %i\n", client->rate ? client->rate : (int)sv_rate.value, client->num_choked, client->num_dropped);
 	}
 }
 
@@ -945,6 +946,37 @@ void Host_Name_f (void)
 	MSG_WriteString (&sv.reliable_datagram, host_client->name);
 }
 
+/*
+======================
+Host_Rate_f
+======================
+*/
+void Host_Rate_f (void)
+{
+	int		rate;
+
+	if (Cmd_Argc () == 1)
+	{
+		Con_Printf ("\"rate\" is \"%s\"\n", cl_rate.string);
+		return;
+	}
+	rate = Q_atoi(Cmd_Argv(1));
+	if (rate < 0)
+		rate = 0;
+
+	if (cmd_source == src_command)
+	{
+		Cvar_SetValue ("_cl_rate", rate);
+		if (cls.state == ca_connected)
+			Cmd_ForwardToServer ();
+		return;
+	}
+
+	if (rate && rate < 1000)
+		rate = 1000;
+	host_client->rate = rate;
+}
+
 	
 void Host_Version_f (void)
 {
@@ -1279,7 +1311,6 @@ Host_Spawn_f
 void Host_Spawn_f (void)
 {
 	int		i;
-	client_t	*client;
 	edict_t	*ent;
 
 	if (cmd_source == src_command)
@@ -1335,47 +1366,8 @@ void Host_Spawn_f (void)
 	MSG_WriteByte (&host_client->message, svc_time);
 	MSG_WriteFloat (&host_client->message, sv.time);
 
-	for (i=0, client = svs.clients ; i<svs.maxclients ; i++, client++)
-	{
-		MSG_WriteByte (&host_client->message, svc_updatename);
-		MSG_WriteByte (&host_client->message, i);
-		MSG_WriteString (&host_client->message, client->name);
-		MSG_WriteByte (&host_client->message, svc_updatefrags);
-		MSG_WriteByte (&host_client->message, i);
-		MSG_WriteShort (&host_client->message, client->old_frags);
-		MSG_WriteByte (&host_client->message, svc_updatecolors);
-		MSG_WriteByte (&host_client->message, i);
-		MSG_WriteByte (&host_client->message, client->colors);
-	}
-	
-// send all current light styles
-	for (i=0 ; i<MAX_LIGHTSTYLES ; i++)
-	{
-		MSG_WriteByte (&host_client->message, svc_lightstyle);
-		MSG_WriteByte (&host_client->message, (char)i);
-		MSG_WriteString (&host_client->message, sv.lightstyles[i]);
-	}
-
-//
-// send some stats
-//
-	MSG_WriteByte (&host_client->message, svc_updatestat);
-	MSG_WriteByte (&host_client->message, STAT_TOTALSECRETS);
-	MSG_WriteLong (&host_client->message, pr_global_struct->total_secrets);
+	SV_WriteSpawnState (&host_client->message);
 
-	MSG_WriteByte (&host_client->message, svc_updatestat);
-	MSG_WriteByte (&host_client->message, STAT_TOTALMONSTERS);
-	MSG_WriteLong (&host_client->message, pr_global_struct->total_monsters);
-
-	MSG_WriteByte (&host_client->message, svc_updatestat);
-	MSG_WriteByte (&host_client->message, STAT_SECRETS);
-	MSG_WriteLong (&host_client->message, pr_global_struct->found_secrets);
-
-	MSG_WriteByte (&host_client->message, svc_updatestat);
-	MSG_WriteByte (&host_client->message, STAT_MONSTERS);
-	MSG_WriteLong (&host_client->message, pr_global_struct->killed_monsters);
-
-	
 //
 // send a fixangle
 // Never send a roll angle, because savegames can catch the server
@@ -1385,8 +1377,8 @@ void Host_Spawn_f (void)
 	ent = EDICT_NUM( 1 + (host_client - svs.clients) );
 	MSG_WriteByte (&host_client->message, svc_setangle);
 	for (i=0 ; i < 2 ; i++)
-		MSG_WriteAngle (&host_client->message, ent->v.angles[i] );
-	MSG_WriteAngle (&host_client->message, 0 );
+		MSG_WriteAngle (&host_client->message, ent->v.angles[i], sv.protocol);
+	MSG_WriteAngle (&host_client->message, 0, sv.protocol);
 
 	SV_WriteClientdataToMessage (sv_player, &host_client->message);
 
@@ -1892,6 +1884,7 @@ void Host_InitCommands (void)
 	Cmd_AddCommand ("connect", Host_Connect_f);
 	Cmd_AddCommand ("reconnect", Host_Reconnect_f);
 	Cmd_AddCommand ("name", Host_Name_f);
+	Cmd_AddCommand ("rate", Host_Rate_f);
 	Cmd_AddCommand ("noclip", Host_Noclip_f);
 	Cmd_AddCommand ("version", Host_Version_f);
 #ifdef IDGODS
@@ -0,0 +1,225 @@
+/*
+Copyright (C) 1996-1997 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// job.c -- worker threads
+
+#include "quakedef.h"
+
+/*
+Work is handed out one index at a time under a mutex, which is plenty
+for the few hundred items a caller passes.  The workers are started the
+first time they are needed and sleep on their own event between runs;
+the last index to finish wakes the caller.
+*/
+
+typedef struct
+{
+	void	*handle;
+	void	*wake;
+	int		num;
+} jobworker_t;
+
+cvar_t	job_threads = {"job_threads", "0", true};	// 0 = one per processor
+
+static jobworker_t	job_workers[MAX_JOB_THREADS];	// 0 is the caller
+static int			job_numworkers;		// started, including the caller
+static void			*job_lock;
+static void			*job_done;
+static volatile qboolean	job_quit;
+
+static jobfunc_t	job_func;
+static void			*job_data;
+static int			job_count;
+static int			job_next;
+static int			job_remaining;
+
+/*
+================
+Job_Work
+
+Runs indexes until there are none left to start
+================
+*/
+static void Job_Work (int thread)
+{
+	int			index;
+	jobfunc_t	func;
+	void		*data;
+	qboolean	last;
+
+	while (1)
+	{
+		Sys_LockMutex (job_lock);
+		if (job_next >= job_count)
+		{
+			Sys_UnlockMutex (job_lock);
+			return;
+		}
+		index = job_next++;
+		func = job_func;
+		data = job_data;
+		Sys_UnlockMutex (job_lock);
+
+		func (data, index, thread);
+
+		Sys_LockMutex (job_lock);
+		last = (--job_remaining == 0);
+		Sys_UnlockMutex (job_lock);
+		if (last)
+			Sys_SignalEvent (job_done);
+	}
+}
+
+/*
+================
+Job_Worker
+================
+*/
+static int Job_Worker (void *parm)
+{
+	jobworker_t	*w;
+
+	w = parm;
+	while (!job_quit)
+	{
+		if (!Sys_WaitEvent (w->wake, 100))
+			continue;
+		if (job_quit)
+			break;
+		Job_Work (w->num);
+	}
+	return 0;
+}
+
+/*
+================
+Job_Threads
+================
+*/
+int Job_Threads (void)
+{
+	int		threads;
+
+	threads = (int)job_threads.value;
+	if (threads <= 0)
+		threads = Sys_NumProcessors ();
+	if (threads > MAX_JOB_THREADS)
+		threads = MAX_JOB_THREADS;
+	if (threads < 1)
+		threads = 1;
+	return threads;
+}
+
+/*
+================
+Job_Run
+================
+*/
+void Job_Run (jobfunc_t func, void *data, int count)
+{
+	int			i, threads;
+	qboolean	busy;
+
+	if (count <= 0)
+		return;
+
+	threads = Job_Threads ();
+	if (threads > count)
+		threads = count;
+	if (threads == 1 || !job_lock)
+	{
+		for (i=0 ; i<count ; i++)
+			func (data, i, 0);
+		return;
+	}
+
+	while (job_numworkers < threads)
+	{
+		jobworker_t	*w;
+
+		w = &job_workers[job_numworkers];
+		w->num = job_numworkers;
+		w->wake = Sys_CreateEvent ();
+		w->handle = Sys_CreateThread (Job_Worker, w);
+		job_numworkers++;
+	}
+
+	Sys_LockMutex (job_lock);
+	job_func = func;
+	job_data = data;
+	job_count = count;
+	job_next = 0;
+	job_remaining = count;
+	Sys_UnlockMutex (job_lock);
+
+	for (i=1 ; i<threads ; i++)
+		Sys_SignalEvent (job_workers[i].wake);
+
+	Job_Work (0);
+
+	do
+	{
+		Sys_LockMutex (job_lock);
+		busy = job_remaining > 0;
+		Sys_UnlockMutex (job_lock);
+		if (busy)
+			Sys_WaitEvent (job_done, 100);
+	} while (busy);
+}
+
+/*
+================
+Job_Init
+================
+*/
+void Job_Init (void)
+{
+	Cvar_RegisterVariable (&job_threads);
+
+	job_lock = Sys_CreateMutex ();
+	job_done = Sys_CreateEvent ();
+	job_numworkers = 1;
+}
+
+/*
+================
+Job_Shutdown
+================
+*/
+void Job_Shutdown (void)
+{
+	int		i;
+
+	if (!job_lock)
+		return;
+
+	job_quit = true;
+	Sys_MemoryBarrier ();
+	for (i=1 ; i<job_numworkers ; i++)
+	{
+		Sys_SignalEvent (job_workers[i].wake);
+		Sys_WaitThread (job_workers[i].handle);
+		Sys_DestroyEvent (job_workers[i].wake);
+	}
+	job_numworkers = 0;
+
+	Sys_DestroyEvent (job_done);
+	Sys_DestroyMutex (job_lock);
+	job_lock = NULL;
+}
@@ -0,0 +1,37 @@
+/*
+Copyright (C) 1996-1997 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// job.h -- a pool of worker threads for data-parallel loops
+
+#define	MAX_JOB_THREADS		16		// including the thread calling Job_Run
+
+typedef void (*jobfunc_t) (void *data, int index, int thread);
+
+extern	cvar_t	job_threads;
+
+void Job_Init (void);
+void Job_Shutdown (void);
+
+void Job_Run (jobfunc_t func, void *data, int count);
+// calls func for every index below count, spread over the workers and the
+// calling thread, and returns when all have finished.  thread is 0 for the
+// caller and 1 up for workers, so callers can keep per-thread scratch space.
+
+int Job_Threads (void);
+// how many threads Job_Run will use, from job_threads or the processor count
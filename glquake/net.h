@@ -28,10 +28,14 @@ struct qsockaddr
 
 #define	NET_NAMELEN			64
 
-#define NET_MAXMESSAGE		8192
+#define NET_MAXMESSAGE		32768
 #define NET_HEADERSIZE		(2 * sizeof(unsigned int))
 #define NET_DATAGRAMSIZE	(MAX_DATAGRAM + NET_HEADERSIZE)
 
+// reliable messages are split into packets no larger than the stock
+// client's datagram buffer, whatever protocol the game layer runs
+#define NET_MAXFRAGMENT		NQ_MAX_DATAGRAM
+
 // NetHeader flags
 #define NETFLAG_LENGTH_MASK	0x0000ffff
 #define NETFLAG_DATA		0x00010000
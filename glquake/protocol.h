@@ -21,6 +21,12 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #define	PROTOCOL_VERSION	15
 
+// extended variant, chosen by the server with sv_protocol and announced in
+// svc_serverinfo: 24 bit (16.8 fixed point) coords, 16 bit angles, short
+// model / sound indexes, a separate short entity number in svc_sound, and
+// the larger MAX_EDICTS / MAX_MODELS / MAX_SOUNDS / MAX_DATAGRAM limits
+#define	PROTOCOL_EXTENDED	1015
+
 // if the high bit of the servercmd is set, the low bits are fast update flags:
 #define	U_MOREBITS	(1<<0)
 #define	U_ORIGIN1	(1<<1)
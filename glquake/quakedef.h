@@ -67,6 +67,14 @@ void	VID_UnlockBuffer (void);
 #define id386	0
 #endif
 
+// SSE2 kernels are compiled wherever the intrinsics are available and
+// still check Sys_HaveSSE2 before they are used
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define idSSE	1
+#else
+#define idSSE	0
+#endif
+
 #if id386
 #define UNALIGNED_OK	1	// set to 0 if unaligned accesses are not supported
 #else
@@ -98,16 +106,27 @@ void	VID_UnlockBuffer (void);
 
 #define	ON_EPSILON		0.1			// point on plane side epsilon
 
-#define	MAX_MSGLEN		8000		// max length of a reliable message
-#define	MAX_DATAGRAM	1024		// max length of unreliable message
+#define	MAX_MSGLEN		32000		// max length of a reliable message
+#define	MAX_DATAGRAM	1400		// max length of unreliable message
 
 //
 // per-level limits
 //
-#define	MAX_EDICTS		600			// FIXME: ouch! ouch! ouch!
+#define	MAX_EDICTS		8192
 #define	MAX_LIGHTSTYLES	64
-#define	MAX_MODELS		256			// these are sent over the net as bytes
-#define	MAX_SOUNDS		256			// so they cannot be blindly increased
+#define	MAX_MODELS		1024		// only PROTOCOL_EXTENDED sends these as shorts
+#define	MAX_SOUNDS		1024
+
+//
+// what stock clients size their buffers by, so PROTOCOL_VERSION
+// servers must stay within these
+//
+#define	NQ_MAX_MSGLEN		8000
+#define	NQ_MAX_DATAGRAM		1024
+#define	NQ_MAX_EDICTS		600
+#define	NQ_MAX_MODELS		256
+#define	NQ_MAX_SOUNDS		256
+#define	NQ_MAX_SIGNON		8192		// the stock server's signon buffer
 
 #define	SAVEGAME_COMMENT_LENGTH	39
 
@@ -256,6 +275,7 @@ typedef struct
 #include "view.h"
 #include "menu.h"
 #include "crc.h"
+#include "job.h"
 #include "cdaudio.h"
 
 #ifdef GLQUAKE
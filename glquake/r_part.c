@@ -21,19 +21,42 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "quakedef.h"
 #include "r_local.h"
 
-#define MAX_PARTICLES			2048	// default max # of particles at one
+#if idSSE
+#include <emmintrin.h>
+#endif
+
+#define MAX_PARTICLES			65536	// default max # of particles at one
 										//  time
 #define ABSOLUTE_MIN_PARTICLES	512		// no fewer than this no matter what's
 										//  on the command line
+#define	MAX_NEW_PARTICLES		1024	// spawned since the last update
 
 int		ramp1[8] = {0x6f, 0x6d, 0x6b, 0x69, 0x67, 0x65, 0x63, 0x61};
 int		ramp2[8] = {0x6f, 0x6e, 0x6d, 0x6c, 0x6b, 0x6a, 0x68, 0x66};
 int		ramp3[8] = {0x6d, 0x6b, 6, 5, 4, 3};
 
-particle_t	*active_particles, *free_particles;
-
-particle_t	*particles;
-int			r_numparticles;
+//
+// Live particles are kept packed at the front of structure of arrays
+// storage, so the physics runs four at a time down each array.  A dead
+// particle is replaced by the last one.  New particles are built in
+// newparticles and moved in at the next update.
+//
+int			r_numparticles;			// capacity
+int			numparticles;			// live
+float		*part_org[3], *part_vel[3];
+float		*part_ramp, *part_die;
+byte		*part_color, *part_type;
+
+particle_t	newparticles[MAX_NEW_PARTICLES];
+int			numnewparticles;
+
+// drawn a batch of triangles at a time; the texture coordinates
+// never change
+#define	PARTICLE_BATCH	4096
+
+float		partverts[PARTICLE_BATCH*3][3];
+float		parttexcoords[PARTICLE_BATCH*3][2];
+unsigned	partcolors[PARTICLE_BATCH*3];
 
 vec3_t			r_pright, r_pup, r_ppn;
 
@@ -46,6 +69,7 @@ R_InitParticles
 void R_InitParticles (void)
 {
 	int		i;
+	float	*f;
 
 	i = COM_CheckParm ("-particles");
 
@@ -59,9 +83,75 @@ void R_InitParticles (void)
 	{
 		r_numparticles = MAX_PARTICLES;
 	}
+	r_numparticles = (r_numparticles + 3) & ~3;
 
-	particles = (particle_t *)
-			Hunk_AllocName (r_numparticles * sizeof(particle_t), "particles");
+	f = calloc (r_numparticles, 8*sizeof(float) + 2);
+	if (!f)
+		Sys_Error ("R_InitParticles: couldn't allocate %i particles", r_numparticles);
+	for (i=0 ; i<3 ; i++)
+	{
+		part_org[i] = f + i*r_numparticles;
+		part_vel[i] = f + (3+i)*r_numparticles;
+	}
+	part_ramp = f + 6*r_numparticles;
+	part_die = f + 7*r_numparticles;
+	part_color = (byte *)(f + 8*r_numparticles);
+	part_type = part_color + r_numparticles;
+
+	for (i=0 ; i<PARTICLE_BATCH ; i++)
+	{
+		parttexcoords[i*3+1][0] = 1;
+		parttexcoords[i*3+2][1] = 1;
+	}
+}
+
+/*
+===============
+R_NewParticle
+
+Returns a cleared particle to fill in, or NULL if there is no room
+===============
+*/
+particle_t *R_NewParticle (void)
+{
+	particle_t	*p;
+
+	if (numnewparticles == MAX_NEW_PARTICLES)
+		R_FlushNewParticles ();
+	if (numparticles + numnewparticles >= r_numparticles)
+		return NULL;
+
+	p = &newparticles[numnewparticles++];
+	memset (p, 0, sizeof(*p));
+	return p;
+}
+
+/*
+===============
+R_FlushNewParticles
+
+Moves the particles spawned since the last update into the arrays
+===============
+*/
+void R_FlushNewParticles (void)
+{
+	int			i, j, n;
+	particle_t	*p;
+
+	for (i=0, p=newparticles ; i<numnewparticles ; i++, p++)
+	{
+		n = numparticles++;
+		for (j=0 ; j<3 ; j++)
+		{
+			part_org[j][n] = p->org[j];
+			part_vel[j][n] = p->vel[j];
+		}
+		part_ramp[n] = p->ramp;
+		part_die[n] = p->die;
+		part_color[n] = (int)p->color;
+		part_type[n] = p->type;
+	}
+	numnewparticles = 0;
 }
 
 #ifdef QUAKE2
@@ -80,12 +170,8 @@ void R_DarkFieldParticles (entity_t *ent)
 		for (j=-16 ; j<16 ; j+=8)
 			for (k=0 ; k<32 ; k+=8)
 			{
-				if (!free_particles)
+				if (!(p = R_NewParticle ()))
 					return;
-				p = free_particles;
-				free_particles = p->next;
-				p->next = active_particles;
-				active_particles = p;
 		
 				p->die = cl.time + 0.2 + (rand()&7) * 0.02;
 				p->color = 150 + rand()%6;
@@ -157,12 +243,8 @@ avelocities[0][i] = (rand()&255) * 0.01;
 		forward[1] = cp*sy;
 		forward[2] = -sp;
 
-		if (!free_particles)
+		if (!(p = R_NewParticle ()))
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 
 		p->die = cl.time + 0.01;
 		p->color = 0x6f;
@@ -182,14 +264,8 @@ R_ClearParticles
 */
 void R_ClearParticles (void)
 {
-	int		i;
-	
-	free_particles = &particles[0];
-	active_particles = NULL;
-
-	for (i=0 ;i<r_numparticles ; i++)
-		particles[i].next = &particles[i+1];
-	particles[r_numparticles-1].next = NULL;
+	numparticles = 0;
+	numnewparticles = 0;
 }
 
 
@@ -220,15 +296,11 @@ void R_ReadPointFile_f (void)
 			break;
 		c++;
 		
-		if (!free_particles)
+		if (!(p = R_NewParticle ()))
 		{
 			Con_Printf ("Not enough free particles\n");
 			break;
 		}
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 		
 		p->die = 99999;
 		p->color = (-c)&15;
@@ -254,7 +326,7 @@ void R_ParseParticleEffect (void)
 	int			i, count, msgcount, color;
 	
 	for (i=0 ; i<3 ; i++)
-		org[i] = MSG_ReadCoord ();
+		org[i] = MSG_ReadCoord (cl.protocol);
 	for (i=0 ; i<3 ; i++)
 		dir[i] = MSG_ReadChar () * (1.0/16);
 	msgcount = MSG_ReadByte ();
@@ -281,12 +353,8 @@ void R_ParticleExplosion (vec3_t org)
 	
 	for (i=0 ; i<1024 ; i++)
 	{
-		if (!free_particles)
+		if (!(p = R_NewParticle ()))
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 
 		p->die = cl.time + 5;
 		p->color = ramp1[0];
@@ -326,12 +394,8 @@ void R_ParticleExplosion2 (vec3_t org, int colorStart, int colorLength)
 
 	for (i=0; i<512; i++)
 	{
-		if (!free_particles)
+		if (!(p = R_NewParticle ()))
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 
 		p->die = cl.time + 0.3;
 		p->color = colorStart + (colorMod % colorLength);
@@ -359,12 +423,8 @@ void R_BlobExplosion (vec3_t org)
 	
 	for (i=0 ; i<1024 ; i++)
 	{
-		if (!free_particles)
+		if (!(p = R_NewParticle ()))
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 
 		p->die = cl.time + 1 + (rand()&8)*0.05;
 
@@ -404,12 +464,8 @@ void R_RunParticleEffect (vec3_t org, vec3_t dir, int color, int count)
 	
 	for (i=0 ; i<count ; i++)
 	{
-		if (!free_particles)
+		if (!(p = R_NewParticle ()))
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 
 		if (count == 1024)
 		{	// rocket explosion
@@ -467,12 +523,8 @@ void R_LavaSplash (vec3_t org)
 		for (j=-16 ; j<16 ; j++)
 			for (k=0 ; k<1 ; k++)
 			{
-				if (!free_particles)
+				if (!(p = R_NewParticle ()))
 					return;
-				p = free_particles;
-				free_particles = p->next;
-				p->next = active_particles;
-				active_particles = p;
 		
 				p->die = cl.time + 2 + (rand()&31) * 0.02;
 				p->color = 224 + (rand()&7);
@@ -509,12 +561,8 @@ void R_TeleportSplash (vec3_t org)
 		for (j=-16 ; j<16 ; j+=4)
 			for (k=-24 ; k<32 ; k+=4)
 			{
-				if (!free_particles)
+				if (!(p = R_NewParticle ()))
 					return;
-				p = free_particles;
-				free_particles = p->next;
-				p->next = active_particles;
-				active_particles = p;
 		
 				p->die = cl.time + 0.2 + (rand()&7) * 0.02;
 				p->color = 7 + (rand()&7);
@@ -557,12 +605,8 @@ void R_RocketTrail (vec3_t start, vec3_t end, int type)
 	{
 		len -= dec;
 
-		if (!free_particles)
+		if (!(p = R_NewParticle ()))
 			return;
-		p = free_particles;
-		free_particles = p->next;
-		p->next = active_particles;
-		active_particles = p;
 		
 		VectorCopy (vec3_origin, p->vel);
 		p->die = cl.time + 2;
@@ -639,162 +683,395 @@ void R_RocketTrail (vec3_t start, vec3_t end, int type)
 }
 
 
+extern	cvar_t	sv_gravity;
+
+//
+// what a frame of physics does to each type: the x and y velocity are
+// scaled by kxy, z velocity by kz and then dz is added, and ramp moves
+// by dramp
+//
+typedef struct
+{
+	float	kxy[8], kz[8], dz[8], dramp[8];
+} partphysics_t;
+
+typedef void (*partkernel_t) (int count, float frametime, partphysics_t *phys);
+
+partkernel_t	R_ParticlePhysics;
+
 /*
 ===============
-R_DrawParticles
+R_ParticlePhysics_C
 ===============
 */
-extern	cvar_t	sv_gravity;
+void R_ParticlePhysics_C (int count, float frametime, partphysics_t *phys)
+{
+	int		i, t;
 
-void R_DrawParticles (void)
+	for (i=0 ; i<count ; i++)
+	{
+		part_org[0][i] += part_vel[0][i]*frametime;
+		part_org[1][i] += part_vel[1][i]*frametime;
+		part_org[2][i] += part_vel[2][i]*frametime;
+
+		t = part_type[i];
+		part_vel[0][i] *= phys->kxy[t];
+		part_vel[1][i] *= phys->kxy[t];
+		part_vel[2][i] = part_vel[2][i]*phys->kz[t] + phys->dz[t];
+		part_ramp[i] += phys->dramp[t];
+	}
+}
+
+#if idSSE
+
+/*
+===============
+R_ParticlePhysics_SSE
+
+The capacity is a multiple of four, so the last group can run past
+count into unused slots
+===============
+*/
+void R_ParticlePhysics_SSE (int count, float frametime, partphysics_t *phys)
 {
-	particle_t		*p, *kill;
-	float			grav;
-	int				i;
-	float			time2, time3;
-	float			time1;
-	float			dvel;
-	float			frametime;
-	
-#ifdef GLQUAKE
-	vec3_t			up, right;
-	float			scale;
+	int		i, j;
+	byte	*t;
+	__m128	ft, kxy, kz, dz, dramp, vel;
 
-    GL_Bind(particletexture);
-	glEnable (GL_BLEND);
-	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
-	glBegin (GL_TRIANGLES);
+	ft = _mm_set1_ps (frametime);
+	for (i=0 ; i<count ; i+=4)
+	{
+		for (j=0 ; j<3 ; j++)
+		{
+			vel = _mm_loadu_ps (part_vel[j] + i);
+			_mm_storeu_ps (part_org[j] + i, _mm_add_ps (_mm_loadu_ps (part_org[j] + i), _mm_mul_ps (vel, ft)));
+		}
 
-	VectorScale (vup, 1.5, up);
-	VectorScale (vright, 1.5, right);
-#else
-	D_StartParticles ();
+		t = part_type + i;
+		kxy = _mm_set_ps (phys->kxy[t[3]], phys->kxy[t[2]], phys->kxy[t[1]], phys->kxy[t[0]]);
+		kz = _mm_set_ps (phys->kz[t[3]], phys->kz[t[2]], phys->kz[t[1]], phys->kz[t[0]]);
+		dz = _mm_set_ps (phys->dz[t[3]], phys->dz[t[2]], phys->dz[t[1]], phys->dz[t[0]]);
+		dramp = _mm_set_ps (phys->dramp[t[3]], phys->dramp[t[2]], phys->dramp[t[1]], phys->dramp[t[0]]);
+
+		_mm_storeu_ps (part_vel[0] + i, _mm_mul_ps (_mm_loadu_ps (part_vel[0] + i), kxy));
+		_mm_storeu_ps (part_vel[1] + i, _mm_mul_ps (_mm_loadu_ps (part_vel[1] + i), kxy));
+		_mm_storeu_ps (part_vel[2] + i, _mm_add_ps (_mm_mul_ps (_mm_loadu_ps (part_vel[2] + i), kz), dz));
+		_mm_storeu_ps (part_ramp + i, _mm_add_ps (_mm_loadu_ps (part_ramp + i), dramp));
+	}
+}
 
-	VectorScale (vright, xscaleshrink, r_pright);
-	VectorScale (vup, yscaleshrink, r_pup);
-	VectorCopy (vpn, r_ppn);
 #endif
+
+/*
+===============
+R_SelectParticleKernel
+===============
+*/
+void R_SelectParticleKernel (void)
+{
+#if idSSE
+	if (r_simd.value && Sys_HaveSSE2 ())
+	{
+		R_ParticlePhysics = R_ParticlePhysics_SSE;
+		return;
+	}
+#endif
+	R_ParticlePhysics = R_ParticlePhysics_C;
+}
+
+/*
+===============
+R_KillParticle
+
+Moves the last particle into the slot
+===============
+*/
+void R_KillParticle (int i)
+{
+	int		j, last;
+
+	last = --numparticles;
+	if (i == last)
+		return;
+	for (j=0 ; j<3 ; j++)
+	{
+		part_org[j][i] = part_org[j][last];
+		part_vel[j][i] = part_vel[j][last];
+	}
+	part_ramp[i] = part_ramp[last];
+	part_die[i] = part_die[last];
+	part_color[i] = part_color[last];
+	part_type[i] = part_type[last];
+}
+
+/*
+===============
+R_UpdateParticles
+
+Runs this frame's physics, then frees expired particles and moves the
+ramped ones to their new color
+===============
+*/
+void R_UpdateParticles (void)
+{
+	int				i;
+	float			frametime, grav, dvel;
+	partphysics_t	phys;
+
+	R_FlushNewParticles ();
+	R_SelectParticleKernel ();
+
 	frametime = cl.time - cl.oldtime;
-	time3 = frametime * 15;
-	time2 = frametime * 10; // 15;
-	time1 = frametime * 5;
 	grav = frametime * sv_gravity.value * 0.05;
 	dvel = 4*frametime;
-	
-	for ( ;; ) 
+
+	for (i=0 ; i<8 ; i++)
 	{
-		kill = active_particles;
-		if (kill && kill->die < cl.time)
-		{
-			active_particles = kill->next;
-			kill->next = free_particles;
-			free_particles = kill;
-			continue;
-		}
-		break;
+		phys.kxy[i] = phys.kz[i] = 1;
+		phys.dz[i] = -grav;
+		phys.dramp[i] = 0;
 	}
+	phys.dz[pt_static] = 0;
+	phys.dz[pt_fire] = grav;
+	phys.dramp[pt_fire] = frametime * 5;
+	phys.kxy[pt_explode] = phys.kz[pt_explode] = 1 + dvel;
+	phys.dramp[pt_explode] = frametime * 10;
+	phys.kxy[pt_explode2] = phys.kz[pt_explode2] = 1 - frametime;
+	phys.dramp[pt_explode2] = frametime * 15;
+	phys.kxy[pt_blob] = phys.kz[pt_blob] = 1 + dvel;
+	phys.kxy[pt_blob2] = 1 - dvel;
+#ifdef QUAKE2
+	phys.dz[pt_grav] = -grav * 20;
+#endif
+
+	R_ParticlePhysics (numparticles, frametime, &phys);
 
-	for (p=active_particles ; p ; p=p->next)
+	for (i=0 ; i<numparticles ; )
 	{
-		for ( ;; )
+		if (part_die[i] < cl.time)
 		{
-			kill = p->next;
-			if (kill && kill->die < cl.time)
-			{
-				p->next = kill->next;
-				kill->next = free_particles;
-				free_particles = kill;
-				continue;
-			}
-			break;
+			R_KillParticle (i);
+			continue;
 		}
 
-#ifdef GLQUAKE
-		// hack a scale up to keep particles from disapearing
-		scale = (p->org[0] - r_origin[0])*vpn[0] + (p->org[1] - r_origin[1])*vpn[1]
-			+ (p->org[2] - r_origin[2])*vpn[2];
-		if (scale < 20)
-			scale = 1;
-		else
-			scale = 1 + scale * 0.004;
-		glColor3ubv ((byte *)&d_8to24table[(int)p->color]);
-		glTexCoord2f (0,0);
-		glVertex3fv (p->org);
-		glTexCoord2f (1,0);
-		glVertex3f (p->org[0] + up[0]*scale, p->org[1] + up[1]*scale, p->org[2] + up[2]*scale);
-		glTexCoord2f (0,1);
-		glVertex3f (p->org[0] + right[0]*scale, p->org[1] + right[1]*scale, p->org[2] + right[2]*scale);
-#else
-		D_DrawParticle (p);
-#endif
-		p->org[0] += p->vel[0]*frametime;
-		p->org[1] += p->vel[1]*frametime;
-		p->org[2] += p->vel[2]*frametime;
-		
-		switch (p->type)
+		switch (part_type[i])
 		{
-		case pt_static:
-			break;
 		case pt_fire:
-			p->ramp += time1;
-			if (p->ramp >= 6)
-				p->die = -1;
+			if (part_ramp[i] >= 6)
+				part_die[i] = -1;
 			else
-				p->color = ramp3[(int)p->ramp];
-			p->vel[2] += grav;
+				part_color[i] = ramp3[(int)part_ramp[i]];
 			break;
-
 		case pt_explode:
-			p->ramp += time2;
-			if (p->ramp >=8)
-				p->die = -1;
+			if (part_ramp[i] >= 8)
+				part_die[i] = -1;
 			else
-				p->color = ramp1[(int)p->ramp];
-			for (i=0 ; i<3 ; i++)
-				p->vel[i] += p->vel[i]*dvel;
-			p->vel[2] -= grav;
+				part_color[i] = ramp1[(int)part_ramp[i]];
 			break;
-
 		case pt_explode2:
-			p->ramp += time3;
-			if (p->ramp >=8)
-				p->die = -1;
+			if (part_ramp[i] >= 8)
+				part_die[i] = -1;
 			else
-				p->color = ramp2[(int)p->ramp];
-			for (i=0 ; i<3 ; i++)
-				p->vel[i] -= p->vel[i]*frametime;
-			p->vel[2] -= grav;
+				part_color[i] = ramp2[(int)part_ramp[i]];
 			break;
+		}
+		i++;
+	}
+}
 
-		case pt_blob:
-			for (i=0 ; i<3 ; i++)
-				p->vel[i] += p->vel[i]*dvel;
-			p->vel[2] -= grav;
-			break;
+/*
+===============
+R_BuildParticleArrays
 
-		case pt_blob2:
-			for (i=0 ; i<2 ; i++)
-				p->vel[i] -= p->vel[i]*dvel;
-			p->vel[2] -= grav;
-			break;
+Fills the vertex and color arrays with a triangle for each of count
+particles from first
+===============
+*/
+void R_BuildParticleArrays (int first, int count)
+{
+	int		i;
+	float	scale, x, y, z, *v;
+	vec3_t	up, right;
+	unsigned	*c;
 
-		case pt_grav:
-#ifdef QUAKE2
-			p->vel[2] -= grav * 20;
-			break;
-#endif
-		case pt_slowgrav:
-			p->vel[2] -= grav;
-			break;
-		}
+	VectorScale (vup, 1.5, up);
+	VectorScale (vright, 1.5, right);
+
+	v = partverts[0];
+	c = partcolors;
+	for (i=first ; i<first+count ; i++, v += 9, c += 3)
+	{
+		x = part_org[0][i];
+		y = part_org[1][i];
+		z = part_org[2][i];
+
+		// hack a scale up to keep particles from disapearing
+		scale = (x - r_origin[0])*vpn[0] + (y - r_origin[1])*vpn[1]
+			+ (z - r_origin[2])*vpn[2];
+		if (scale < 20)
+			scale = 1;
+		else
+			scale = 1 + scale * 0.004;
+
+		v[0] = x;
+		v[1] = y;
+		v[2] = z;
+		v[3] = x + up[0]*scale;
+		v[4] = y + up[1]*scale;
+		v[5] = z + up[2]*scale;
+		v[6] = x + right[0]*scale;
+		v[7] = y + right[1]*scale;
+		v[8] = z + right[2]*scale;
+		c[0] = c[1] = c[2] = d_8to24table[part_color[i]] | (255<<24);
 	}
+}
+
+/*
+===============
+R_DrawParticles
+===============
+*/
+void R_DrawParticles (void)
+{
+	int		i, count;
+
+	R_UpdateParticles ();
+
+	if (!numparticles)
+		return;
+
+	GL_Bind(particletexture);
+	glEnable (GL_BLEND);
+	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+
+	glVertexPointer (3, GL_FLOAT, 0, partverts);
+	glTexCoordPointer (2, GL_FLOAT, 0, parttexcoords);
+	glColorPointer (4, GL_UNSIGNED_BYTE, 0, partcolors);
+	glEnableClientState (GL_VERTEX_ARRAY);
+	glEnableClientState (GL_TEXTURE_COORD_ARRAY);
+	glEnableClientState (GL_COLOR_ARRAY);
+
+	for (i=0 ; i<numparticles ; i+=PARTICLE_BATCH)
+	{
+		count = numparticles - i;
+		if (count > PARTICLE_BATCH)
+			count = PARTICLE_BATCH;
+		R_BuildParticleArrays (i, count);
+		glDrawArrays (GL_TRIANGLES, 0, count*3);
+	}
+
+	glDisableClientState (GL_VERTEX_ARRAY);
+	glDisableClientState (GL_TEXTURE_COORD_ARRAY);
+	glDisableClientState (GL_COLOR_ARRAY);
+	glColor4f (1,1,1,1);
 
-#ifdef GLQUAKE
-	glEnd ();
 	glDisable (GL_BLEND);
 	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
-#else
-	D_EndParticles ();
+}
+
+/*
+===============
+R_PartBench_f
+
+r_partbench [seconds] [budget ms]
+Runs a heavy fight without drawing: a rocket explosion every frame and
+sixteen rocket trails, at 72 frames a second.  The explosions come from
+a local generator, so both runs see the same ones and the game's rand
+is left alone.  Times the physics with
+the C and SSE2 kernels and the vertex arrays, and reports whether a
+frame stayed inside the budget.  Clears the particles.
+===============
+*/
+#define	PARTBENCH_TRAILS	16
+
+double R_PartBenchRun (int frames, double *fill, double *worst, int *peak, int *total)
+{
+	int			f, k;
+	unsigned	seed;
+	vec3_t		org, start, end;
+	double		oldtime, time, update, t0, t1, t2;
+
+	oldtime = cl.oldtime;
+	time = cl.time;
+	seed = 0;
+	R_ClearParticles ();
+
+	update = *fill = *worst = 0;
+	*peak = *total = 0;
+	cl.time = 0;
+	for (f=0 ; f<frames ; f++)
+	{
+		cl.oldtime = cl.time;
+		cl.time += 1.0/72;
+
+		for (k=0 ; k<3 ; k++)
+		{
+			seed = seed*1103515245 + 12345;
+			org[k] = ((seed>>16)&1023) - 512;
+		}
+		R_ParticleExplosion (org);
+		for (k=0 ; k<PARTBENCH_TRAILS ; k++)
+		{
+			start[0] = k*64 - 512;
+			start[1] = cl.time*1000 - 1024;
+			start[2] = k*16;
+			VectorCopy (start, end);
+			end[1] += 1000.0/72;
+			R_RocketTrail (start, end, 0);
+		}
+
+		t0 = Sys_ProfileTime ();
+		R_UpdateParticles ();
+		t1 = Sys_ProfileTime ();
+		for (k=0 ; k<numparticles ; k+=PARTICLE_BATCH)
+			R_BuildParticleArrays (k, numparticles-k < PARTICLE_BATCH ? numparticles-k : PARTICLE_BATCH);
+		t2 = Sys_ProfileTime ();
+
+		update += t1 - t0;
+		*fill += t2 - t1;
+		if (t2 - t0 > *worst)
+			*worst = t2 - t0;
+		if (numparticles > *peak)
+			*peak = numparticles;
+		*total += numparticles;
+	}
+
+	R_ClearParticles ();
+	cl.oldtime = oldtime;
+	cl.time = time;
+	return update;
+}
+
+void R_PartBench_f (void)
+{
+	int		frames, peak, total;
+	float	savedsimd, budget;
+	double	cupdate, supdate, fill, worst;
+
+	frames = 72*10;
+	if (Cmd_Argc () > 1)
+		frames = 72*Q_atof (Cmd_Argv (1));
+	if (frames < 1)
+		frames = 1;
+	budget = 2;
+	if (Cmd_Argc () > 2)
+		budget = Q_atof (Cmd_Argv (2));
+
+	savedsimd = r_simd.value;
+	r_simd.value = 0;
+	cupdate = R_PartBenchRun (frames, &fill, &worst, &peak, &total);
+	r_simd.value = 1;
+	supdate = R_PartBenchRun (frames, &fill, &worst, &peak, &total);
+	r_simd.value = savedsimd;
+
+	Con_Printf ("%i frames, %i particles average, %i peak of %i\n", frames, total/frames, peak, r_numparticles);
+	Con_Printf ("update: C %6.3f ms", cupdate*1000/frames);
+#if idSSE
+	if (Sys_HaveSSE2 ())
+		Con_Printf ("  SSE2 %6.3f ms (%.1fx)", supdate*1000/frames, cupdate/supdate);
 #endif
+	Con_Printf ("\narrays: %6.3f ms\n", fill*1000/frames);
+	Con_Printf ("worst frame %.3f ms, %s the %.1f ms budget\n", worst*1000,
+		worst*1000 <= budget ? "inside" : "over", budget);
 }
 
@@ -67,6 +67,18 @@ typedef struct entity_s
 	struct mnode_s			*topnode;		// for bmodels, first world node
 											//  that splits bmodel, or NULL if
 											//  not split
+
+	struct model_s			*lerpmodel;		// model the poses below are for
+	int						previouspose;	// alias pose interpolation
+	int						currentpose;
+	double					lerpstart;		// cl.time currentpose was set
+
+	// brush model to world transform, kept until origin or angles change
+	vec3_t					transformorigin;
+	vec3_t					transformangles;
+	float					transform[16];	// columns forward, left, up, origin
+	qboolean				transformvalid;
+	int						worldframe;		// drawn in the world's batches
 } entity_t;
 
 // !!! if this is changed, it must be changed in asm_draw.h too !!!
@@ -127,6 +139,8 @@ void R_RemoveEfrags (entity_t *ent);
 void R_NewMap (void);
 
 
+void R_ClearParticles (void);
+void R_UpdateParticles (void);
 void R_ParseParticleEffect (void);
 void R_RunParticleEffect (vec3_t org, vec3_t dir, int color, int count);
 void R_RocketTrail (vec3_t start, vec3_t end, int type);
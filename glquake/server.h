@@ -39,6 +39,8 @@ typedef struct
 	qboolean	paused;
 	qboolean	loadgame;			// handle connections specially
 
+	int			protocol;			// PROTOCOL_VERSION or PROTOCOL_EXTENDED
+
 	double		time;
 	
 	int			lastcheck;			// used by PF_checkclient
@@ -68,7 +70,7 @@ typedef struct
 	byte		reliable_datagram_buf[MAX_DATAGRAM];
 
 	sizebuf_t	signon;
-	byte		signon_buf[8192];
+	byte		signon_buf[MAX_MSGLEN];
 } server_t;
 
 
@@ -106,6 +108,14 @@ typedef struct client_s
 
 // client known data for deltas	
 	int				old_frags;
+
+// datagram rate limiting
+	int				rate;				// bytes per second, 0 = sv_rate
+	double			cleartime;			// realtime the rate has paid for all sent
+	float			*ent_senttime;		// [sv.max_edicts] sv.time of last update, 0 = never
+	vec3_t			*ent_sentorigin;	// [sv.max_edicts] origin in that update
+	int				num_choked;			// datagrams held back by the rate
+	int				num_dropped;		// entity updates that didn't fit a datagram
 } client_t;
 
 
@@ -201,6 +211,9 @@ extern	cvar_t	deathmatch;
 extern	cvar_t	coop;
 extern	cvar_t	fraglimit;
 extern	cvar_t	timelimit;
+extern	cvar_t	sv_rate;
+extern	cvar_t	sv_maxrate;
+extern	cvar_t	sv_protocol;
 
 extern	server_static_t	svs;				// persistant server info
 extern	server_t		sv;					// local server
@@ -227,6 +240,7 @@ void SV_SendClientMessages (void);
 void SV_ClearDatagram (void);
 
 int SV_ModelIndex (char *name);
+void SV_WritePrecacheIndex (sizebuf_t *sb, int index);
 
 void SV_SetIdealPitch (void);
 
@@ -244,6 +258,17 @@ qboolean SV_CheckBottom (edict_t *ent);
 qboolean SV_movestep (edict_t *ent, vec3_t move, qboolean relink);
 
 void SV_WriteClientdataToMessage (edict_t *ent, sizebuf_t *msg);
+void SV_WriteServerinfo (sizebuf_t *msg);
+void SV_WriteSpawnState (sizebuf_t *msg);
+int SV_EntityUpdateBits (edict_t *ent, int e);
+void SV_WriteEntityUpdate (edict_t *ent, int e, int bits, sizebuf_t *msg);
+
+void SV_MVDInit (void);
+void SV_MVDNewLevel (void);
+void SV_MVDClientData (client_t *client, byte *data, int len);
+void SV_MVDReliable (client_t *client);
+void SV_MVDFrame (void);
+void SV_MVDStop (void);
 
 void SV_MoveToGoal (void);
 
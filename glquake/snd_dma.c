@@ -25,12 +25,20 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #include "winquake.h"
 #endif
 
+#if idSSE
+#include <emmintrin.h>
+#endif
+
 void S_Play(void);
 void S_PlayVol(void);
 void S_SoundList(void);
 void S_Update_();
 void S_StopAllSounds(qboolean clear);
 void S_StopAllSoundsC(void);
+void S_MixStats_f (void);
+void S_VoiceStats_f (void);
+void S_SpatialCheck_f (void);
+static void S_ClearDMA (void);
 
 // =======================================================================
 // Internal sound data & structures
@@ -56,6 +64,23 @@ vec_t		sound_nominal_clip_dist=1000.0;
 int			soundtime;		// sample PAIRS
 int   		paintedtime; 	// sample PAIRS
 
+int			snd_underruns;	// times the DMA position passed paintedtime
+int			snd_latency;	// sample pairs mixed ahead after the last mix
+
+// mixer thread
+qboolean	snd_threaded;
+static void	S_StartMixThread (void);
+static void	S_StopMixThread (void);
+static void	S_MixThreadStopAll (void);
+static void	S_QueueCommand (int cmd, int index, channel_t *chan);
+static void	S_SendChannelUpdates (void);
+
+#define	SNDCMD_START	1		// copy a whole channel
+#define	SNDCMD_UPDATE	2		// sfx and volumes after spatialization
+#define	SNDCMD_STOP		3
+#define	SNDCMD_STOPALL	4
+#define	SNDCMD_CLEAR	5		// silence the DMA buffer
+
 
 #define	MAX_SFX		512
 sfx_t		*known_sfx;		// hunk allocated [MAX_SFX]
@@ -80,6 +105,9 @@ cvar_t ambient_fade = {"ambient_fade", "100"};
 cvar_t snd_noextraupdate = {"snd_noextraupdate", "0"};
 cvar_t snd_show = {"snd_show", "0"};
 cvar_t _snd_mixahead = {"_snd_mixahead", "0.1", true};
+cvar_t snd_mixthread = {"snd_mixthread", "0", true};
+cvar_t snd_voices = {"snd_voices", "32", true};		// most channels mixed at once, 0 = all
+cvar_t snd_audible = {"snd_audible", "2"};			// quieter channels aren't mixed
 
 
 // ====================================================================
@@ -95,6 +123,20 @@ cvar_t _snd_mixahead = {"_snd_mixahead", "0.1", true};
 
 qboolean fakedma = false;
 int fakedma_updates = 15;
+double fakedma_samples;
+
+snddriver_t	snd_drivers[] =
+{
+#ifdef _WIN32
+	{"system", SNDDMA_Init, SNDDMA_GetDMAPos, SNDDMA_Submit, SNDDMA_Shutdown},
+#endif
+	{"null", SNDNULL_Init, SNDNULL_GetDMAPos, SNDNULL_Submit, SNDNULL_Shutdown},
+	{"wav", SNDWAV_Init, SNDNULL_GetDMAPos, SNDWAV_Submit, SNDWAV_Shutdown}
+};
+
+#define	NUM_SNDDRIVERS	(sizeof(snd_drivers)/sizeof(snd_drivers[0]))
+
+snddriver_t	*snd_driver = &snd_drivers[0];
 
 
 void S_AmbientOff (void)
@@ -141,18 +183,15 @@ void S_Startup (void)
 	if (!snd_initialized)
 		return;
 
-	if (!fakedma)
-	{
-		rc = SNDDMA_Init();
+	rc = snd_driver->Init ();
 
-		if (!rc)
-		{
+	if (!rc)
+	{
 #ifndef	_WIN32
-			Con_Printf("S_Startup: SNDDMA_Init failed.\n");
+		Con_Printf("S_Startup: %s device failed.\n", snd_driver->name);
 #endif
-			sound_started = 0;
-			return;
-		}
+		sound_started = 0;
+		return;
 	}
 
 	sound_started = 1;
@@ -166,6 +205,7 @@ S_Init
 */
 void S_Init (void)
 {
+	int		i, j;
 
 	Con_Printf("\nSound Initialization\n");
 
@@ -173,13 +213,33 @@ void S_Init (void)
 		return;
 
 	if (COM_CheckParm("-simsound"))
+	{
 		fakedma = true;
+		snd_driver = &snd_drivers[NUM_SNDDRIVERS-2];	// null, unless asked for the file
+	}
+
+	i = COM_CheckParm ("-snddevice");
+	if (i && i < com_argc-1)
+	{
+		for (j=0 ; j<NUM_SNDDRIVERS ; j++)
+			if (!Q_strcasecmp (snd_drivers[j].name, com_argv[i+1]))
+				break;
+		if (j == NUM_SNDDRIVERS)
+			Con_Printf ("Unknown sound device %s\n", com_argv[i+1]);
+		else
+			snd_driver = &snd_drivers[j];
+	}
 
 	Cmd_AddCommand("play", S_Play);
 	Cmd_AddCommand("playvol", S_PlayVol);
 	Cmd_AddCommand("stopsound", S_StopAllSoundsC);
 	Cmd_AddCommand("soundlist", S_SoundList);
 	Cmd_AddCommand("soundinfo", S_SoundInfo_f);
+	Cmd_AddCommand("snd_benchmark", SND_Benchmark_f);
+	Cmd_AddCommand("snd_mixstats", S_MixStats_f);
+	Cmd_AddCommand("snd_voicestats", S_VoiceStats_f);
+	Cmd_AddCommand("snd_spatialcheck", S_SpatialCheck_f);
+	Cmd_AddCommand("snd_goldentest", SND_GoldenTest_f);
 
 	Cvar_RegisterVariable(&nosound);
 	Cvar_RegisterVariable(&volume);
@@ -192,6 +252,13 @@ void S_Init (void)
 	Cvar_RegisterVariable(&snd_noextraupdate);
 	Cvar_RegisterVariable(&snd_show);
 	Cvar_RegisterVariable(&_snd_mixahead);
+	Cvar_RegisterVariable(&snd_simd);
+	Cvar_RegisterVariable(&snd_mixthread);
+	Cvar_RegisterVariable(&snd_resample);
+	Cvar_RegisterVariable(&snd_diskcache);
+	Cvar_RegisterVariable(&snd_streamsize);
+	Cvar_RegisterVariable(&snd_voices);
+	Cvar_RegisterVariable(&snd_audible);
 
 	if (host_parms.memsize < 0x800000)
 	{
@@ -205,28 +272,9 @@ void S_Init (void)
 
 	S_Startup ();
 
-	SND_InitScaletable ();
-
 	known_sfx = Hunk_AllocName (MAX_SFX*sizeof(sfx_t), "sfx_t");
 	num_sfx = 0;
 
-// create a piece of DMA memory
-
-	if (fakedma)
-	{
-		shm = (void *) Hunk_AllocName(sizeof(*shm), "shm");
-		shm->splitbuffer = 0;
-		shm->samplebits = 16;
-		shm->speed = 22050;
-		shm->channels = 2;
-		shm->samples = 32768;
-		shm->samplepos = 0;
-		shm->soundalive = true;
-		shm->gamealive = true;
-		shm->submission_chunk = 1;
-		shm->buffer = Hunk_AllocName(1<<16, "shmbuf");
-	}
-
 	Con_Printf ("Sound sampling rate: %i\n", shm->speed);
 
 	// provides a tick sound until washed clean
@@ -251,16 +299,19 @@ void S_Shutdown(void)
 	if (!sound_started)
 		return;
 
+	if (snd_threaded)
+		S_StopMixThread ();
+
+	S_CloseStreams ();
+
 	if (shm)
 		shm->gamealive = 0;
 
+	// the device may still need shm, the wav writer for its header
+	snd_driver->Shutdown ();
+
 	shm = 0;
 	sound_started = 0;
-
-	if (!fakedma)
-	{
-		SNDDMA_Shutdown();
-	}
 }
 
 
@@ -356,6 +407,7 @@ channel_t *SND_PickChannel(int entnum, int entchannel)
     int ch_idx;
     int first_to_die;
     int life_left;
+	int	life;
 
 // Check for replacement sound, or find the best one to replace
     first_to_die = -1;
@@ -374,9 +426,17 @@ channel_t *SND_PickChannel(int entnum, int entchannel)
 		if (channels[ch_idx].entnum == cl.viewentity && entnum != cl.viewentity && channels[ch_idx].sfx)
 			continue;
 
-		if (channels[ch_idx].end - paintedtime < life_left)
+	// free channels go first, then virtual voices, then the audible
+	// one closest to finishing
+		life = channels[ch_idx].end - paintedtime;
+		if (!channels[ch_idx].sfx || life <= 0)
+			life = -0x7fffffff;
+		else if (!channels[ch_idx].leftvol && !channels[ch_idx].rightvol)
+			life -= 0x40000000;
+
+		if (life < life_left)
 		{
-			life_left = channels[ch_idx].end - paintedtime;
+			life_left = life;
 			first_to_die = ch_idx;
 		}
    }
@@ -494,6 +554,8 @@ void S_StartSound(int entnum, int entchannel, sfx_t *sfx, vec3_t origin, float f
 
 	target_chan->sfx = sfx;
 	target_chan->pos = 0.0;
+	target_chan->mixleft = target_chan->leftvol;	// no ramp in from silence
+	target_chan->mixright = target_chan->rightvol;
     target_chan->end = paintedtime + sc->length;	
 
 // if an identical sound has also been started this frame, offset the pos
@@ -514,6 +576,112 @@ void S_StartSound(int entnum, int entchannel, sfx_t *sfx, vec3_t origin, float f
 		}
 		
 	}
+
+	if (sc->stream)
+	{
+		target_chan->stream = S_OpenStream (sfx, sc, target_chan->pos);
+		if (!target_chan->stream)
+		{
+			target_chan->sfx = NULL;
+			return;
+		}
+	}
+
+	if (snd_threaded)
+		S_QueueCommand (SNDCMD_START, target_chan - channels, target_chan);
+}
+
+/*
+=================
+SND_SpatializeChannels
+
+SND_Spatialize for count channels at once.  Positions relative to the
+listener, attenuation and volume are gathered into separate arrays so
+SSE2 can work on four channels per instruction.
+=================
+*/
+static float	spat_x[MAX_CHANNELS+3], spat_y[MAX_CHANNELS+3], spat_z[MAX_CHANNELS+3];
+static float	spat_mult[MAX_CHANNELS+3], spat_vol[MAX_CHANNELS+3];
+static int		spat_left[MAX_CHANNELS+3], spat_right[MAX_CHANNELS+3];
+static channel_t	*spat_chan[MAX_CHANNELS];
+
+void SND_SpatializeChannels (channel_t *list, int count)
+{
+	int			i, n;
+	channel_t	*ch;
+#if idSSE
+	__m128		x, y, z, len, inv, dot, att, zero, one;
+	__m128		rx, ry, rz;
+	float		stereo;
+#endif
+
+#if idSSE
+	if (!snd_simd.value || !Sys_HaveSSE2 ())
+#endif
+	{
+		for (i=0, ch=list ; i<count ; i++, ch++)
+			if (ch->sfx)
+				SND_Spatialize (ch);
+		return;
+	}
+
+#if idSSE
+// gather
+	n = 0;
+	for (i=0, ch=list ; i<count ; i++, ch++)
+	{
+		if (!ch->sfx)
+			continue;
+		if (ch->entnum == cl.viewentity)
+		{
+			ch->leftvol = ch->rightvol = ch->master_vol;
+			continue;
+		}
+		spat_chan[n] = ch;
+		spat_x[n] = ch->origin[0] - listener_origin[0];
+		spat_y[n] = ch->origin[1] - listener_origin[1];
+		spat_z[n] = ch->origin[2] - listener_origin[2];
+		spat_mult[n] = ch->dist_mult;
+		spat_vol[n] = ch->master_vol;
+		n++;
+	}
+	for (i=n ; i&3 ; i++)
+		spat_x[i] = spat_y[i] = spat_z[i] = spat_mult[i] = spat_vol[i] = 0;
+
+// mono output has no separation
+	stereo = shm->channels == 1 ? 0 : 1;
+	rx = _mm_set1_ps (listener_right[0] * stereo);
+	ry = _mm_set1_ps (listener_right[1] * stereo);
+	rz = _mm_set1_ps (listener_right[2] * stereo);
+	zero = _mm_setzero_ps ();
+	one = _mm_set1_ps (1);
+
+	for (i=0 ; i<n ; i+=4)
+	{
+		x = _mm_loadu_ps (spat_x + i);
+		y = _mm_loadu_ps (spat_y + i);
+		z = _mm_loadu_ps (spat_z + i);
+
+		len = _mm_sqrt_ps (_mm_add_ps (_mm_add_ps (_mm_mul_ps (x, x), _mm_mul_ps (y, y)), _mm_mul_ps (z, z)));
+		inv = _mm_and_ps (_mm_div_ps (one, len), _mm_cmpgt_ps (len, zero));	// 0 at the listener
+		dot = _mm_mul_ps (_mm_add_ps (_mm_add_ps (_mm_mul_ps (rx, x), _mm_mul_ps (ry, y)), _mm_mul_ps (rz, z)), inv);
+
+		att = _mm_sub_ps (one, _mm_mul_ps (len, _mm_loadu_ps (spat_mult + i)));
+		att = _mm_mul_ps (att, _mm_loadu_ps (spat_vol + i));
+
+		_mm_storeu_si128 ((__m128i *)(spat_right + i),
+			_mm_cvttps_epi32 (_mm_max_ps (_mm_mul_ps (att, _mm_add_ps (one, dot)), zero)));
+		_mm_storeu_si128 ((__m128i *)(spat_left + i),
+			_mm_cvttps_epi32 (_mm_max_ps (_mm_mul_ps (att, _mm_sub_ps (one, dot)), zero)));
+	}
+
+// scatter
+	for (i=0 ; i<n ; i++)
+	{
+		spat_chan[i]->leftvol = spat_left[i];
+		spat_chan[i]->rightvol = spat_right[i];
+	}
+#endif
 }
 
 void S_StopSound(int entnum, int entchannel)
@@ -527,11 +695,38 @@ void S_StopSound(int entnum, int entchannel)
 		{
 			channels[i].end = 0;
 			channels[i].sfx = NULL;
+			if (snd_threaded)
+				S_QueueCommand (SNDCMD_STOP, i, NULL);
 			return;
 		}
 	}
 }
 
+/*
+==================
+S_StopDynamicSounds
+
+Stops entity sounds but leaves the ambient and static channels playing
+==================
+*/
+void S_StopDynamicSounds (void)
+{
+	int		i;
+
+	if (!sound_started)
+		return;
+
+	for (i=NUM_AMBIENTS ; i<NUM_AMBIENTS + MAX_DYNAMIC_CHANNELS ; i++)
+	{
+		if (!channels[i].sfx)
+			continue;
+		channels[i].end = 0;
+		channels[i].sfx = NULL;
+		if (snd_threaded)
+			S_QueueCommand (SNDCMD_STOP, i, NULL);
+	}
+}
+
 void S_StopAllSounds(qboolean clear)
 {
 	int		i;
@@ -547,6 +742,9 @@ void S_StopAllSounds(qboolean clear)
 
 	Q_memset(channels, 0, MAX_CHANNELS * sizeof(channel_t));
 
+	if (snd_threaded)
+		S_QueueCommand (SNDCMD_STOPALL, 0, NULL);
+
 	if (clear)
 		S_ClearBuffer ();
 }
@@ -557,6 +755,14 @@ void S_StopAllSoundsC (void)
 }
 
 void S_ClearBuffer (void)
+{
+	if (snd_threaded)
+		S_QueueCommand (SNDCMD_CLEAR, 0, NULL);
+	else
+		S_ClearDMA ();
+}
+
+static void S_ClearDMA (void)
 {
 	int		clear;
 		
@@ -649,8 +855,23 @@ void S_StaticSound (sfx_t *sfx, vec3_t origin, float vol, float attenuation)
 	ss->master_vol = vol;
 	ss->dist_mult = (attenuation/64) / sound_nominal_clip_dist;
     ss->end = paintedtime + sc->length;	
+
+	if (sc->stream)
+	{
+		ss->stream = S_OpenStream (sfx, sc, 0);
+		if (!ss->stream)
+		{
+			ss->sfx = NULL;
+			return;
+		}
+	}
 	
 	SND_Spatialize (ss);
+	ss->mixleft = ss->leftvol;
+	ss->mixright = ss->rightvol;
+
+	if (snd_threaded)
+		S_QueueCommand (SNDCMD_START, ss - channels, ss);
 }
 
 
@@ -711,6 +932,59 @@ void S_UpdateAmbientSounds (void)
 }
 
 
+/*
+============
+S_CullVoices
+
+Silences channels below snd_audible and all but the snd_voices loudest
+of the rest.  A silenced channel is a virtual voice: the mixer keeps its
+position moving without painting it, so it comes back in the right place
+when it is audible again.  The player's own sounds always stay real.
+Ambients are faded by S_UpdateAmbientSounds and are left alone.
+============
+*/
+static void S_CullVoices (void)
+{
+	int			order[MAX_CHANNELS];
+	int			priority[MAX_CHANNELS];
+	channel_t	*ch;
+	int			i, j, count, p;
+
+	count = 0;
+	for (i=NUM_AMBIENTS, ch=channels+NUM_AMBIENTS ; i<total_channels ; i++, ch++)
+	{
+		if (!ch->sfx || (!ch->leftvol && !ch->rightvol))
+			continue;
+
+		p = ch->leftvol > ch->rightvol ? ch->leftvol : ch->rightvol;
+		if (p < snd_audible.value)
+		{
+			ch->leftvol = ch->rightvol = 0;
+			continue;
+		}
+		if (ch->entnum == cl.viewentity && i < NUM_AMBIENTS + MAX_DYNAMIC_CHANNELS)
+			p += 0x10000;
+
+	// insertion sort, loudest first
+		for (j=count ; j>0 && priority[j-1] < p ; j--)
+		{
+			priority[j] = priority[j-1];
+			order[j] = order[j-1];
+		}
+		priority[j] = p;
+		order[j] = i;
+		count++;
+	}
+
+	if (snd_voices.value <= 0)
+		return;
+	for (i=(int)snd_voices.value ; i<count ; i++)
+	{
+		ch = &channels[order[i]];
+		ch->leftvol = ch->rightvol = 0;
+	}
+}
+
 /*
 ============
 S_Update
@@ -728,23 +1002,36 @@ void S_Update(vec3_t origin, vec3_t forward, vec3_t right, vec3_t up)
 	if (!sound_started || (snd_blocked > 0))
 		return;
 
+	if (snd_mixthread.value && !snd_threaded && !fakedma)
+		S_StartMixThread ();
+	else if (!snd_mixthread.value && snd_threaded)
+		S_StopMixThread ();
+
 	VectorCopy(origin, listener_origin);
 	VectorCopy(forward, listener_forward);
 	VectorCopy(right, listener_right);
 	VectorCopy(up, listener_up);
+
+// a simulated device plays back exactly as fast as the game runs
+	if (fakedma)
+		fakedma_samples += host_frametime * shm->speed * shm->channels;
 	
 // update general area ambient sound sources
 	S_UpdateAmbientSounds ();
 
+// keep streamed sounds decoded ahead of the mixer
+	S_UpdateStreams ();
+
 	combine = NULL;
 
 // update spatialization for static and dynamic sounds	
+	SND_SpatializeChannels (channels+NUM_AMBIENTS, total_channels-NUM_AMBIENTS);
+
 	ch = channels+NUM_AMBIENTS;
 	for (i=NUM_AMBIENTS ; i<total_channels; i++, ch++)
 	{
 		if (!ch->sfx)
 			continue;
-		SND_Spatialize(ch);         // respatialize channel
 		if (!ch->leftvol && !ch->rightvol)
 			continue;
 
@@ -786,6 +1073,8 @@ void S_Update(vec3_t origin, vec3_t forward, vec3_t right, vec3_t up)
 		
 	}
 
+	S_CullVoices ();
+
 //
 // debugging output
 //
@@ -804,7 +1093,10 @@ void S_Update(vec3_t origin, vec3_t forward, vec3_t right, vec3_t up)
 	}
 
 // mix some sound
-	S_Update_();
+	if (snd_threaded)
+		S_SendChannelUpdates ();
+	else
+		S_Update_();
 }
 
 void GetSoundtime(void)
@@ -821,7 +1113,7 @@ void GetSoundtime(void)
 #ifdef __sun__
 	soundtime = SNDDMA_GetSamples();
 #else
-	samplepos = SNDDMA_GetDMAPos();
+	samplepos = snd_driver->GetDMAPos ();
 
 
 	if (samplepos < oldsamplepos)
@@ -832,7 +1124,10 @@ void GetSoundtime(void)
 		{	// time to chop things off to avoid 32 bit limits
 			buffers = 0;
 			paintedtime = fullsamples;
-			S_StopAllSounds (true);
+			if (snd_threaded)
+				S_MixThreadStopAll ();
+			else
+				S_StopAllSounds (true);
 		}
 	}
 	oldsamplepos = samplepos;
@@ -848,18 +1143,22 @@ void S_ExtraUpdate (void)
 	IN_Accumulate ();
 #endif
 
-	if (snd_noextraupdate.value)
+	if (snd_noextraupdate.value || snd_threaded)
 		return;		// don't pollute timings
 	S_Update_();
 }
 
-void S_Update_(void)
+/*
+============
+S_MixAhead
+
+Mixes list from the DMA position to _snd_mixahead seconds past it
+============
+*/
+void S_MixAhead (channel_t *list, int count, qboolean load)
 {
 	unsigned        endtime;
 	int				samps;
-	
-	if (!sound_started || (snd_blocked > 0))
-		return;
 
 // Updates DMA time
 	GetSoundtime();
@@ -868,6 +1167,8 @@ void S_Update_(void)
 	if (paintedtime < soundtime)
 	{
 		//Con_Printf ("S_Update_ : overflow\n");
+		if (paintedtime)
+			snd_underruns++;
 		paintedtime = soundtime;
 	}
 
@@ -896,9 +1197,403 @@ void S_Update_(void)
 	}
 #endif
 
-	S_PaintChannels (endtime);
+	S_PaintChannelList (list, count, endtime, load);
+
+	snd_driver->Submit ();
+
+	snd_latency = paintedtime - soundtime;
+}
+
+void S_Update_(void)
+{
+	if (!sound_started || (snd_blocked > 0))
+		return;
 
-	SNDDMA_Submit ();
+	S_MixAhead (channels, total_channels, true);
+}
+
+/*
+===============================================================================
+
+MIXER THREAD
+
+With snd_mixthread set, mixing runs on its own thread so long frames don't
+starve the DMA buffer.  The mixer has a private copy of the channels; the
+main thread still picks, starts and spatializes channels in channels[] and
+sends the changes through a single producer / single consumer queue.
+
+The mixer only reads sound data already in the cache, and holds the cache
+lock while it mixes so nothing moves underneath it.
+
+===============================================================================
+*/
+
+typedef struct
+{
+	int			cmd;
+	int			index;
+	int			total;		// total_channels when sent
+	channel_t	chan;
+} sndcmd_t;
+
+#define	SNDCMD_QUEUE	4096	// must be a power of two
+
+static sndcmd_t		snd_cmds[SNDCMD_QUEUE];
+static volatile int	snd_cmdhead;	// only moved by the main thread
+static volatile int	snd_cmdtail;	// only moved by the mixer
+static int			snd_cmdwaits;
+
+static channel_t	mix_channels[MAX_CHANNELS];
+static int			mix_total;
+static channel_t	sent_channels[MAX_CHANNELS];	// what the mixer was last told
+
+static void			*snd_mixthread_handle;
+static void			*snd_mixwake;
+static volatile qboolean	snd_mixquit;
+static int			snd_mixes;
+
+/*
+============
+S_QueueCommand
+
+============
+*/
+static void S_QueueCommand (int cmd, int index, channel_t *chan)
+{
+	sndcmd_t	*c;
+
+	while (((snd_cmdhead + 1) & (SNDCMD_QUEUE-1)) == snd_cmdtail)
+	{	// the mixer has fallen behind, let it drain
+		snd_cmdwaits++;
+		Sys_SignalEvent (snd_mixwake);
+		Sys_Sleep ();
+	}
+
+	c = &snd_cmds[snd_cmdhead];
+	c->cmd = cmd;
+	c->index = index;
+	c->total = total_channels;
+	if (chan)
+	{
+		c->chan = *chan;
+		sent_channels[index] = *chan;
+	}
+	else if (cmd == SNDCMD_STOPALL)
+		memset (sent_channels, 0, sizeof(sent_channels));
+	else if (cmd == SNDCMD_STOP)
+		sent_channels[index].sfx = NULL;
+
+// the command has to be visible before the head moves past it
+	Sys_MemoryBarrier ();
+	snd_cmdhead = (snd_cmdhead + 1) & (SNDCMD_QUEUE-1);
+
+	if (cmd != SNDCMD_UPDATE)
+		Sys_SignalEvent (snd_mixwake);
+}
+
+/*
+============
+S_SendChannelUpdates
+
+Tells the mixer about channels whose sound or volume changed this frame
+============
+*/
+static void S_SendChannelUpdates (void)
+{
+	int			i;
+	channel_t	*ch, *sent;
+
+	for (i=0, ch = channels, sent = sent_channels ; i<total_channels ; i++, ch++, sent++)
+	{
+		if (ch->sfx == sent->sfx && ch->leftvol == sent->leftvol
+		&& ch->rightvol == sent->rightvol)
+			continue;
+
+	// keep the sound resident while it plays
+		if (ch->sfx)
+			S_LoadSound (ch->sfx);
+
+		S_QueueCommand (SNDCMD_UPDATE, i, ch);
+	}
+}
+
+/*
+============
+S_RunCommands
+
+Mixer side of the queue
+============
+*/
+static void S_RunCommands (void)
+{
+	sndcmd_t	*c;
+	channel_t	*ch;
+
+	while (snd_cmdtail != snd_cmdhead)
+	{
+		Sys_MemoryBarrier ();
+
+		c = &snd_cmds[snd_cmdtail];
+		ch = &mix_channels[c->index];
+		switch (c->cmd)
+		{
+		case SNDCMD_START:
+			*ch = c->chan;
+			break;
+		case SNDCMD_UPDATE:
+			ch->sfx = c->chan.sfx;
+			ch->leftvol = c->chan.leftvol;
+			ch->rightvol = c->chan.rightvol;
+			break;
+		case SNDCMD_STOP:
+			ch->sfx = NULL;
+			ch->end = 0;
+			break;
+		case SNDCMD_STOPALL:
+			memset (mix_channels, 0, sizeof(mix_channels));
+			break;
+		case SNDCMD_CLEAR:
+			S_ClearDMA ();
+			break;
+		}
+		mix_total = c->total;
+
+		Sys_MemoryBarrier ();
+		snd_cmdtail = (snd_cmdtail + 1) & (SNDCMD_QUEUE-1);
+	}
+}
+
+/*
+============
+S_MixThreadStopAll
+
+GetSoundtime wrapped paintedtime on the mixer thread
+============
+*/
+static void S_MixThreadStopAll (void)
+{
+	memset (mix_channels, 0, sizeof(mix_channels));
+	S_ClearDMA ();
+}
+
+/*
+============
+S_MixThread
+
+============
+*/
+static int S_MixThread (void *parm)
+{
+	while (!snd_mixquit)
+	{
+		S_RunCommands ();
+
+		if (snd_blocked <= 0)
+		{
+			Cache_Lock ();
+			S_MixAhead (mix_channels, mix_total, false);
+			Cache_Unlock ();
+			snd_mixes++;
+		}
+
+	// a few ms is well inside any sane _snd_mixahead
+		Sys_WaitEvent (snd_mixwake, 5);
+	}
+
+	return 0;
+}
+
+/*
+============
+S_StartMixThread
+
+============
+*/
+static void S_StartMixThread (void)
+{
+	Cache_EnableLocking ();
+
+	memcpy (mix_channels, channels, sizeof(mix_channels));
+	memcpy (sent_channels, channels, sizeof(sent_channels));
+	mix_total = total_channels;
+	snd_cmdhead = snd_cmdtail = 0;
+	snd_mixquit = false;
+
+	snd_mixwake = Sys_CreateEvent ();
+	snd_mixthread_handle = Sys_CreateThread (S_MixThread, NULL);
+	snd_threaded = true;
+}
+
+/*
+============
+S_StopMixThread
+
+Hands the play positions back to the main thread's channels
+============
+*/
+static void S_StopMixThread (void)
+{
+	int		i;
+
+	snd_mixquit = true;
+	Sys_SignalEvent (snd_mixwake);
+	Sys_WaitThread (snd_mixthread_handle);
+	Sys_DestroyEvent (snd_mixwake);
+	snd_threaded = false;
+
+	S_RunCommands ();
+
+	for (i=0 ; i<MAX_CHANNELS ; i++)
+	{
+		if (!mix_channels[i].sfx)
+			channels[i].sfx = NULL;
+		channels[i].pos = mix_channels[i].pos;
+		channels[i].end = mix_channels[i].end;
+		channels[i].mixleft = mix_channels[i].mixleft;
+		channels[i].mixright = mix_channels[i].mixright;
+	}
+}
+
+/*
+============
+S_MixStats_f
+
+============
+*/
+void S_MixStats_f (void)
+{
+	if (!sound_started || !shm)
+	{
+		Con_Printf ("sound system not started\n");
+		return;
+	}
+
+	Con_Printf ("mixer: %s\n", snd_threaded ? "thread" : "main loop");
+	Con_Printf ("%5i underruns\n", snd_underruns);
+	Con_Printf ("%5.1f ms mixed ahead\n", snd_latency * 1000.0 / shm->speed);
+	Con_Printf ("%5i stream starves\n", snd_streamstarves);
+	if (snd_threaded)
+	{
+		Con_Printf ("%5i mixes\n", snd_mixes);
+		Con_Printf ("%5i queue waits\n", snd_cmdwaits);
+	}
+}
+
+/*
+============
+S_VoiceStats_f
+
+Real and virtual voices now, and what the virtual ones saved since the
+last call
+============
+*/
+void S_VoiceStats_f (void)
+{
+	int			i, real, virt;
+	channel_t	*ch;
+	double		persample, saved;
+
+	if (!sound_started || !shm)
+	{
+		Con_Printf ("sound system not started\n");
+		return;
+	}
+
+	real = virt = 0;
+	for (i=0, ch=channels ; i<total_channels ; i++, ch++)
+	{
+		if (!ch->sfx)
+			continue;
+		if (ch->leftvol || ch->rightvol)
+			real++;
+		else
+			virt++;
+	}
+
+	Con_Printf ("%3i real voices (limit %i)\n", real, (int)snd_voices.value);
+	Con_Printf ("%3i virtual voices\n", virt);
+
+	if (snd_mixedsamples)
+	{
+		persample = snd_mixtime / snd_mixedsamples;
+		saved = snd_virtualsamples * persample;
+		Con_Printf ("mixed %.0f channel samples in %.1f ms (%.1f ns each)\n",
+			snd_mixedsamples, snd_mixtime * 1000, persample * 1.0e9);
+		Con_Printf ("skipped %.0f virtual samples, about %.1f ms (%.0f%%) saved\n",
+			snd_virtualsamples, saved * 1000, 100 * saved / (saved + snd_mixtime));
+	}
+
+	snd_statsreset++;		// the mixer clears them before its next mix
+}
+
+/*
+============
+S_SpatialCheck_f
+
+snd_spatialcheck [iterations]
+Spatializes random channels with SND_Spatialize and the batch version,
+reports the largest volume difference and the time each took
+============
+*/
+void S_SpatialCheck_f (void)
+{
+	static channel_t	scalar[MAX_CHANNELS], batch[MAX_CHANNELS];
+	static sfx_t		dummy;
+	int			i, j, iterations, diff, maxdiff;
+	double		start, tscalar, tbatch;
+
+	if (!sound_started || !shm)
+	{
+		Con_Printf ("sound system not started\n");
+		return;
+	}
+
+	iterations = 1000;
+	if (Cmd_Argc () > 1)
+		iterations = Q_atoi (Cmd_Argv (1));
+	if (iterations < 1)
+		iterations = 1;
+
+	memset (scalar, 0, sizeof(scalar));
+	for (i=0 ; i<MAX_CHANNELS ; i++)
+	{
+		scalar[i].sfx = &dummy;
+		for (j=0 ; j<3 ; j++)
+			scalar[i].origin[j] = listener_origin[j] + (rand () % 4001) - 2000;
+		if (i == 0)
+			VectorCopy (listener_origin, scalar[i].origin);		// zero length
+		scalar[i].dist_mult = (rand () % 4) / sound_nominal_clip_dist;
+		scalar[i].master_vol = rand () & 255;
+		scalar[i].entnum = (i % 17 == 1) ? cl.viewentity : i + 1024;
+	}
+	memcpy (batch, scalar, sizeof(batch));
+
+	start = Sys_FloatTime ();
+	for (j=0 ; j<iterations ; j++)
+		for (i=0 ; i<MAX_CHANNELS ; i++)
+			SND_Spatialize (&scalar[i]);
+	tscalar = Sys_FloatTime () - start;
+
+	start = Sys_FloatTime ();
+	for (j=0 ; j<iterations ; j++)
+		SND_SpatializeChannels (batch, MAX_CHANNELS);
+	tbatch = Sys_FloatTime () - start;
+
+	maxdiff = 0;
+	for (i=0 ; i<MAX_CHANNELS ; i++)
+	{
+		diff = abs (scalar[i].leftvol - batch[i].leftvol);
+		if (diff > maxdiff)
+			maxdiff = diff;
+		diff = abs (scalar[i].rightvol - batch[i].rightvol);
+		if (diff > maxdiff)
+			maxdiff = diff;
+	}
+
+	Con_Printf ("largest difference: %i volume step%s (%s)\n", maxdiff,
+		maxdiff == 1 ? "" : "s", maxdiff <= 1 ? "ok" : "FAILED");
+	Con_Printf ("scalar: %.3f us per %i channels\n", tscalar * 1.0e6 / iterations, MAX_CHANNELS);
+	Con_Printf ("batch:  %.3f us per %i channels\n", tbatch * 1.0e6 / iterations, MAX_CHANNELS);
 }
 
 /*
@@ -970,12 +1665,19 @@ void S_SoundList(void)
 		sc = Cache_Check (&sfx->cache);
 		if (!sc)
 			continue;
-		size = sc->length*sc->width*(sc->stereo+1);
+		if (sc->stream)
+			size = 0;		// nothing resident
+		else
+			size = sc->length*sc->width*(sc->stereo+1);
 		total += size;
 		if (sc->loopstart >= 0)
 			Con_Printf ("L");
 		else
 			Con_Printf (" ");
+		if (sc->stream)
+			Con_Printf ("S");
+		else
+			Con_Printf (" ");
 		Con_Printf("(%2db) %6i : %s\n",sc->width*8,  size, sfx->name);
 	}
 	Con_Printf ("Total resident: %i\n", total);
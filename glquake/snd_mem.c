@@ -21,10 +21,200 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #include "quakedef.h"
 
+#if idSSE
+#include <xmmintrin.h>
+#endif
+
 int			cache_full_cycle;
 
 byte *S_Alloc (int size);
 
+cvar_t	snd_resample = {"snd_resample", "1", true};	// 0 = point sampling
+cvar_t	snd_diskcache = {"snd_diskcache", "1", true};
+cvar_t	snd_streamsize = {"snd_streamsize", "1048576", true};	// bytes, 0 = never stream
+
+/*
+===============================================================================
+
+WINDOWED SINC RESAMPLING
+
+Each output sample is a 16 tap FIR over the source, using the nearest of
+SINC_PHASES precomputed sub-sample offsets.  The filter cuts off just
+below the lower of the two Nyquist rates, so upsampling doesn't image and
+downsampling doesn't alias.
+
+===============================================================================
+*/
+
+#define	SINC_TAPS		16
+#define	SINC_PHASES		128
+
+static float	sinc_table[SINC_PHASES+1][SINC_TAPS];
+static int		sinc_inrate, sinc_outrate;
+
+/*
+================
+S_BuildSincTable
+================
+*/
+static void S_BuildSincTable (int inrate, int outrate)
+{
+	int		p, k;
+	double	fc, t, x, w, sum;
+	float	*taps;
+
+	if (inrate == sinc_inrate && outrate == sinc_outrate)
+		return;
+	sinc_inrate = inrate;
+	sinc_outrate = outrate;
+
+// cutoff as a fraction of the source rate
+	fc = 0.5 * 0.95;
+	if (outrate < inrate)
+		fc *= (double)outrate / inrate;
+
+	for (p=0 ; p<=SINC_PHASES ; p++)
+	{
+		taps = sinc_table[p];
+		sum = 0;
+		for (k=0 ; k<SINC_TAPS ; k++)
+		{
+			t = (k - (SINC_TAPS/2 - 1)) - (double)p / SINC_PHASES;
+
+			x = 2 * M_PI * fc * t;
+			if (fabs(x) < 1e-9)
+				taps[k] = 2 * fc;
+			else
+				taps[k] = 2 * fc * sin(x) / x;
+
+		// blackman window across the taps
+			w = (t + SINC_TAPS/2) / SINC_TAPS;
+			if (w < 0 || w > 1)
+				w = 0;
+			else
+				w = 0.42 - 0.5 * cos(2 * M_PI * w) + 0.08 * cos(4 * M_PI * w);
+			taps[k] *= w;
+			sum += taps[k];
+		}
+
+	// unity gain at DC for every phase
+		for (k=0 ; k<SINC_TAPS ; k++)
+			taps[k] /= sum;
+	}
+}
+
+static float S_SincDot_C (float *in, float *taps)
+{
+	int		k;
+	float	sum;
+
+	sum = 0;
+	for (k=0 ; k<SINC_TAPS ; k++)
+		sum += in[k] * taps[k];
+	return sum;
+}
+
+#if idSSE
+static float S_SincDot_SSE (float *in, float *taps)
+{
+	__m128	a;
+	float	out[4];
+
+	a = _mm_mul_ps (_mm_loadu_ps (in), _mm_loadu_ps (taps));
+	a = _mm_add_ps (a, _mm_mul_ps (_mm_loadu_ps (in + 4), _mm_loadu_ps (taps + 4)));
+	a = _mm_add_ps (a, _mm_mul_ps (_mm_loadu_ps (in + 8), _mm_loadu_ps (taps + 8)));
+	a = _mm_add_ps (a, _mm_mul_ps (_mm_loadu_ps (in + 12), _mm_loadu_ps (taps + 12)));
+	_mm_storeu_ps (out, a);
+	return (out[0] + out[1]) + (out[2] + out[3]);
+}
+#endif
+
+/*
+================
+S_ResampleSinc
+
+Writes outcount samples of width outwidth into out.  Looping sounds are
+filtered across the loop point so the seam doesn't click.
+================
+*/
+static void S_ResampleSinc (byte *out, int outwidth, int outcount, byte *data, int inwidth,
+	int incount, int loopstart, int inrate, int outrate)
+{
+	float	*in;
+	float	(*dot) (float *in, float *taps);
+	double	pos, step;
+	int		i, j, ip, phase, val;
+
+	S_BuildSincTable (inrate, outrate);
+
+	dot = S_SincDot_C;
+#if idSSE
+	if (Sys_HaveSSE2 ())
+		dot = S_SincDot_SSE;
+#endif
+
+// float copy of the source with room for the taps past either end
+	in = malloc ((incount + 2*SINC_TAPS) * sizeof(float));
+	if (!in)
+		Sys_Error ("S_ResampleSinc: out of memory");
+	for (i=0 ; i<incount + 2*SINC_TAPS ; i++)
+	{
+		j = i - SINC_TAPS;
+		if (j >= incount)
+		{
+			if (loopstart < 0 || loopstart >= incount)
+			{
+				in[i] = 0;
+				continue;
+			}
+			j = loopstart + (j - incount) % (incount - loopstart);
+		}
+		if (j < 0)
+			in[i] = 0;
+		else if (inwidth == 2)
+			in[i] = LittleShort (((short *)data)[j]);
+		else
+			in[i] = (int)((unsigned char)data[j] - 128) << 8;
+	}
+
+	step = (double)inrate / outrate;
+	for (i=0 ; i<outcount ; i++)
+	{
+		pos = i * step;
+		ip = (int)pos;
+		phase = (int)((pos - ip) * SINC_PHASES + 0.5);
+
+		val = (int)dot (in + SINC_TAPS + ip - (SINC_TAPS/2 - 1), sinc_table[phase]);
+		if (val > 32767)
+			val = 32767;
+		else if (val < -32768)
+			val = -32768;
+
+		if (outwidth == 2)
+			((short *)out)[i] = val;
+		else
+			((signed char *)out)[i] = val >> 8;
+	}
+
+	free (in);
+}
+
+/*
+================
+S_OutputWidth
+
+The sample width ResampleSfx will produce
+================
+*/
+static int S_OutputWidth (int inrate, int inwidth)
+{
+	if (loadas8bit.value)
+		return 1;
+	if (snd_resample.value && inrate != shm->speed)
+		return 2;		// keep what the filter adds
+	return inwidth;
+}
+
 /*
 ================
 ResampleSfx
@@ -37,6 +227,7 @@ void ResampleSfx (sfx_t *sfx, int inrate, int inwidth, byte *data)
 	float	stepscale;
 	int		i;
 	int		sample, samplefrac, fracstep;
+	int		incount, inloop;
 	sfxcache_t	*sc;
 	
 	sc = Cache_Check (&sfx->cache);
@@ -45,16 +236,15 @@ void ResampleSfx (sfx_t *sfx, int inrate, int inwidth, byte *data)
 
 	stepscale = (float)inrate / shm->speed;	// this is usually 0.5, 1, or 2
 
+	incount = sc->length;
+	inloop = sc->loopstart;
 	outcount = sc->length / stepscale;
 	sc->length = outcount;
 	if (sc->loopstart != -1)
 		sc->loopstart = sc->loopstart / stepscale;
 
 	sc->speed = shm->speed;
-	if (loadas8bit.value)
-		sc->width = 1;
-	else
-		sc->width = inwidth;
+	sc->width = S_OutputWidth (inrate, inwidth);
 	sc->stereo = 0;
 
 // resample / decimate to the current source rate
@@ -66,6 +256,11 @@ void ResampleSfx (sfx_t *sfx, int inrate, int inwidth, byte *data)
 			((signed char *)sc->data)[i]
 			= (int)( (unsigned char)(data[i]) - 128);
 	}
+	else if (snd_resample.value && stepscale != 1)
+	{
+		S_ResampleSinc (sc->data, sc->width, outcount, data, inwidth,
+			incount, inloop, inrate, shm->speed);
+	}
 	else
 	{
 // general case
@@ -87,71 +282,122 @@ void ResampleSfx (sfx_t *sfx, int inrate, int inwidth, byte *data)
 	}
 }
 
-//=============================================================================
-
 /*
-==============
-S_LoadSound
-==============
+===============================================================================
+
+DISK CACHE
+
+Resampled sounds are saved under <gamedir>/sndcache so later runs only pay
+for reading them.  The file name carries the source CRC, output rate and
+width, so a changed wav or a different output format never matches.
+
+===============================================================================
 */
-sfxcache_t *S_LoadSound (sfx_t *s)
+
+#define	SNDCACHE_VERSION	1
+
+typedef struct
 {
-    char	namebuffer[256];
-	byte	*data;
-	wavinfo_t	info;
-	int		len;
-	float	stepscale;
-	sfxcache_t	*sc;
-	byte	stackbuf[1*1024];		// avoid dirtying the cache heap
+	char	id[4];		// "QSND"
+	int		version;
+	int		length;
+	int		loopstart;
+	int		speed;
+	int		width;
+} sndcachehdr_t;
 
-// see if still in memory
-	sc = Cache_Check (&s->cache);
-	if (sc)
-		return sc;
+/*
+================
+S_SoundCachePath
+================
+*/
+static void S_SoundCachePath (char *path, char *name, unsigned short crc, int width)
+{
+	char	base[MAX_QPATH];
+	char	*s;
 
-//Con_Printf ("S_LoadSound: %x\n", (int)stackbuf);
-// load it in
-    Q_strcpy(namebuffer, "sound/");
-    Q_strcat(namebuffer, s->name);
+	COM_StripExtension (name, base);
+	for (s = base ; *s ; s++)
+		if (*s == '/' || *s == '\\')
+			*s = '_';
 
-//	Con_Printf ("loading %s\n",namebuffer);
+	sprintf (path, "%s/sndcache/%s_%04x_%i_%i.snd", com_gamedir, base, crc, shm->speed, width);
+}
 
-	data = COM_LoadStackFile(namebuffer, stackbuf, sizeof(stackbuf));
+/*
+================
+S_ReadSoundCache
+================
+*/
+static sfxcache_t *S_ReadSoundCache (sfx_t *s, char *path, int width)
+{
+	FILE			*f;
+	sndcachehdr_t	h;
+	sfxcache_t		*sc;
+	int				size;
 
-	if (!data)
-	{
-		Con_Printf ("Couldn't load %s\n", namebuffer);
+	f = fopen (path, "rb");
+	if (!f)
 		return NULL;
-	}
 
-	info = GetWavinfo (s->name, data, com_filesize);
-	if (info.channels != 1)
+	if (fread (&h, sizeof(h), 1, f) != 1 || memcmp (h.id, "QSND", 4)
+	|| LittleLong (h.version) != SNDCACHE_VERSION || LittleLong (h.speed) != shm->speed
+	|| LittleLong (h.width) != width || LittleLong (h.length) <= 0)
 	{
-		Con_Printf ("%s is a stereo sample\n",s->name);
+		fclose (f);
 		return NULL;
 	}
 
-	stepscale = (float)info.rate / shm->speed;	
-	len = info.samples / stepscale;
-
-	len = len * info.width * info.channels;
-
-	sc = Cache_Alloc ( &s->cache, len + sizeof(sfxcache_t), s->name);
+	size = LittleLong (h.length) * width;
+	sc = Cache_Alloc (&s->cache, size + sizeof(sfxcache_t), s->name);
 	if (!sc)
+	{
+		fclose (f);
 		return NULL;
-	
-	sc->length = info.samples;
-	sc->loopstart = info.loopstart;
-	sc->speed = info.rate;
-	sc->width = info.width;
-	sc->stereo = info.channels;
+	}
 
-	ResampleSfx (s, sc->speed, sc->width, data + info.dataofs);
+	sc->length = LittleLong (h.length);
+	sc->loopstart = LittleLong (h.loopstart);
+	sc->speed = shm->speed;
+	sc->width = width;
+	sc->stereo = 0;
+	sc->stream = false;
+	if (fread (sc->data, 1, size, f) != (size_t)size)
+	{
+		Cache_Free (&s->cache);
+		sc = NULL;
+	}
 
+	fclose (f);
 	return sc;
 }
 
+/*
+================
+S_WriteSoundCache
+================
+*/
+static void S_WriteSoundCache (sfxcache_t *sc, char *path)
+{
+	FILE			*f;
+	sndcachehdr_t	h;
+
+	COM_CreatePath (path);
+	f = fopen (path, "wb");
+	if (!f)
+		return;
 
+	memcpy (h.id, "QSND", 4);
+	h.version = LittleLong (SNDCACHE_VERSION);
+	h.length = LittleLong (sc->length);
+	h.loopstart = LittleLong (sc->loopstart);
+	h.speed = LittleLong (sc->speed);
+	h.width = LittleLong (sc->width);
+
+	fwrite (&h, sizeof(h), 1, f);
+	fwrite (sc->data, 1, sc->length * sc->width, f);
+	fclose (f);
+}
 
 /*
 ===============================================================================
@@ -161,181 +407,458 @@ WAV loading
 ===============================================================================
 */
 
-
-byte	*data_p;
-byte 	*iff_end;
-byte 	*last_chunk;
-byte 	*iff_data;
-int 	iff_chunk_len;
-
-
-short GetLittleShort(void)
+static int S_ChunkShort (byte *p)
 {
-	short val = 0;
-	val = *data_p;
-	val = val + (*(data_p+1)<<8);
-	data_p += 2;
-	return val;
+	return (short)(p[0] + (p[1]<<8));
 }
 
-int GetLittleLong(void)
+static int S_ChunkLong (byte *p)
 {
-	int val = 0;
-	val = *data_p;
-	val = val + (*(data_p+1)<<8);
-	val = val + (*(data_p+2)<<16);
-	val = val + (*(data_p+3)<<24);
-	data_p += 4;
-	return val;
+	return p[0] + (p[1]<<8) + (p[2]<<16) + (p[3]<<24);
 }
 
-void FindNextChunk(char *name)
+/*
+================
+S_ReadWavinfo
+
+Walks the chunks of an open wav, reading only their headers, so a sound
+can be streamed without loading it.  The file is positioned at the start
+of the wav; dataofs comes back relative to that.  Only mono 8 and 16 bit
+PCM is accepted.
+================
+*/
+static qboolean S_ReadWavinfo (FILE *f, int filelen, wavinfo_t *info)
 {
-	while (1)
+	byte		chunk[64];
+	int			base, ofs, len, n;
+	int			datalen, loopsamples;
+	qboolean	aftercue;
+
+	memset (info, 0, sizeof(*info));
+	info->loopstart = -1;
+
+	base = ftell (f);
+	if (fread (chunk, 1, 12, f) != 12 || memcmp (chunk, "RIFF", 4) || memcmp (chunk+8, "WAVE", 4))
+		return false;
+
+	datalen = -1;
+	loopsamples = 0;
+	aftercue = false;
+	for (ofs = 12 ; ofs + 8 <= filelen ; ofs += 8 + ((len + 1) & ~1))
 	{
-		data_p=last_chunk;
+		fseek (f, base + ofs, SEEK_SET);
+		n = fread (chunk, 1, sizeof(chunk), f);
+		if (n < 8)
+			break;
+		memset (chunk + n, 0, sizeof(chunk) - n);
+
+		len = S_ChunkLong (chunk + 4);
+		if (len < 0)
+			break;
 
-		if (data_p >= iff_end)
-		{	// didn't find the chunk
-			data_p = NULL;
-			return;
+		if (!memcmp (chunk, "fmt ", 4))
+		{
+			if (S_ChunkShort (chunk + 8) != 1)
+				return false;		// PCM only
+			info->channels = S_ChunkShort (chunk + 10);
+			info->rate = S_ChunkLong (chunk + 12);
+			info->width = S_ChunkShort (chunk + 22) / 8;
+		}
+		else if (!memcmp (chunk, "cue ", 4))
+		{
+			info->loopstart = S_ChunkLong (chunk + 32);
+			aftercue = true;
 		}
-		
-		data_p += 4;
-		iff_chunk_len = GetLittleLong();
-		if (iff_chunk_len < 0)
+		else if (!memcmp (chunk, "LIST", 4) && aftercue && !memcmp (chunk + 28, "mark", 4))
+			loopsamples = S_ChunkLong (chunk + 24);
+		else if (!memcmp (chunk, "data", 4))
 		{
-			data_p = NULL;
-			return;
+			info->dataofs = ofs + 8;
+			datalen = len;
 		}
-//		if (iff_chunk_len > 1024*1024)
-//			Sys_Error ("FindNextChunk: %i length is past the 1 meg sanity limit", iff_chunk_len);
-		data_p -= 8;
-		last_chunk = data_p + 8 + ( (iff_chunk_len + 1) & ~1 );
-		if (!Q_strncmp(data_p, name, 4))
-			return;
 	}
+
+	if (datalen < 0 || info->channels != 1 || info->rate <= 0
+	|| info->width < 1 || info->width > 2)
+		return false;
+	if (datalen > filelen - info->dataofs)
+		datalen = filelen - info->dataofs;	// truncated file
+
+	info->samples = datalen / info->width;
+	if (loopsamples && info->loopstart + loopsamples <= info->samples)
+		info->samples = info->loopstart + loopsamples;
+	if (info->loopstart >= info->samples)
+		info->loopstart = -1;
+	return true;
 }
 
-void FindChunk(char *name)
+/*
+===============================================================================
+
+STREAMING
+
+A sound whose decoded data would be larger than snd_streamsize only gets a
+header in the cache; its sfxcache_t data holds the source wavinfo_t.  Each
+channel playing it opens a stream that reads the wav out of the pak a chunk
+at a time and keeps about a second of output decoded ahead of the mixer.
+Streams use linear interpolation rather than the sinc filter.
+
+Slots are static so the mixer thread never sees one freed under it, and a
+closed slot rests a moment before reuse in case a queued channel still
+points at it.
+
+===============================================================================
+*/
+
+static sndstream_t	snd_streams[MAX_STREAMS];
+int			snd_streamstarves;		// mixes that ran past the decoded data
+
+/*
+================
+S_StreamHeader
+
+A data-less cache entry for a sound too big to keep resident
+================
+*/
+static sfxcache_t *S_StreamHeader (sfx_t *s, wavinfo_t *info)
 {
-	last_chunk = iff_data;
-	FindNextChunk (name);
+	float		stepscale;
+	sfxcache_t	*sc;
+
+	sc = Cache_Alloc (&s->cache, sizeof(sfxcache_t) + sizeof(wavinfo_t), s->name);
+	if (!sc)
+		return NULL;
+
+	stepscale = (float)info->rate / shm->speed;
+	sc->length = info->samples / stepscale;
+	sc->loopstart = info->loopstart;
+	if (sc->loopstart != -1)
+		sc->loopstart = sc->loopstart / stepscale;
+	sc->speed = shm->speed;
+	sc->width = 2;
+	sc->stereo = 0;
+	sc->stream = true;
+	memcpy (sc->data, info, sizeof(*info));
+
+	return sc;
 }
 
+/*
+================
+S_StreamAdvance
 
-void DumpChunks(void)
+Moves an output position on by count, following the loop
+================
+*/
+static int S_StreamAdvance (sndstream_t *st, int pos, int count)
 {
-	char	str[5];
-	
-	str[4] = 0;
-	data_p=iff_data;
-	do
-	{
-		memcpy (str, data_p, 4);
-		data_p += 4;
-		iff_chunk_len = GetLittleLong();
-		Con_Printf ("0x%x : %s (%d)\n", (int)(data_p - 4), str, iff_chunk_len);
-		data_p += (iff_chunk_len + 1) & ~1;
-	} while (data_p < iff_end);
+	pos += count;
+	if (pos < st->length)
+		return pos;
+	if (st->loopstart < 0 || st->loopstart >= st->length)
+		return st->length;		// silence from here on
+	return st->loopstart + (pos - st->length) % (st->length - st->loopstart);
 }
 
 /*
-============
-GetWavinfo
-============
+================
+S_StreamSource
+
+Source sample i in 16 bit range, read through the chunk buffer
+================
 */
-wavinfo_t GetWavinfo (char *name, byte *wav, int wavlength)
+static int S_StreamSource (sndstream_t *st, int i)
 {
-	wavinfo_t	info;
-	int     i;
-	int     format;
-	int		samples;
+	if (i >= st->info.samples)
+	{
+		if (st->info.loopstart < 0)
+			return 0;
+		i = st->info.loopstart + (i - st->info.samples) % (st->info.samples - st->info.loopstart);
+	}
 
-	memset (&info, 0, sizeof(info));
+	if (i < st->srcstart || i >= st->srcstart + st->srccount)
+	{
+		fseek (st->file, st->fileofs + i * st->info.width, SEEK_SET);
+		st->srcstart = i;
+		st->srccount = fread (st->src, st->info.width, STREAM_CHUNK / st->info.width, st->file);
+		if (st->srccount <= 0)
+		{
+			st->srccount = 0;
+			return 0;
+		}
+	}
+
+	i -= st->srcstart;
+	if (st->info.width == 2)
+		return LittleShort (((short *)st->src)[i]);
+	return (int)(st->src[i] - 128) << 8;
+}
 
-	if (!wav)
-		return info;
-		
-	iff_data = wav;
-	iff_end = wav + wavlength;
+/*
+================
+S_FillStream
 
-// find "RIFF" chunk
-	FindChunk("RIFF");
-	if (!(data_p && !Q_strncmp(data_p+8, "WAVE", 4)))
+Decodes until the ring is a full second ahead of the mixer
+================
+*/
+static void S_FillStream (sndstream_t *st)
+{
+	int		written, played, end;
+	int		i, s0, s1;
+	double	step, pos;
+
+	written = st->written;
+	played = st->played;
+	if (played > written)
+	{	// the mixer ran dry; don't decode what it has already passed
+		st->decodepos = S_StreamAdvance (st, st->decodepos, played - written);
+		written = played;
+	}
+
+	step = (double)st->info.rate / shm->speed;
+	for (end = played + st->ringsize ; written < end ; written++)
 	{
-		Con_Printf("Missing RIFF/WAVE chunks\n");
-		return info;
+		if (st->decodepos >= st->length)
+			st->ring[written % st->ringsize] = 0;
+		else
+		{
+			pos = st->decodepos * step;
+			i = (int)pos;
+			s0 = S_StreamSource (st, i);
+			s1 = S_StreamSource (st, i + 1);
+			st->ring[written % st->ringsize] = s0 + (int)((s1 - s0) * (pos - i));
+		}
+		st->decodepos = S_StreamAdvance (st, st->decodepos, 1);
 	}
 
-// get "fmt " chunk
-	iff_data = data_p + 12;
-// DumpChunks ();
+// the samples have to land before the mixer is told about them
+	Sys_MemoryBarrier ();
+	st->written = written;
+}
+
+/*
+================
+S_OpenStream
 
-	FindChunk("fmt ");
-	if (!data_p)
+Starts decoding sfx from output position pos.  Returns NULL if every
+stream slot is busy.
+================
+*/
+sndstream_t *S_OpenStream (sfx_t *sfx, sfxcache_t *sc, int pos)
+{
+	char		name[MAX_QPATH];
+	sndstream_t	*st;
+	FILE		*f;
+	double		now;
+	int			i;
+
+	now = Sys_FloatTime ();
+	for (i=0, st=snd_streams ; i<MAX_STREAMS ; i++, st++)
+		if (!st->active && st->freetime <= now)
+			break;
+	if (i == MAX_STREAMS)
 	{
-		Con_Printf("Missing fmt chunk\n");
-		return info;
+		Con_DPrintf ("S_OpenStream: no free stream for %s\n", sfx->name);
+		return NULL;
 	}
-	data_p += 8;
-	format = GetLittleShort();
-	if (format != 1)
+
+	sprintf (name, "sound/%s", sfx->name);
+	COM_FOpenFile (name, &f);
+	if (!f)
+		return NULL;
+
+	if (!st->ring || st->ringsize != shm->speed)
 	{
-		Con_Printf("Microsoft PCM format only\n");
-		return info;
+		free (st->ring);
+		st->ringsize = shm->speed;
+		st->ring = malloc (st->ringsize * sizeof(short));
+		if (!st->ring)
+			Sys_Error ("S_OpenStream: out of memory");
 	}
 
-	info.channels = GetLittleShort();
-	info.rate = GetLittleLong();
-	data_p += 4+2;
-	info.width = GetLittleShort() / 8;
+	memcpy (&st->info, sc->data, sizeof(st->info));
+	st->file = f;
+	st->fileofs = ftell (f) + st->info.dataofs;
+	st->sfx = sfx;
+	st->length = sc->length;
+	st->loopstart = sc->loopstart;
+	st->written = st->played = 0;
+	st->decodepos = pos;
+	st->srcstart = st->srccount = 0;
+	st->active = true;
+
+	S_FillStream (st);
+	return st;
+}
+
+/*
+================
+S_FreeStream
+================
+*/
+static void S_FreeStream (sndstream_t *st, float rest)
+{
+	fclose (st->file);
+	st->file = NULL;
+	st->sfx = NULL;
+	st->active = false;
+	st->freetime = Sys_FloatTime () + rest;
+}
+
+/*
+================
+S_UpdateStreams
+
+Called from S_Update.  Closes streams no channel plays any more and tops
+up the rest.
+================
+*/
+void S_UpdateStreams (void)
+{
+	sndstream_t	*st;
+	int			i, j;
 
-// get cue chunk
-	FindChunk("cue ");
-	if (data_p)
+	for (i=0, st=snd_streams ; i<MAX_STREAMS ; i++, st++)
 	{
-		data_p += 32;
-		info.loopstart = GetLittleLong();
-//		Con_Printf("loopstart=%d\n", sfx->loopstart);
+		if (!st->active)
+			continue;
 
-	// if the next chunk is a LIST chunk, look for a cue length marker
-		FindNextChunk ("LIST");
-		if (data_p)
+		for (j=0 ; j<total_channels ; j++)
+			if (channels[j].sfx && channels[j].stream == st)
+				break;
+		if (j == total_channels)
 		{
-			if (!strncmp (data_p + 28, "mark", 4))
-			{	// this is not a proper parse, but it works with cooledit...
-				data_p += 24;
-				i = GetLittleLong ();	// samples in loop
-				info.samples = info.loopstart + i;
-//				Con_Printf("looped length: %i\n", i);
-			}
+			S_FreeStream (st, 0.25);
+			continue;
 		}
+
+		S_FillStream (st);
 	}
-	else
-		info.loopstart = -1;
+}
+
+/*
+================
+S_CloseStreams
+================
+*/
+void S_CloseStreams (void)
+{
+	sndstream_t	*st;
+	int			i;
+
+	for (i=0, st=snd_streams ; i<MAX_STREAMS ; i++, st++)
+		if (st->active)
+			S_FreeStream (st, 0);
+}
+
+//=============================================================================
+
+/*
+==============
+S_LoadSound
+==============
+*/
+sfxcache_t *S_LoadSound (sfx_t *s)
+{
+    char	namebuffer[256];
+	char	cachepath[MAX_OSPATH];
+	byte	*data;
+	wavinfo_t	info;
+	FILE	*f;
+	int		filelen, base;
+	int		len, i;
+	int		width;
+	float	stepscale;
+	unsigned short	crc;
+	qboolean	usecache;
+	sfxcache_t	*sc;
+	byte	stackbuf[1*1024];		// avoid dirtying the cache heap
 
-// find data chunk
-	FindChunk("data");
-	if (!data_p)
+// see if still in memory
+	sc = Cache_Check (&s->cache);
+	if (sc)
+		return sc;
+
+//Con_Printf ("S_LoadSound: %x\n", (int)stackbuf);
+// load it in
+    Q_strcpy(namebuffer, "sound/");
+    Q_strcat(namebuffer, s->name);
+
+//	Con_Printf ("loading %s\n",namebuffer);
+
+	filelen = COM_FOpenFile (namebuffer, &f);
+	if (!f)
 	{
-		Con_Printf("Missing data chunk\n");
-		return info;
+		Con_Printf ("Couldn't load %s\n", namebuffer);
+		return NULL;
 	}
 
-	data_p += 4;
-	samples = GetLittleLong () / info.width;
+// the headers decide whether the samples are read at all
+	base = ftell (f);
+	if (!S_ReadWavinfo (f, filelen, &info))
+	{
+		Con_Printf ("%s is not a mono PCM wav\n", s->name);
+		fclose (f);
+		return NULL;
+	}
+
+	stepscale = (float)info.rate / shm->speed;	
+	len = info.samples / stepscale;
+
+	width = S_OutputWidth (info.rate, info.width);
+	len = len * width * info.channels;
 
-	if (info.samples)
+	if (snd_streamsize.value > 0 && len > snd_streamsize.value)
 	{
-		if (samples < info.samples)
-			Sys_Error ("Sound %s has a bad loop length", name);
+		fclose (f);
+		return S_StreamHeader (s, &info);
 	}
+
+	if (filelen > (int)sizeof(stackbuf))
+		data = Hunk_TempAlloc (filelen);
 	else
-		info.samples = samples;
+		data = stackbuf;
+
+	Draw_BeginDisc ();
+	fseek (f, base, SEEK_SET);
+	i = fread (data, 1, filelen, f);
+	fclose (f);
+	Draw_EndDisc ();
+	if (i != filelen)
+	{
+		Con_Printf ("Couldn't load %s\n", namebuffer);
+		return NULL;
+	}
 
-	info.dataofs = data_p - wav;
+// only filtered output is worth keeping on disk
+	usecache = snd_diskcache.value && snd_resample.value && stepscale != 1;
+	if (usecache)
+	{
+		CRC_Init (&crc);
+		for (i=0 ; i<filelen ; i++)
+			CRC_ProcessByte (&crc, data[i]);
+		S_SoundCachePath (cachepath, s->name, CRC_Value (crc), width);
+
+		sc = S_ReadSoundCache (s, cachepath, width);
+		if (sc)
+			return sc;
+	}
+
+	sc = Cache_Alloc ( &s->cache, len + sizeof(sfxcache_t), s->name);
+	if (!sc)
+		return NULL;
 	
-	return info;
-}
+	sc->length = info.samples;
+	sc->loopstart = info.loopstart;
+	sc->speed = info.rate;
+	sc->width = info.width;
+	sc->stereo = info.channels;
+	sc->stream = false;
 
+	ResampleSfx (s, sc->speed, sc->width, data + info.dataofs);
+
+	if (usecache)
+		S_WriteSoundCache (sc, cachepath);
+
+	return sc;
+}
@@ -27,35 +27,213 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 #define DWORD	unsigned long
 #endif
 
+#if idSSE
+#include <emmintrin.h>
+#endif
+
 #define	PAINTBUFFER_SIZE	512
 portable_samplepair_t paintbuffer[PAINTBUFFER_SIZE];
-int		snd_scaletable[32][256];
-int 	*snd_p, snd_linear_count, snd_vol;
+float	*snd_p, snd_vol;
+int		snd_linear_count;
 short	*snd_out;
 
-void Snd_WriteLinearBlastStereo16 (void)
+cvar_t	snd_simd = {"snd_simd", "1"};
+
+// voice statistics, in channel sample pairs
+double	snd_mixedsamples;		// painted into the paintbuffer
+double	snd_virtualsamples;		// only advanced
+double	snd_mixtime;			// seconds spent in SND_MixChannels
+int		snd_statsreset;			// bumped to have the mixer zero the above
+static int	snd_statsresetseen;
+
+/*
+===============================================================================
+
+MIXING KERNELS
+
+Each kernel adds count source samples into an interleaved stereo float
+buffer.  The gains move linearly by lstep/rstep per sample so volume
+changes don't step audibly ("zipper" noise).  8 bit sources are passed
+gains already scaled by 256, so both widths land in 16 bit range.
+
+===============================================================================
+*/
+
+typedef void (*mix8_t) (float *out, signed char *in, int count, float l, float r, float lstep, float rstep);
+typedef void (*mix16_t) (float *out, short *in, int count, float l, float r, float lstep, float rstep);
+typedef void (*blast_t) (short *out, float *in, int count, float vol);
+
+static mix8_t	SND_Mix8;
+static mix16_t	SND_Mix16;
+static blast_t	SND_Blast16;
+
+static void SND_Mix8_C (float *out, signed char *in, int count, float l, float r, float lstep, float rstep)
+{
+	int		i;
+	float	data;
+
+	for (i=0 ; i<count ; i++, out += 2)
+	{
+		data = in[i];
+		out[0] += data * l;
+		out[1] += data * r;
+		l += lstep;
+		r += rstep;
+	}
+}
+
+static void SND_Mix16_C (float *out, short *in, int count, float l, float r, float lstep, float rstep)
+{
+	int		i;
+	float	data;
+
+	for (i=0 ; i<count ; i++, out += 2)
+	{
+		data = in[i];
+		out[0] += data * l;
+		out[1] += data * r;
+		l += lstep;
+		r += rstep;
+	}
+}
+
+static void SND_Blast16_C (short *out, float *in, int count, float vol)
 {
 	int		i;
 	int		val;
 
-	for (i=0 ; i<snd_linear_count ; i+=2)
+	for (i=0 ; i<count ; i++)
 	{
-		val = (snd_p[i]*snd_vol)>>8;
+		val = (int)(in[i] * vol);
 		if (val > 0x7fff)
-			snd_out[i] = 0x7fff;
+			out[i] = 0x7fff;
 		else if (val < (short)0x8000)
-			snd_out[i] = (short)0x8000;
+			out[i] = (short)0x8000;
 		else
-			snd_out[i] = val;
+			out[i] = val;
+	}
+}
 
-		val = (snd_p[i+1]*snd_vol)>>8;
-		if (val > 0x7fff)
-			snd_out[i+1] = 0x7fff;
-		else if (val < (short)0x8000)
-			snd_out[i+1] = (short)0x8000;
-		else
-			snd_out[i+1] = val;
+#if idSSE
+
+static void SND_Mix8_SSE (float *out, signed char *in, int count, float l, float r, float lstep, float rstep)
+{
+	int		i, bytes;
+	__m128	vl, vr, vlstep, vrstep, s, a, b;
+	__m128i	x;
+
+	vl = _mm_add_ps (_mm_set1_ps (l), _mm_mul_ps (_mm_set1_ps (lstep), _mm_set_ps (3, 2, 1, 0)));
+	vr = _mm_add_ps (_mm_set1_ps (r), _mm_mul_ps (_mm_set1_ps (rstep), _mm_set_ps (3, 2, 1, 0)));
+	vlstep = _mm_set1_ps (lstep * 4);
+	vrstep = _mm_set1_ps (rstep * 4);
+
+	for (i=0 ; i+4 <= count ; i+=4)
+	{
+	// sign extend four bytes into the top of each lane
+		memcpy (&bytes, in + i, 4);
+		x = _mm_cvtsi32_si128 (bytes);
+		x = _mm_unpacklo_epi8 (x, x);
+		x = _mm_unpacklo_epi16 (x, x);
+		s = _mm_cvtepi32_ps (_mm_srai_epi32 (x, 24));
+
+		a = _mm_mul_ps (s, vl);
+		b = _mm_mul_ps (s, vr);
+		_mm_storeu_ps (out + i*2, _mm_add_ps (_mm_loadu_ps (out + i*2), _mm_unpacklo_ps (a, b)));
+		_mm_storeu_ps (out + i*2 + 4, _mm_add_ps (_mm_loadu_ps (out + i*2 + 4), _mm_unpackhi_ps (a, b)));
+
+		vl = _mm_add_ps (vl, vlstep);
+		vr = _mm_add_ps (vr, vrstep);
+	}
+
+	if (i < count)
+		SND_Mix8_C (out + i*2, in + i, count - i, l + lstep*i, r + rstep*i, lstep, rstep);
+}
+
+static void SND_Mix16_SSE (float *out, short *in, int count, float l, float r, float lstep, float rstep)
+{
+	int		i;
+	__m128	vl, vr, vlstep, vrstep, s, a, b;
+	__m128i	x;
+
+	vl = _mm_add_ps (_mm_set1_ps (l), _mm_mul_ps (_mm_set1_ps (lstep), _mm_set_ps (3, 2, 1, 0)));
+	vr = _mm_add_ps (_mm_set1_ps (r), _mm_mul_ps (_mm_set1_ps (rstep), _mm_set_ps (3, 2, 1, 0)));
+	vlstep = _mm_set1_ps (lstep * 4);
+	vrstep = _mm_set1_ps (rstep * 4);
+
+	for (i=0 ; i+4 <= count ; i+=4)
+	{
+		x = _mm_loadl_epi64 ((__m128i *)(in + i));
+		x = _mm_unpacklo_epi16 (x, x);
+		s = _mm_cvtepi32_ps (_mm_srai_epi32 (x, 16));
+
+		a = _mm_mul_ps (s, vl);
+		b = _mm_mul_ps (s, vr);
+		_mm_storeu_ps (out + i*2, _mm_add_ps (_mm_loadu_ps (out + i*2), _mm_unpacklo_ps (a, b)));
+		_mm_storeu_ps (out + i*2 + 4, _mm_add_ps (_mm_loadu_ps (out + i*2 + 4), _mm_unpackhi_ps (a, b)));
+
+		vl = _mm_add_ps (vl, vlstep);
+		vr = _mm_add_ps (vr, vrstep);
 	}
+
+	if (i < count)
+		SND_Mix16_C (out + i*2, in + i, count - i, l + lstep*i, r + rstep*i, lstep, rstep);
+}
+
+static void SND_Blast16_SSE (short *out, float *in, int count, float vol)
+{
+	int		i;
+	__m128	v;
+	__m128i	a, b;
+
+	v = _mm_set1_ps (vol);
+	for (i=0 ; i+8 <= count ; i+=8)
+	{
+	// packs saturates to the 16 bit range for us
+		a = _mm_cvttps_epi32 (_mm_mul_ps (_mm_loadu_ps (in + i), v));
+		b = _mm_cvttps_epi32 (_mm_mul_ps (_mm_loadu_ps (in + i + 4), v));
+		_mm_storeu_si128 ((__m128i *)(out + i), _mm_packs_epi32 (a, b));
+	}
+
+	if (i < count)
+		SND_Blast16_C (out + i, in + i, count - i, vol);
+}
+
+#endif
+
+/*
+================
+SND_SelectMixer
+
+Picks the kernels for this mix; snd_simd 0 forces the C versions
+================
+*/
+void SND_SelectMixer (void)
+{
+#if idSSE
+	if (snd_simd.value && Sys_HaveSSE2 ())
+	{
+		SND_Mix8 = SND_Mix8_SSE;
+		SND_Mix16 = SND_Mix16_SSE;
+		SND_Blast16 = SND_Blast16_SSE;
+		return;
+	}
+#endif
+	SND_Mix8 = SND_Mix8_C;
+	SND_Mix16 = SND_Mix16_C;
+	SND_Blast16 = SND_Blast16_C;
+}
+
+/*
+===============================================================================
+
+TRANSFER
+
+===============================================================================
+*/
+
+void Snd_WriteLinearBlastStereo16 (void)
+{
+	SND_Blast16 (snd_out, snd_p, snd_linear_count, snd_vol);
 }
 
 void S_TransferStereo16 (int endtime)
@@ -70,9 +248,9 @@ void S_TransferStereo16 (int endtime)
 	HRESULT	hresult;
 #endif
 	
-	snd_vol = volume.value*256;
+	snd_vol = volume.value;
 
-	snd_p = (int *) paintbuffer;
+	snd_p = (float *) paintbuffer;
 	lpaintedtime = paintedtime;
 
 #ifdef _WIN32
@@ -137,10 +315,10 @@ void S_TransferPaintBuffer(int endtime)
 	int 	out_idx;
 	int 	count;
 	int 	out_mask;
-	int 	*p;
+	float 	*p;
 	int 	step;
 	int		val;
-	int		snd_vol;
+	float	snd_vol;
 	DWORD	*pbuf;
 #ifdef _WIN32
 	int		reps;
@@ -155,12 +333,12 @@ void S_TransferPaintBuffer(int endtime)
 		return;
 	}
 	
-	p = (int *) paintbuffer;
+	p = (float *) paintbuffer;
 	count = (endtime - paintedtime) * shm->channels;
 	out_mask = shm->samples - 1; 
 	out_idx = paintedtime * shm->channels & out_mask;
 	step = 3 - shm->channels;
-	snd_vol = volume.value*256;
+	snd_vol = volume.value;
 
 #ifdef _WIN32
 	if (pDSBuf)
@@ -198,7 +376,7 @@ void S_TransferPaintBuffer(int endtime)
 		short *out = (short *) pbuf;
 		while (count--)
 		{
-			val = (*p * snd_vol) >> 8;
+			val = (int)(*p * snd_vol);
 			p+= step;
 			if (val > 0x7fff)
 				val = 0x7fff;
@@ -213,7 +391,7 @@ void S_TransferPaintBuffer(int endtime)
 		unsigned char *out = (unsigned char *) pbuf;
 		while (count--)
 		{
-			val = (*p * snd_vol) >> 8;
+			val = (int)(*p * snd_vol);
 			p+= step;
 			if (val > 0x7fff)
 				val = 0x7fff;
@@ -251,75 +429,221 @@ CHANNEL MIXING
 ===============================================================================
 */
 
-void SND_PaintChannelFrom8 (channel_t *ch, sfxcache_t *sc, int endtime);
-void SND_PaintChannelFrom16 (channel_t *ch, sfxcache_t *sc, int endtime);
+/*
+================
+SND_PaintStream
 
-void S_PaintChannels(int endtime)
+Mixes from a stream's ring.  If the main thread hasn't decoded far enough
+the rest is left silent and skipped, so the stream stays in step with pos.
+================
+*/
+static void SND_PaintStream (sndstream_t *st, float *out, int count, float l, float r, float lstep, float rstep)
+{
+	int		avail, start, n;
+
+	avail = st->written - st->played;
+	Sys_MemoryBarrier ();
+	if (avail < count)
+	{
+		snd_streamstarves++;
+		if (avail < 0)
+			avail = 0;
+	}
+	else
+		avail = count;
+
+	while (avail > 0)
+	{
+		start = st->played % st->ringsize;
+		n = st->ringsize - start;
+		if (n > avail)
+			n = avail;
+		SND_Mix16 (out, st->ring + start, n, l, r, lstep, rstep);
+		out += n*2;
+		l += lstep*n;
+		r += rstep*n;
+		st->played += n;
+		avail -= n;
+		count -= n;
+	}
+
+	st->played += count;
+}
+
+/*
+================
+SND_PaintChannel
+
+Mixes count samples of a channel into the paintbuffer at ofs, ramping its
+gains from the last mixed values toward leftvol/rightvol
+================
+*/
+void SND_PaintChannel (channel_t *ch, sfxcache_t *sc, int ofs, int count)
+{
+	float	l, r, lstep, rstep;
+	float	*out;
+
+	if (ch->leftvol > 255)
+		ch->leftvol = 255;
+	if (ch->rightvol > 255)
+		ch->rightvol = 255;
+
+	l = ch->mixleft;
+	r = ch->mixright;
+	lstep = (ch->leftvol - l) / count;
+	rstep = (ch->rightvol - r) / count;
+	ch->mixleft = ch->leftvol;
+	ch->mixright = ch->rightvol;
+
+	out = (float *)(paintbuffer + ofs);
+	if (ch->stream)
+		SND_PaintStream (ch->stream, out, count,
+			l * (1.0/256), r * (1.0/256), lstep * (1.0/256), rstep * (1.0/256));
+	else if (sc->width == 1)
+		SND_Mix8 (out, (signed char *)sc->data + ch->pos, count, l, r, lstep, rstep);
+	else
+		SND_Mix16 (out, (short *)sc->data + ch->pos, count,
+			l * (1.0/256), r * (1.0/256), lstep * (1.0/256), rstep * (1.0/256));
+
+	ch->pos += count;
+}
+
+/*
+================
+SND_SkipChannel
+
+A virtual voice moves through its sound exactly as if it had been mixed
+================
+*/
+static void SND_SkipChannel (channel_t *ch, int count)
+{
+	ch->pos += count;
+	if (ch->stream)
+		ch->stream->played += count;
+}
+
+/*
+================
+SND_MixChannels
+
+Paints every audible channel in list from paintedtime up to end.  Silent
+channels are virtual: they keep their place in the sound without being
+mixed.  Without load, sounds that aren't resident are skipped.
+================
+*/
+void SND_MixChannels (channel_t *list, int numchannels, int end, qboolean load)
 {
 	int 	i;
-	int 	end;
 	channel_t *ch;
 	sfxcache_t	*sc;
 	int		ltime, count;
+	qboolean	virt;
 
-	while (paintedtime < endtime)
+	ch = list;
+	for (i=0; i<numchannels ; i++, ch++)
 	{
-	// if paintbuffer is smaller than DMA buffer
-		end = endtime;
-		if (endtime - paintedtime > PAINTBUFFER_SIZE)
-			end = paintedtime + PAINTBUFFER_SIZE;
-
-	// clear the paint buffer
-		Q_memset(paintbuffer, 0, (end - paintedtime) * sizeof(portable_samplepair_t));
+		if (!ch->sfx)
+			continue;
 
-	// paint in the channels.
-		ch = channels;
-		for (i=0; i<total_channels ; i++, ch++)
-		{
-			if (!ch->sfx)
-				continue;
-			if (!ch->leftvol && !ch->rightvol)
-				continue;
+	// a channel that just went silent still ramps down once
+		virt = !ch->leftvol && !ch->rightvol && !ch->mixleft && !ch->mixright;
+		if (load && !virt)
 			sc = S_LoadSound (ch->sfx);
-			if (!sc)
-				continue;
+		else
+			sc = Cache_Check (&ch->sfx->cache);	// the mixer thread can't load
+		if (!sc)
+		{
+		// a silent voice keeps its place while its sound is out of the
+		// cache, up to ch->end; looping or stopping waits until it's back
+			if (virt)
+			{
+				count = (ch->end < end ? ch->end : end) - paintedtime;
+				if (count > 0)
+				{
+					SND_SkipChannel (ch, count);
+					snd_virtualsamples += count;
+				}
+			}
+			continue;
+		}
+		if (sc->stream && !ch->stream)
+			continue;		// nothing resident to mix from
 
-			ltime = paintedtime;
+		ltime = paintedtime;
 
-			while (ltime < end)
-			{	// paint up to end
-				if (ch->end < end)
-					count = ch->end - ltime;
-				else
-					count = end - ltime;
+		while (ltime < end)
+		{	// paint up to end
+			if (ch->end < end)
+				count = ch->end - ltime;
+			else
+				count = end - ltime;
 
-				if (count > 0)
-				{	
-					if (sc->width == 1)
-						SND_PaintChannelFrom8(ch, sc, count);
-					else
-						SND_PaintChannelFrom16(ch, sc, count);
-	
-					ltime += count;
+			if (count > 0)
+			{	
+				if (virt)
+				{
+					SND_SkipChannel (ch, count);
+					snd_virtualsamples += count;
 				}
+				else
+				{
+					SND_PaintChannel (ch, sc, ltime - paintedtime, count);
+					snd_mixedsamples += count;
+				}
+				ltime += count;
+			}
 
-			// if at end of loop, restart
-				if (ltime >= ch->end)
+		// if at end of loop, restart
+			if (ltime >= ch->end)
+			{
+				if (sc->loopstart >= 0)
 				{
-					if (sc->loopstart >= 0)
-					{
-						ch->pos = sc->loopstart;
-						ch->end = ltime + sc->length - ch->pos;
-					}
-					else				
-					{	// channel just stopped
-						ch->sfx = NULL;
-						break;
-					}
+					ch->pos = sc->loopstart;
+					ch->end = ltime + sc->length - ch->pos;
+				}
+				else				
+				{	// channel just stopped
+					ch->sfx = NULL;
+					break;
 				}
 			}
-															  
 		}
+	}
+}
+
+void S_PaintChannels(int endtime)
+{
+	S_PaintChannelList (channels, total_channels, endtime, true);
+}
+
+void S_PaintChannelList (channel_t *list, int numchannels, int endtime, qboolean load)
+{
+	int 	end;
+	double	start;
+
+	SND_SelectMixer ();
+
+// the stats are only written by whichever thread mixes
+	if (snd_statsreset != snd_statsresetseen)
+	{
+		snd_statsresetseen = snd_statsreset;
+		snd_mixedsamples = snd_virtualsamples = snd_mixtime = 0;
+	}
+
+	while (paintedtime < endtime)
+	{
+	// if paintbuffer is smaller than DMA buffer
+		end = endtime;
+		if (endtime - paintedtime > PAINTBUFFER_SIZE)
+			end = paintedtime + PAINTBUFFER_SIZE;
+
+	// clear the paint buffer
+		Q_memset(paintbuffer, 0, (end - paintedtime) * sizeof(portable_samplepair_t));
+
+	// paint in the channels.
+		start = Sys_ProfileTime ();
+		SND_MixChannels (list, numchannels, end, load);
+		snd_mixtime += Sys_ProfileTime () - start;
 
 	// transfer out according to DMA format
 		S_TransferPaintBuffer(end);
@@ -327,64 +651,477 @@ void S_PaintChannels(int endtime)
 	}
 }
 
-void SND_InitScaletable (void)
+/*
+===============================================================================
+
+BENCHMARK
+
+===============================================================================
+*/
+
+#define	BENCH_SAMPLES	(22050*4)
+
+/*
+================
+SND_BenchmarkPath
+
+Mixes all channels for length seconds of output into a null buffer
+================
+*/
+static double SND_BenchmarkPath (float length)
 {
-	int		i, j;
-	
-	for (i=0 ; i<32 ; i++)
-		for (j=0 ; j<256 ; j++)
-			snd_scaletable[i][j] = ((signed char)j) * i * 8;
+	int		i, total;
+	double	start;
+
+	for (i=0 ; i<MAX_CHANNELS ; i++)
+		channels[i].end = paintedtime + 0x10000000;	// never stop
+
+	total = (int)(length * shm->speed);
+	start = Sys_FloatTime ();
+	S_PaintChannels (paintedtime + total);
+	return total / (Sys_FloatTime () - start);
 }
 
+/*
+================
+SND_Benchmark_f
 
-void SND_PaintChannelFrom8 (channel_t *ch, sfxcache_t *sc, int count)
+snd_benchmark [seconds]
+Mixes MAX_CHANNELS looping channels with both the C and SIMD kernels
+================
+*/
+void SND_Benchmark_f (void)
 {
-	int 	data;
-	int		*lscale, *rscale;
-	unsigned char *sfx;
-	int		i;
+	static sfx_t	sfx8, sfx16;
+	static channel_t	saved[MAX_CHANNELS];
+	volatile dma_t	*savedshm;
+	dma_t		nulldma;
+	sfxcache_t	*sc;
+	int			i, savedtotal, savedpainted;
+	float		length, savedsimd;
+	double		c, simd;
+#ifdef _WIN32
+	LPDIRECTSOUNDBUFFER	saveddsbuf;
+#endif
 
-	if (ch->leftvol > 255)
-		ch->leftvol = 255;
-	if (ch->rightvol > 255)
-		ch->rightvol = 255;
-		
-	lscale = snd_scaletable[ch->leftvol >> 3];
-	rscale = snd_scaletable[ch->rightvol >> 3];
-	sfx = (signed char *)sc->data + ch->pos;
+	if (snd_threaded)
+	{
+		Con_Printf ("set snd_mixthread 0 before benchmarking\n");
+		return;
+	}
 
-	for (i=0 ; i<count ; i++)
+	length = 5;
+	if (Cmd_Argc () > 1)
+		length = Q_atof (Cmd_Argv (1));
+
+// looping noise at 8 and 16 bits
+	strcpy (sfx8.name, "*bench8");
+	strcpy (sfx16.name, "*bench16");
+	sc = Cache_Alloc (&sfx8.cache, sizeof(sfxcache_t) + BENCH_SAMPLES, sfx8.name);
+	if (!sc)
+		return;
+	sc->length = BENCH_SAMPLES;
+	sc->loopstart = 0;
+	sc->speed = 22050;
+	sc->width = 1;
+	sc->stereo = 0;
+	sc->stream = false;
+	for (i=0 ; i<BENCH_SAMPLES ; i++)
+		sc->data[i] = rand ();
+
+	sc = Cache_Alloc (&sfx16.cache, sizeof(sfxcache_t) + BENCH_SAMPLES*2, sfx16.name);
+	if (!sc)
 	{
-		data = sfx[i];
-		paintbuffer[i].left += lscale[data];
-		paintbuffer[i].right += rscale[data];
+		Cache_Free (&sfx8.cache);
+		return;
 	}
-	
-	ch->pos += count;
+	sc->length = BENCH_SAMPLES;
+	sc->loopstart = 0;
+	sc->speed = 22050;
+	sc->width = 2;
+	sc->stereo = 0;
+	sc->stream = false;
+	for (i=0 ; i<BENCH_SAMPLES ; i++)
+		((short *)sc->data)[i] = rand ();
+
+// mix into memory instead of the device
+	memset (&nulldma, 0, sizeof(nulldma));
+	nulldma.channels = 2;
+	nulldma.samplebits = 16;
+	nulldma.speed = 22050;
+	nulldma.samples = 32768;
+	nulldma.buffer = malloc (nulldma.samples * 2);
+	if (!nulldma.buffer)
+		Sys_Error ("SND_Benchmark_f: out of memory");
+
+	savedshm = shm;
+	savedtotal = total_channels;
+	savedpainted = paintedtime;
+	savedsimd = snd_simd.value;
+	memcpy (saved, channels, sizeof(saved));
+#ifdef _WIN32
+	saveddsbuf = pDSBuf;
+	pDSBuf = NULL;
+#endif
+	shm = &nulldma;
+
+	memset (channels, 0, sizeof(channels));
+	for (i=0 ; i<MAX_CHANNELS ; i++)
+	{
+		channels[i].sfx = (i & 1) ? &sfx16 : &sfx8;
+		channels[i].leftvol = rand () & 255;
+		channels[i].rightvol = rand () & 255;
+		channels[i].pos = rand () % BENCH_SAMPLES;
+	}
+	total_channels = MAX_CHANNELS;
+
+	snd_simd.value = 0;
+	c = SND_BenchmarkPath (length);
+	snd_simd.value = 1;
+	simd = SND_BenchmarkPath (length);
+
+	snd_simd.value = savedsimd;
+	memcpy (channels, saved, sizeof(saved));
+	total_channels = savedtotal;
+	paintedtime = savedpainted;
+	shm = savedshm;
+#ifdef _WIN32
+	pDSBuf = saveddsbuf;
+#endif
+	free (nulldma.buffer);
+	Cache_Free (&sfx8.cache);
+	Cache_Free (&sfx16.cache);
+
+	Con_Printf ("%i channels, C: %.0f samples/sec (%.1fx realtime)\n",
+		MAX_CHANNELS, c, c / 22050);
+#if idSSE
+	if (Sys_HaveSSE2 ())
+		Con_Printf ("%i channels, SSE2: %.0f samples/sec (%.1fx realtime)\n",
+			MAX_CHANNELS, simd, simd / 22050);
+#endif
+}
+
+/*
+===============================================================================
+
+GOLDEN OUTPUT TEST
+
+snd_goldentest renders a fixed script of synthetic sounds through the real
+start / spatialize / mix path into memory, once with the C kernels and once
+with SIMD.  Every run checks the two outputs agree to within
+GOLDEN_TOLERANCE: the kernels only differ in how the gain ramps round,
+which moves a sample by a fraction of a step per overlapping channel.
+Both runs spatialize with SND_Spatialize so they mix the same volumes;
+snd_spatialcheck covers the batch spatializer.
+
+The checksums of both outputs are also compared with
+<gamedir>/sndgolden.txt if it exists; "snd_goldentest record" writes that
+file.  Float results depend on the compiler and its flags, so those
+goldens belong to a build and are not shipped.
+
+===============================================================================
+*/
+
+#define	GOLDEN_SPEED	22050
+#define	GOLDEN_LENGTH	4.0			// seconds rendered
+#define	GOLDEN_STEP		(GOLDEN_SPEED/20)
+#define	GOLDEN_TOLERANCE	4			// largest C / SIMD difference, 16 bit steps
+
+typedef struct
+{
+	float	time;
+	int		sound;
+	int		entnum;
+	int		entchannel;
+	float	x, y;
+	float	vol, attenuation;
+} goldenevent_t;
+
+static goldenevent_t	golden_script[] =
+{
+	{0.00,	0, 1001, 1,	 200,	0,		1.0,	1.0},
+	{0.20,	1, 1002, 1,	 0,		300,	0.8,	1.0},
+	{0.45,	2, 1003, 1,	 0,		-250,	1.0,	2.0},
+	{0.70,	2, 1004, 1,	 600,	600,	0.5,	0.5},
+	{1.00,	1, 1002, 1,	 -300,	0,		1.0,	1.0},	// replaces the first chirp
+	{1.30,	2, 1005, 0,	 50,	50,		1.0,	3.0},
+	{1.60,	0, 1001, 1,	 -900,	0,		0.6,	1.0},	// loop restarted far away
+	{2.10,	1, 1006, 2,	 0,		0,		1.0,	0.0},	// on top of the listener
+	{2.50,	2, 1007, 1,	 3000,	0,		1.0,	1.0},	// out of range
+	{3.00,	1, 1008, 1,	 100,	-100,	0.3,	1.0},
+};
+
+static sfx_t	golden_sfx[3];
+
+/*
+==================
+SND_GoldenSounds
+
+A looping 8 bit tone, a 16 bit chirp and a short burst of 16 bit noise
+==================
+*/
+static qboolean SND_GoldenSounds (void)
+{
+	sfxcache_t	*sc;
+	int			i, len;
+	unsigned	seed;
+	double		phase;
+
+	strcpy (golden_sfx[0].name, "*goldtone");
+	strcpy (golden_sfx[1].name, "*goldchirp");
+	strcpy (golden_sfx[2].name, "*goldnoise");
+
+	len = GOLDEN_SPEED / 2;
+	sc = Cache_Alloc (&golden_sfx[0].cache, sizeof(sfxcache_t) + len, golden_sfx[0].name);
+	if (!sc)
+		return false;
+	sc->length = len;
+	sc->loopstart = 0;
+	sc->speed = GOLDEN_SPEED;
+	sc->width = 1;
+	sc->stereo = 0;
+	sc->stream = false;
+	for (i=0 ; i<len ; i++)		// 441 Hz, a whole number of cycles
+		((signed char *)sc->data)[i] = (int)(100 * sin (2 * M_PI * 441 * i / GOLDEN_SPEED));
+
+	len = GOLDEN_SPEED;
+	sc = Cache_Alloc (&golden_sfx[1].cache, sizeof(sfxcache_t) + len*2, golden_sfx[1].name);
+	if (!sc)
+		return false;
+	sc->length = len;
+	sc->loopstart = -1;
+	sc->speed = GOLDEN_SPEED;
+	sc->width = 2;
+	sc->stereo = 0;
+	sc->stream = false;
+	phase = 0;
+	for (i=0 ; i<len ; i++)
+	{
+		phase += 2 * M_PI * (200 + 1800.0 * i / len) / GOLDEN_SPEED;
+		((short *)sc->data)[i] = (int)(20000 * sin (phase));
+	}
+
+	len = GOLDEN_SPEED / 4;
+	sc = Cache_Alloc (&golden_sfx[2].cache, sizeof(sfxcache_t) + len*2, golden_sfx[2].name);
+	if (!sc)
+		return false;
+	sc->length = len;
+	sc->loopstart = -1;
+	sc->speed = GOLDEN_SPEED;
+	sc->width = 2;
+	sc->stereo = 0;
+	sc->stream = false;
+	seed = 12345;
+	for (i=0 ; i<len ; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		((short *)sc->data)[i] = (short)(seed >> 16) / 2;
+	}
+
+	return true;
 }
 
+/*
+==================
+SND_GoldenRender
 
-void SND_PaintChannelFrom16 (channel_t *ch, sfxcache_t *sc, int count)
+Plays the script with the current kernels into out, which holds
+GOLDEN_LENGTH seconds of stereo, and returns the checksum of the output
+==================
+*/
+static unsigned short SND_GoldenRender (short *out)
 {
-	int data;
-	int left, right;
-	int leftvol, rightvol;
-	signed short *sfx;
-	int	i;
+	unsigned short	crc;
+	goldenevent_t	*ev;
+	vec3_t		origin;
+	int			t, end, next, pairs, i;
+	byte		*p;
 
-	leftvol = ch->leftvol;
-	rightvol = ch->rightvol;
-	sfx = (signed short *)sc->data + ch->pos;
+	memset (channels, 0, sizeof(channels));
+	total_channels = MAX_DYNAMIC_CHANNELS + NUM_AMBIENTS;
+	paintedtime = 0;
+	memset (shm->buffer, 0, shm->samples * 2);
+	pairs = shm->samples / 2;
 
-	for (i=0 ; i<count ; i++)
+	CRC_Init (&crc);
+	ev = golden_script;
+	end = (int)(GOLDEN_LENGTH * GOLDEN_SPEED);
+	for (t=0 ; t<end ; t=next)
 	{
-		data = sfx[i];
-		left = (data * leftvol) >> 8;
-		right = (data * rightvol) >> 8;
-		paintbuffer[i].left += left;
-		paintbuffer[i].right += right;
+		for ( ; ev < golden_script + sizeof(golden_script)/sizeof(golden_script[0])
+			&& ev->time * GOLDEN_SPEED <= t ; ev++)
+		{
+			origin[0] = ev->x;
+			origin[1] = ev->y;
+			origin[2] = 0;
+			S_StartSound (ev->entnum, ev->entchannel, &golden_sfx[ev->sound], origin,
+				ev->vol, ev->attenuation);
+		}
+
+	// the listener drifts and turns a little
+		listener_origin[0] = 64 * sin (t * 2.0 / GOLDEN_SPEED);
+		listener_origin[1] = 0;
+		listener_origin[2] = 0;
+		listener_right[0] = sin (t * 0.5 / GOLDEN_SPEED);
+		listener_right[1] = -cos (t * 0.5 / GOLDEN_SPEED);
+		listener_right[2] = 0;
+		for (i=NUM_AMBIENTS ; i<total_channels ; i++)
+			if (channels[i].sfx)
+				SND_Spatialize (&channels[i]);
+
+		next = t + GOLDEN_STEP;
+		S_PaintChannelList (channels, total_channels, next, true);
+
+		for (i=t ; i<next ; i++)
+		{
+			p = shm->buffer + (i & (pairs-1))*4;
+			memcpy (out + i*2, p, 4);
+			CRC_ProcessByte (&crc, p[0]);
+			CRC_ProcessByte (&crc, p[1]);
+			CRC_ProcessByte (&crc, p[2]);
+			CRC_ProcessByte (&crc, p[3]);
+		}
 	}
 
-	ch->pos += count;
+	return CRC_Value (crc);
 }
 
+/*
+==================
+SND_GoldenTest_f
+
+snd_goldentest [record]
+==================
+*/
+void SND_GoldenTest_f (void)
+{
+	static channel_t	saved[MAX_CHANNELS];
+	volatile dma_t	*savedshm;
+	dma_t		nulldma;
+	vec3_t		savedorigin, savedright;
+	int			savedtotal, savedpainted, i;
+	float		savedsimd, savedvolume;
+	unsigned short	crc[2];
+	unsigned	golden[2];
+	short		*out[2];
+	int			samples, diff, maxdiff;
+	char		name[MAX_OSPATH];
+	FILE		*f;
+	static char	*kernels[2] = {"c", "simd"};
+#ifdef _WIN32
+	LPDIRECTSOUNDBUFFER	saveddsbuf;
+#endif
+
+	if (!shm || nosound.value)
+	{
+		Con_Printf ("sound system not started\n");
+		return;
+	}
+	if (snd_threaded)
+	{
+		Con_Printf ("set snd_mixthread 0 before testing\n");
+		return;
+	}
+
+	if (!SND_GoldenSounds ())
+	{
+		Con_Printf ("snd_goldentest: not enough cache memory\n");
+		for (i=0 ; i<3 ; i++)
+			if (Cache_Check (&golden_sfx[i].cache))
+				Cache_Free (&golden_sfx[i].cache);
+		return;
+	}
+
+// render into memory with fixed settings
+	memset (&nulldma, 0, sizeof(nulldma));
+	nulldma.channels = 2;
+	nulldma.samplebits = 16;
+	nulldma.speed = GOLDEN_SPEED;
+	nulldma.samples = 32768;
+	nulldma.buffer = malloc (nulldma.samples * 2);
+	samples = (int)(GOLDEN_LENGTH * GOLDEN_SPEED) * 2;
+	out[0] = malloc (samples * sizeof(short));
+	out[1] = malloc (samples * sizeof(short));
+	if (!nulldma.buffer || !out[0] || !out[1])
+		Sys_Error ("SND_GoldenTest_f: out of memory");
+
+	savedshm = shm;
+	savedtotal = total_channels;
+	savedpainted = paintedtime;
+	savedsimd = snd_simd.value;
+	savedvolume = volume.value;
+	VectorCopy (listener_origin, savedorigin);
+	VectorCopy (listener_right, savedright);
+	memcpy (saved, channels, sizeof(saved));
+#ifdef _WIN32
+	saveddsbuf = pDSBuf;
+	pDSBuf = NULL;
+#endif
+	shm = &nulldma;
+	volume.value = 0.7;
+
+	for (i=0 ; i<2 ; i++)
+	{
+		snd_simd.value = i;
+		crc[i] = SND_GoldenRender (out[i]);
+	}
+
+	snd_simd.value = savedsimd;
+	volume.value = savedvolume;
+	VectorCopy (savedorigin, listener_origin);
+	VectorCopy (savedright, listener_right);
+	memcpy (channels, saved, sizeof(saved));
+	total_channels = savedtotal;
+	paintedtime = savedpainted;
+	shm = savedshm;
+#ifdef _WIN32
+	pDSBuf = saveddsbuf;
+#endif
+	free (nulldma.buffer);
+	for (i=0 ; i<3 ; i++)
+		Cache_Free (&golden_sfx[i].cache);
+
+	maxdiff = 0;
+	for (i=0 ; i<samples ; i++)
+	{
+		diff = abs (out[0][i] - out[1][i]);
+		if (diff > maxdiff)
+			maxdiff = diff;
+	}
+	free (out[0]);
+	free (out[1]);
+
+	Con_Printf ("c / simd largest difference %i, tolerance %i: %s\n", maxdiff,
+		GOLDEN_TOLERANCE, maxdiff <= GOLDEN_TOLERANCE ? "ok" : "FAILED");
+
+	sprintf (name, "%s/sndgolden.txt", com_gamedir);
+
+	if (Cmd_Argc () > 1 && !Q_strcasecmp (Cmd_Argv (1), "record"))
+	{
+		f = fopen (name, "w");
+		if (!f)
+		{
+			Con_Printf ("couldn't write %s\n", name);
+			return;
+		}
+		fprintf (f, "c %04x\nsimd %04x\n", crc[0], crc[1]);
+		fclose (f);
+		Con_Printf ("recorded c %04x, simd %04x\n", crc[0], crc[1]);
+		return;
+	}
+
+	f = fopen (name, "r");
+	if (!f || fscanf (f, "c %x simd %x", &golden[0], &golden[1]) != 2)
+	{
+		if (f)
+			fclose (f);
+		Con_Printf ("c %04x, simd %04x; no checksums in %s to compare\n",
+			crc[0], crc[1], name);
+		return;
+	}
+	fclose (f);
+
+	for (i=0 ; i<2 ; i++)
+		Con_Printf ("%-4s %04x, expected %04x: %s\n", kernels[i], crc[i], golden[i],
+			crc[i] == golden[i] ? "ok" : "FAILED");
+}
@@ -0,0 +1,254 @@
+/*
+Copyright (C) 1996-1997 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// snd_null.c -- sound output devices that don't need any hardware
+
+#include "quakedef.h"
+
+#ifdef _WIN32
+#include "winquake.h"
+#endif
+
+/*
+===============================================================================
+
+NULL DEVICE
+
+Mixes into a buffer nobody plays.  The play position follows the wall
+clock, or with -simsound (fakedma) the game clock that S_Update advances,
+so a run gives the same output however fast it goes.
+
+===============================================================================
+*/
+
+#define	NULL_SAMPLES	32768		// mono samples, a power of two
+
+static double	null_starttime;
+
+/*
+==================
+SNDNULL_Init
+==================
+*/
+qboolean SNDNULL_Init (void)
+{
+	shm = &sn;
+	memset ((void *)shm, 0, sizeof(*shm));
+	shm->splitbuffer = 0;
+	shm->samplebits = 16;
+	shm->speed = 22050;
+	shm->channels = 2;
+	shm->samples = NULL_SAMPLES;
+	shm->samplepos = 0;
+	shm->soundalive = true;
+	shm->gamealive = true;
+	shm->submission_chunk = 1;
+	shm->buffer = malloc (shm->samples * (shm->samplebits/8));
+	if (!shm->buffer)
+		Sys_Error ("SNDNULL_Init: out of memory");
+	memset (shm->buffer, 0, shm->samples * (shm->samplebits/8));
+
+	fakedma_samples = 0;
+	null_starttime = Sys_ProfileTime ();	// may be read from the mixer thread
+	return true;
+}
+
+/*
+==================
+SNDNULL_GetDMAPos
+==================
+*/
+int SNDNULL_GetDMAPos (void)
+{
+	double	samples;
+
+	if (fakedma)
+		samples = fakedma_samples;
+	else
+		samples = (Sys_ProfileTime () - null_starttime) * shm->speed * shm->channels;
+
+	shm->samplepos = (int)fmod (samples, shm->samples);
+	return shm->samplepos;
+}
+
+/*
+==================
+SNDNULL_Submit
+==================
+*/
+void SNDNULL_Submit (void)
+{
+}
+
+/*
+==================
+SNDNULL_Shutdown
+==================
+*/
+void SNDNULL_Shutdown (void)
+{
+	if (shm && shm->buffer)
+	{
+		free (shm->buffer);
+		shm->buffer = NULL;
+	}
+}
+
+/*
+===============================================================================
+
+WAV FILE DEVICE
+
+The null device, but everything mixed is also appended to a 16 bit stereo
+wav file, <gamedir>/sndout.wav or the -sndfile name.  The header sizes are
+filled in at shutdown.
+
+===============================================================================
+*/
+
+static FILE		*wav_file;
+static int		wav_written;		// paintedtime of the next pair to write
+static int		wav_bytes;
+
+static void SNDWAV_PutShort (byte *p, int v)
+{
+	p[0] = v & 255;
+	p[1] = (v >> 8) & 255;
+}
+
+static void SNDWAV_PutLong (byte *p, int v)
+{
+	SNDWAV_PutShort (p, v);
+	SNDWAV_PutShort (p + 2, v >> 16);
+}
+
+/*
+==================
+SNDWAV_WriteHeader
+==================
+*/
+static void SNDWAV_WriteHeader (void)
+{
+	byte	h[44];
+
+	memcpy (h, "RIFF", 4);
+	SNDWAV_PutLong (h + 4, 36 + wav_bytes);
+	memcpy (h + 8, "WAVEfmt ", 8);
+	SNDWAV_PutLong (h + 16, 16);
+	SNDWAV_PutShort (h + 20, 1);		// PCM
+	SNDWAV_PutShort (h + 22, shm->channels);
+	SNDWAV_PutLong (h + 24, shm->speed);
+	SNDWAV_PutLong (h + 28, shm->speed * shm->channels * 2);
+	SNDWAV_PutShort (h + 32, shm->channels * 2);
+	SNDWAV_PutShort (h + 34, 16);
+	memcpy (h + 36, "data", 4);
+	SNDWAV_PutLong (h + 40, wav_bytes);
+
+	fseek (wav_file, 0, SEEK_SET);
+	fwrite (h, 1, sizeof(h), wav_file);
+	fseek (wav_file, 0, SEEK_END);
+}
+
+/*
+==================
+SNDWAV_Init
+==================
+*/
+qboolean SNDWAV_Init (void)
+{
+	char	name[MAX_OSPATH];
+	int		i;
+
+	if (!SNDNULL_Init ())
+		return false;
+
+	i = COM_CheckParm ("-sndfile");
+	if (i && i < com_argc-1)
+		sprintf (name, "%s/%s", com_gamedir, com_argv[i+1]);
+	else
+		sprintf (name, "%s/sndout", com_gamedir);
+	COM_DefaultExtension (name, ".wav");
+
+	wav_file = fopen (name, "wb");
+	if (!wav_file)
+	{
+		Con_Printf ("SNDWAV_Init: couldn't create %s\n", name);
+		SNDNULL_Shutdown ();
+		return false;
+	}
+
+	wav_bytes = 0;
+	wav_written = paintedtime;
+	SNDWAV_WriteHeader ();
+
+	Con_Printf ("Writing sound to %s\n", name);
+	return true;
+}
+
+/*
+==================
+SNDWAV_Submit
+
+Appends whatever was painted since the last call
+==================
+*/
+void SNDWAV_Submit (void)
+{
+	int		pairs, total, pos, count;
+
+	if (!wav_file)
+		return;
+
+	pairs = shm->samples / shm->channels;
+	total = paintedtime - wav_written;
+	if (total < 0 || total > pairs)
+	{	// paintedtime was reset, or more went by than the buffer holds
+		wav_written = paintedtime;
+		return;
+	}
+
+	while (total > 0)
+	{
+		pos = wav_written & (pairs-1);
+		count = pairs - pos;
+		if (count > total)
+			count = total;
+
+		fwrite (shm->buffer + pos*4, 4, count, wav_file);
+		wav_written += count;
+		wav_bytes += count*4;
+		total -= count;
+	}
+}
+
+/*
+==================
+SNDWAV_Shutdown
+==================
+*/
+void SNDWAV_Shutdown (void)
+{
+	if (wav_file)
+	{
+		SNDWAV_WriteHeader ();
+		fclose (wav_file);
+		wav_file = NULL;
+	}
+	SNDNULL_Shutdown ();
+}
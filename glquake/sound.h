@@ -28,8 +28,8 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 // !!! if this is changed, it much be changed in asm_i386.h too !!!
 typedef struct
 {
-	int left;
-	int right;
+	float left;
+	float right;
 } portable_samplepair_t;
 
 typedef struct sfx_s
@@ -46,6 +46,7 @@ typedef struct
 	int 	speed;
 	int 	width;
 	int 	stereo;
+	int		stream;			// data is left on disk, see sndstream_t
 	byte	data[1];		// variable sized
 } sfxcache_t;
 
@@ -77,6 +78,9 @@ typedef struct
 	vec3_t	origin;			// origin of sound effect
 	vec_t	dist_mult;		// distance multiplier (attenuation/clipK)
 	int		master_vol;		// 0-255 master volume
+	float	mixleft;		// leftvol/rightvol as last mixed, for ramping
+	float	mixright;
+	struct sndstream_s	*stream;	// for sounds played from disk
 } channel_t;
 
 typedef struct
@@ -89,6 +93,36 @@ typedef struct
 	int		dataofs;		// chunk starts this many bytes from file start
 } wavinfo_t;
 
+//
+// Sounds that would decode larger than snd_streamsize are never resident;
+// a stream decodes them from the pak into a short ring a second ahead of
+// the mixer.  The main thread fills, the mixer only advances played.
+//
+#define	MAX_STREAMS			8
+#define	STREAM_CHUNK		16384		// source bytes read at a time
+
+typedef struct sndstream_s
+{
+	int			active;
+	double		freetime;		// slot may be reused after this
+	sfx_t		*sfx;
+	FILE		*file;
+	int			fileofs;		// file position of the first source sample
+	wavinfo_t	info;			// source format
+	int			length;			// in output samples
+	int			loopstart;
+
+	short		*ring;
+	int			ringsize;		// output samples
+	volatile int	written;	// output samples decoded, ever
+	volatile int	played;		// output samples mixed, ever
+	int			decodepos;		// sfx position of the next decoded sample
+
+	byte		src[STREAM_CHUNK];
+	int			srcstart;		// first source sample in src
+	int			srccount;
+} sndstream_t;
+
 void S_Init (void);
 void S_Startup (void);
 void S_Shutdown (void);
@@ -96,6 +130,7 @@ void S_StartSound (int entnum, int entchannel, sfx_t *sfx, vec3_t origin, float
 void S_StaticSound (sfx_t *sfx, vec3_t origin, float vol, float attenuation);
 void S_StopSound (int entnum, int entchannel);
 void S_StopAllSounds(qboolean clear);
+void S_StopDynamicSounds (void);
 void S_ClearBuffer (void);
 void S_Update (vec3_t origin, vec3_t v_forward, vec3_t v_right, vec3_t v_up);
 void S_ExtraUpdate (void);
@@ -106,6 +141,8 @@ void S_ClearPrecache (void);
 void S_BeginPrecaching (void);
 void S_EndPrecaching (void);
 void S_PaintChannels(int endtime);
+void S_PaintChannelList (channel_t *list, int numchannels, int endtime, qboolean load);
+void S_MixAhead (channel_t *list, int count, qboolean load);
 void S_InitPaintChannels (void);
 
 // picks a channel based on priorities, empty slots, number of channels
@@ -113,6 +150,7 @@ channel_t *SND_PickChannel(int entnum, int entchannel);
 
 // spatializes a channel
 void SND_Spatialize(channel_t *ch);
+void SND_SpatializeChannels (channel_t *list, int count);
 
 // initializes cycling through a DMA buffer and returns information on it
 qboolean SNDDMA_Init(void);
@@ -123,6 +161,30 @@ int SNDDMA_GetDMAPos(void);
 // shutdown the DMA xfer.
 void SNDDMA_Shutdown(void);
 
+//
+// output devices.  SNDDMA_* in snd_win.c drive the sound card; snd_null.c
+// has a device that plays nothing and one that writes a wav file.  The
+// device is picked with -snddevice at startup.
+//
+typedef struct
+{
+	char		*name;
+	qboolean	(*Init) (void);			// sets up shm
+	int			(*GetDMAPos) (void);
+	void		(*Submit) (void);
+	void		(*Shutdown) (void);
+} snddriver_t;
+
+extern	snddriver_t	*snd_driver;
+
+qboolean SNDNULL_Init (void);
+int SNDNULL_GetDMAPos (void);
+void SNDNULL_Submit (void);
+void SNDNULL_Shutdown (void);
+qboolean SNDWAV_Init (void);
+void SNDWAV_Submit (void);
+void SNDWAV_Shutdown (void);
+
 // ====================================================================
 // User-setable variables
 // ====================================================================
@@ -141,11 +203,13 @@ extern	int			total_channels;
 //
 // Fake dma is a synchronous faking of the DMA progress used for
 // isolating performance in the renderer.  The fakedma_updates is
-// number of times S_Update() is called per second.
+// number of times S_Update() is called per second.  fakedma_samples is
+// the play position, advanced by each S_Update's host_frametime.
 //
 
 extern qboolean 		fakedma;
 extern int 			fakedma_updates;
+extern double		fakedma_samples;
 extern int		paintedtime;
 extern vec3_t listener_origin;
 extern vec3_t listener_forward;
@@ -155,9 +219,26 @@ extern volatile dma_t *shm;
 extern volatile dma_t sn;
 extern vec_t sound_nominal_clip_dist;
 
+extern	cvar_t nosound;
 extern	cvar_t loadas8bit;
 extern	cvar_t bgmvolume;
 extern	cvar_t volume;
+extern	cvar_t snd_simd;
+extern	cvar_t snd_mixthread;
+extern	cvar_t snd_resample;
+extern	cvar_t snd_diskcache;
+extern	cvar_t snd_streamsize;
+extern	cvar_t snd_voices;
+extern	cvar_t snd_audible;
+
+extern	qboolean	snd_threaded;
+extern	int			snd_underruns;
+extern	int			snd_latency;
+extern	int			snd_streamstarves;
+extern	double		snd_mixedsamples;
+extern	double		snd_virtualsamples;
+extern	double		snd_mixtime;
+extern	int			snd_statsreset;
 
 extern qboolean	snd_initialized;
 
@@ -166,9 +247,13 @@ extern int		snd_blocked;
 void S_LocalSound (char *s);
 sfxcache_t *S_LoadSound (sfx_t *s);
 
-wavinfo_t GetWavinfo (char *name, byte *wav, int wavlength);
+sndstream_t *S_OpenStream (sfx_t *sfx, sfxcache_t *sc, int pos);
+void S_UpdateStreams (void);
+void S_CloseStreams (void);
 
-void SND_InitScaletable (void);
+void SND_SelectMixer (void);
+void SND_Benchmark_f (void);
+void SND_GoldenTest_f (void);
 void SNDDMA_Submit(void);
 
 void S_AmbientOff (void);
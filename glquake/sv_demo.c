@@ -0,0 +1,712 @@
+/*
+Copyright (C) 1996-1997 Id Software, Inc.
+
+This program is free software; you can redistribute it and/or
+modify it under the terms of the GNU General Public License
+as published by the Free Software Foundation; either version 2
+of the License, or (at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+See the GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program; if not, write to the Free Software
+Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+*/
+// sv_demo.c -- server side multi-view demo recording
+
+#include "quakedef.h"
+
+/*
+==============================================================================
+
+MULTI-VIEW DEMOS
+
+An .mvd holds everything the server sends to all of its clients.  The world
+state (entity updates and broadcast datagrams) is stored once per server
+frame; only the small per client parts (clientdata, view angles and
+reliable messages) are stored for each client.  mvdextract rebuilds the
+stream one client would have received as an ordinary .dem.
+
+The file is "QMVD", a version long, and then blocks of
+	byte	type
+	byte	client number
+	long	length
+	data
+
+The server frame only copies blocks into a ring buffer; a writer thread does
+all of the file IO.
+
+==============================================================================
+*/
+
+#define	MVD_VERSION		1
+
+#define	MVD_SERVERINFO	1		// svc_serverinfo through svc_cdtrack
+#define	MVD_SIGNON		2		// sv.signon: baselines, static entities
+#define	MVD_SPAWN		3		// names, frags, lightstyles and stats
+#define	MVD_RELIABLE	4		// reliable data sent to one client
+#define	MVD_CLIENTDATA	5		// svc_clientdata for one client
+#define	MVD_VIEW		6		// one client's view angles
+#define	MVD_DATAGRAM	7		// broadcast unreliable data
+#define	MVD_ENTITIES	8		// a run of entity updates
+#define	MVD_FRAME		9		// end of a server frame
+
+#define	MVD_BUFFERSIZE	(4*1024*1024)
+#define	MVD_ENTCHUNK	1024	// entity runs are cut here so extraction can pack them
+#define	MVD_MAXBLOCK	(MAX_MSGLEN*2)
+
+static FILE		*mvd_file;
+static byte		*mvd_buffer;
+static int		mvd_head;		// only moved by the server
+static int		mvd_tail;		// only moved by the writer
+static qboolean	mvd_quit;
+static void		*mvd_thread;
+static void		*mvd_lock;
+static void		*mvd_wake;		// data was added, or mvd_quit was set
+static void		*mvd_space;		// the writer made room
+static int		mvd_frames;
+static int		mvd_stalls;
+
+static byte		mvd_entbuf[MVD_ENTCHUNK + 64];
+static byte		mvd_msgbuf[MAX_MSGLEN];
+
+/*
+====================
+SV_MVDWriterThread
+
+Drains the ring buffer to disk
+====================
+*/
+static int SV_MVDWriterThread (void *parm)
+{
+	int			head, tail, len;
+	qboolean	quit;
+
+	while (1)
+	{
+		Sys_LockMutex (mvd_lock);
+		head = mvd_head;
+		tail = mvd_tail;
+		quit = mvd_quit;
+		Sys_UnlockMutex (mvd_lock);
+
+		if (head == tail)
+		{
+			fflush (mvd_file);
+			if (quit)
+				break;
+			Sys_WaitEvent (mvd_wake, 100);
+			continue;
+		}
+
+		if (head > tail)
+			len = head - tail;
+		else
+			len = MVD_BUFFERSIZE - tail;	// up to the wrap first
+		fwrite (mvd_buffer + tail, 1, len, mvd_file);
+
+		Sys_LockMutex (mvd_lock);
+		mvd_tail = (tail + len) % MVD_BUFFERSIZE;
+		Sys_UnlockMutex (mvd_lock);
+		Sys_SignalEvent (mvd_space);
+	}
+
+	return 0;
+}
+
+/*
+====================
+SV_MVDWrite
+
+Copies data into the ring buffer, only waiting if the disk has fallen a
+whole buffer behind
+====================
+*/
+static void SV_MVDWrite (void *data, int len)
+{
+	byte	*p;
+	int		space, count;
+
+	p = data;
+	while (len)
+	{
+		Sys_LockMutex (mvd_lock);
+		space = (mvd_tail - mvd_head - 1 + MVD_BUFFERSIZE) % MVD_BUFFERSIZE;
+		Sys_UnlockMutex (mvd_lock);
+
+		if (!space)
+		{
+			mvd_stalls++;
+			Sys_SignalEvent (mvd_wake);
+			Sys_WaitEvent (mvd_space, 100);
+			continue;
+		}
+
+		count = len;
+		if (count > space)
+			count = space;
+		if (count > MVD_BUFFERSIZE - mvd_head)
+			count = MVD_BUFFERSIZE - mvd_head;
+		memcpy (mvd_buffer + mvd_head, p, count);
+
+		Sys_LockMutex (mvd_lock);
+		mvd_head = (mvd_head + count) % MVD_BUFFERSIZE;
+		Sys_UnlockMutex (mvd_lock);
+
+		p += count;
+		len -= count;
+	}
+}
+
+/*
+====================
+SV_MVDWriteBlock
+
+====================
+*/
+static void SV_MVDWriteBlock (int type, int client, void *data, int len)
+{
+	byte	header[6];
+
+	header[0] = type;
+	header[1] = client;
+	header[2] = len & 255;
+	header[3] = (len >> 8) & 255;
+	header[4] = (len >> 16) & 255;
+	header[5] = len >> 24;
+
+	SV_MVDWrite (header, sizeof(header));
+	SV_MVDWrite (data, len);
+}
+
+/*
+====================
+SV_MVDNewLevel
+
+Writes what every client is told when it joins the level.  Called on
+each level change and when recording starts.
+====================
+*/
+void SV_MVDNewLevel (void)
+{
+	sizebuf_t	msg;
+
+	if (!mvd_file)
+		return;
+
+	msg.data = mvd_msgbuf;
+	msg.maxsize = sizeof(mvd_msgbuf);
+	msg.cursize = 0;
+	msg.allowoverflow = true;
+	msg.overflowed = false;
+
+	SV_WriteServerinfo (&msg);
+	SV_MVDWriteBlock (MVD_SERVERINFO, 0, msg.data, msg.cursize);
+
+	SV_MVDWriteBlock (MVD_SIGNON, 0, sv.signon.data, sv.signon.cursize);
+
+	SZ_Clear (&msg);
+	SV_WriteSpawnState (&msg);
+	SV_MVDWriteBlock (MVD_SPAWN, 0, msg.data, msg.cursize);
+}
+
+/*
+====================
+SV_MVDClientData
+
+Called with the client specific part of each datagram
+====================
+*/
+void SV_MVDClientData (client_t *client, byte *data, int len)
+{
+	int		i;
+	float	angles[3];
+
+	if (!mvd_file)
+		return;
+
+	i = client - svs.clients;
+	SV_MVDWriteBlock (MVD_CLIENTDATA, i, data, len);
+
+	angles[0] = LittleFloat (client->edict->v.v_angle[0]);
+	angles[1] = LittleFloat (client->edict->v.v_angle[1]);
+	angles[2] = LittleFloat (client->edict->v.v_angle[2]);
+	SV_MVDWriteBlock (MVD_VIEW, i, angles, sizeof(angles));
+}
+
+/*
+====================
+SV_MVDReliable
+
+Called with a spawned client's reliable message just before it is sent
+====================
+*/
+void SV_MVDReliable (client_t *client)
+{
+	if (!mvd_file || !client->message.cursize)
+		return;
+
+	SV_MVDWriteBlock (MVD_RELIABLE, client - svs.clients,
+		client->message.data, client->message.cursize);
+}
+
+/*
+====================
+SV_MVDFrame
+
+Stores the world state once for all clients.  Player entities come first
+so an extracted view always finds its own entity.
+====================
+*/
+void SV_MVDFrame (void)
+{
+	int			e, pass;
+	sizebuf_t	msg;
+	edict_t		*ent;
+	float		time;
+
+	if (!mvd_file)
+		return;
+
+	if (sv.datagram.cursize)
+		SV_MVDWriteBlock (MVD_DATAGRAM, 0, sv.datagram.data, sv.datagram.cursize);
+
+	msg.data = mvd_entbuf;
+	msg.maxsize = sizeof(mvd_entbuf);
+	msg.cursize = 0;
+	msg.allowoverflow = false;
+	msg.overflowed = false;
+
+	for (pass=0 ; pass<2 ; pass++)
+	{
+		ent = NEXT_EDICT(sv.edicts);
+		for (e=1 ; e<sv.num_edicts ; e++, ent = NEXT_EDICT(ent))
+		{
+			if (e <= svs.maxclients)
+			{
+				if (pass || !svs.clients[e-1].active)
+					continue;
+			}
+			else
+			{
+				if (!pass || !ent->v.modelindex || !pr_strings[ent->v.model])
+					continue;
+#ifdef QUAKE2
+				if (ent->v.effects == EF_NODRAW)
+					continue;
+#endif
+			}
+
+			SV_WriteEntityUpdate (ent, e, SV_EntityUpdateBits (ent, e), &msg);
+			if (msg.cursize >= MVD_ENTCHUNK)
+			{
+				SV_MVDWriteBlock (MVD_ENTITIES, 0, msg.data, msg.cursize);
+				msg.cursize = 0;
+			}
+		}
+	}
+	if (msg.cursize)
+		SV_MVDWriteBlock (MVD_ENTITIES, 0, msg.data, msg.cursize);
+
+	time = LittleFloat (sv.time);
+	SV_MVDWriteBlock (MVD_FRAME, 0, &time, sizeof(time));
+	mvd_frames++;
+
+	Sys_SignalEvent (mvd_wake);
+}
+
+/*
+====================
+SV_MVDStop
+
+Waits for the writer to empty the buffer and closes the file
+====================
+*/
+void SV_MVDStop (void)
+{
+	if (!mvd_file)
+		return;
+
+	Sys_LockMutex (mvd_lock);
+	mvd_quit = true;
+	Sys_UnlockMutex (mvd_lock);
+	Sys_SignalEvent (mvd_wake);
+	Sys_WaitThread (mvd_thread);
+
+	fclose (mvd_file);
+	mvd_file = NULL;
+
+	Sys_DestroyEvent (mvd_space);
+	Sys_DestroyEvent (mvd_wake);
+	Sys_DestroyMutex (mvd_lock);
+	free (mvd_buffer);
+	mvd_buffer = NULL;
+
+	Con_Printf ("Completed mvd: %i frames", mvd_frames);
+	if (mvd_stalls)
+		Con_Printf (", %i stalls", mvd_stalls);
+	Con_Printf ("\n");
+}
+
+/*
+====================
+SV_MVDStop_f
+
+mvdstop
+====================
+*/
+void SV_MVDStop_f (void)
+{
+	if (cmd_source != src_command)
+		return;
+
+	if (!mvd_file)
+	{
+		Con_Printf ("Not recording an mvd.\n");
+		return;
+	}
+
+	SV_MVDStop ();
+}
+
+/*
+====================
+SV_MVDRecord_f
+
+mvdrecord <demoname>
+====================
+*/
+void SV_MVDRecord_f (void)
+{
+	char	name[MAX_OSPATH];
+	int		l;
+
+	if (cmd_source != src_command)
+		return;
+
+	if (Cmd_Argc() != 2)
+	{
+		Con_Printf ("mvdrecord <demoname> : record every client's view\n");
+		return;
+	}
+
+	if (!sv.active)
+	{
+		Con_Printf ("Not running a server.\n");
+		return;
+	}
+
+	if (strstr(Cmd_Argv(1), ".."))
+	{
+		Con_Printf ("Relative pathnames are not allowed.\n");
+		return;
+	}
+
+	if (mvd_file)
+		SV_MVDStop ();
+
+	sprintf (name, "%s/%s", com_gamedir, Cmd_Argv(1));
+	COM_DefaultExtension (name, ".mvd");
+
+	Con_Printf ("recording to %s.\n", name);
+	mvd_file = fopen (name, "wb");
+	if (!mvd_file)
+	{
+		Con_Printf ("ERROR: couldn't open.\n");
+		return;
+	}
+
+	fwrite ("QMVD", 4, 1, mvd_file);
+	l = LittleLong (MVD_VERSION);
+	fwrite (&l, 4, 1, mvd_file);
+
+	mvd_buffer = malloc (MVD_BUFFERSIZE);
+	if (!mvd_buffer)
+	{
+		fclose (mvd_file);
+		mvd_file = NULL;
+		Con_Printf ("ERROR: couldn't allocate the mvd buffer.\n");
+		return;
+	}
+	mvd_head = mvd_tail = 0;
+	mvd_quit = false;
+	mvd_frames = 0;
+	mvd_stalls = 0;
+
+	mvd_lock = Sys_CreateMutex ();
+	mvd_wake = Sys_CreateEvent ();
+	mvd_space = Sys_CreateEvent ();
+	mvd_thread = Sys_CreateThread (SV_MVDWriterThread, NULL);
+
+	SV_MVDNewLevel ();
+}
+
+/*
+==============================================================================
+
+EXTRACTION
+
+==============================================================================
+*/
+
+/*
+====================
+SV_MVDWriteDemoMessage
+
+Same layout as CL_WriteDemoMessage
+====================
+*/
+static void SV_MVDWriteDemoMessage (FILE *f, sizebuf_t *msg, float *angles)
+{
+	int		len;
+	int		i;
+	float	a;
+
+	len = LittleLong (msg->cursize);
+	fwrite (&len, 4, 1, f);
+	for (i=0 ; i<3 ; i++)
+	{
+		a = LittleFloat (angles[i]);
+		fwrite (&a, 4, 1, f);
+	}
+	fwrite (msg->data, msg->cursize, 1, f);
+}
+
+/*
+====================
+SV_MVDExtract_f
+
+mvdextract <mvdname> <clientnum> <demoname>
+====================
+*/
+void SV_MVDExtract_f (void)
+{
+	char		name[MAX_OSPATH];
+	FILE		*in, *out;
+	byte		header[6];
+	byte		*block;
+	byte		*clientdata, *datagram, *entities;
+	int			clientlen, datagramlen, entitieslen;
+	int			type, client, len, ofs, chunk;
+	int			view, l, frames, levels, maxsize;
+	float		angles[3], time;
+	qboolean	haveview;
+	sizebuf_t	msg;
+
+	if (cmd_source != src_command)
+		return;
+
+	if (Cmd_Argc() != 4)
+	{
+		Con_Printf ("mvdextract <mvdname> <clientnum> <demoname> : write one client's view as a .dem\n");
+		return;
+	}
+
+	if (strstr(Cmd_Argv(1), "..") || strstr(Cmd_Argv(3), ".."))
+	{
+		Con_Printf ("Relative pathnames are not allowed.\n");
+		return;
+	}
+
+	view = Q_atoi (Cmd_Argv(2));
+	if (view < 0 || view >= MAX_SCOREBOARD)
+	{
+		Con_Printf ("Bad client number.\n");
+		return;
+	}
+
+	sprintf (name, "%s/%s", com_gamedir, Cmd_Argv(1));
+	COM_DefaultExtension (name, ".mvd");
+	in = fopen (name, "rb");
+	if (!in)
+	{
+		Con_Printf ("ERROR: couldn't open %s.\n", name);
+		return;
+	}
+
+	fread (header, 1, 4, in);
+	fread (&l, 4, 1, in);
+	if (memcmp (header, "QMVD", 4) || LittleLong (l) != MVD_VERSION)
+	{
+		fclose (in);
+		Con_Printf ("%s is not a version %i mvd.\n", name, MVD_VERSION);
+		return;
+	}
+
+	sprintf (name, "%s/%s", com_gamedir, Cmd_Argv(3));
+	COM_DefaultExtension (name, ".dem");
+	out = fopen (name, "wb");
+	if (!out)
+	{
+		fclose (in);
+		Con_Printf ("ERROR: couldn't open %s.\n", name);
+		return;
+	}
+	fprintf (out, "%i\n", -1);		// no forced cd track
+
+	block = malloc (MVD_MAXBLOCK);
+	clientdata = malloc (MVD_MAXBLOCK);
+	datagram = malloc (MVD_MAXBLOCK);
+	entities = malloc (MAX_EDICTS*32);
+	msg.data = malloc (MVD_MAXBLOCK);
+	if (!block || !clientdata || !datagram || !entities || !msg.data)
+		Sys_Error ("SV_MVDExtract_f: out of memory");
+	msg.maxsize = MAX_MSGLEN;
+	msg.allowoverflow = true;
+
+	angles[0] = angles[1] = angles[2] = 0;
+	clientlen = datagramlen = entitieslen = 0;
+	haveview = false;
+	frames = levels = 0;
+	maxsize = NQ_MAX_MSGLEN;
+
+	while (fread (header, sizeof(header), 1, in) == 1)
+	{
+		type = header[0];
+		client = header[1];
+		len = header[2] + (header[3]<<8) + (header[4]<<16) + (header[5]<<24);
+		if (len < 0 || len > MVD_MAXBLOCK)
+		{
+			Con_Printf ("Bad block in mvd, stopping.\n");
+			break;
+		}
+		if (fread (block, 1, len, in) != (size_t)len)
+			break;
+
+		if (type == MVD_RELIABLE || type == MVD_CLIENTDATA || type == MVD_VIEW)
+			if (client != view)
+				continue;
+
+		SZ_Clear (&msg);
+		msg.overflowed = false;
+
+		switch (type)
+		{
+		case MVD_SERVERINFO:
+		// a stock client can't take messages larger than it would get live
+			l = block[1] + (block[2]<<8) + (block[3]<<16) + (block[4]<<24);
+			if (l == PROTOCOL_EXTENDED)
+				maxsize = MAX_MSGLEN;
+			else
+				maxsize = NQ_MAX_MSGLEN;
+
+			if (levels++)
+			{
+				MSG_WriteByte (&msg, svc_stufftext);
+				MSG_WriteString (&msg, "reconnect\n");
+				SV_MVDWriteDemoMessage (out, &msg, angles);
+				SZ_Clear (&msg);
+			}
+			SZ_Write (&msg, block, len);
+			MSG_WriteByte (&msg, svc_setview);
+			MSG_WriteShort (&msg, view + 1);
+			MSG_WriteByte (&msg, svc_signonnum);
+			MSG_WriteByte (&msg, 1);
+			SV_MVDWriteDemoMessage (out, &msg, angles);
+			haveview = false;
+			break;
+
+		case MVD_SIGNON:
+			SZ_Write (&msg, block, len);
+			MSG_WriteByte (&msg, svc_signonnum);
+			MSG_WriteByte (&msg, 2);
+			SV_MVDWriteDemoMessage (out, &msg, angles);
+			break;
+
+		case MVD_SPAWN:
+			SZ_Write (&msg, block, len);
+			MSG_WriteByte (&msg, svc_signonnum);
+			MSG_WriteByte (&msg, 3);
+			SV_MVDWriteDemoMessage (out, &msg, angles);
+			break;
+
+		case MVD_RELIABLE:
+			SZ_Write (&msg, block, len);
+			SV_MVDWriteDemoMessage (out, &msg, angles);
+			break;
+
+		case MVD_CLIENTDATA:
+			memcpy (clientdata, block, len);
+			clientlen = len;
+			haveview = true;
+			break;
+
+		case MVD_VIEW:
+			for (l=0 ; l<3 ; l++)
+				angles[l] = LittleFloat (((float *)block)[l]);
+			break;
+
+		case MVD_DATAGRAM:
+			memcpy (datagram, block, len);
+			datagramlen = len;
+			break;
+
+		case MVD_ENTITIES:
+			if (entitieslen + len + 4 <= MAX_EDICTS*32)
+			{
+				entities[entitieslen] = len & 255;
+				entities[entitieslen+1] = len >> 8;
+				memcpy (entities + entitieslen + 2, block, len);
+				entitieslen += len + 2;
+			}
+			break;
+
+		case MVD_FRAME:
+			if (haveview)
+			{
+				time = LittleFloat (*(float *)block);
+				MSG_WriteByte (&msg, svc_time);
+				MSG_WriteFloat (&msg, time);
+				SZ_Write (&msg, clientdata, clientlen);
+
+			// entity runs until the message is full, players first
+				for (ofs = 0 ; ofs < entitieslen ; ofs += chunk + 2)
+				{
+					chunk = entities[ofs] + (entities[ofs+1]<<8);
+					if (msg.cursize + chunk > maxsize)
+						break;
+					SZ_Write (&msg, entities + ofs + 2, chunk);
+				}
+
+				if (msg.cursize + datagramlen <= maxsize)
+					SZ_Write (&msg, datagram, datagramlen);
+
+				SV_MVDWriteDemoMessage (out, &msg, angles);
+				frames++;
+			}
+			clientlen = datagramlen = entitieslen = 0;
+			break;
+		}
+
+		if (msg.overflowed)
+			Con_Printf ("Warning: oversize %i block in mvd\n", type);
+	}
+
+	free (block);
+	free (clientdata);
+	free (datagram);
+	free (entities);
+	free (msg.data);
+	fclose (in);
+	fclose (out);
+
+	Con_Printf ("Wrote %s: %i frames from client %i\n", name, frames, view);
+}
+
+/*
+====================
+SV_MVDInit
+
+====================
+*/
+void SV_MVDInit (void)
+{
+	Cmd_AddCommand ("mvdrecord", SV_MVDRecord_f);
+	Cmd_AddCommand ("mvdstop", SV_MVDStop_f);
+	Cmd_AddCommand ("mvdextract", SV_MVDExtract_f);
+}
@@ -24,10 +24,263 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 server_t		sv;
 server_static_t	svs;
 
-char	localmodels[MAX_MODELS][5];			// inline model names for precache
+char	localmodels[MAX_MODELS][8];			// inline model names for precache
+
+cvar_t	sv_protocol = {"sv_protocol", "15"};	// PROTOCOL_VERSION or PROTOCOL_EXTENDED, read at map start
 
 //============================================================================
 
+static float	protocheck_coords[] =
+{
+	0, 0.125, -0.125, 1.0/256, -1.0/256, 0.3, -0.3, 0.99, -0.99,
+	100.5, -100.5, 1234.5678, -1234.5678,
+	4095.875, -4096, 8191.5, -8192, 32767.99, -32768
+};
+
+static float	protocheck_angles[] =
+{
+	0, 0.5, 1, 12.3, 45, 90, 179.9, 180, 270, 359, 359.99, -1, -45.7, -90, -180
+};
+
+/*
+===============
+SV_ProtoCheckEncodings
+
+Round trips boundary and fractional coords and angles and checks each
+comes back quantized the way the protocol defines:
+stock coords	13.3 fixed point, truncated
+stock angles	360/256 steps of the whole degrees, truncated
+extended coords	16.8 fixed point, rounded
+extended angles	360/65536 steps, rounded
+===============
+*/
+int SV_ProtoCheckEncodings (int protocol, byte *buf, int size)
+{
+	sizebuf_t	sb;
+	int			i, c, count, bad;
+	float		f, in, out, expect, maxcoord;
+
+	if (protocol == PROTOCOL_EXTENDED)
+		maxcoord = 32768;
+	else
+		maxcoord = 4096;
+
+	sb.data = buf;
+	sb.maxsize = size;
+	sb.allowoverflow = false;
+	sb.overflowed = false;
+	sb.cursize = 0;
+	count = sizeof(protocheck_coords)/sizeof(protocheck_coords[0]);
+	for (i=0 ; i<count ; i++)
+	{
+		if (protocheck_coords[i] >= maxcoord || protocheck_coords[i] < -maxcoord)
+			continue;
+		MSG_WriteCoord (&sb, protocheck_coords[i], protocol);
+	}
+	count = sizeof(protocheck_angles)/sizeof(protocheck_angles[0]);
+	for (i=0 ; i<count ; i++)
+		MSG_WriteAngle (&sb, protocheck_angles[i], protocol);
+
+	net_message.data = buf;
+	net_message.cursize = sb.cursize;
+	MSG_BeginReading ();
+	bad = 0;
+
+	count = sizeof(protocheck_coords)/sizeof(protocheck_coords[0]);
+	for (i=0 ; i<count ; i++)
+	{
+		in = protocheck_coords[i];
+		if (in >= maxcoord || in < -maxcoord)
+			continue;
+		out = MSG_ReadCoord (protocol);
+		if (protocol == PROTOCOL_EXTENDED)
+			expect = floor(in*256 + 0.5) * (1.0/256);
+		else
+			expect = (int)(in*8) * (1.0/8);
+		if (out != expect || fabs(out - in) > (protocol == PROTOCOL_EXTENDED ? 0.5/256 : 1.0/8))
+		{
+			Con_Printf ("coord %f came back %f, expected %f\n", in, out, expect);
+			bad++;
+		}
+	}
+
+	count = sizeof(protocheck_angles)/sizeof(protocheck_angles[0]);
+	for (i=0 ; i<count ; i++)
+	{
+		in = protocheck_angles[i];
+		out = MSG_ReadAngle (protocol);
+		if (protocol == PROTOCOL_EXTENDED)
+		{
+			c = (int)floor(in*65536/360 + 0.5) & 65535;
+			expect = (short)c * (360.0/65536);
+		}
+		else
+		{
+			c = ((int)in*256/360) & 255;
+			expect = (signed char)c * (360.0/256);
+		}
+
+		// the error, wrapped into -180 to 180
+		f = out - in;
+		f -= 360 * floor(f/360 + 0.5);
+		if (out != expect || fabs(f) > (protocol == PROTOCOL_EXTENDED ? 0.5*360/65536 + 0.0001 : 1 + 360.0/256))
+		{
+			Con_Printf ("angle %f came back %f, expected %f\n", in, out, expect);
+			bad++;
+		}
+	}
+
+	if (msg_badread || msg_readcount != sb.cursize)
+		bad++;
+
+	return bad;
+}
+
+/*
+===============
+SV_ProtoCheckProtocol
+
+Writes every legal model, sound and entity number for one protocol the
+way the server sends them and reads them back the way the client parses
+them, then checks the coord and angle encodings.  Returns the number of
+values that didn't survive.
+===============
+*/
+int SV_ProtoCheckProtocol (int protocol)
+{
+	static byte	buf[MAX_EDICTS*4];
+	sizebuf_t	sb;
+	int			i, n, ent, channel, bad;
+	int			maxmodels, maxsounds, maxedicts;
+
+	if (protocol == PROTOCOL_EXTENDED)
+	{
+		maxmodels = MAX_MODELS;
+		maxsounds = MAX_SOUNDS;
+		maxedicts = MAX_EDICTS;
+	}
+	else
+	{
+		maxmodels = NQ_MAX_MODELS;
+		maxsounds = NQ_MAX_SOUNDS;
+		maxedicts = NQ_MAX_EDICTS;
+	}
+
+	sv.protocol = protocol;
+	cl.protocol = protocol;
+	bad = 0;
+
+// model and sound indexes
+	sb.data = buf;
+	sb.maxsize = sizeof(buf);
+	sb.allowoverflow = false;
+	sb.overflowed = false;
+	sb.cursize = 0;
+	for (i=0 ; i<maxmodels ; i++)
+		SV_WritePrecacheIndex (&sb, i);
+	for (i=0 ; i<maxsounds ; i++)
+		SV_WritePrecacheIndex (&sb, i);
+
+	net_message.data = buf;
+	net_message.cursize = sb.cursize;
+	MSG_BeginReading ();
+	for (i=0 ; i<maxmodels ; i++)
+		if (CL_ReadPrecacheIndex () != i)
+			bad++;
+	for (i=0 ; i<maxsounds ; i++)
+		if (CL_ReadPrecacheIndex () != i)
+			bad++;
+	if (msg_badread || msg_readcount != sb.cursize)
+		bad++;
+
+// entity numbers in entity updates, always a short past 255
+	sb.cursize = 0;
+	for (i=0 ; i<maxedicts ; i++)
+		MSG_WriteShort (&sb, i);
+
+	net_message.cursize = sb.cursize;
+	MSG_BeginReading ();
+	for (i=0 ; i<maxedicts ; i++)
+		if (MSG_ReadShort () != i)
+			bad++;
+	if (msg_badread)
+		bad++;
+
+// entity numbers and channels in svc_sound, packed as SV_StartSound does
+	sb.cursize = 0;
+	for (i=0 ; i<maxedicts ; i++)
+	{
+		if (protocol == PROTOCOL_EXTENDED)
+		{
+			MSG_WriteShort (&sb, i);
+			MSG_WriteByte (&sb, i&7);
+		}
+		else
+			MSG_WriteShort (&sb, (i<<3) | (i&7));
+	}
+
+	net_message.cursize = sb.cursize;
+	MSG_BeginReading ();
+	for (i=0 ; i<maxedicts ; i++)
+	{
+		if (protocol == PROTOCOL_EXTENDED)
+		{
+			ent = (unsigned short)MSG_ReadShort ();
+			channel = MSG_ReadByte ();
+		}
+		else
+		{
+			n = MSG_ReadShort ();
+			ent = n >> 3;
+			channel = n & 7;
+		}
+		if (ent != i || channel != (i&7))
+			bad++;
+	}
+	if (msg_badread)
+		bad++;
+
+	bad += SV_ProtoCheckEncodings (protocol, buf, sizeof(buf));
+
+	return bad;
+}
+
+/*
+===============
+SV_ProtoCheck_f
+
+sv_protocheck
+Round trips the model, sound and entity number fields and the coord and
+angle encodings of both protocols through a sizebuf and the client's
+readers.
+===============
+*/
+void SV_ProtoCheck_f (void)
+{
+	sizebuf_t	savedmessage;
+	int			savedcount, savedsv, savedcl;
+	qboolean	savedbad;
+	int			stock, extended;
+
+	savedmessage = net_message;
+	savedcount = msg_readcount;
+	savedbad = msg_badread;
+	savedsv = sv.protocol;
+	savedcl = cl.protocol;
+
+	stock = SV_ProtoCheckProtocol (PROTOCOL_VERSION);
+	extended = SV_ProtoCheckProtocol (PROTOCOL_EXTENDED);
+
+	net_message = savedmessage;
+	msg_readcount = savedcount;
+	msg_badread = savedbad;
+	sv.protocol = savedsv;
+	cl.protocol = savedcl;
+
+	Con_Printf ("protocol %i: %s (%i bad)\n", PROTOCOL_VERSION, stock ? "FAILED" : "ok", stock);
+	Con_Printf ("protocol %i: %s (%i bad)\n", PROTOCOL_EXTENDED, extended ? "FAILED" : "ok", extended);
+}
+
 /*
 ===============
 SV_Init
@@ -57,6 +310,13 @@ void SV_Init (void)
 	Cvar_RegisterVariable (&sv_idealpitchscale);
 	Cvar_RegisterVariable (&sv_aim);
 	Cvar_RegisterVariable (&sv_nostep);
+	Cvar_RegisterVariable (&sv_rate);
+	Cvar_RegisterVariable (&sv_maxrate);
+	Cvar_RegisterVariable (&sv_protocol);
+
+	Cmd_AddCommand ("sv_protocheck", SV_ProtoCheck_f);
+
+	SV_MVDInit ();
 
 	for (i=0 ; i<MAX_MODELS ; i++)
 		sprintf (localmodels[i], "*%i", i);
@@ -81,12 +341,12 @@ void SV_StartParticle (vec3_t org, vec3_t dir, int color, int count)
 {
 	int		i, v;
 
-	if (sv.datagram.cursize > MAX_DATAGRAM-16)
+	if (sv.datagram.cursize > sv.datagram.maxsize-16)
 		return;	
 	MSG_WriteByte (&sv.datagram, svc_particle);
-	MSG_WriteCoord (&sv.datagram, org[0]);
-	MSG_WriteCoord (&sv.datagram, org[1]);
-	MSG_WriteCoord (&sv.datagram, org[2]);
+	MSG_WriteCoord (&sv.datagram, org[0], sv.protocol);
+	MSG_WriteCoord (&sv.datagram, org[1], sv.protocol);
+	MSG_WriteCoord (&sv.datagram, org[2], sv.protocol);
 	for (i=0 ; i<3 ; i++)
 	{
 		v = dir[i]*16;
@@ -132,7 +392,7 @@ void SV_StartSound (edict_t *entity, int channel, char *sample, int volume,
 	if (channel < 0 || channel > 7)
 		Sys_Error ("SV_StartSound: channel = %i", channel);
 
-	if (sv.datagram.cursize > MAX_DATAGRAM-16)
+	if (sv.datagram.cursize > sv.datagram.maxsize-24)
 		return;	
 
 // find precache number for sound
@@ -149,8 +409,6 @@ void SV_StartSound (edict_t *entity, int channel, char *sample, int volume,
     
 	ent = NUM_FOR_EDICT(entity);
 
-	channel = (ent<<3) | channel;
-
 	field_mask = 0;
 	if (volume != DEFAULT_SOUND_PACKET_VOLUME)
 		field_mask |= SND_VOLUME;
@@ -164,10 +422,16 @@ void SV_StartSound (edict_t *entity, int channel, char *sample, int volume,
 		MSG_WriteByte (&sv.datagram, volume);
 	if (field_mask & SND_ATTENUATION)
 		MSG_WriteByte (&sv.datagram, attenuation*64);
-	MSG_WriteShort (&sv.datagram, channel);
-	MSG_WriteByte (&sv.datagram, sound_num);
+	if (sv.protocol == PROTOCOL_EXTENDED)
+	{
+		MSG_WriteShort (&sv.datagram, ent);
+		MSG_WriteByte (&sv.datagram, channel);
+	}
+	else
+		MSG_WriteShort (&sv.datagram, (ent<<3) | channel);
+	SV_WritePrecacheIndex (&sv.datagram, sound_num);
 	for (i=0 ; i<3 ; i++)
-		MSG_WriteCoord (&sv.datagram, entity->v.origin[i]+0.5*(entity->v.mins[i]+entity->v.maxs[i]));
+		MSG_WriteCoord (&sv.datagram, entity->v.origin[i]+0.5*(entity->v.mins[i]+entity->v.maxs[i]), sv.protocol);
 }           
 
 /*
@@ -180,46 +444,66 @@ CLIENT SPAWNING
 
 /*
 ================
-SV_SendServerinfo
+SV_WriteServerinfo
 
-Sends the first message from the server to a connected client.
-This will be sent on the initial connection and upon each server load.
+The level description shared by every client: protocol, precaches and music
 ================
 */
-void SV_SendServerinfo (client_t *client)
+void SV_WriteServerinfo (sizebuf_t *msg)
 {
 	char			**s;
 	char			message[2048];
 
-	MSG_WriteByte (&client->message, svc_print);
-	sprintf (message, "%c\nVERSION %4.2f SERVER (%i CRC)", 2, VERSION, pr_crc);
-	MSG_WriteString (&client->message,message);
-
-	MSG_WriteByte (&client->message, svc_serverinfo);
-	MSG_WriteLong (&client->message, PROTOCOL_VERSION);
-	MSG_WriteByte (&client->message, svs.maxclients);
+	MSG_WriteByte (msg, svc_serverinfo);
+	MSG_WriteLong (msg, sv.protocol);
+	MSG_WriteByte (msg, svs.maxclients);
 
 	if (!coop.value && deathmatch.value)
-		MSG_WriteByte (&client->message, GAME_DEATHMATCH);
+		MSG_WriteByte (msg, GAME_DEATHMATCH);
 	else
-		MSG_WriteByte (&client->message, GAME_COOP);
+		MSG_WriteByte (msg, GAME_COOP);
 
 	sprintf (message, pr_strings+sv.edicts->v.message);
 
-	MSG_WriteString (&client->message,message);
+	MSG_WriteString (msg,message);
 
 	for (s = sv.model_precache+1 ; *s ; s++)
-		MSG_WriteString (&client->message, *s);
-	MSG_WriteByte (&client->message, 0);
+		MSG_WriteString (msg, *s);
+	MSG_WriteByte (msg, 0);
 
 	for (s = sv.sound_precache+1 ; *s ; s++)
-		MSG_WriteString (&client->message, *s);
-	MSG_WriteByte (&client->message, 0);
+		MSG_WriteString (msg, *s);
+	MSG_WriteByte (msg, 0);
 
 // send music
-	MSG_WriteByte (&client->message, svc_cdtrack);
-	MSG_WriteByte (&client->message, sv.edicts->v.sounds);
-	MSG_WriteByte (&client->message, sv.edicts->v.sounds);
+	MSG_WriteByte (msg, svc_cdtrack);
+	MSG_WriteByte (msg, sv.edicts->v.sounds);
+	MSG_WriteByte (msg, sv.edicts->v.sounds);
+}
+
+/*
+================
+SV_SendServerinfo
+
+Sends the first message from the server to a connected client.
+This will be sent on the initial connection and upon each server load.
+================
+*/
+void SV_SendServerinfo (client_t *client)
+{
+	char			message[2048];
+
+	MSG_WriteByte (&client->message, svc_print);
+	sprintf (message, "%c\nVERSION %4.2f SERVER (%i CRC)", 2, VERSION, pr_crc);
+	MSG_WriteString (&client->message,message);
+
+// a stock client can't take reliable messages larger than it can buffer
+	if (sv.protocol == PROTOCOL_EXTENDED)
+		client->message.maxsize = sizeof(client->msgbuf);
+	else
+		client->message.maxsize = NQ_MAX_MSGLEN;
+
+	SV_WriteServerinfo (&client->message);
 
 // set view	
 	MSG_WriteByte (&client->message, svc_setview);
@@ -228,6 +512,9 @@ void SV_SendServerinfo (client_t *client)
 	MSG_WriteByte (&client->message, svc_signonnum);
 	MSG_WriteByte (&client->message, 1);
 
+// edict numbers mean something else on the new level
+	memset (client->ent_senttime, 0, sv.max_edicts*sizeof(*client->ent_senttime));
+
 	client->sendsignon = true;
 	client->spawned = false;		// need prespawn, spawn, etc
 }
@@ -248,6 +535,8 @@ void SV_ConnectClient (int clientnum)
 	struct qsocket_s *netconnection;
 	int				i;
 	float			spawn_parms[NUM_SPAWN_PARMS];
+	float			*senttime;
+	vec3_t			*sentorigin;
 
 	client = svs.clients + clientnum;
 
@@ -259,11 +548,15 @@ void SV_ConnectClient (int clientnum)
 	
 // set up the client_t
 	netconnection = client->netconnection;
+	senttime = client->ent_senttime;
+	sentorigin = client->ent_sentorigin;
 	
 	if (sv.loadgame)
 		memcpy (spawn_parms, client->spawn_parms, sizeof(spawn_parms));
 	memset (client, 0, sizeof(*client));
 	client->netconnection = netconnection;
+	client->ent_senttime = senttime;
+	client->ent_sentorigin = sentorigin;
 
 	strcpy (client->name, "unconnected");
 	client->active = true;
@@ -418,26 +711,313 @@ byte *SV_FatPVS (vec3_t org)
 //=============================================================================
 
 
+/*
+=============================================================================
+
+Datagrams are rate limited whole, the way QuakeWorld does it.  Every byte
+sent to a client pushes its clear time forward by 1/rate seconds, and no
+datagram goes out until realtime has caught up with it.  A stock client
+removes any entity missing from a packet it gets, so a datagram that does
+go out always carries every visible entity.
+
+Visible entities are scored by distance, how far they have moved since
+they were last sent to this client and how long ago that was, and written
+in priority order.  If the datagram fills up, the updates left out are the
+least important ones, and they keep aging so they win a slot in a
+following frame instead of starving at the end of the edict list.
+
+=============================================================================
+*/
+
+cvar_t	sv_rate = {"sv_rate", "10000"};			// bytes/sec for clients that don't set one
+cvar_t	sv_maxrate = {"sv_maxrate", "20000"};	// 0 = no cap
+
+typedef struct
+{
+	int		num;
+	int		bits;
+	float	priority;
+} sendent_t;
+
+static sendent_t	sendents[MAX_EDICTS];
+
+/*
+=============
+SV_ClientRate
+
+Bytes per second the client may be sent, 0 for no limit
+=============
+*/
+float SV_ClientRate (client_t *client)
+{
+	float	rate;
+
+	if (client->netconnection->driver == 0)
+		return 0;			// loopback is never rate limited
+
+	rate = client->rate ? client->rate : sv_rate.value;
+	if (sv_maxrate.value && rate > sv_maxrate.value)
+		rate = sv_maxrate.value;
+	if (rate <= 0)
+		return 0;
+	return rate;
+}
+
+/*
+=============
+SV_RateClear
+
+True once the client's rate has paid for everything sent to it so far
+=============
+*/
+qboolean SV_RateClear (client_t *client)
+{
+	if (!SV_ClientRate (client))
+		return true;
+	return client->cleartime <= realtime;
+}
+
+/*
+=============
+SV_RateCharge
+
+Moves the clear time forward by the time bytes take at the client's rate
+=============
+*/
+void SV_RateCharge (client_t *client, int bytes)
+{
+	float	rate;
+
+	rate = SV_ClientRate (client);
+	if (!rate)
+		return;
+	if (client->cleartime < realtime)
+		client->cleartime = realtime;	// an idle period doesn't bank bandwidth
+	client->cleartime += bytes / rate;
+}
+
+/*
+=============
+SV_EntityUpdateBits
+
+Delta of an entity against its baseline
+=============
+*/
+int SV_EntityUpdateBits (edict_t *ent, int e)
+{
+	int		i;
+	int		bits;
+	float	miss;
+
+	bits = 0;
+	
+	for (i=0 ; i<3 ; i++)
+	{
+		miss = ent->v.origin[i] - ent->baseline.origin[i];
+		if ( miss < -0.1 || miss > 0.1 )
+			bits |= U_ORIGIN1<<i;
+	}
+
+	if ( ent->v.angles[0] != ent->baseline.angles[0] )
+		bits |= U_ANGLE1;
+		
+	if ( ent->v.angles[1] != ent->baseline.angles[1] )
+		bits |= U_ANGLE2;
+		
+	if ( ent->v.angles[2] != ent->baseline.angles[2] )
+		bits |= U_ANGLE3;
+		
+	if (ent->v.movetype == MOVETYPE_STEP)
+		bits |= U_NOLERP;	// don't mess up the step animation
+
+	if (ent->baseline.colormap != ent->v.colormap)
+		bits |= U_COLORMAP;
+		
+	if (ent->baseline.skin != ent->v.skin)
+		bits |= U_SKIN;
+		
+	if (ent->baseline.frame != ent->v.frame)
+		bits |= U_FRAME;
+	
+	if (ent->baseline.effects != ent->v.effects)
+		bits |= U_EFFECTS;
+	
+	if (ent->baseline.modelindex != ent->v.modelindex)
+		bits |= U_MODEL;
+
+	if (e >= 256)
+		bits |= U_LONGENTITY;
+		
+	if (bits >= 256)
+		bits |= U_MOREBITS;
+
+	return bits;
+}
+
+/*
+=============
+SV_EntityUpdateSize
+
+Exact number of bytes SV_WriteEntityUpdate will emit for these bits
+=============
+*/
+int SV_EntityUpdateSize (int bits)
+{
+	int		size;
+	int		coordsize, anglesize, indexsize;
+
+	if (sv.protocol == PROTOCOL_EXTENDED)
+	{
+		coordsize = 3;
+		anglesize = 2;
+		indexsize = 2;
+	}
+	else
+	{
+		coordsize = 2;
+		anglesize = 1;
+		indexsize = 1;
+	}
+
+	size = 2;
+	if (bits & U_MOREBITS)
+		size++;
+	if (bits & U_LONGENTITY)
+		size++;
+	if (bits & U_MODEL)
+		size += indexsize;
+	if (bits & U_FRAME)
+		size++;
+	if (bits & U_COLORMAP)
+		size++;
+	if (bits & U_SKIN)
+		size++;
+	if (bits & U_EFFECTS)
+		size++;
+	if (bits & U_ORIGIN1)
+		size += coordsize;
+	if (bits & U_ORIGIN2)
+		size += coordsize;
+	if (bits & U_ORIGIN3)
+		size += coordsize;
+	if (bits & U_ANGLE1)
+		size += anglesize;
+	if (bits & U_ANGLE2)
+		size += anglesize;
+	if (bits & U_ANGLE3)
+		size += anglesize;
+	return size;
+}
+
+/*
+=============
+SV_WriteEntityUpdate
+
+=============
+*/
+void SV_WriteEntityUpdate (edict_t *ent, int e, int bits, sizebuf_t *msg)
+{
+	MSG_WriteByte (msg,bits | U_SIGNAL);
+	
+	if (bits & U_MOREBITS)
+		MSG_WriteByte (msg, bits>>8);
+	if (bits & U_LONGENTITY)
+		MSG_WriteShort (msg,e);
+	else
+		MSG_WriteByte (msg,e);
+
+	if (bits & U_MODEL)
+		SV_WritePrecacheIndex (msg, ent->v.modelindex);
+	if (bits & U_FRAME)
+		MSG_WriteByte (msg, ent->v.frame);
+	if (bits & U_COLORMAP)
+		MSG_WriteByte (msg, ent->v.colormap);
+	if (bits & U_SKIN)
+		MSG_WriteByte (msg, ent->v.skin);
+	if (bits & U_EFFECTS)
+		MSG_WriteByte (msg, ent->v.effects);
+	if (bits & U_ORIGIN1)
+		MSG_WriteCoord (msg, ent->v.origin[0], sv.protocol);		
+	if (bits & U_ANGLE1)
+		MSG_WriteAngle(msg, ent->v.angles[0], sv.protocol);
+	if (bits & U_ORIGIN2)
+		MSG_WriteCoord (msg, ent->v.origin[1], sv.protocol);
+	if (bits & U_ANGLE2)
+		MSG_WriteAngle(msg, ent->v.angles[1], sv.protocol);
+	if (bits & U_ORIGIN3)
+		MSG_WriteCoord (msg, ent->v.origin[2], sv.protocol);
+	if (bits & U_ANGLE3)
+		MSG_WriteAngle(msg, ent->v.angles[2], sv.protocol);
+}
+
+/*
+=============
+SV_EntityPriority
+
+Closer, faster moving and longer unsent entities score higher
+=============
+*/
+float SV_EntityPriority (client_t *client, edict_t *ent, int e, vec3_t org)
+{
+	vec3_t	delta;
+	float	dist, change, age;
+
+	if (!client->ent_senttime[e])
+		age = 1.0;			// just came into view
+	else
+		age = sv.time - client->ent_senttime[e];
+	if (age < 0.01)
+		age = 0.01;
+
+	VectorSubtract (ent->v.origin, client->ent_sentorigin[e], delta);
+	change = Length (delta);
+	if (change > 256)
+		change = 256;
+
+	VectorSubtract (ent->v.origin, org, delta);
+	dist = Length (delta);
+
+	return age * (8 + change) * 1024 / (dist + 128);
+}
+
+int SV_SendEntCompare (const void *a, const void *b)
+{
+	float	pa, pb;
+
+	pa = ((sendent_t *)a)->priority;
+	pb = ((sendent_t *)b)->priority;
+	if (pa > pb)
+		return -1;
+	if (pa < pb)
+		return 1;
+	return ((sendent_t *)a)->num - ((sendent_t *)b)->num;
+}
+
 /*
 =============
 SV_WriteEntitiesToClient
 
 =============
 */
-void SV_WriteEntitiesToClient (edict_t	*clent, sizebuf_t *msg)
+void SV_WriteEntitiesToClient (client_t *client, sizebuf_t *msg)
 {
 	int		e, i;
-	int		bits;
+	int		numsend;
+	int		size, dropped;
 	byte	*pvs;
 	vec3_t	org;
-	float	miss;
 	edict_t	*ent;
+	edict_t	*clent;
+	sendent_t	*se;
+
+	clent = client->edict;
 
 // find the client's PVS
 	VectorAdd (clent->v.origin, clent->v.view_ofs, org);
 	pvs = SV_FatPVS (org);
 
-// send over all entities (excpet the client) that touch the pvs
+// collect all entities (excpet the client) that touch the pvs
+	numsend = 0;
 	ent = NEXT_EDICT(sv.edicts);
 	for (e=1 ; e<sv.num_edicts ; e++, ent = NEXT_EDICT(ent))
 	{
@@ -462,90 +1042,36 @@ void SV_WriteEntitiesToClient (edict_t	*clent, sizebuf_t *msg)
 				continue;		// not visible
 		}
 
-		if (msg->maxsize - msg->cursize < 16)
-		{
-			Con_Printf ("packet overflow\n");
-			return;
-		}
+		se = &sendents[numsend++];
+		se->num = e;
+		se->bits = SV_EntityUpdateBits (ent, e);
+		if (ent == clent)
+			se->priority = 1e30;
+		else
+			se->priority = SV_EntityPriority (client, ent, e, org);
+	}
 
-// send an update
-		bits = 0;
-		
-		for (i=0 ; i<3 ; i++)
+	qsort (sendents, numsend, sizeof(sendent_t), SV_SendEntCompare);
+
+// send updates in priority order while they fit
+	dropped = 0;
+	for (i=0, se = sendents ; i<numsend ; i++, se++)
+	{
+		size = SV_EntityUpdateSize (se->bits);
+		if (msg->cursize + size > msg->maxsize)
 		{
-			miss = ent->v.origin[i] - ent->baseline.origin[i];
-			if ( miss < -0.1 || miss > 0.1 )
-				bits |= U_ORIGIN1<<i;
+			dropped++;
+			continue;		// a smaller update further down may still fit
 		}
 
-		if ( ent->v.angles[0] != ent->baseline.angles[0] )
-			bits |= U_ANGLE1;
-			
-		if ( ent->v.angles[1] != ent->baseline.angles[1] )
-			bits |= U_ANGLE2;
-			
-		if ( ent->v.angles[2] != ent->baseline.angles[2] )
-			bits |= U_ANGLE3;
-			
-		if (ent->v.movetype == MOVETYPE_STEP)
-			bits |= U_NOLERP;	// don't mess up the step animation
-	
-		if (ent->baseline.colormap != ent->v.colormap)
-			bits |= U_COLORMAP;
-			
-		if (ent->baseline.skin != ent->v.skin)
-			bits |= U_SKIN;
-			
-		if (ent->baseline.frame != ent->v.frame)
-			bits |= U_FRAME;
-		
-		if (ent->baseline.effects != ent->v.effects)
-			bits |= U_EFFECTS;
-		
-		if (ent->baseline.modelindex != ent->v.modelindex)
-			bits |= U_MODEL;
+		ent = EDICT_NUM(se->num);
+		SV_WriteEntityUpdate (ent, se->num, se->bits, msg);
 
-		if (e >= 256)
-			bits |= U_LONGENTITY;
-			
-		if (bits >= 256)
-			bits |= U_MOREBITS;
-
-	//
-	// write the message
-	//
-		MSG_WriteByte (msg,bits | U_SIGNAL);
-		
-		if (bits & U_MOREBITS)
-			MSG_WriteByte (msg, bits>>8);
-		if (bits & U_LONGENTITY)
-			MSG_WriteShort (msg,e);
-		else
-			MSG_WriteByte (msg,e);
-
-		if (bits & U_MODEL)
-			MSG_WriteByte (msg,	ent->v.modelindex);
-		if (bits & U_FRAME)
-			MSG_WriteByte (msg, ent->v.frame);
-		if (bits & U_COLORMAP)
-			MSG_WriteByte (msg, ent->v.colormap);
-		if (bits & U_SKIN)
-			MSG_WriteByte (msg, ent->v.skin);
-		if (bits & U_EFFECTS)
-			MSG_WriteByte (msg, ent->v.effects);
-		if (bits & U_ORIGIN1)
-			MSG_WriteCoord (msg, ent->v.origin[0]);		
-		if (bits & U_ANGLE1)
-			MSG_WriteAngle(msg, ent->v.angles[0]);
-		if (bits & U_ORIGIN2)
-			MSG_WriteCoord (msg, ent->v.origin[1]);
-		if (bits & U_ANGLE2)
-			MSG_WriteAngle(msg, ent->v.angles[1]);
-		if (bits & U_ORIGIN3)
-			MSG_WriteCoord (msg, ent->v.origin[2]);
-		if (bits & U_ANGLE3)
-			MSG_WriteAngle(msg, ent->v.angles[2]);
+		client->ent_senttime[se->num] = sv.time;
+		VectorCopy (ent->v.origin, client->ent_sentorigin[se->num]);
 	}
+
+	client->num_dropped += dropped;
 }
 
 /*
@@ -593,7 +1119,7 @@ void SV_WriteClientdataToMessage (edict_t *ent, sizebuf_t *msg)
 		MSG_WriteByte (msg, ent->v.dmg_save);
 		MSG_WriteByte (msg, ent->v.dmg_take);
 		for (i=0 ; i<3 ; i++)
-			MSG_WriteCoord (msg, other->v.origin[i] + 0.5*(other->v.mins[i] + other->v.maxs[i]));
+			MSG_WriteCoord (msg, other->v.origin[i] + 0.5*(other->v.mins[i] + other->v.maxs[i]), sv.protocol);
 	
 		ent->v.dmg_take = 0;
 		ent->v.dmg_save = 0;
@@ -609,7 +1135,7 @@ void SV_WriteClientdataToMessage (edict_t *ent, sizebuf_t *msg)
 	{
 		MSG_WriteByte (msg, svc_setangle);
 		for (i=0 ; i < 3 ; i++)
-			MSG_WriteAngle (msg, ent->v.angles[i] );
+			MSG_WriteAngle (msg, ent->v.angles[i], sv.protocol);
 		ent->v.fixangle = 0;
 	}
 
@@ -686,7 +1212,7 @@ void SV_WriteClientdataToMessage (edict_t *ent, sizebuf_t *msg)
 	if (bits & SU_ARMOR)
 		MSG_WriteByte (msg, ent->v.armorvalue);
 	if (bits & SU_WEAPON)
-		MSG_WriteByte (msg, SV_ModelIndex(pr_strings+ent->v.weaponmodel));
+		SV_WritePrecacheIndex (msg, SV_ModelIndex(pr_strings+ent->v.weaponmodel));
 	
 	MSG_WriteShort (msg, ent->v.health);
 	MSG_WriteByte (msg, ent->v.currentammo);
@@ -712,6 +1238,60 @@ void SV_WriteClientdataToMessage (edict_t *ent, sizebuf_t *msg)
 	}
 }
 
+/*
+==================
+SV_WriteSpawnState
+
+Names, frags, colors, light styles and level stats that a client gets
+when it spawns into the level
+==================
+*/
+void SV_WriteSpawnState (sizebuf_t *msg)
+{
+	int			i;
+	client_t	*client;
+
+	for (i=0, client = svs.clients ; i<svs.maxclients ; i++, client++)
+	{
+		MSG_WriteByte (msg, svc_updatename);
+		MSG_WriteByte (msg, i);
+		MSG_WriteString (msg, client->name);
+		MSG_WriteByte (msg, svc_updatefrags);
+		MSG_WriteByte (msg, i);
+		MSG_WriteShort (msg, client->old_frags);
+		MSG_WriteByte (msg, svc_updatecolors);
+		MSG_WriteByte (msg, i);
+		MSG_WriteByte (msg, client->colors);
+	}
+	
+// send all current light styles
+	for (i=0 ; i<MAX_LIGHTSTYLES ; i++)
+	{
+		MSG_WriteByte (msg, svc_lightstyle);
+		MSG_WriteByte (msg, (char)i);
+		MSG_WriteString (msg, sv.lightstyles[i]);
+	}
+
+//
+// send some stats
+//
+	MSG_WriteByte (msg, svc_updatestat);
+	MSG_WriteByte (msg, STAT_TOTALSECRETS);
+	MSG_WriteLong (msg, pr_global_struct->total_secrets);
+
+	MSG_WriteByte (msg, svc_updatestat);
+	MSG_WriteByte (msg, STAT_TOTALMONSTERS);
+	MSG_WriteLong (msg, pr_global_struct->total_monsters);
+
+	MSG_WriteByte (msg, svc_updatestat);
+	MSG_WriteByte (msg, STAT_SECRETS);
+	MSG_WriteLong (msg, pr_global_struct->found_secrets);
+
+	MSG_WriteByte (msg, svc_updatestat);
+	MSG_WriteByte (msg, STAT_MONSTERS);
+	MSG_WriteLong (msg, pr_global_struct->killed_monsters);
+}
+
 /*
 =======================
 SV_SendClientDatagram
@@ -723,7 +1303,7 @@ qboolean SV_SendClientDatagram (client_t *client)
 	sizebuf_t	msg;
 	
 	msg.data = buf;
-	msg.maxsize = sizeof(buf);
+	msg.maxsize = sv.datagram.maxsize;
 	msg.cursize = 0;
 
 	MSG_WriteByte (&msg, svc_time);
@@ -731,8 +1311,9 @@ qboolean SV_SendClientDatagram (client_t *client)
 
 // add the client specific data to the datagram
 	SV_WriteClientdataToMessage (client->edict, &msg);
+	SV_MVDClientData (client, msg.data + 5, msg.cursize - 5);
 
-	SV_WriteEntitiesToClient (client->edict, &msg);
+	SV_WriteEntitiesToClient (client, &msg);
 
 // copy the server datagram if there is space
 	if (msg.cursize + sv.datagram.cursize < msg.maxsize)
@@ -744,6 +1325,7 @@ qboolean SV_SendClientDatagram (client_t *client)
 		SV_DropClient (true);// if the message couldn't send, kick off
 		return false;
 	}
+	SV_RateCharge (client, msg.cursize);
 	
 	return true;
 }
@@ -831,7 +1413,9 @@ void SV_SendClientMessages (void)
 
 		if (host_client->spawned)
 		{
-			if (!SV_SendClientDatagram (host_client))
+			if (!SV_RateClear (host_client))
+				host_client->num_choked++;	// wait for the rate to catch up
+			else if (!SV_SendClientDatagram (host_client))
 				continue;
 		}
 		else
@@ -871,6 +1455,9 @@ void SV_SendClientMessages (void)
 				SV_DropClient (false);	// went to another level
 			else
 			{
+				if (host_client->spawned)
+					SV_MVDReliable (host_client);
+				SV_RateCharge (host_client, host_client->message.cursize);
 				if (NET_SendMessage (host_client->netconnection
 				, &host_client->message) == -1)
 					SV_DropClient (true);	// if the message couldn't send, kick off
@@ -880,8 +1467,10 @@ void SV_SendClientMessages (void)
 			}
 		}
 	}
-	
-	
+
+// the recorder takes the world state once, before muzzle flashes are cleared
+	SV_MVDFrame ();
+
 // clear muzzle flashes
 	SV_CleanupEnts ();
 }
@@ -916,6 +1505,21 @@ int SV_ModelIndex (char *name)
 	return i;
 }
 
+/*
+================
+SV_WritePrecacheIndex
+
+Model and sound numbers only fit in a byte for the stock protocol
+================
+*/
+void SV_WritePrecacheIndex (sizebuf_t *sb, int index)
+{
+	if (sv.protocol == PROTOCOL_EXTENDED)
+		MSG_WriteShort (sb, index);
+	else
+		MSG_WriteByte (sb, index);
+}
+
 /*
 ================
 SV_CreateBaseline
@@ -962,14 +1566,14 @@ void SV_CreateBaseline (void)
 		MSG_WriteByte (&sv.signon,svc_spawnbaseline);		
 		MSG_WriteShort (&sv.signon,entnum);
 
-		MSG_WriteByte (&sv.signon, svent->baseline.modelindex);
+		SV_WritePrecacheIndex (&sv.signon, svent->baseline.modelindex);
 		MSG_WriteByte (&sv.signon, svent->baseline.frame);
 		MSG_WriteByte (&sv.signon, svent->baseline.colormap);
 		MSG_WriteByte (&sv.signon, svent->baseline.skin);
 		for (i=0 ; i<3 ; i++)
 		{
-			MSG_WriteCoord(&sv.signon, svent->baseline.origin[i]);
-			MSG_WriteAngle(&sv.signon, svent->baseline.angles[i]);
+			MSG_WriteCoord(&sv.signon, svent->baseline.origin[i], sv.protocol);
+			MSG_WriteAngle(&sv.signon, svent->baseline.angles[i], sv.protocol);
 		}
 	}
 }
@@ -1095,20 +1699,39 @@ void SV_SpawnServer (char *server)
 // load progs to get entity field count
 	PR_LoadProgs ();
 
+// the protocol can only change between levels
+	if (sv_protocol.value == PROTOCOL_EXTENDED)
+		sv.protocol = PROTOCOL_EXTENDED;
+	else
+	{
+		if (sv_protocol.value != PROTOCOL_VERSION)
+			Con_Printf ("sv_protocol %i unknown, using %i\n", (int)sv_protocol.value, PROTOCOL_VERSION);
+		sv.protocol = PROTOCOL_VERSION;
+	}
+
 // allocate server memory
-	sv.max_edicts = MAX_EDICTS;
+	if (sv.protocol == PROTOCOL_EXTENDED)
+		sv.max_edicts = MAX_EDICTS;
+	else
+		sv.max_edicts = NQ_MAX_EDICTS;
 	
 	sv.edicts = Hunk_AllocName (sv.max_edicts*pr_edict_size, "edicts");
 
-	sv.datagram.maxsize = sizeof(sv.datagram_buf);
+	if (sv.protocol == PROTOCOL_EXTENDED)
+		sv.datagram.maxsize = sizeof(sv.datagram_buf);
+	else
+		sv.datagram.maxsize = NQ_MAX_DATAGRAM;
 	sv.datagram.cursize = 0;
 	sv.datagram.data = sv.datagram_buf;
 	
-	sv.reliable_datagram.maxsize = sizeof(sv.reliable_datagram_buf);
+	sv.reliable_datagram.maxsize = sv.datagram.maxsize;
 	sv.reliable_datagram.cursize = 0;
 	sv.reliable_datagram.data = sv.reliable_datagram_buf;
 	
-	sv.signon.maxsize = sizeof(sv.signon_buf);
+	if (sv.protocol == PROTOCOL_EXTENDED)
+		sv.signon.maxsize = sizeof(sv.signon_buf);
+	else
+		sv.signon.maxsize = NQ_MAX_SIGNON;
 	sv.signon.cursize = 0;
 	sv.signon.data = sv.signon_buf;
 	
@@ -1118,6 +1741,8 @@ void SV_SpawnServer (char *server)
 	{
 		ent = EDICT_NUM(i+1);
 		svs.clients[i].edict = ent;
+		svs.clients[i].ent_senttime = Hunk_AllocName (sv.max_edicts*sizeof(float), "senttime");
+		svs.clients[i].ent_sentorigin = Hunk_AllocName (sv.max_edicts*sizeof(vec3_t), "sentorg");
 	}
 	
 	sv.state = ss_loading;
@@ -1190,6 +1815,8 @@ void SV_SpawnServer (char *server)
 // create a baseline for more efficient communications
 	SV_CreateBaseline ();
 
+	SV_MVDNewLevel ();
+
 // send serverinfo to all connected clients
 	for (i=0,host_client = svs.clients ; i<svs.maxclients ; i++, host_client++)
 		if (host_client->active)
@@ -448,7 +448,7 @@ void SV_ReadClientMove (usercmd_t *move)
 
 // read current angles	
 	for (i=0 ; i<3 ; i++)
-		angle[i] = MSG_ReadAngle ();
+		angle[i] = MSG_ReadAngle (sv.protocol);
 
 	VectorCopy (angle, host_client->edict->v.v_angle);
 		
@@ -541,6 +541,8 @@ nextmsg:
 					ret = 1;
 				else if (Q_strncasecmp(s, "name", 4) == 0)
 					ret = 1;
+				else if (Q_strncasecmp(s, "rate", 4) == 0)
+					ret = 1;
 				else if (Q_strncasecmp(s, "noclip", 6) == 0)
 					ret = 1;
 				else if (Q_strncasecmp(s, "say", 3) == 0)
@@ -56,6 +56,9 @@ void Sys_Quit (void);
 
 double Sys_FloatTime (void);
 
+double Sys_ProfileTime (void);
+// raw seconds, safe from any thread; only for measuring intervals
+
 char *Sys_ConsoleInput (void);
 
 void Sys_Sleep (void);
@@ -65,6 +68,31 @@ void Sys_Sleep (void);
 void Sys_SendKeyEvents (void);
 // Perform Key_Event () callbacks until the input que is empty
 
+//
+// threads
+//
+void *Sys_CreateThread (int (*func) (void *), void *parm);
+void Sys_WaitThread (void *thread);
+// waits for the thread function to return and frees the handle
+
+void *Sys_CreateMutex (void);
+void Sys_DestroyMutex (void *mutex);
+void Sys_LockMutex (void *mutex);
+void Sys_UnlockMutex (void *mutex);
+
+void *Sys_CreateEvent (void);
+void Sys_DestroyEvent (void *event);
+void Sys_SignalEvent (void *event);
+qboolean Sys_WaitEvent (void *event, int msec);
+// auto-reset; returns false if msec passed without a signal
+
+void Sys_MemoryBarrier (void);
+// orders memory accesses for data shared without a mutex
+
+qboolean Sys_HaveSSE2 (void);
+
+int Sys_NumProcessors (void);
+
 void Sys_LowFPPrecision (void);
 void Sys_HighFPPrecision (void);
 void Sys_SetFPCW (void);
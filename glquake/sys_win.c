@@ -636,6 +636,161 @@ void Sys_Sleep (void)
 	Sleep (1);
 }
 
+/*
+================
+Sys_ProfileTime
+
+Sys_FloatTime keeps state for the main loop, so other threads time
+themselves with this
+================
+*/
+double Sys_ProfileTime (void)
+{
+	static double	scale;
+	LARGE_INTEGER	count;
+
+	if (!scale)
+	{
+		QueryPerformanceFrequency (&count);
+		scale = 1.0 / (double)count.QuadPart;
+	}
+	QueryPerformanceCounter (&count);
+	return (double)count.QuadPart * scale;
+}
+
+/*
+================
+Sys_HaveSSE2
+================
+*/
+qboolean Sys_HaveSSE2 (void)
+{
+	static int	have = -1;
+
+	if (have == -1)
+		have = IsProcessorFeaturePresent (PF_XMMI64_INSTRUCTIONS_AVAILABLE) != 0;
+	return have;
+}
+
+/*
+================
+Sys_NumProcessors
+================
+*/
+int Sys_NumProcessors (void)
+{
+	SYSTEM_INFO	info;
+
+	GetSystemInfo (&info);
+	return info.dwNumberOfProcessors;
+}
+
+/*
+==============================================================================
+
+THREADS
+
+Thin wrappers so the portable code never sees a HANDLE
+
+==============================================================================
+*/
+
+typedef struct
+{
+	int		(*func) (void *);
+	void	*parm;
+} systhread_t;
+
+static DWORD WINAPI Sys_ThreadProc (LPVOID parm)
+{
+	systhread_t	t;
+
+	t = *(systhread_t *)parm;
+	free (parm);
+	return t.func (t.parm);
+}
+
+void *Sys_CreateThread (int (*func) (void *), void *parm)
+{
+	systhread_t	*t;
+	HANDLE		thread;
+	DWORD		id;
+
+	t = malloc (sizeof(*t));
+	if (!t)
+		Sys_Error ("Sys_CreateThread: out of memory");
+	t->func = func;
+	t->parm = parm;
+
+	thread = CreateThread (NULL, 0, Sys_ThreadProc, t, 0, &id);
+	if (!thread)
+		Sys_Error ("Sys_CreateThread: CreateThread failed");
+	return thread;
+}
+
+void Sys_WaitThread (void *thread)
+{
+	WaitForSingleObject ((HANDLE)thread, INFINITE);
+	CloseHandle ((HANDLE)thread);
+}
+
+void *Sys_CreateMutex (void)
+{
+	CRITICAL_SECTION	*cs;
+
+	cs = malloc (sizeof(*cs));
+	if (!cs)
+		Sys_Error ("Sys_CreateMutex: out of memory");
+	InitializeCriticalSection (cs);
+	return cs;
+}
+
+void Sys_DestroyMutex (void *mutex)
+{
+	DeleteCriticalSection ((CRITICAL_SECTION *)mutex);
+	free (mutex);
+}
+
+void Sys_LockMutex (void *mutex)
+{
+	EnterCriticalSection ((CRITICAL_SECTION *)mutex);
+}
+
+void Sys_UnlockMutex (void *mutex)
+{
+	LeaveCriticalSection ((CRITICAL_SECTION *)mutex);
+}
+
+void *Sys_CreateEvent (void)
+{
+	HANDLE	event;
+
+	event = CreateEvent (NULL, FALSE, FALSE, NULL);
+	if (!event)
+		Sys_Error ("Sys_CreateEvent: CreateEvent failed");
+	return event;
+}
+
+void Sys_DestroyEvent (void *event)
+{
+	CloseHandle ((HANDLE)event);
+}
+
+void Sys_SignalEvent (void *event)
+{
+	SetEvent ((HANDLE)event);
+}
+
+qboolean Sys_WaitEvent (void *event, int msec)
+{
+	return WaitForSingleObject ((HANDLE)event, msec) == WAIT_OBJECT_0;
+}
+
+void Sys_MemoryBarrier (void)
+{
+	MemoryBarrier ();
+}
+
 
 void Sys_SendKeyEvents (void)
 {
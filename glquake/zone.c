@@ -567,6 +567,34 @@ cache_system_t *Cache_TryAlloc (int size, qboolean nobottom);
 
 cache_system_t	cache_head;
 
+static void		*cache_lock;	// only created once another thread reads the cache
+
+/*
+===========
+Cache_EnableLocking
+
+Called before starting a thread that uses Cache_Check.  Every entry point
+that can move, free or relink cache memory takes the lock after this.
+===========
+*/
+void Cache_EnableLocking (void)
+{
+	if (!cache_lock)
+		cache_lock = Sys_CreateMutex ();
+}
+
+void Cache_Lock (void)
+{
+	if (cache_lock)
+		Sys_LockMutex (cache_lock);
+}
+
+void Cache_Unlock (void)
+{
+	if (cache_lock)
+		Sys_UnlockMutex (cache_lock);
+}
+
 /*
 ===========
 Cache_Move
@@ -607,15 +635,17 @@ void Cache_FreeLow (int new_low_hunk)
 {
 	cache_system_t	*c;
 	
+	Cache_Lock ();
 	while (1)
 	{
 		c = cache_head.next;
 		if (c == &cache_head)
-			return;		// nothing in cache at all
+			break;		// nothing in cache at all
 		if ((byte *)c >= hunk_base + new_low_hunk)
-			return;		// there is space to grow the hunk
+			break;		// there is space to grow the hunk
 		Cache_Move ( c );	// reclaim the space
 	}
+	Cache_Unlock ();
 }
 
 /*
@@ -630,13 +660,14 @@ void Cache_FreeHigh (int new_high_hunk)
 	cache_system_t	*c, *prev;
 	
 	prev = NULL;
+	Cache_Lock ();
 	while (1)
 	{
 		c = cache_head.prev;
 		if (c == &cache_head)
-			return;		// nothing in cache at all
+			break;		// nothing in cache at all
 		if ( (byte *)c + c->size <= hunk_base + hunk_size - new_high_hunk)
-			return;		// there is space to grow the hunk
+			break;		// there is space to grow the hunk
 		if (c == prev)
 			Cache_Free (c->user);	// didn't move out of the way
 		else
@@ -645,6 +676,7 @@ void Cache_FreeHigh (int new_high_hunk)
 			prev = c;
 		}
 	}
+	Cache_Unlock ();
 }
 
 void Cache_UnlinkLRU (cache_system_t *cs)
@@ -758,8 +790,10 @@ Throw everything out, so new data will be demand cached
 */
 void Cache_Flush (void)
 {
+	Cache_Lock ();
 	while (cache_head.next != &cache_head)
 		Cache_Free ( cache_head.next->user );	// reclaim the space
+	Cache_Unlock ();
 }
 
 
@@ -828,6 +862,7 @@ void Cache_Free (cache_user_t *c)
 	if (!c->data)
 		Sys_Error ("Cache_Free: not allocated");
 
+	Cache_Lock ();
 	cs = ((cache_system_t *)c->data) - 1;
 
 	cs->prev->next = cs->next;
@@ -837,6 +872,7 @@ void Cache_Free (cache_user_t *c)
 	c->data = NULL;
 
 	Cache_UnlinkLRU (cs);
+	Cache_Unlock ();
 }
 
 
@@ -849,17 +885,21 @@ Cache_Check
 void *Cache_Check (cache_user_t *c)
 {
 	cache_system_t	*cs;
+	void			*data;
 
-	if (!c->data)
-		return NULL;
-
-	cs = ((cache_system_t *)c->data) - 1;
+	Cache_Lock ();
+	data = c->data;
+	if (data)
+	{
+		cs = ((cache_system_t *)data) - 1;
 
-// move to head of LRU
-	Cache_UnlinkLRU (cs);
-	Cache_MakeLRU (cs);
+	// move to head of LRU
+		Cache_UnlinkLRU (cs);
+		Cache_MakeLRU (cs);
+	}
+	Cache_Unlock ();
 	
-	return c->data;
+	return data;
 }
 
 
@@ -881,6 +921,7 @@ void *Cache_Alloc (cache_user_t *c, int size, char *name)
 	size = (size + sizeof(cache_system_t) + 15) & ~15;
 
 // find memory for it	
+	Cache_Lock ();
 	while (1)
 	{
 		cs = Cache_TryAlloc (size, false);
@@ -898,6 +939,7 @@ void *Cache_Alloc (cache_user_t *c, int size, char *name)
 													// not enough memory at all
 		Cache_Free ( cache_head.lru_prev->user );
 	} 
+	Cache_Unlock ();
 	
 	return Cache_Check (c);
 }
@@ -127,5 +127,10 @@ void *Cache_Alloc (cache_user_t *c, int size, char *name);
 
 void Cache_Report (void);
 
+void Cache_EnableLocking (void);
+void Cache_Lock (void);
+void Cache_Unlock (void);
+// held by other threads while they use Cache_Check data
+
 
 